@@ -0,0 +1,94 @@
+//! @file bench/Bench.h
+//! Общие объявления тестов производительности signGen_bench
+
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include <ostream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+typedef std::vector<size_t> CSizeList;
+
+//! Параметры запуска тестов.
+struct BenchParams
+{
+    BenchParams() : fileSize(256 * 1024 * 1024), scaleSize(static_cast<uint64_t>(4) << 50), minSeconds(0.5),
+                    runMicro(true), runMacro(true), runScale(true) {}
+
+    CSizeList   blockSizes;     //!< Размеры блоков
+    CSizeList   threadCounts;   //!< Кол-во потоков рассчета CRC (потоков-потребителей)
+    uint64_t    fileSize;       //!< Размер генерируемых файлов для сквозных тестов
+    uint64_t    scaleSize;      //!< Размер виртуального файла для тестов масштаба
+    double      minSeconds;     //!< Минимальное время одного микротеста
+    std::string tmpDir;         //!< Каталог для генерируемых файлов
+    bool        runMicro;
+    bool        runMacro;
+    bool        runScale;
+};
+
+//! Результат одного теста.
+struct BenchResult
+{
+    BenchResult() : blockSize(0), threads(0), bytes(0), ops(0), seconds(0) {}
+
+    std::string suite;      //!< micro, macro или scale
+    std::string name;       //!< Название теста
+    std::string data;       //!< Вид данных сквозного теста (sparse, dense)
+    size_t      blockSize;
+    size_t      threads;
+    uint64_t    bytes;      //!< Обработано байтов
+    uint64_t    ops;        //!< Выполнено операций
+    double      seconds;    //!< Время выполнения
+};
+
+//! Вывод результатов в машиночитаемом виде.
+//! JSON - по объекту на строку (JSON Lines), CSV - с заголовком.
+class CBenchReport
+{
+public:
+    enum EFormat
+    {
+        FORMAT_JSON,
+        FORMAT_CSV
+    };
+
+public:
+    CBenchReport(std::ostream& out, EFormat format, const std::string& label);
+
+    void Add(const BenchResult& result);
+
+private:
+    std::ostream& m_out;
+    EFormat       m_format;
+    std::string   m_label;          //!< Метка запуска (например версия), пишется в каждую запись
+    bool          m_isHeaderWritten;
+};
+
+//! Измеритель времени выполнения.
+class CBenchTimer
+{
+public:
+    CBenchTimer() : m_start(boost::posix_time::microsec_clock::universal_time()) {}
+
+    //! Возвращает время в секундах с момента создания.
+    double Elapsed() const
+    {
+        const boost::posix_time::time_duration elapsed =
+            boost::posix_time::microsec_clock::universal_time() - m_start;
+
+        return elapsed.total_microseconds() / 1e6;
+    }
+
+private:
+    boost::posix_time::ptime m_start;
+};
+
+void RunMicroBenchmarks(const BenchParams& params, CBenchReport& report);
+void RunMacroBenchmarks(const BenchParams& params, CBenchReport& report);
+void RunScaleBenchmarks(const BenchParams& params, CBenchReport& report);
+
+#endif // _BENCH_H
@@ -0,0 +1,246 @@
+//! @file BenchMain.cpp
+//! Точка входа signGen_bench: разбор параметров и вывод результатов.
+
+#include "Bench.h"
+#include "../common/util/ParseSize.h"
+
+#include <boost/thread.hpp>
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdlib.h>
+
+//! Конструктор.
+//! @param out    - [in] поток для результатов;
+//! @param format - [in] формат результатов;
+//! @param label  - [in] метка запуска.
+CBenchReport::CBenchReport(std::ostream& out, EFormat format, const std::string& label) :
+    m_out(out), m_format(format), m_label(label), m_isHeaderWritten(false)
+{
+}
+
+//! Выводит результат теста.
+//! Кроме исходных величин выводятся производные: время операции и пропускная способность.
+//! @param result - [in] результат.
+void CBenchReport::Add(const BenchResult& result)
+{
+    const double nsPerOp = (result.ops != 0) ? result.seconds * 1e9 / result.ops : 0;
+    const double mbPerS  = (result.seconds > 0) ? result.bytes / result.seconds / (1024 * 1024)
+                                                : 0;
+
+    m_out << std::fixed << std::setprecision(3);
+
+    if (m_format == FORMAT_CSV)
+    {
+        if (!m_isHeaderWritten)
+        {
+            m_out << "label,suite,name,data,block_size,threads,bytes,ops,seconds,ns_per_op,mb_per_s"
+                  << std::endl;
+            m_isHeaderWritten = true;
+        }
+
+        m_out << m_label          << ','
+              << result.suite     << ','
+              << result.name      << ','
+              << result.data      << ','
+              << result.blockSize << ','
+              << result.threads   << ','
+              << result.bytes     << ','
+              << result.ops       << ','
+              << result.seconds   << ','
+              << nsPerOp          << ','
+              << mbPerS           << std::endl;
+    }
+    else
+    {
+        m_out << "{\"label\":\""      << m_label          << "\""
+              << ",\"suite\":\""      << result.suite     << "\""
+              << ",\"name\":\""       << result.name      << "\""
+              << ",\"data\":\""       << result.data      << "\""
+              << ",\"block_size\":"   << result.blockSize
+              << ",\"threads\":"      << result.threads
+              << ",\"bytes\":"        << result.bytes
+              << ",\"ops\":"          << result.ops
+              << ",\"seconds\":"      << result.seconds
+              << ",\"ns_per_op\":"    << nsPerOp
+              << ",\"mb_per_s\":"     << mbPerS
+              << "}" << std::endl;
+    }
+}
+
+//! Разбирает список размеров через запятую (например 4K,64K,1M).
+//! @param str   - [in]  строка со списком
+//! @param sizes - [out] размеры
+//! @return true - успех, false - в случае ошибки.
+static bool ParseSizeList(const std::string& str, CSizeList& sizes)
+{
+    sizes.clear();
+
+    std::string::size_type begin = 0;
+
+    while (begin <= str.size())
+    {
+        std::string::size_type end = str.find(',', begin);
+
+        if (end == std::string::npos)
+        {
+            end = str.size();
+        }
+
+        uint64_t size = 0;
+
+        if (!ParseSize(str.substr(begin, end - begin), size) || (size == 0) ||
+            (size > static_cast<size_t>(-1)))
+        {
+            return false;
+        }
+
+        sizes.push_back(static_cast<size_t>(size));
+        begin = end + 1;
+    }
+
+    return !sizes.empty();
+}
+
+//! Точка входа
+int main(int argc, char *argv[])
+{
+    BenchParams params;
+    params.tmpDir = ".";
+
+    CBenchReport::EFormat format = CBenchReport::FORMAT_JSON;
+    std::string           outputPath;
+    std::string           label;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        std::string name;
+        std::string value;
+
+        std::string::size_type posEq = arg.find('=');
+
+        if ((arg.compare(0, 2, "--") != 0) || (posEq == std::string::npos))
+        {
+            std::cerr << "Invalid argument: " << arg << std::endl;
+            name.clear();
+        }
+        else
+        {
+            name  = arg.substr(2, posEq - 2);
+            value = arg.substr(posEq + 1);
+        }
+
+        bool isOk = true;
+
+        if (name == "suite")
+        {
+            params.runMicro = (value == "micro") || (value == "all");
+            params.runMacro = (value == "macro") || (value == "all");
+            params.runScale = (value == "scale") || (value == "all");
+            isOk            = params.runMicro || params.runMacro || params.runScale;
+        }
+        else if (name == "file-size")
+        {
+            isOk = ParseSize(value, params.fileSize) && (params.fileSize != 0);
+        }
+        else if (name == "scale-size")
+        {
+            isOk = ParseSize(value, params.scaleSize) && (params.scaleSize != 0);
+        }
+        else if (name == "block-sizes")
+        {
+            isOk = ParseSizeList(value, params.blockSizes);
+        }
+        else if (name == "threads")
+        {
+            isOk = ParseSizeList(value, params.threadCounts);
+        }
+        else if (name == "min-time")
+        {
+            params.minSeconds = atof(value.c_str());
+        }
+        else if (name == "tmp-dir")
+        {
+            params.tmpDir = value;
+        }
+        else if (name == "format")
+        {
+            format = (value == "csv") ? CBenchReport::FORMAT_CSV : CBenchReport::FORMAT_JSON;
+            isOk   = (value == "csv") || (value == "json");
+        }
+        else if (name == "output")
+        {
+            outputPath = value;
+        }
+        else if (name == "label")
+        {
+            label = value;
+        }
+        else
+        {
+            isOk = false;
+        }
+
+        if (!isOk)
+        {
+            std::cerr << "Usage: signGen_bench [--suite=micro|macro|scale|all] [--file-size=256M]"
+                      << " [--scale-size=4P] [--block-sizes=4K,64K,1M] [--threads=1,N] [--min-time=0.5]"
+                      << " [--tmp-dir=.] [--format=json|csv] [--output=file] [--label=text]"
+                      << std::endl;
+            return 1;
+        }
+    }
+
+    if (params.blockSizes.empty())
+    {
+        params.blockSizes.push_back(4 * 1024);
+        params.blockSizes.push_back(64 * 1024);
+        params.blockSizes.push_back(1024 * 1024);
+    }
+
+    if (params.threadCounts.empty())
+    {
+        const size_t hardwareThreads = boost::thread::hardware_concurrency();
+
+        params.threadCounts.push_back(1);
+
+        if (hardwareThreads > 1)
+        {
+            params.threadCounts.push_back(hardwareThreads);
+        }
+    }
+
+    std::ofstream outFile;
+
+    if (!outputPath.empty())
+    {
+        outFile.open(outputPath.c_str(), std::ios::out | std::ios::trunc);
+
+        if (!outFile.is_open())
+        {
+            std::cerr << "Unable to open output file " << outputPath << std::endl;
+            return 1;
+        }
+    }
+
+    CBenchReport report(outputPath.empty() ? std::cout : outFile, format, label);
+
+    if (params.runMicro)
+    {
+        RunMicroBenchmarks(params, report);
+    }
+
+    if (params.runMacro)
+    {
+        RunMacroBenchmarks(params, report);
+    }
+
+    if (params.runScale)
+    {
+        RunScaleBenchmarks(params, report);
+    }
+
+    return 0;
+}
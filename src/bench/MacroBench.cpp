@@ -0,0 +1,156 @@
+//! @file MacroBench.cpp
+//! Сквозные тесты конвейера CSignatureGenerator на сгенерированных файлах
+
+#include "Bench.h"
+
+#include "../signGenerator/SignatureGenerator.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+//! Размер буфера при генерации плотного файла.
+const size_t GENERATE_CHUNK_SIZE = 1024 * 1024;
+
+//! Создает разреженный файл: заданного размера, но без записанных данных.
+//! @param path - [in] путь к файлу;
+//! @param size - [in] размер файла.
+//! @return true - успех, false - в случае ошибки.
+static bool CreateSparseFile(const std::string& path, uint64_t size)
+{
+    std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+
+    if (size != 0)
+    {
+        file.seekp(static_cast<std::streamoff>(size - 1));
+        file.put(0);
+    }
+
+    return file.good();
+}
+
+//! Создает плотный файл, заполненный псевдослучайными данными.
+//! @param path - [in] путь к файлу;
+//! @param size - [in] размер файла.
+//! @return true - успех, false - в случае ошибки.
+static bool CreateDenseFile(const std::string& path, uint64_t size)
+{
+    std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+
+    std::vector<uint32_t> chunk(GENERATE_CHUNK_SIZE / sizeof(uint32_t));
+    uint32_t state = 2463534242u;
+
+    for (uint64_t written = 0; (written < size) && file.good(); )
+    {
+        for (size_t i = 0; i < chunk.size(); ++i)
+        {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            chunk[i] = state;
+        }
+
+        const size_t toWrite = static_cast<size_t>(std::min<uint64_t>(GENERATE_CHUNK_SIZE, size - written));
+
+        file.write(reinterpret_cast<const char*>(&chunk[0]), toWrite);
+        written += toWrite;
+    }
+
+    return file.good();
+}
+
+//! Рассчитывает сигнатуру файла и измеряет время.
+//! @param inPath    - [in]  входной файл;
+//! @param outPath   - [in]  файл сигнатуры;
+//! @param blockSize - [in]  размер блока;
+//! @param threads   - [in]  кол-во потоков рассчета CRC;
+//! @param seconds   - [out] время рассчета.
+//! @return true - успех, false - в случае ошибки.
+static bool RunPipeline(const std::string& inPath, const std::string& outPath,
+                        size_t blockSize, size_t threads, double& seconds)
+{
+    std::ifstream inFile(inPath.c_str(), std::ios::binary);
+    std::ofstream outFile(outPath.c_str(), std::ios::binary | std::ios::trunc);
+
+    if (!inFile.is_open() || !outFile.is_open())
+    {
+        return false;
+    }
+
+    CStreamSource source(inFile);
+    CStreamSink   sink(outFile);
+
+    CSignatureGenerator signGen;
+
+    if (!signGen.Init(source, sink, blockSize, threads))
+    {
+        return false;
+    }
+
+    CBenchTimer timer;
+
+    signGen.StartProcessing();
+    const bool isOk = signGen.WaitFinished();
+
+    seconds = timer.Elapsed();
+
+    return isOk;
+}
+
+//! Запускает сквозные тесты конвейера для каждого сочетания вида данных, размера блока
+//! и кол-ва потоков. Файлы читаются из кэша ОС: после генерации они в нем остаются.
+//! @param params - [in] параметры запуска;
+//! @param report - [in] вывод результатов.
+void RunMacroBenchmarks(const BenchParams& params, CBenchReport& report)
+{
+    const char* const kinds[] = { "sparse", "dense" };
+
+    const std::string outPath = params.tmpDir + "/signGen_bench_out.bin";
+
+    for (size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); ++k)
+    {
+        const std::string kind   = kinds[k];
+        const std::string inPath = params.tmpDir + "/signGen_bench_" + kind + ".bin";
+
+        std::cerr << "Generating " << kind << " file " << inPath << std::endl;
+
+        const bool isCreated = (kind == "sparse") ? CreateSparseFile(inPath, params.fileSize)
+                                                  : CreateDenseFile(inPath, params.fileSize);
+
+        if (!isCreated)
+        {
+            std::cerr << "Unable to create " << inPath << std::endl;
+            remove(inPath.c_str());
+            continue;
+        }
+
+        for (size_t i = 0; i < params.blockSizes.size(); ++i)
+        {
+            for (size_t j = 0; j < params.threadCounts.size(); ++j)
+            {
+                BenchResult result;
+                result.suite     = "macro";
+                result.name      = "pipeline";
+                result.data      = kind;
+                result.blockSize = params.blockSizes[i];
+                result.threads   = params.threadCounts[j];
+                result.bytes     = params.fileSize;
+                result.ops       = (params.fileSize + result.blockSize - 1) / result.blockSize;
+
+                if (!RunPipeline(inPath, outPath, result.blockSize, result.threads,
+                                 result.seconds))
+                {
+                    std::cerr << "Pipeline failed: " << kind << ", block size "
+                              << result.blockSize << ", threads " << result.threads << std::endl;
+                    continue;
+                }
+
+                report.Add(result);
+            }
+        }
+
+        remove(inPath.c_str());
+    }
+
+    remove(outPath.c_str());
+}
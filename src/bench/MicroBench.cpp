@@ -0,0 +1,291 @@
+//! @file MicroBench.cpp
+//! Микротесты: CalcCrc32 и CalcCrc32Fixed, пул памяти, передача блоков через очередь
+
+#include "Bench.h"
+
+#include "../common/memory/MemoryPool.h"
+#include "../includes/Crc32.h"
+
+#include <boost/bind/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <iostream>
+#include <queue>
+
+//! Кол-во операций одного потока в тесте пула.
+const uint64_t POOL_OPS_PER_THREAD = 200000;
+//! Кол-во блоков, передаваемых через очередь.
+const uint64_t QUEUE_ITEMS         = 200000;
+//! Объем данных, обрабатываемый CalcCrc32 между проверками времени.
+const size_t   CRC_BATCH_BYTES     = 16 * 1024 * 1024;
+
+//! Заполняет буфер псевдослучайными данными.
+//! @param pBuff - [out] буфер;
+//! @param size  - [in]  размер буфера.
+static void FillRandom(uint8_t* pBuff, size_t size)
+{
+    uint32_t state = 2463534242u;
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        pBuff[i] = static_cast<uint8_t>(state);
+    }
+}
+
+//! Скорость CalcCrc32 для каждого размера блока.
+static void BenchCrc32(const BenchParams& params, CBenchReport& report)
+{
+    for (size_t i = 0; i < params.blockSizes.size(); ++i)
+    {
+        const size_t blockSize = params.blockSizes[i];
+
+        std::vector<uint8_t> buff(blockSize);
+        FillRandom(&buff[0], buff.size());
+
+        const uint64_t batch = std::max<size_t>(CRC_BATCH_BYTES / blockSize, 1);
+
+        BenchResult result;
+        result.suite     = "micro";
+        result.name      = "crc32";
+        result.blockSize = blockSize;
+        result.threads   = 1;
+
+        // Результат накапливается, чтобы компилятор не выбросил вызовы
+        volatile uint32_t sink = 0;
+
+        CBenchTimer timer;
+
+        do
+        {
+            for (uint64_t n = 0; n < batch; ++n)
+            {
+                sink = sink ^ CalcCrc32(&buff[0], blockSize);
+            }
+
+            result.ops += batch;
+        }
+        while (timer.Elapsed() < params.minSeconds);
+
+        result.seconds = timer.Elapsed();
+        result.bytes   = result.ops * blockSize;
+
+        report.Add(result);
+    }
+}
+
+//! Скорость CalcCrc32Fixed для размера блока BlockSize, известного при компиляции.
+template <size_t BlockSize>
+static void BenchCrc32Fixed(const BenchParams& params, CBenchReport& report)
+{
+    std::vector<uint8_t> buff(BlockSize);
+    FillRandom(&buff[0], buff.size());
+
+    const uint64_t batch = std::max<size_t>(CRC_BATCH_BYTES / BlockSize, 1);
+
+    BenchResult result;
+    result.suite     = "micro";
+    result.name      = "crc32_fixed";
+    result.blockSize = BlockSize;
+    result.threads   = 1;
+
+    volatile uint32_t sink = 0;
+
+    CBenchTimer timer;
+
+    do
+    {
+        for (uint64_t n = 0; n < batch; ++n)
+        {
+            sink = sink ^ CalcCrc32Fixed<BlockSize>(&buff[0]);
+        }
+
+        result.ops += batch;
+    }
+    while (timer.Elapsed() < params.minSeconds);
+
+    result.seconds = timer.Elapsed();
+    result.bytes   = result.ops * BlockSize;
+
+    report.Add(result);
+}
+
+//! Тело потока теста пула: получает и сразу возвращает блоки.
+static void PoolWorker(CMemoryPool* pPool, size_t blockSize, boost::barrier* pStart)
+{
+    pStart->wait();
+
+    for (uint64_t n = 0; n < POOL_OPS_PER_THREAD; ++n)
+    {
+        CPoolBuffer buff = pPool->Get(blockSize, boost::posix_time::seconds(1));
+        buff[0] = static_cast<uint8_t>(n);
+    }
+}
+
+//! CMemoryPool::Get() и возврат блока при одновременной работе нескольких потоков.
+static void BenchPoolContention(const BenchParams& params, CBenchReport& report)
+{
+    for (size_t i = 0; i < params.blockSizes.size(); ++i)
+    {
+        for (size_t j = 0; j < params.threadCounts.size(); ++j)
+        {
+            const size_t blockSize = params.blockSizes[i];
+            const size_t threads   = params.threadCounts[j];
+
+            CMemoryPool pool;
+            CMemoryPool::PoolsParams poolParams;
+            poolParams.push_back(CMemoryPool::FixedPoolParams(blockSize, threads * 4));
+
+            if (!pool.Init(CMemoryPool::POOL_FIXED, poolParams))
+            {
+                std::cerr << "Unable to init pool for block size " << blockSize << std::endl;
+                continue;
+            }
+
+            boost::barrier      start(static_cast<unsigned>(threads + 1));
+            boost::thread_group workers;
+
+            for (size_t t = 0; t < threads; ++t)
+            {
+                workers.create_thread(boost::bind(&PoolWorker, &pool, blockSize, &start));
+            }
+
+            start.wait();
+
+            CBenchTimer timer;
+            workers.join_all();
+
+            BenchResult result;
+            result.suite     = "micro";
+            result.name      = "pool_get_release";
+            result.blockSize = blockSize;
+            result.threads   = threads;
+            result.ops       = POOL_OPS_PER_THREAD * threads;
+            result.seconds   = timer.Elapsed();
+
+            report.Add(result);
+        }
+    }
+}
+
+//! Очередь блоков, устроенная так же, как очередь чтения CSignatureGenerator.
+struct HandoffQueue
+{
+    HandoffQueue() : maxSize(0), isFinished(false) {}
+
+    std::queue<CPoolBuffer>   queue;
+    boost::mutex              mutex;
+    boost::condition_variable condVarFree;
+    boost::condition_variable condVarHaveData;
+    size_t                    maxSize;
+    bool                      isFinished;
+};
+
+//! Тело потока-потребителя: забирает блоки из очереди и возвращает их в пул.
+static void QueueConsumer(HandoffQueue* pQueue)
+{
+    while (true)
+    {
+        boost::unique_lock<boost::mutex> lock(pQueue->mutex);
+
+        while (pQueue->queue.empty() && !pQueue->isFinished)
+        {
+            pQueue->condVarHaveData.wait(lock);
+        }
+
+        if (pQueue->queue.empty())
+        {
+            return;
+        }
+
+        CPoolBuffer buff = boost::move(pQueue->queue.front());
+        pQueue->queue.pop();
+
+        pQueue->condVarFree.notify_all();
+
+        lock.unlock();
+
+        buff[0] = 0;
+    }
+}
+
+//! Передача блоков пула от одного потока-производителя нескольким потребителям.
+static void BenchQueueHandoff(const BenchParams& params, CBenchReport& report)
+{
+    const size_t blockSize = params.blockSizes.empty() ? 4096 : params.blockSizes[0];
+
+    for (size_t j = 0; j < params.threadCounts.size(); ++j)
+    {
+        const size_t threads = params.threadCounts[j];
+
+        HandoffQueue handoff;
+        handoff.maxSize = threads * 2;
+
+        CMemoryPool pool;
+        CMemoryPool::PoolsParams poolParams;
+        poolParams.push_back(CMemoryPool::FixedPoolParams(blockSize, handoff.maxSize * 2));
+
+        if (!pool.Init(CMemoryPool::POOL_FIXED, poolParams))
+        {
+            std::cerr << "Unable to init pool for block size " << blockSize << std::endl;
+            continue;
+        }
+
+        boost::thread_group consumers;
+
+        for (size_t t = 0; t < threads; ++t)
+        {
+            consumers.create_thread(boost::bind(&QueueConsumer, &handoff));
+        }
+
+        CBenchTimer timer;
+
+        for (uint64_t n = 0; n < QUEUE_ITEMS; ++n)
+        {
+            CPoolBuffer buff = pool.Get(blockSize, boost::posix_time::seconds(1));
+
+            boost::unique_lock<boost::mutex> lock(handoff.mutex);
+
+            while (handoff.queue.size() >= handoff.maxSize)
+            {
+                handoff.condVarFree.wait(lock);
+            }
+
+            handoff.queue.push(boost::move(buff));
+            handoff.condVarHaveData.notify_all();
+        }
+
+        {
+            boost::unique_lock<boost::mutex> lock(handoff.mutex);
+            handoff.isFinished = true;
+            handoff.condVarHaveData.notify_all();
+        }
+
+        consumers.join_all();
+
+        BenchResult result;
+        result.suite     = "micro";
+        result.name      = "queue_handoff";
+        result.blockSize = blockSize;
+        result.threads   = threads;
+        result.ops       = QUEUE_ITEMS;
+        result.seconds   = timer.Elapsed();
+
+        report.Add(result);
+    }
+}
+
+//! Запускает микротесты.
+//! @param params - [in] параметры запуска;
+//! @param report - [in] вывод результатов.
+void RunMicroBenchmarks(const BenchParams& params, CBenchReport& report)
+{
+    BenchCrc32(params, report);
+    BenchCrc32Fixed<4 * 1024>(params, report);
+    BenchCrc32Fixed<64 * 1024>(params, report);
+    BenchCrc32Fixed<1024 * 1024>(params, report);
+    BenchPoolContention(params, report);
+    BenchQueueHandoff(params, report);
+}
@@ -0,0 +1,219 @@
+//! @file ScaleBench.cpp
+//! Тесты масштаба: сигнатуры окон виртуального разреженного файла размером в петабайты.
+//! Номера блоков в конце такого файла не помещаются в 32 бита, смещения - в 48 бит.
+
+#include "Bench.h"
+
+#include "../signGenerator/SignatureGenerator.h"
+
+#include <algorithm>
+#include <iostream>
+#include <string.h>
+
+//! Размер окна файла, сигнатура которого рассчитывается в одном тесте.
+const uint64_t SCALE_WINDOW_SIZE  = 64 * 1024 * 1024;
+//! Участки с данными начинаются через каждые столько байтов виртуального файла.
+const uint64_t DATA_EXTENT_STRIDE = 1024 * 1024 * 1024;
+//! Размер участка с данными, остальное - дыры из нулей.
+const uint64_t DATA_EXTENT_SIZE   = 1024 * 1024;
+
+//! Заполняет буфер данными виртуального файла.
+//! Байты участков с данными - смещение 8-байтового слова в файле (младшим байтом вперед),
+//! поэтому данные на разных смещениях не повторяются. Вне участков - нули.
+//! @param offset - [in]  смещение данных в файле;
+//! @param pBuff  - [out] буфер;
+//! @param size   - [in]  размер буфера.
+static void FillVirtualData(uint64_t offset, uint8_t* pBuff, size_t size)
+{
+    memset(pBuff, 0, size);
+
+    const uint64_t end = offset + size;
+
+    for (uint64_t extent = offset - offset % DATA_EXTENT_STRIDE; extent < end; extent += DATA_EXTENT_STRIDE)
+    {
+        const uint64_t dataEnd = std::min(end, extent + DATA_EXTENT_SIZE);
+
+        for (uint64_t pos = std::max(offset, extent); pos < dataEnd; ++pos)
+        {
+            pBuff[pos - offset] = static_cast<uint8_t>((pos / 8) >> (8 * (pos % 8)));
+        }
+    }
+}
+
+//! Проверяет, что часть файла - дыра.
+//! @param offset - [in] смещение части;
+//! @param size   - [in] размер части.
+//! @return true - в части нет данных.
+static bool IsHole(uint64_t offset, uint64_t size)
+{
+    const uint64_t extent = offset - offset % DATA_EXTENT_STRIDE;
+
+    return (offset >= extent + DATA_EXTENT_SIZE) && (offset + size <= extent + DATA_EXTENT_STRIDE);
+}
+
+//! Источник: окно виртуального разреженного файла.
+class CSparseVirtualSource : public CSignatureSource
+{
+public:
+    //! Конструктор.
+    //! @param offset - [in] смещение окна в файле;
+    //! @param size   - [in] размер окна.
+    CSparseVirtualSource(uint64_t offset, uint64_t size) : m_offset(offset), m_end(offset + size) {}
+
+    virtual bool Read(uint8_t* pBuffer, size_t size, size_t& readSize)
+    {
+        readSize = static_cast<size_t>(std::min<uint64_t>(size, m_end - m_offset));
+
+        FillVirtualData(m_offset, pBuffer, readSize);
+        m_offset += readSize;
+
+        return true;
+    }
+
+    virtual bool GetSize(uint64_t& size) const
+    {
+        size = m_end - m_offset;
+        return true;
+    }
+
+private:
+    uint64_t m_offset;
+    uint64_t m_end;
+};
+
+//! Приемник, проверяющий номера блоков и CRC по данным виртуального файла.
+class CCheckSink : public CSignatureSink
+{
+public:
+    //! Конструктор.
+    //! @param fileSize   - [in] размер виртуального файла;
+    //! @param blockSize  - [in] размер блока;
+    //! @param firstBlock - [in] номер первого блока окна.
+    CCheckSink(uint64_t fileSize, size_t blockSize, uint64_t firstBlock) :
+        m_fileSize(fileSize), m_blockSize(blockSize), m_nextBlock(firstBlock), m_buffer(blockSize)
+    {
+        m_zeroCrc = CalcCrc32(&m_buffer[0], m_blockSize);
+    }
+
+    virtual bool Write(uint64_t blockNum, const uint8_t* pRecord, size_t size)
+    {
+        if ((blockNum != m_nextBlock++) || (size != sizeof(uint32_t)))
+        {
+            return false;
+        }
+
+        const uint64_t offset = blockNum * m_blockSize;
+        uint32_t       crc    = m_zeroCrc;
+
+        // Дыры не пересчитываются, чтобы проверка не замедляла конвейер
+        if (!IsHole(offset, m_blockSize))
+        {
+            const size_t dataSize = static_cast<size_t>(std::min<uint64_t>(m_blockSize, m_fileSize - offset));
+
+            FillVirtualData(offset, &m_buffer[0], dataSize);
+            memset(&m_buffer[dataSize], 0, m_blockSize - dataSize);
+
+            crc = CalcCrc32(&m_buffer[0], m_blockSize);
+        }
+
+        return memcmp(pRecord, &crc, sizeof(crc)) == 0;
+    }
+
+    uint64_t NextBlock() const
+    {
+        return m_nextBlock;
+    }
+
+private:
+    uint64_t             m_fileSize;
+    size_t               m_blockSize;
+    uint64_t             m_nextBlock;
+    uint32_t             m_zeroCrc;
+    std::vector<uint8_t> m_buffer;
+};
+
+//! Рассчитывает сигнатуру окна виртуального файла, проверяет ее и измеряет время.
+//! @param fileSize  - [in]  размер файла;
+//! @param offset    - [in]  смещение окна, кратно blockSize;
+//! @param size      - [in]  размер окна;
+//! @param blockSize - [in]  размер блока;
+//! @param threads   - [in]  кол-во потоков рассчета CRC;
+//! @param seconds   - [out] время рассчета.
+//! @return true - успех, false - ошибка конвейера или неверная сигнатура.
+static bool RunWindow(uint64_t fileSize, uint64_t offset, uint64_t size, size_t blockSize,
+                      size_t threads, double& seconds)
+{
+    const uint64_t firstBlock = offset / blockSize;
+    const uint64_t numBlocks  = (size + blockSize - 1) / blockSize;
+
+    CSparseVirtualSource source(offset, size);
+    CCheckSink           sink(fileSize, blockSize, firstBlock);
+
+    CSignatureGenerator signGen;
+    signGen.SetBlockRange(firstBlock);
+
+    if (!signGen.Init(source, sink, blockSize, threads))
+    {
+        return false;
+    }
+
+    CBenchTimer timer;
+
+    signGen.StartProcessing();
+    const bool isOk = signGen.WaitFinished();
+
+    seconds = timer.Elapsed();
+
+    return isOk && (sink.NextBlock() == firstBlock + numBlocks);
+}
+
+//! Запускает тесты масштаба: сигнатуры окон в начале, середине и конце виртуального
+//! файла для каждого сочетания размера блока и кол-ва потоков.
+//! @param params - [in] параметры запуска;
+//! @param report - [in] вывод результатов.
+void RunScaleBenchmarks(const BenchParams& params, CBenchReport& report)
+{
+    const char* const windows[] = { "virtual_start", "virtual_middle", "virtual_end" };
+
+    for (size_t i = 0; i < params.blockSizes.size(); ++i)
+    {
+        const size_t   blockSize  = params.blockSizes[i];
+        const uint64_t windowSize = std::min(SCALE_WINDOW_SIZE, params.scaleSize);
+
+        // Окна начинаются с границы блока; последнее заканчивается концом файла
+        const uint64_t lastOffset = params.scaleSize - windowSize;
+        const uint64_t offsets[]  = { 0,
+                                      params.scaleSize / 2 - params.scaleSize / 2 % blockSize,
+                                      lastOffset - lastOffset % blockSize };
+        const uint64_t sizes[]    = { windowSize,
+                                      std::min(windowSize, params.scaleSize - offsets[1]),
+                                      params.scaleSize - offsets[2] };
+
+        for (size_t w = 0; w < sizeof(windows) / sizeof(windows[0]); ++w)
+        {
+            const uint64_t size = sizes[w];
+
+            for (size_t j = 0; j < params.threadCounts.size(); ++j)
+            {
+                BenchResult result;
+                result.suite     = "scale";
+                result.name      = windows[w];
+                result.data      = "sparse";
+                result.blockSize = blockSize;
+                result.threads   = params.threadCounts[j];
+                result.bytes     = size;
+                result.ops       = (size + blockSize - 1) / blockSize;
+
+                if (!RunWindow(params.scaleSize, offsets[w], size, blockSize, result.threads,
+                               result.seconds))
+                {
+                    std::cerr << "Scale check failed: " << windows[w] << ", block size "
+                              << blockSize << ", threads " << result.threads << std::endl;
+                    continue;
+                }
+
+                report.Add(result);
+            }
+        }
+    }
+}
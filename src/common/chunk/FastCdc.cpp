@@ -0,0 +1,109 @@
+//! @file chunk/FastCdc.cpp
+//! Реализация класса CFastCdc
+
+#include "FastCdc.h"
+
+#include <algorithm>
+
+//! Уровень нормализации: на сколько битов маски до и после среднего размера
+//! отличаются от log2(среднего размера)
+const size_t NORMALIZATION_LEVEL = 2;
+//! Начальное значение генератора gear-таблицы. Таблица - часть формата: при ее изменении
+//! меняются границы, и сигнатуры, рассчитанные раньше, перестают совпадать
+const uint64_t GEAR_SEED = 0x9E3779B97F4A7C15ULL;
+
+//! Маска из старших битов.
+//! @param bits - [in] кол-во битов, 1..63.
+static uint64_t HighBitsMask(size_t bits)
+{
+    return ~0ULL << (64 - bits);
+}
+
+//! Конструктор. Заполняет gear-таблицу псевдослучайными числами (SplitMix64).
+CFastCdc::CFastCdc() : m_minSize(0), m_avgSize(0), m_maxSize(0), m_maskStrict(0), m_maskLoose(0)
+{
+    uint64_t state = GEAR_SEED;
+
+    for (size_t i = 0; i < 256; ++i)
+    {
+        state += 0x9E3779B97F4A7C15ULL;
+
+        uint64_t value = state;
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+
+        m_gear[i] = value ^ (value >> 31);
+    }
+}
+
+//! Задает размеры блоков.
+//! @param minSize - [in] минимальный размер, не меньше MIN_CHUNK_SIZE;
+//! @param avgSize - [in] средний (ожидаемый) размер;
+//! @param maxSize - [in] максимальный размер, не больше 4Гб.
+//! @return true - успех, false - если не выполняется min < avg < max.
+bool CFastCdc::Init(size_t minSize, size_t avgSize, size_t maxSize)
+{
+    if ((minSize < MIN_CHUNK_SIZE) || (avgSize <= minSize) || (maxSize <= avgSize) ||
+        (static_cast<uint64_t>(maxSize) > 0xFFFFFFFFULL))
+    {
+        return false;
+    }
+
+    size_t avgBits = 0;
+
+    while ((static_cast<size_t>(2) << avgBits) <= avgSize)
+    {
+        ++avgBits;
+    }
+
+    m_minSize    = minSize;
+    m_avgSize    = avgSize;
+    m_maxSize    = maxSize;
+    m_maskStrict = HighBitsMask(std::min<size_t>(avgBits + NORMALIZATION_LEVEL, 63));
+    m_maskLoose  = HighBitsMask(avgBits - NORMALIZATION_LEVEL);
+
+    return true;
+}
+
+//! Ищет конец блока, начинающегося с pData.
+//! Если конец не найден в пределах size байтов и size меньше максимального размера блока,
+//! возвращается size: граница зависит от следующих данных, и если они есть, поиск
+//! надо повторить с большим size.
+//! @param pData - [in] данные с начала блока;
+//! @param size  - [in] кол-во доступных байтов.
+//! @return размер блока, 0 - только при size == 0.
+size_t CFastCdc::FindBoundary(const uint8_t* pData, size_t size) const
+{
+    if (size <= m_minSize)
+    {
+        return size;
+    }
+
+    const size_t maxSize    = std::min(size, m_maxSize);
+    const size_t normalSize = std::min(maxSize, m_avgSize);
+
+    uint64_t hash = 0;
+    size_t   i    = m_minSize;
+
+    for (; i < normalSize; ++i)
+    {
+        hash = (hash << 1) + m_gear[pData[i]];
+
+        if ((hash & m_maskStrict) == 0)
+        {
+            return i + 1;
+        }
+    }
+
+    for (; i < maxSize; ++i)
+    {
+        hash = (hash << 1) + m_gear[pData[i]];
+
+        if ((hash & m_maskLoose) == 0)
+        {
+            return i + 1;
+        }
+    }
+
+    return maxSize;
+}
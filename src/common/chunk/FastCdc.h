@@ -0,0 +1,49 @@
+//! @file chunk/FastCdc.h
+//! Объявление класса CFastCdc
+
+#ifndef _FAST_CDC_H
+#define _FAST_CDC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//! Поиск границ блоков по содержимому (content-defined chunking, FastCDC).
+//! Граница ставится там, где gear-хэш последних байтов удовлетворяет маске, поэтому
+//! вставка данных сдвигает только соседние границы, а не все последующие блоки.
+//! До среднего размера используется более строгая маска, после него - более слабая
+//! (нормализация), что сужает разброс размеров блоков.
+//! Gear-хэш 64 бит зависит только от последних 64 байтов, маска проверяет старшие биты,
+//! поэтому, начиная с 64-го байта поиска, граница определяется только окном данных.
+class CFastCdc
+{
+public:
+    //! Наименьший допустимый минимальный размер блока: не меньше окна хэша
+    static const size_t MIN_CHUNK_SIZE = 64;
+
+public:
+    CFastCdc();
+
+    bool Init(size_t minSize, size_t avgSize, size_t maxSize);
+
+    size_t FindBoundary(const uint8_t* pData, size_t size) const;
+
+    size_t MinSize() const
+    {
+        return m_minSize;
+    }
+
+    size_t MaxSize() const
+    {
+        return m_maxSize;
+    }
+
+private:
+    size_t   m_minSize;
+    size_t   m_avgSize;
+    size_t   m_maxSize;
+    uint64_t m_maskStrict;  //!< Маска до среднего размера
+    uint64_t m_maskLoose;   //!< Маска после среднего размера
+    uint64_t m_gear[256];
+};
+
+#endif // _FAST_CDC_H
@@ -0,0 +1,437 @@
+//! @file dedup/DedupIndex.cpp
+//! Реализация класса CDedupIndex
+
+#include "DedupIndex.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string.h>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+//! Кол-во сегментов индекса
+const size_t NUM_SHARDS        = 64;
+//! Наименьшее кол-во записей сегмента в памяти перед сбросом на диск
+const size_t MIN_SHARD_ENTRIES = 1024;
+
+//! Порядок записей: по дайджесту, затем по номеру блока.
+static bool EntryLess(const CDedupIndex::Entry& left, const CDedupIndex::Entry& right)
+{
+    const int result = memcmp(left.digest, right.digest, SHA256_SIZE);
+
+    return (result != 0) ? (result < 0) : (left.blockNum < right.blockNum);
+}
+
+//! Очередная запись файла сегмента при слиянии.
+struct MergeItem
+{
+    CDedupIndex::Entry entry;
+    size_t             run;     //!< Индекс файла
+};
+
+//! Обратный порядок для кучи слияния: наверху наименьшая запись.
+static bool MergeItemGreater(const MergeItem& left, const MergeItem& right)
+{
+    return EntryLess(right.entry, left.entry);
+}
+
+//! Читает запись из файла сегмента.
+//! @return true - прочитана, false - конец файла или ошибка.
+static bool ReadEntry(std::istream& file, CDedupIndex::Entry& entry)
+{
+    return file.read(reinterpret_cast<char*>(&entry), sizeof(entry)).gcount() == sizeof(entry);
+}
+
+//! Порядок групп для кучи самых больших групп: наверху наименьшая.
+static bool GroupGreater(const CDedupIndex::Group& left, const CDedupIndex::Group& right)
+{
+    return left.count > right.count;
+}
+
+//! Проверяет, что в каталоге можно создавать файлы: создает и удаляет пробный файл.
+//! @param dir - [in] каталог.
+//! @return true - файлы создаются, false - каталога нет или он недоступен для записи.
+static bool IsWritableDir(const std::string& dir)
+{
+#ifdef _WIN32
+    const int pid = _getpid();
+#else
+    const int pid = getpid();
+#endif
+
+    std::ostringstream fileName;
+    fileName << dir << "/signgen-dedup-" << pid << ".probe";
+
+    std::ofstream file(fileName.str().c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    file.close();
+    std::remove(fileName.str().c_str());
+
+    return true;
+}
+
+//! Конструктор.
+CDedupIndex::CDedupIndex() : m_maxShardEntries(0), m_runCounter(0), m_abError(false)
+{
+}
+
+//! Деструктор. Удаляет файлы, сброшенные на диск.
+CDedupIndex::~CDedupIndex()
+{
+    RemoveRunFiles();
+}
+
+//! Инициализация индекса. Записи предыдущего использования удаляются.
+//! @param memoryLimit - [in] ограничение памяти под записи, 0 - без ограничения;
+//! @param spillDir    - [in] каталог для файлов, сбрасываемых на диск.
+//! @return true - успех, false - каталог не существует или недоступен для записи.
+bool CDedupIndex::Init(size_t memoryLimit, const std::string& spillDir)
+{
+    RemoveRunFiles();
+
+    const std::string dir = spillDir.empty() ? std::string(".") : spillDir;
+
+    // Сбросить сегменты на диск может понадобиться лишь в конце долгого рассчета
+    if (!IsWritableDir(dir))
+    {
+        std::cerr << "Dedup index directory is not writable: " << dir << std::endl;
+        return false;
+    }
+
+    m_shards.clear();
+
+    for (size_t i = 0; i < NUM_SHARDS; ++i)
+    {
+        m_shards.push_back(boost::shared_ptr<Shard>(new Shard()));
+    }
+
+    m_spillDir        = dir;
+    m_maxShardEntries = (memoryLimit != 0)
+                      ? std::max(memoryLimit / sizeof(Entry) / NUM_SHARDS, MIN_SHARD_ENTRIES)
+                      : static_cast<size_t>(-1);
+    m_abError         = false;
+
+    return true;
+}
+
+//! Добавляет дайджест блока. Вызывается из нескольких потоков одновременно.
+//! Если сегмент заполнен, он сбрасывается на диск в вызывающем потоке.
+//! @param pDigest  - [in] SHA-256 блока;
+//! @param blockNum - [in] номер блока;
+//! @param size     - [in] размер блока, в байтах.
+void CDedupIndex::Insert(const uint8_t* pDigest, uint64_t blockNum, uint64_t size)
+{
+    if (m_abError)
+    {
+        return;
+    }
+
+    Entry entry;
+    memcpy(entry.digest, pDigest, SHA256_SIZE);
+    entry.blockNum = blockNum;
+    entry.size     = size;
+
+    Shard& shard = *m_shards[pDigest[0] % NUM_SHARDS];
+
+    boost::unique_lock<boost::mutex> lock(shard.mutex);
+
+    // Емкость растет не дальше предела сегмента, чтобы не превышать ограничение памяти
+    if (shard.entries.size() == shard.entries.capacity())
+    {
+        shard.entries.reserve(std::min(std::max<size_t>(shard.entries.capacity() * 2, MIN_SHARD_ENTRIES),
+                                       m_maxShardEntries));
+    }
+
+    shard.entries.push_back(entry);
+
+    if ((shard.entries.size() >= m_maxShardEntries) && !SpillShard(shard))
+    {
+        m_abError = true;
+    }
+}
+
+//! Сортирует записи сегмента в памяти и сбрасывает их в новый файл.
+//! Вызывается под блокировкой сегмента.
+//! @param shard - [in/out] сегмент.
+//! @return true - успех, false - ошибка записи файла.
+bool CDedupIndex::SpillShard(Shard& shard)
+{
+    std::sort(shard.entries.begin(), shard.entries.end(), &EntryLess);
+
+    boost::unique_lock<boost::mutex> lockRun(m_runMutex);
+
+#ifdef _WIN32
+    const int pid = _getpid();
+#else
+    const int pid = getpid();
+#endif
+
+    std::ostringstream fileName;
+    fileName << m_spillDir << "/signgen-dedup-" << pid << "-" << m_runCounter++ << ".run";
+
+    lockRun.unlock();
+
+    shard.runFiles.push_back(fileName.str());
+
+    std::ofstream file(fileName.str().c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+
+    file.write(reinterpret_cast<const char*>(&shard.entries[0]),
+               static_cast<std::streamsize>(shard.entries.size() * sizeof(Entry)));
+    file.close();
+
+    if (file.fail())
+    {
+        std::cerr << "Unable to write dedup index file " << fileName.str() << std::endl;
+        return false;
+    }
+
+    shard.entries.clear();
+
+    return true;
+}
+
+//! Строит отчет о повторяющихся блоках. Вызывается после добавления всех блоков,
+//! после него индекс пуст.
+//! @param report    - [out] отчет;
+//! @param maxGroups - [in]  кол-во самых больших групп в отчете.
+//! @return true - успех, false - ошибка записи или чтения файлов индекса.
+bool CDedupIndex::BuildReport(Report& report, size_t maxGroups)
+{
+    report = Report();
+
+    bool isOk = !m_abError;
+
+    for (size_t i = 0; (i < m_shards.size()) && isOk; ++i)
+    {
+        isOk = MergeShard(*m_shards[i], report, maxGroups);
+    }
+
+    std::sort_heap(report.topGroups.begin(), report.topGroups.end(), &GroupGreater);
+
+    RemoveRunFiles();
+
+    for (size_t i = 0; i < m_shards.size(); ++i)
+    {
+        std::vector<Entry>().swap(m_shards[i]->entries);
+    }
+
+    return isOk;
+}
+
+//! Перебирает записи сегмента по порядку и собирает группы одинаковых блоков.
+//! Если сегмент сбрасывался на диск, остаток в памяти тоже сбрасывается, и файлы
+//! сливаются через кучу по наименьшей записи.
+//! @param shard     - [in/out] сегмент;
+//! @param report    - [in/out] отчет;
+//! @param maxGroups - [in]     кол-во самых больших групп в отчете.
+//! @return true - успех, false - ошибка записи или чтения файлов.
+bool CDedupIndex::MergeShard(Shard& shard, Report& report, size_t maxGroups)
+{
+    Group group;
+
+    if (shard.runFiles.empty())
+    {
+        std::sort(shard.entries.begin(), shard.entries.end(), &EntryLess);
+
+        for (size_t i = 0; i < shard.entries.size(); ++i)
+        {
+            AddEntry(shard.entries[i], group, report, maxGroups);
+        }
+    }
+    else
+    {
+        if (!shard.entries.empty() && !SpillShard(shard))
+        {
+            return false;
+        }
+
+        report.spilledRuns += shard.runFiles.size();
+
+        std::vector< boost::shared_ptr<std::ifstream> > runs;
+        std::vector<MergeItem>                          heap;
+
+        for (size_t i = 0; i < shard.runFiles.size(); ++i)
+        {
+            runs.push_back(boost::shared_ptr<std::ifstream>(
+                               new std::ifstream(shard.runFiles[i].c_str(), std::ios::in | std::ios::binary)));
+
+            MergeItem item;
+            item.run = i;
+
+            if (!runs[i]->is_open())
+            {
+                return false;
+            }
+
+            if (ReadEntry(*runs[i], item.entry))
+            {
+                heap.push_back(item);
+            }
+        }
+
+        std::make_heap(heap.begin(), heap.end(), &MergeItemGreater);
+
+        while (!heap.empty())
+        {
+            std::pop_heap(heap.begin(), heap.end(), &MergeItemGreater);
+
+            MergeItem& item = heap.back();
+
+            AddEntry(item.entry, group, report, maxGroups);
+
+            if (ReadEntry(*runs[item.run], item.entry))
+            {
+                std::push_heap(heap.begin(), heap.end(), &MergeItemGreater);
+            }
+            else
+            {
+                if (runs[item.run]->bad())
+                {
+                    return false;
+                }
+
+                heap.pop_back();
+            }
+        }
+    }
+
+    if (group.count != 0)
+    {
+        AddGroup(group, report, maxGroups);
+    }
+
+    return true;
+}
+
+//! Добавляет очередную по порядку запись в текущую группу или начинает новую.
+//! @param entry     - [in]     запись;
+//! @param group     - [in/out] текущая группа;
+//! @param report    - [in/out] отчет;
+//! @param maxGroups - [in]     кол-во самых больших групп в отчете.
+void CDedupIndex::AddEntry(const Entry& entry, Group& group, Report& report, size_t maxGroups)
+{
+    if ((group.count != 0) && (memcmp(group.digest, entry.digest, SHA256_SIZE) == 0))
+    {
+        ++group.count;
+
+        if (group.blocks.size() < MAX_GROUP_BLOCKS)
+        {
+            group.blocks.push_back(entry.blockNum);
+        }
+
+        return;
+    }
+
+    if (group.count != 0)
+    {
+        AddGroup(group, report, maxGroups);
+    }
+
+    memcpy(group.digest, entry.digest, SHA256_SIZE);
+    group.size  = entry.size;
+    group.count = 1;
+    group.blocks.assign(1, entry.blockNum);
+}
+
+//! Учитывает собранную группу в отчете.
+//! @param group     - [in]     группа;
+//! @param report    - [in/out] отчет;
+//! @param maxGroups - [in]     кол-во самых больших групп в отчете.
+void CDedupIndex::AddGroup(const Group& group, Report& report, size_t maxGroups)
+{
+    report.blocks       += group.count;
+    report.bytes        += group.count * group.size;
+    report.uniqueBlocks += 1;
+
+    if (group.count < 2)
+    {
+        return;
+    }
+
+    report.duplicateBlocks += group.count - 1;
+    report.duplicateBytes  += (group.count - 1) * group.size;
+    report.duplicateGroups += 1;
+
+    if (report.topGroups.size() < maxGroups)
+    {
+        report.topGroups.push_back(group);
+        std::push_heap(report.topGroups.begin(), report.topGroups.end(), &GroupGreater);
+    }
+    else if ((maxGroups != 0) && (group.count > report.topGroups.front().count))
+    {
+        std::pop_heap(report.topGroups.begin(), report.topGroups.end(), &GroupGreater);
+        report.topGroups.back() = group;
+        std::push_heap(report.topGroups.begin(), report.topGroups.end(), &GroupGreater);
+    }
+}
+
+//! Удаляет файлы сегментов, сброшенные на диск.
+void CDedupIndex::RemoveRunFiles()
+{
+    for (size_t i = 0; i < m_shards.size(); ++i)
+    {
+        for (size_t j = 0; j < m_shards[i]->runFiles.size(); ++j)
+        {
+            std::remove(m_shards[i]->runFiles[j].c_str());
+        }
+
+        m_shards[i]->runFiles.clear();
+    }
+}
+
+//! Выводит отчет в JSON.
+//! @param out - [in] поток вывода.
+void CDedupIndex::Report::WriteJson(std::ostream& out) const
+{
+    const double ratio = (blocks != 0) ? static_cast<double>(duplicateBlocks) / blocks : 0;
+
+    out << std::fixed << std::setprecision(4)
+        << "{\"dedup\":{\"blocks\":"  << blocks
+        << ",\"unique_blocks\":"      << uniqueBlocks
+        << ",\"duplicate_blocks\":"   << duplicateBlocks
+        << ",\"duplicate_ratio\":"    << ratio
+        << ",\"bytes\":"              << bytes
+        << ",\"duplicate_bytes\":"    << duplicateBytes
+        << ",\"duplicate_groups\":"   << duplicateGroups
+        << ",\"spilled_runs\":"       << spilledRuns
+        << ",\"top_groups\":[";
+
+    for (size_t i = 0; i < topGroups.size(); ++i)
+    {
+        const Group& group = topGroups[i];
+
+        out << ((i != 0) ? "," : "") << "{\"sha256\":\"" << std::hex << std::setfill('0');
+
+        for (size_t j = 0; j < SHA256_SIZE; ++j)
+        {
+            out << std::setw(2) << static_cast<unsigned>(group.digest[j]);
+        }
+
+        out << std::dec << std::setfill(' ')
+            << "\",\"size\":"   << group.size
+            << ",\"count\":"    << group.count
+            << ",\"blocks\":[";
+
+        for (size_t j = 0; j < group.blocks.size(); ++j)
+        {
+            out << ((j != 0) ? "," : "") << group.blocks[j];
+        }
+
+        out << "]}";
+    }
+
+    out << "]}}" << std::endl;
+}
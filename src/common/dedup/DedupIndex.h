@@ -0,0 +1,105 @@
+//! @file dedup/DedupIndex.h
+//! Объявление класса CDedupIndex
+
+#ifndef _DEDUP_INDEX_H
+#define _DEDUP_INDEX_H
+
+#include "../hash/Sha256.h"
+
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <ostream>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//! Индекс дайджестов блоков для поиска повторяющихся блоков.
+//! Потоки рассчета добавляют SHA-256 блоков одновременно: индекс разделен на сегменты
+//! по первому байту дайджеста, у каждого сегмента своя блокировка.
+//! Память ограничена: заполненный сегмент сортируется и сбрасывается на диск отдельным
+//! файлом, поэтому индекс вмещает любое кол-во блоков, на которое хватает диска.
+//! Повторы ищутся после рассчета слиянием отсортированных файлов сегмента; блоки
+//! считаются одинаковыми только при совпадении SHA-256 целиком.
+class CDedupIndex
+{
+public:
+    //! Наибольшее кол-во номеров блоков группы в отчете
+    static const size_t MAX_GROUP_BLOCKS = 16;
+
+    //! Группа одинаковых блоков.
+    struct Group
+    {
+        Group() : size(0), count(0) {}
+
+        uint8_t               digest[SHA256_SIZE];
+        uint64_t              size;     //!< Размер блока, в байтах
+        uint64_t              count;    //!< Кол-во блоков
+        std::vector<uint64_t> blocks;   //!< Первые MAX_GROUP_BLOCKS номеров блоков по возрастанию
+    };
+
+    //! Отчет о повторяющихся блоках.
+    struct Report
+    {
+        Report() : blocks(0), uniqueBlocks(0), duplicateBlocks(0), bytes(0), duplicateBytes(0),
+                   duplicateGroups(0), spilledRuns(0) {}
+
+        void WriteJson(std::ostream& out) const;
+
+        uint64_t           blocks;
+        uint64_t           uniqueBlocks;     //!< Блоков с различным содержимым
+        uint64_t           duplicateBlocks;  //!< Блоков, повторяющих более ранние
+        uint64_t           bytes;
+        uint64_t           duplicateBytes;
+        uint64_t           duplicateGroups;  //!< Групп из двух и более одинаковых блоков
+        size_t             spilledRuns;      //!< Файлов, сброшенных на диск
+        std::vector<Group> topGroups;        //!< Самые большие группы по убыванию
+    };
+
+    //! Запись индекса
+    struct Entry
+    {
+        uint8_t  digest[SHA256_SIZE];
+        uint64_t blockNum;
+        uint64_t size;
+    };
+
+public:
+    CDedupIndex();
+    ~CDedupIndex();
+
+    bool Init(size_t memoryLimit, const std::string& spillDir);
+
+    void Insert(const uint8_t* pDigest, uint64_t blockNum, uint64_t size);
+
+    bool BuildReport(Report& report, size_t maxGroups);
+
+private:
+    //! Сегмент индекса: записи в памяти и отсортированные файлы на диске
+    struct Shard
+    {
+        boost::mutex             mutex;
+        std::vector<Entry>       entries;
+        std::vector<std::string> runFiles;
+    };
+
+    typedef std::vector< boost::shared_ptr<Shard> > CShards;
+
+    bool SpillShard(Shard& shard);
+    bool MergeShard(Shard& shard, Report& report, size_t maxGroups);
+    void AddEntry(const Entry& entry, Group& group, Report& report, size_t maxGroups);
+    void AddGroup(const Group& group, Report& report, size_t maxGroups);
+    void RemoveRunFiles();
+
+private:
+    CShards             m_shards;
+    std::string         m_spillDir;
+    size_t              m_maxShardEntries;
+    size_t              m_runCounter;       //!< Под m_runMutex
+    boost::mutex        m_runMutex;
+    boost::atomic<bool> m_abError;
+};
+
+#endif // _DEDUP_INDEX_H
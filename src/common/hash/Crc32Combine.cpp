@@ -0,0 +1,97 @@
+//! @file hash/Crc32Combine.cpp
+//! Объединение CRC32 соседних участков данных без повторного чтения
+
+#include "Crc32Combine.h"
+
+//! Полином CRC32 без отражения, как в includes/Crc32.h
+const uint32_t CRC32_POLYNOMIAL = 0x04C11DB7;
+//! Кол-во бит регистра CRC32
+const unsigned CRC32_BITS       = 32;
+
+//! Умножает матрицу 32x32 над GF(2) на вектор: matrix[i] - образ бита i.
+static uint32_t MatrixTimes(const uint32_t* matrix, uint32_t vector)
+{
+    uint32_t result = 0;
+
+    for (unsigned i = 0; vector != 0; ++i, vector >>= 1)
+    {
+        if (vector & 1)
+        {
+            result ^= matrix[i];
+        }
+    }
+
+    return result;
+}
+
+//! Перемножает матрицы: result = a * b (сначала b, затем a).
+//! result не должна совпадать ни с a, ни с b.
+static void MatrixMultiply(const uint32_t* a, const uint32_t* b, uint32_t* result)
+{
+    for (unsigned i = 0; i < CRC32_BITS; ++i)
+    {
+        result[i] = MatrixTimes(a, b[i]);
+    }
+}
+
+//! Конструктор: строит оператор сдвига на length байтов.
+//! @param length - [in] длина второго участка, в байтах.
+CCrc32Shift::CCrc32Shift(uint64_t length)
+{
+    uint32_t power[CRC32_BITS];
+    uint32_t shift[CRC32_BITS];
+    uint32_t temp[CRC32_BITS];
+
+    // Один нулевой бит: регистр сдвигается влево, вышедший старший бит добавляет полином
+    for (unsigned i = 0; i + 1 < CRC32_BITS; ++i)
+    {
+        power[i] = 1U << (i + 1);
+    }
+
+    power[CRC32_BITS - 1] = CRC32_POLYNOMIAL;
+
+    // Один нулевой байт - восемь бит
+    for (unsigned i = 0; i < 3; ++i)
+    {
+        MatrixMultiply(power, power, temp);
+
+        for (unsigned j = 0; j < CRC32_BITS; ++j)
+        {
+            power[j] = temp[j];
+        }
+    }
+
+    for (unsigned i = 0; i < CRC32_BITS; ++i)
+    {
+        shift[i] = 1U << i;
+    }
+
+    // Возведение в степень length двоичным разложением
+    for (; length != 0; length >>= 1)
+    {
+        if (length & 1)
+        {
+            MatrixMultiply(power, shift, temp);
+
+            for (unsigned j = 0; j < CRC32_BITS; ++j)
+            {
+                shift[j] = temp[j];
+            }
+        }
+
+        MatrixMultiply(power, power, temp);
+
+        for (unsigned j = 0; j < CRC32_BITS; ++j)
+        {
+            power[j] = temp[j];
+        }
+    }
+
+    for (uint32_t b = 0; b < 256; ++b)
+    {
+        m_table[0][b] = MatrixTimes(shift, b << 24);
+        m_table[1][b] = MatrixTimes(shift, b << 16);
+        m_table[2][b] = MatrixTimes(shift, b << 8);
+        m_table[3][b] = MatrixTimes(shift, b);
+    }
+}
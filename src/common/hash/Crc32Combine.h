@@ -0,0 +1,39 @@
+//! @file hash/Crc32Combine.h
+//! Объединение CRC32 соседних участков данных без повторного чтения
+
+#ifndef _CRC32_COMBINE_H
+#define _CRC32_COMBINE_H
+
+#include <stdint.h>
+
+//! Сдвиг CRC32 (includes/Crc32.h) на участок заданной длины.
+//! CRC32 конкатенации A и B, где длина B равна length, - Combine(CRC32(A), CRC32(B)):
+//! дописывание байтов к данным - линейный оператор над GF(2) на регистре CRC, поэтому
+//! CRC32(A) достаточно "провести" через length нулевых байтов. Оператор для length
+//! строится один раз возведением в степень оператора одного бита, а применяется по
+//! таблицам - четыре обращения на сдвиг, независимо от length.
+class CCrc32Shift
+{
+public:
+    explicit CCrc32Shift(uint64_t length);
+
+    //! Возвращает CRC32(A), сдвинутый на length нулевых байтов.
+    uint32_t Apply(uint32_t crc) const
+    {
+        return m_table[0][crc >> 24] ^ m_table[1][(crc >> 16) & 0xFF] ^
+               m_table[2][(crc >> 8) & 0xFF] ^ m_table[3][crc & 0xFF];
+    }
+
+    //! Возвращает CRC32 конкатенации A и B.
+    //! @param crcA - [in] CRC32 первого участка;
+    //! @param crcB - [in] CRC32 второго участка длиной length.
+    uint32_t Combine(uint32_t crcA, uint32_t crcB) const
+    {
+        return Apply(crcA) ^ crcB;
+    }
+
+private:
+    uint32_t m_table[4][256];   //!< m_table[k][b] - сдвиг байта b, за которым следуют 3 - k байтов
+};
+
+#endif // _CRC32_COMBINE_H
@@ -0,0 +1,114 @@
+//! @file hash/Digest.cpp
+//! Рассчет дайджестов блока
+
+#include "Digest.h"
+
+#include "Sha256.h"
+#include "Xxh3.h"
+
+#include <algorithm>
+
+//! Возвращает название дайджеста (в командной строке и отчетах).
+//! @param type - [in] вид дайджеста.
+const char* DigestName(EDigestType type)
+{
+    switch (type)
+    {
+    case DIGEST_CRC32:  return "crc32";
+    case DIGEST_SHA256: return "sha256";
+    case DIGEST_XXH3:   return "xxh3";
+    default:            return "unknown";
+    }
+}
+
+//! Возвращает размер дайджеста, в байтах.
+//! @param type - [in] вид дайджеста.
+size_t DigestSize(EDigestType type)
+{
+    switch (type)
+    {
+    case DIGEST_CRC32:  return sizeof(uint32_t);
+    case DIGEST_SHA256: return SHA256_SIZE;
+    case DIGEST_XXH3:   return sizeof(uint64_t);
+    default:            return 0;
+    }
+}
+
+//! Рассчитывает дайджест.
+//! @param type    - [in]  вид дайджеста;
+//! @param buff    - [in]  буфер;
+//! @param size    - [in]  размер буфера, в байтах;
+//! @param pDigest - [out] дайджест, DigestSize(type) байтов.
+void CalcDigest(EDigestType type, const uint8_t* buff, size_t size, uint8_t* pDigest)
+{
+    switch (type)
+    {
+    case DIGEST_CRC32:
+        {
+            const uint32_t crc32 = CalcCrc32(buff, size);
+            memcpy(pDigest, &crc32, sizeof(crc32));
+        }
+        break;
+
+    case DIGEST_SHA256:
+        CalcSha256(buff, size, pDigest);
+        break;
+
+    case DIGEST_XXH3:
+        {
+            const uint64_t xxh3 = CalcXxh3(buff, size);
+
+            for (size_t i = 0; i < sizeof(xxh3); ++i)
+            {
+                pDigest[i] = static_cast<uint8_t>(xxh3 >> (8 * (sizeof(xxh3) - 1 - i)));
+            }
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+//! Разбирает список дайджестов через запятую, например "crc32,sha256".
+//! @param str     - [in]  строка со списком;
+//! @param digests - [out] дайджесты в порядке перечисления, без повторов.
+//! @return true - успех, false - пустой список или неизвестное название.
+bool ParseDigestList(const std::string& str, CDigestList& digests)
+{
+    digests.clear();
+
+    std::string::size_type posStart = 0;
+
+    while (posStart <= str.size())
+    {
+        std::string::size_type posComma = str.find(',', posStart);
+
+        if (posComma == std::string::npos)
+        {
+            posComma = str.size();
+        }
+
+        const std::string name = str.substr(posStart, posComma - posStart);
+        size_t            type = 0;
+
+        while ((type < DIGEST_TYPE_COUNT) && (name != DigestName(static_cast<EDigestType>(type))))
+        {
+            ++type;
+        }
+
+        if (type == DIGEST_TYPE_COUNT)
+        {
+            return false;
+        }
+
+        if (std::find(digests.begin(), digests.end(), static_cast<EDigestType>(type)) == digests.end())
+        {
+            digests.push_back(static_cast<EDigestType>(type));
+        }
+
+        posStart = posComma + 1;
+    }
+
+    return !digests.empty();
+}
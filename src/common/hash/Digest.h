@@ -0,0 +1,56 @@
+//! @file hash/Digest.h
+//! Виды дайджестов блока и их рассчет
+
+#ifndef _DIGEST_H
+#define _DIGEST_H
+
+#include "../../includes/Crc32.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+//! Виды дайджестов блока.
+enum EDigestType
+{
+    DIGEST_CRC32,       //!< CRC32, 4 байта в порядке байтов платформы (формат файла сигнатур)
+    DIGEST_SHA256,      //!< SHA-256, 32 байта
+    DIGEST_XXH3,        //!< XXH3 64 бит, 8 байтов big-endian (каноническая запись xxHash)
+    DIGEST_TYPE_COUNT
+};
+
+typedef std::vector<EDigestType> CDigestList;
+
+//! Наибольший размер дайджеста, в байтах
+const size_t MAX_DIGEST_SIZE        = 32;
+//! Наибольший размер записи из всех видов дайджестов блока, в байтах
+const size_t MAX_DIGEST_RECORD_SIZE = 4 + 32 + 8;
+
+const char* DigestName(EDigestType type);
+size_t      DigestSize(EDigestType type);
+
+void CalcDigest(EDigestType type, const uint8_t* buff, size_t size, uint8_t* pDigest);
+
+bool ParseDigestList(const std::string& str, CDigestList& digests);
+
+//! Рассчитывает дайджест блока, размер которого известен при компиляции.
+//! CRC32 рассчитывается без обработки остатка, остальные дайджесты - как в CalcDigest().
+//! @param type    - [in]  вид дайджеста;
+//! @param buff    - [in]  буфер размером BlockSize байтов;
+//! @param pDigest - [out] дайджест, DigestSize(type) байтов.
+template <size_t BlockSize>
+inline void CalcDigestFixed(EDigestType type, const uint8_t* buff, uint8_t* pDigest)
+{
+    if (type == DIGEST_CRC32)
+    {
+        const uint32_t crc32 = CalcCrc32Fixed<BlockSize>(buff);
+        memcpy(pDigest, &crc32, sizeof(crc32));
+        return;
+    }
+
+    CalcDigest(type, buff, BlockSize, pDigest);
+}
+
+#endif // _DIGEST_H
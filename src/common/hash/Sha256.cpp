@@ -0,0 +1,118 @@
+//! @file hash/Sha256.cpp
+//! Реализация SHA-256
+
+#include "Sha256.h"
+
+#include <string.h>
+
+//! Размер блока SHA-256, в байтах
+const size_t SHA256_BLOCK_SIZE = 64;
+
+//! Константы раундов
+const uint32_t SHA256_K[64] =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t Rotr32(uint32_t x, int r)
+{
+    return (x >> r) | (x << (32 - r));
+}
+
+//! Обрабатывает один блок.
+//! @param state  - [in/out] состояние;
+//! @param pBlock - [in]     блок, SHA256_BLOCK_SIZE байтов.
+static void ProcessBlock(uint32_t* state, const uint8_t* pBlock)
+{
+    uint32_t w[64];
+
+    for (size_t i = 0; i < 16; ++i)
+    {
+        w[i] = (static_cast<uint32_t>(pBlock[4 * i]) << 24)     |
+               (static_cast<uint32_t>(pBlock[4 * i + 1]) << 16) |
+               (static_cast<uint32_t>(pBlock[4 * i + 2]) << 8)  |
+                static_cast<uint32_t>(pBlock[4 * i + 3]);
+    }
+
+    for (size_t i = 16; i < 64; ++i)
+    {
+        const uint32_t s0 = Rotr32(w[i - 15], 7) ^ Rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        const uint32_t s1 = Rotr32(w[i - 2], 17) ^ Rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for (size_t i = 0; i < 64; ++i)
+    {
+        const uint32_t s1    = Rotr32(e, 6) ^ Rotr32(e, 11) ^ Rotr32(e, 25);
+        const uint32_t ch    = (e & f) ^ (~e & g);
+        const uint32_t temp1 = h + s1 + ch + SHA256_K[i] + w[i];
+        const uint32_t s0    = Rotr32(a, 2) ^ Rotr32(a, 13) ^ Rotr32(a, 22);
+        const uint32_t maj   = (a & b) ^ (a & c) ^ (b & c);
+        const uint32_t temp2 = s0 + maj;
+
+        h = g;
+        g = f;
+        f = e;
+        e = d + temp1;
+        d = c;
+        c = b;
+        b = a;
+        a = temp1 + temp2;
+    }
+
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+void CalcSha256(const uint8_t* buff, size_t size, uint8_t* pDigest)
+{
+    uint32_t state[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                          0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+
+    const size_t fullBlocks = size / SHA256_BLOCK_SIZE;
+
+    for (size_t i = 0; i < fullBlocks; ++i)
+    {
+        ProcessBlock(state, buff + i * SHA256_BLOCK_SIZE);
+    }
+
+    // Хвост данных, бит 1, нули и длина в битах занимают один или два последних блока
+    uint8_t      tail[2 * SHA256_BLOCK_SIZE];
+    const size_t tailSize = size - fullBlocks * SHA256_BLOCK_SIZE;
+
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, buff + fullBlocks * SHA256_BLOCK_SIZE, tailSize);
+    tail[tailSize] = 0x80;
+
+    const size_t   tailBlocks = (tailSize + 1 + 8 > SHA256_BLOCK_SIZE) ? 2 : 1;
+    const uint64_t bitLength  = static_cast<uint64_t>(size) * 8;
+
+    for (size_t i = 0; i < 8; ++i)
+    {
+        tail[tailBlocks * SHA256_BLOCK_SIZE - 1 - i] = static_cast<uint8_t>(bitLength >> (8 * i));
+    }
+
+    for (size_t i = 0; i < tailBlocks; ++i)
+    {
+        ProcessBlock(state, tail + i * SHA256_BLOCK_SIZE);
+    }
+
+    for (size_t i = 0; i < 8; ++i)
+    {
+        pDigest[4 * i]     = static_cast<uint8_t>(state[i] >> 24);
+        pDigest[4 * i + 1] = static_cast<uint8_t>(state[i] >> 16);
+        pDigest[4 * i + 2] = static_cast<uint8_t>(state[i] >> 8);
+        pDigest[4 * i + 3] = static_cast<uint8_t>(state[i]);
+    }
+}
@@ -0,0 +1,19 @@
+//! @file hash/Sha256.h
+//! Объявление функции рассчета SHA-256
+
+#ifndef _SHA256_H
+#define _SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//! Размер SHA-256, в байтах
+const size_t SHA256_SIZE = 32;
+
+//! Рассчитывает SHA-256 (FIPS 180-4).
+//! @param buff    - [in]  буфер;
+//! @param size    - [in]  размер буфера, в байтах;
+//! @param pDigest - [out] SHA-256, SHA256_SIZE байтов.
+void CalcSha256(const uint8_t* buff, size_t size, uint8_t* pDigest);
+
+#endif // _SHA256_H
@@ -0,0 +1,299 @@
+//! @file hash/Xxh3.cpp
+//! Реализация XXH3 (скалярная, по спецификации xxHash 0.8)
+
+#include "Xxh3.h"
+
+#include <string.h>
+
+const uint32_t PRIME32_1 = 0x9E3779B1U;
+const uint32_t PRIME32_2 = 0x85EBCA77U;
+const uint32_t PRIME32_3 = 0xC2B2AE3DU;
+
+const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+const uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+const uint64_t PRIME_MX1 = 0x165667919E3779F9ULL;
+const uint64_t PRIME_MX2 = 0x9FB21C651E98DF25ULL;
+
+//! Длина полосы длинного хэша
+const size_t STRIPE_LEN          = 64;
+//! Сдвиг секрета на каждую полосу
+const size_t SECRET_CONSUME_RATE = 8;
+//! Кол-во аккумуляторов длинного хэша
+const size_t ACC_NB              = 8;
+
+//! Секрет по-умолчанию
+const uint8_t SECRET[192] =
+{
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+    0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+    0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+    0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+    0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+    0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+    0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+    0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+    0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+//! Читает 32 бита в порядке little-endian.
+static inline uint32_t Read32(const uint8_t* p)
+{
+    return static_cast<uint32_t>(p[0])         | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+//! Читает 64 бита в порядке little-endian.
+static inline uint64_t Read64(const uint8_t* p)
+{
+    return static_cast<uint64_t>(Read32(p)) | (static_cast<uint64_t>(Read32(p + 4)) << 32);
+}
+
+static inline uint64_t Rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t Swap64(uint64_t x)
+{
+    return ((x << 56) & 0xff00000000000000ULL) | ((x << 40) & 0x00ff000000000000ULL) |
+           ((x << 24) & 0x0000ff0000000000ULL) | ((x << 8)  & 0x000000ff00000000ULL) |
+           ((x >> 8)  & 0x00000000ff000000ULL) | ((x >> 24) & 0x0000000000ff0000ULL) |
+           ((x >> 40) & 0x000000000000ff00ULL) | ((x >> 56) & 0x00000000000000ffULL);
+}
+
+//! Возвращает исключающее ИЛИ старшей и младшей половин 128-битного произведения.
+static inline uint64_t Mul128Fold64(uint64_t lhs, uint64_t rhs)
+{
+#if defined(__SIZEOF_INT128__)
+    const unsigned __int128 product = static_cast<unsigned __int128>(lhs) * rhs;
+    return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+#else
+    const uint64_t loLo  = (lhs & 0xFFFFFFFFULL) * (rhs & 0xFFFFFFFFULL);
+    const uint64_t hiLo  = (lhs >> 32) * (rhs & 0xFFFFFFFFULL);
+    const uint64_t loHi  = (lhs & 0xFFFFFFFFULL) * (rhs >> 32);
+    const uint64_t hiHi  = (lhs >> 32) * (rhs >> 32);
+    const uint64_t cross = (loLo >> 32) + (hiLo & 0xFFFFFFFFULL) + loHi;
+    const uint64_t upper = (hiLo >> 32) + (cross >> 32) + hiHi;
+    const uint64_t lower = (cross << 32) | (loLo & 0xFFFFFFFFULL);
+    return lower ^ upper;
+#endif
+}
+
+static inline uint64_t Xxh64Avalanche(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+static inline uint64_t Avalanche(uint64_t h)
+{
+    h ^= h >> 37;
+    h *= PRIME_MX1;
+    h ^= h >> 32;
+    return h;
+}
+
+static inline uint64_t Rrmxmx(uint64_t h, uint64_t len)
+{
+    h ^= Rotl64(h, 49) ^ Rotl64(h, 24);
+    h *= PRIME_MX2;
+    h ^= (h >> 35) + len;
+    h *= PRIME_MX2;
+    return h ^ (h >> 28);
+}
+
+static inline uint64_t Mix16B(const uint8_t* p, const uint8_t* pSecret)
+{
+    return Mul128Fold64(Read64(p) ^ Read64(pSecret), Read64(p + 8) ^ Read64(pSecret + 8));
+}
+
+static uint64_t Hash0To16(const uint8_t* p, size_t len)
+{
+    if (len > 8)
+    {
+        const uint64_t bitflip1 = Read64(SECRET + 24) ^ Read64(SECRET + 32);
+        const uint64_t bitflip2 = Read64(SECRET + 40) ^ Read64(SECRET + 48);
+        const uint64_t inputLo  = Read64(p) ^ bitflip1;
+        const uint64_t inputHi  = Read64(p + len - 8) ^ bitflip2;
+        const uint64_t acc      = len + Swap64(inputLo) + inputHi + Mul128Fold64(inputLo, inputHi);
+
+        return Avalanche(acc);
+    }
+
+    if (len >= 4)
+    {
+        const uint64_t bitflip = Read64(SECRET + 8) ^ Read64(SECRET + 16);
+        const uint64_t input64 = Read32(p + len - 4) + (static_cast<uint64_t>(Read32(p)) << 32);
+
+        return Rrmxmx(input64 ^ bitflip, len);
+    }
+
+    if (len > 0)
+    {
+        const uint32_t combined = (static_cast<uint32_t>(p[0]) << 16) |
+                                  (static_cast<uint32_t>(p[len >> 1]) << 24) |
+                                  static_cast<uint32_t>(p[len - 1]) |
+                                  (static_cast<uint32_t>(len) << 8);
+        const uint64_t bitflip  = Read32(SECRET) ^ Read32(SECRET + 4);
+
+        return Xxh64Avalanche(combined ^ bitflip);
+    }
+
+    return Xxh64Avalanche(Read64(SECRET + 56) ^ Read64(SECRET + 64));
+}
+
+static uint64_t Hash17To128(const uint8_t* p, size_t len)
+{
+    uint64_t acc = len * PRIME64_1;
+
+    if (len > 32)
+    {
+        if (len > 64)
+        {
+            if (len > 96)
+            {
+                acc += Mix16B(p + 48, SECRET + 96);
+                acc += Mix16B(p + len - 64, SECRET + 112);
+            }
+
+            acc += Mix16B(p + 32, SECRET + 64);
+            acc += Mix16B(p + len - 48, SECRET + 80);
+        }
+
+        acc += Mix16B(p + 16, SECRET + 32);
+        acc += Mix16B(p + len - 32, SECRET + 48);
+    }
+
+    acc += Mix16B(p, SECRET);
+    acc += Mix16B(p + len - 16, SECRET + 16);
+
+    return Avalanche(acc);
+}
+
+static uint64_t Hash129To240(const uint8_t* p, size_t len)
+{
+    const size_t MIDSIZE_STARTOFFSET = 3;
+    const size_t MIDSIZE_LASTOFFSET  = 17;
+    const size_t SECRET_SIZE_MIN     = 136;
+
+    uint64_t     acc      = len * PRIME64_1;
+    const size_t nbRounds = len / 16;
+
+    for (size_t i = 0; i < 8; ++i)
+    {
+        acc += Mix16B(p + 16 * i, SECRET + 16 * i);
+    }
+
+    acc = Avalanche(acc);
+
+    for (size_t i = 8; i < nbRounds; ++i)
+    {
+        acc += Mix16B(p + 16 * i, SECRET + 16 * (i - 8) + MIDSIZE_STARTOFFSET);
+    }
+
+    acc += Mix16B(p + len - 16, SECRET + SECRET_SIZE_MIN - MIDSIZE_LASTOFFSET);
+
+    return Avalanche(acc);
+}
+
+static inline void Accumulate512(uint64_t* acc, const uint8_t* p, const uint8_t* pSecret)
+{
+    for (size_t i = 0; i < ACC_NB; ++i)
+    {
+        const uint64_t dataVal = Read64(p + 8 * i);
+        const uint64_t dataKey = dataVal ^ Read64(pSecret + 8 * i);
+
+        acc[i ^ 1] += dataVal;
+        acc[i]     += (dataKey & 0xFFFFFFFFULL) * (dataKey >> 32);
+    }
+}
+
+static inline void ScrambleAcc(uint64_t* acc, const uint8_t* pSecret)
+{
+    for (size_t i = 0; i < ACC_NB; ++i)
+    {
+        uint64_t acc64 = acc[i];
+
+        acc64 ^= acc64 >> 47;
+        acc64 ^= Read64(pSecret + 8 * i);
+        acc64 *= PRIME32_1;
+
+        acc[i] = acc64;
+    }
+}
+
+static uint64_t HashLong(const uint8_t* p, size_t len)
+{
+    const size_t SECRET_LASTACC_START   = 7;
+    const size_t SECRET_MERGEACCS_START = 11;
+
+    uint64_t acc[ACC_NB] = { PRIME32_3, PRIME64_1, PRIME64_2, PRIME64_3,
+                             PRIME64_4, PRIME32_2, PRIME64_5, PRIME32_1 };
+
+    const size_t nbStripesPerBlock = (sizeof(SECRET) - STRIPE_LEN) / SECRET_CONSUME_RATE;
+    const size_t blockLen          = STRIPE_LEN * nbStripesPerBlock;
+    const size_t nbBlocks          = (len - 1) / blockLen;
+
+    for (size_t n = 0; n < nbBlocks; ++n)
+    {
+        for (size_t s = 0; s < nbStripesPerBlock; ++s)
+        {
+            Accumulate512(acc, p + n * blockLen + s * STRIPE_LEN, SECRET + s * SECRET_CONSUME_RATE);
+        }
+
+        ScrambleAcc(acc, SECRET + sizeof(SECRET) - STRIPE_LEN);
+    }
+
+    const size_t nbStripes = ((len - 1) - blockLen * nbBlocks) / STRIPE_LEN;
+
+    for (size_t s = 0; s < nbStripes; ++s)
+    {
+        Accumulate512(acc, p + nbBlocks * blockLen + s * STRIPE_LEN, SECRET + s * SECRET_CONSUME_RATE);
+    }
+
+    // Последняя полоса всегда берется по концу данных
+    Accumulate512(acc, p + len - STRIPE_LEN,
+                  SECRET + sizeof(SECRET) - STRIPE_LEN - SECRET_LASTACC_START);
+
+    uint64_t result = len * PRIME64_1;
+
+    for (size_t i = 0; i < 4; ++i)
+    {
+        const uint8_t* pSecret = SECRET + SECRET_MERGEACCS_START + 16 * i;
+
+        result += Mul128Fold64(acc[2 * i] ^ Read64(pSecret), acc[2 * i + 1] ^ Read64(pSecret + 8));
+    }
+
+    return Avalanche(result);
+}
+
+uint64_t CalcXxh3(const uint8_t* buff, size_t size)
+{
+    if (size <= 16)
+    {
+        return Hash0To16(buff, size);
+    }
+
+    if (size <= 128)
+    {
+        return Hash17To128(buff, size);
+    }
+
+    if (size <= 240)
+    {
+        return Hash129To240(buff, size);
+    }
+
+    return HashLong(buff, size);
+}
@@ -0,0 +1,16 @@
+//! @file hash/Xxh3.h
+//! Объявление функции рассчета XXH3
+
+#ifndef _XXH3_H
+#define _XXH3_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//! Рассчитывает 64-битный XXH3 (XXH3_64bits, seed = 0, секрет по-умолчанию).
+//! @param buff - [in] буфер;
+//! @param size - [in] размер буфера, в байтах.
+//! @return XXH3.
+uint64_t CalcXxh3(const uint8_t* buff, size_t size);
+
+#endif // _XXH3_H
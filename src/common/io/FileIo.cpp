@@ -0,0 +1,93 @@
+//! @file io/FileIo.cpp
+//! Чтение файлов по смещению
+
+#include "FileIo.h"
+
+#include <boost/thread/mutex.hpp>
+
+#include <algorithm>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+//! Возвращает размер обычного файла.
+//! @param fd   - [in]  дескриптор;
+//! @param size - [out] размер файла, в байтах.
+//! @return true - успех, false - ошибка или дескриптор не обычного файла (канал, сокет).
+bool GetRegularFileSize(int fd, uint64_t& size)
+{
+#ifdef _WIN32
+    struct _stat64 st;
+
+    if ((_fstat64(fd, &st) != 0) || !(st.st_mode & _S_IFREG))
+#else
+    struct stat st;
+
+    if ((fstat(fd, &st) != 0) || !S_ISREG(st.st_mode))
+#endif
+    {
+        return false;
+    }
+
+    size = static_cast<uint64_t>(st.st_size);
+
+    return true;
+}
+
+//! Читает данные файла с заданного смещения, не меняя позицию дескриптора,
+//! поэтому блоки одного файла могут читать несколько потоков одновременно.
+//! @param fd     - [in] дескриптор;
+//! @param pBuff  - [in] буфер;
+//! @param size   - [in] кол-во байтов;
+//! @param offset - [in] смещение в файле.
+//! @return true - прочитано size байтов, false - ошибка чтения или файл короче.
+bool ReadFileAt(int fd, uint8_t* pBuff, size_t size, uint64_t offset)
+{
+#ifdef _WIN32
+    // В CRT нет pread, поэтому позиционирование и чтение выполняются под блокировкой
+    static boost::mutex s_readMutex;
+    boost::unique_lock<boost::mutex> lock(s_readMutex);
+
+    if (_lseeki64(fd, static_cast<__int64>(offset), SEEK_SET) < 0)
+    {
+        return false;
+    }
+#endif
+
+    while (size != 0)
+    {
+#ifdef _WIN32
+        const int result = _read(fd, pBuff, static_cast<unsigned int>(std::min<size_t>(size, INT_MAX)));
+#else
+        const ssize_t result = pread(fd, pBuff, size, static_cast<off_t>(offset));
+#endif
+
+        if (result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            return false;
+        }
+
+        if (result == 0)
+        {
+            return false;
+        }
+
+        pBuff  += result;
+        size   -= static_cast<size_t>(result);
+        offset += static_cast<uint64_t>(result);
+    }
+
+    return true;
+}
@@ -0,0 +1,13 @@
+//! @file io/FileIo.h
+//! Объявление функций чтения файлов по смещению
+
+#ifndef _FILE_IO_H
+#define _FILE_IO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+bool GetRegularFileSize(int fd, uint64_t& size);
+bool ReadFileAt(int fd, uint8_t* pBuff, size_t size, uint64_t offset);
+
+#endif // _FILE_IO_H
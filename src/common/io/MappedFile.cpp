@@ -0,0 +1,144 @@
+//! @file io/MappedFile.cpp
+//! Реализация класса CMappedFile
+
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <limits>
+
+//! Конструктор.
+CMappedFile::CMappedFile() : m_pData(NULL), m_size(0)
+#ifdef _WIN32
+    , m_hFile(INVALID_HANDLE_VALUE), m_hMapping(NULL)
+#endif
+{
+}
+
+//! Деструктор.
+CMappedFile::~CMappedFile()
+{
+    Close();
+}
+
+//! Отображает файл в память.
+//! @param path - [in] путь к файлу.
+//! @return true - успех (пустой файл - без отображения), false - в случае ошибки.
+bool CMappedFile::Open(const std::string& path)
+{
+    Close();
+
+#ifdef _WIN32
+    m_hFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                          FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+    LARGE_INTEGER size;
+
+    if ((m_hFile == INVALID_HANDLE_VALUE) || !GetFileSizeEx(m_hFile, &size))
+    {
+        Close();
+        return false;
+    }
+
+    m_size = static_cast<uint64_t>(size.QuadPart);
+
+    if (m_size == 0)
+    {
+        return true;
+    }
+
+    m_hMapping = CreateFileMappingA(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+
+    if ((m_hMapping == NULL) || (m_size > std::numeric_limits<size_t>::max()))
+    {
+        Close();
+        return false;
+    }
+
+    m_pData = static_cast<const uint8_t*>(MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0));
+
+    if (m_pData == NULL)
+    {
+        Close();
+        return false;
+    }
+#else
+    const int fd = open(path.c_str(), O_RDONLY);
+
+    struct stat st;
+
+    if ((fd < 0) || (fstat(fd, &st) != 0) || !S_ISREG(st.st_mode) ||
+        (static_cast<uint64_t>(st.st_size) > std::numeric_limits<size_t>::max()))
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+
+        return false;
+    }
+
+    m_size = static_cast<uint64_t>(st.st_size);
+
+    if (m_size != 0)
+    {
+        void* pData = mmap(NULL, static_cast<size_t>(m_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (pData != MAP_FAILED)
+        {
+            // Файл читается подряд: ядро читает вперед крупнее
+            madvise(pData, static_cast<size_t>(m_size), MADV_SEQUENTIAL);
+            m_pData = static_cast<const uint8_t*>(pData);
+        }
+    }
+
+    // Отображение остается действительным и после закрытия дескриптора
+    close(fd);
+
+    if ((m_size != 0) && (m_pData == NULL))
+    {
+        m_size = 0;
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+//! Снимает отображение.
+void CMappedFile::Close()
+{
+#ifdef _WIN32
+    if (m_pData != NULL)
+    {
+        UnmapViewOfFile(m_pData);
+    }
+
+    if (m_hMapping != NULL)
+    {
+        CloseHandle(m_hMapping);
+        m_hMapping = NULL;
+    }
+
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (m_pData != NULL)
+    {
+        munmap(const_cast<uint8_t*>(m_pData), static_cast<size_t>(m_size));
+    }
+#endif
+
+    m_pData = NULL;
+    m_size  = 0;
+}
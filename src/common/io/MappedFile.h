@@ -0,0 +1,48 @@
+//! @file io/MappedFile.h
+//! Объявление класса CMappedFile
+
+#ifndef _MAPPED_FILE_H
+#define _MAPPED_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+//! Файл, отображенный в память только для чтения.
+//! Страницы читаются по обращению, повторное чтение берет их из кеша файлов без
+//! копирования в буферы процесса.
+class CMappedFile
+{
+public:
+    CMappedFile();
+    ~CMappedFile();
+
+    bool Open(const std::string& path);
+    void Close();
+
+    //! Возвращает начало данных, NULL - файл пуст или не открыт.
+    const uint8_t* Data() const
+    {
+        return m_pData;
+    }
+
+    //! Возвращает размер файла, в байтах.
+    uint64_t Size() const
+    {
+        return m_size;
+    }
+
+private:
+    CMappedFile(const CMappedFile&);
+    CMappedFile& operator=(const CMappedFile&);
+
+private:
+    const uint8_t* m_pData;
+    uint64_t       m_size;
+#ifdef _WIN32
+    void*          m_hFile;
+    void*          m_hMapping;
+#endif
+};
+
+#endif // _MAPPED_FILE_H
@@ -2,13 +2,42 @@
 //! Реализация класса CMemoryPool
 
 #include "MemoryPool.h"
+#include "PageArena.h"
 
+#include <boost/atomic.hpp>
 #include <boost/thread.hpp>
-#include <boost/pool/pool.hpp>
-#include <boost/shared_array.hpp>
-
-//! Шаг увеличения размера блока пула (значение по умолчанию).
-const size_t DEFAULT_CHUNK_STEP = 1024 * 1024;
+#include <boost/thread/tss.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+//! Размер области, из которой нарезаются блоки, выделяемые по требованию.
+const size_t SLAB_SIZE = 256 * 1024;
+//! Наименьший класс размеров расширяемого пула (степень двойки).
+const size_t MIN_SIZE_CLASS_SHIFT = 6;
+//! Кол-во промежуточных классов на каждое удвоение размера (степень двойки).
+//! При 4 классах неиспользуемый остаток блока не превышает 25%.
+const size_t SIZE_CLASS_SUBDIV_SHIFT = 2;
+//! Наибольший класс размеров расширяемого пула (степень двойки).
+const size_t MAX_SIZE_CLASS_SHIFT = 47;
+//! Кол-во классов размеров.
+const size_t SIZE_CLASS_COUNT =
+    (MAX_SIZE_CLASS_SHIFT - MIN_SIZE_CLASS_SHIFT) * (1 << SIZE_CLASS_SUBDIV_SHIFT) + 1;
+//! Кол-во свободных блоков в кэше потока, после которого они отдаются на общий склад.
+const size_t THREAD_CACHE_LIMIT = 64;
+//! Кол-во пулов, свободные блоки которых одновременно хранятся в кэше потока.
+const size_t THREAD_CACHE_SLOTS = 8;
+//! Кол-во запомненных в кэше потока соответствий "размер -> пул".
+const size_t THREAD_CACHE_LOOKUPS = 4;
+//! Размер заголовка блока. Кратен 16, чтобы данные блока оставались выровненными.
+const size_t BUFFER_HEADER_SIZE = 16;
+
+//! Источник уникальных идентификаторов пулов.
+static boost::atomic<uint64_t> s_nextPoolId(1);
 
 //! Закрытый класс для реализации пула памяти.
 class CMemoryPoolImpl
@@ -17,29 +46,128 @@ public:
     CMemoryPoolImpl();
     ~CMemoryPoolImpl();
     bool Init(CMemoryPool::EType type, const CMemoryPool::PoolsParams& poolParams,
-              bool doPreallocate, size_t chunkStep);
+              bool doPreallocate, size_t chunkStep, const CMemoryPool::ArenaParams& arenaParams);
 
     void Clear();
 
-    boost::shared_array<uint8_t> Get(size_t size);
+    CMemoryPool::Stats GetStats();
+
+    size_t Trim();
+
+    CPoolBuffer Get(size_t size, const boost::posix_time::time_duration& timeout);
+
+    static void Release(uint8_t* pBuff);
+
+    static void FlushThreadCache();
 
 private:
-    class CReleaser;
+    class CThreadCache;
+
+    //! Узел списка свободных блоков, размещается в самом свободном блоке.
+    struct FreeNode
+    {
+        FreeNode* pNext;
+    };
 
     class CPool
     {
-        friend class CReleaser;
-    private:
-        struct Data
+    public:
+        //! Общие данные пула.
+        //! Свободные блоки хранятся в кэшах потоков и на общем lock-free складе,
+        //! между которыми передаются целыми списками. Кэш потока доступен только
+        //! своему потоку, атомарные операции нужны лишь складу и счетчику ожидающих.
+        struct Data : public boost::enable_shared_from_this<Data>
         {
-            Data(size_t sizeChunk) : pool(sizeChunk), cntAllocated(0) {};
+            Data(size_t sizeChunk, const CMemoryPool::ArenaParams& params) :
+                id(s_nextPoolId.fetch_add(1)),
+                stride((sizeChunk + 2 * BUFFER_HEADER_SIZE - 1) / BUFFER_HEADER_SIZE *
+                       BUFFER_HEADER_SIZE),
+                arenaParams(params), cntCreated(0), cntIdleTrims(0), pFreeHead(NULL),
+                cntWaiters(0)
+            {
+            }
+
+            //! Выделяет у ОС новую область и нарезает ее на блоки.
+            //! Вызывается под блокировкой lock (или до публикации пула).
+            //! @param cntBlocks - [in] кол-во блоков.
+            //! @param pLast     - [out] последний блок списка.
+            //! @return список новых блоков или NULL, если память выделить не удалось.
+            FreeNode* Grow(size_t cntBlocks, FreeNode*& pLast)
+            {
+                boost::shared_ptr<CPageArena> pArena(new CPageArena());
+
+                if (!pArena->Create(cntBlocks * stride, arenaParams.pageMode,
+                                    arenaParams.lockMemory, arenaParams.numaNode))
+                {
+                    return NULL;
+                }
+
+                uint8_t*  pBlocks = pArena->Data();
+                FreeNode* pList   = NULL;
+
+                // Список строится с конца, чтобы блоки выдавались в порядке адресов
+                for (size_t i = cntBlocks; i > 0; --i)
+                {
+                    FreeNode* pNode = reinterpret_cast<FreeNode*>(pBlocks + (i - 1) * stride);
+                    pNode->pNext = pList;
+                    pList        = pNode;
+                }
+
+                pLast = reinterpret_cast<FreeNode*>(pBlocks + (cntBlocks - 1) * stride);
+
+                arenas.push_back(pArena);
+                cntCreated += cntBlocks;
+
+                return pList;
+            }
+
+            //! Кладет на склад цепочку блоков [pFirst, pLast].
+            void Push(FreeNode* pFirst, FreeNode* pLast)
+            {
+                FreeNode* pHead = pFreeHead.load(boost::memory_order_relaxed);
+
+                do
+                {
+                    pLast->pNext = pHead;
+                }
+                while (!pFreeHead.compare_exchange_weak(pHead, pFirst));
+
+                // Будим поток, ожидающий освобождения блока
+                if (cntWaiters.load() != 0)
+                {
+                    boost::unique_lock<boost::mutex> lockData(lock);
+                    condVarFree.notify_all();
+                }
+            }
+
+            //! Забирает со склада все блоки.
+            //! Снятие всего списка разом не подвержено проблеме ABA.
+            FreeNode* TakeAll()
+            {
+                if (pFreeHead.load(boost::memory_order_relaxed) == NULL)
+                {
+                    return NULL;
+                }
 
-            size_t          cntAllocated;
-            boost::mutex    lock;
-            boost::pool<>   pool;
+                return pFreeHead.exchange(NULL);
+            }
+
+            typedef std::vector< boost::shared_ptr<CPageArena> > CArenas;
+
+            const uint64_t              id;
+            const size_t                stride;         //!< Размер блока вместе с заголовком
+            const CMemoryPool::ArenaParams arenaParams;
+            CArenas                     arenas;         //!< Память блоков (под lock)
+            size_t                      cntCreated;     //!< Кол-во выделенных блоков
+            size_t                      cntIdleTrims;   //!< Сколько раз подряд пул был свободен
+            boost::mutex                lock;
+            boost::condition_variable   condVarFree;    //!< Сигнал о возврате блока в пул
+            boost::atomic<FreeNode*>    pFreeHead;      //!< Вершина склада свободных блоков
+            boost::atomic<size_t>       cntWaiters;     //!< Кол-во потоков, ждущих блок
         };
 
-    public:
+        typedef boost::shared_ptr<Data> DataPtr;
+
         //! Конструктор.
         //! @param type      - [in] тип пула;
         //! @param sizeChunk - [in] размер блоков памяти в пуле;
@@ -51,78 +179,43 @@ private:
 
         //! Создает пул.
         //! @param doPreallocate - [in] true  - выделить память под пул сразу,
-        //!                             false - выделять память только когда она понадобится.
+        //!                             false - выделять память только когда она понадобится;
+        //! @param arenaParams   - [in] параметры размещения предвыделенной памяти.
         //! @return true - пул успешно создан, false - в случае ошибки.
-        bool Create(bool doPreallocate)
+        bool Create(bool doPreallocate, const CMemoryPool::ArenaParams& arenaParams)
         {
-            m_pData.reset(new Data(m_sizeChunk));
+            m_pData.reset(new Data(m_sizeChunk, arenaParams));
 
-            if (m_capacity != 0)
+            // Выделяем все блоки сразу одной областью и кладем их на склад
+            if ((m_capacity != 0) && doPreallocate)
             {
-                m_pData->pool.set_next_size(m_capacity);
+                FreeNode* pLast = NULL;
+                FreeNode* pList = m_pData->Grow(m_capacity, pLast);
 
-                // Выделяем память из пула и сразу освобождаем, таким образом выделяя память
-                if (doPreallocate)
+                if (!pList)
                 {
-                    void* p = m_pData->pool.malloc();
-
-                    if (!p)
-                    {
-                        return false;
-                    }
-
-                    m_pData->pool.free(p);
+                    return false;
                 }
+
+                m_pData->Push(pList, pLast);
             }
 
             return true;
         }
         
-        //! Возвращает блок памяти из пула.
-        //! @return блок памяти из пула или NULL - если выделить память не удалось.
-        boost::shared_array<uint8_t> Malloc(size_t size)
-        {
-            if (size > m_sizeChunk)
-            {
-                return boost::shared_array<uint8_t>();
-            }
-
-            assert(m_pData.get() != NULL);
-
-            boost::unique_lock<boost::mutex> lock(m_pData->lock);
-
-            if ((m_type == CMemoryPool::POOL_EXPANDABLE) || 
-                (m_pData->cntAllocated + 1 <= m_capacity))
-            {
-                boost::shared_array<uint8_t> p(static_cast<uint8_t*>(m_pData->pool.malloc()),
-                                               CReleaser(*this));
-
-                if (p.get())
-                {
-                    ++m_pData->cntAllocated;
-                }
-
-                return p;
-            }
-            else if (m_type == CMemoryPool::POOL_FIXED_NEW_DELETE)
-            {
-                return boost::shared_array<uint8_t>(new (std::nothrow) uint8_t[size]);
-            }
+        CPoolBuffer Malloc(size_t size, const boost::posix_time::time_duration& timeout);
 
-            return boost::shared_array<uint8_t>();
+        //! Возвращает данные пула.
+        const DataPtr& GetData() const
+        {
+            return m_pData;
         }
 
-    private:
-        //! Возвращает блок памяти в пул.
-        //! @param chunk - [in] указатель на блок памяти.
-        void Release(void* chunk)
-        {
-            assert(m_pData.get() != NULL);
+        size_t Trim();
+        void   AddStats(CMemoryPool::Stats& stats) const;
 
-            boost::unique_lock<boost::mutex> lock(m_pData->lock);
-            m_pData->pool.free(chunk);
-            --m_pData->cntAllocated;
-        }
+    private:
+        void* AllocateSlow(const boost::posix_time::time_duration& timeout);
 
     private:
         const CMemoryPool::EType            m_type;
@@ -131,38 +224,526 @@ private:
         boost::shared_ptr<Data>             m_pData;
     };
 
-    class CReleaser
+    //! Заголовок блока, предшествующий его данным.
+    struct BufferHeader
+    {
+        CPool::Data*    pOwner; //!< Пул блока, NULL - блок выделен через new
+        size_t          size;   //!< Запрошенный размер
+    };
+
+    static CPoolBuffer MakeBuffer(void* pBlock, CPool::Data* pOwner, size_t size);
+
+    //! Кэш потока: свободные блоки нескольких пулов и последние найденные пулы.
+    //! Кэш доступен только своему потоку. Ячейка пула заводится, когда поток получает
+    //! из него блок: блоки, возвращенные потоком, который из пула не получает, сразу
+    //! идут на склад и не застревают в кэше, к которому никто не обратится.
+    class CThreadCache
     {
     public:
-        CReleaser(CPool pool) :
-            m_pool(pool)
+        //! Свободные блоки одного пула.
+        struct Slot
         {
-        }
+            Slot() : poolId(0), pHead(NULL), pTail(NULL), count(0) {}
+
+            uint64_t                        poolId;
+            boost::weak_ptr<CPool::Data>    pData;
+            FreeNode*                       pHead;
+            FreeNode*                       pTail;  //!< Последний блок списка, если известен
+            size_t                          count;  //!< Кол-во блоков, положенных в список потоком;
+                                                    //!  блоки, снятые со склада, не считаются
+        };
 
-        void operator()(void* p)
-        {
-            if (p)
-            {
-                m_pool.Release(p);
-            }
-        }
+        CThreadCache() : m_nextEvict(0), m_nextLookup(0) {}
+        ~CThreadCache();
+
+        static CThreadCache& Instance();
+
+        void FlushAll();
+
+        Slot& GetSlot(CPool::Data& data);
+        Slot* FindSlot(const CPool::Data& data);
+
+        static void* Pop(Slot& slot);
+        static void  Put(Slot& slot, FreeNode* pList);
+        static void  Push(Slot& slot, CPool::Data& data, FreeNode* pNode);
+        static void  Flush(Slot& slot, CPool::Data& data);
+
+        CPool* FindPool(uint64_t ownerId, uint64_t generation, size_t size) const;
+        void   RememberPool(uint64_t ownerId, uint64_t generation, size_t size, CPool* pPool);
+
+    private:
+        static void Detach(Slot& slot);
 
     private:
-        CPool m_pool;
+        //! Запомненное соответствие "размер -> пул".
+        struct Lookup
+        {
+            Lookup() : ownerId(0), generation(0), size(0), pPool(NULL) {}
+
+            uint64_t    ownerId;
+            uint64_t    generation;
+            size_t      size;
+            CPool*      pPool;
+        };
+
+        static boost::thread_specific_ptr<CThreadCache> s_pInstance;
+
+        Slot            m_slots[THREAD_CACHE_SLOTS];
+        Lookup          m_lookups[THREAD_CACHE_LOOKUPS];
+        size_t          m_nextEvict;
+        size_t          m_nextLookup;
     };
 
     typedef std::map< size_t, CPool > CPoolMap;
 
+    typedef std::vector<CPool::DataPtr> CDataList;
+
 private:
-    bool AddPool(CMemoryPool::EType type, size_t chunkSize, size_t capacity, bool doPreallocate);
+    bool   AddPool(CMemoryPool::EType type, size_t chunkSize, size_t capacity, bool doPreallocate);
+    CPool* GetClassPool(size_t index);
+
+    static size_t SizeClassIndex(size_t size);
+    static size_t SizeClassSize(size_t index);
 
 private:
-    CMemoryPool::EType  m_type;
-    CPoolMap            m_pools;
-    boost::mutex        m_lockPools;
-    size_t              m_chunkStep;
+    CMemoryPool::ArenaParams m_arenaParams;
+    const uint64_t          m_id;
+    CMemoryPool::EType      m_type;
+    CPoolMap                m_pools;
+    size_t                  m_maxPoolChunk; //!< Наибольший размер блока среди заданных пулов
+    CDataList               m_retired;      //!< Пулы, убранные Clear(), ждут разрушения
+
+    //! Пулы классов размеров расширяемого пула, создаются по требованию
+    boost::scoped_array< boost::atomic<CPool*> > m_classes;
+
+    boost::mutex            m_lockPools;
+    boost::atomic<uint64_t> m_generation;   //!< Меняется при любом изменении набора пулов
 };
 
+//! Кэши потоков. Освобождаются (с возвратом блоков на склады) при завершении потока.
+boost::thread_specific_ptr<CMemoryPoolImpl::CThreadCache> CMemoryPoolImpl::CThreadCache::s_pInstance;
+
+//! Возвращает кэш текущего потока.
+CMemoryPoolImpl::CThreadCache& CMemoryPoolImpl::CThreadCache::Instance()
+{
+    CThreadCache* pCache = s_pInstance.get();
+
+    if (!pCache)
+    {
+        pCache = new CThreadCache();
+        s_pInstance.reset(pCache);
+    }
+
+    return *pCache;
+}
+
+//! Деструктор. Возвращает закэшированные блоки на склады живых пулов.
+CMemoryPoolImpl::CThreadCache::~CThreadCache()
+{
+    for (size_t i = 0; i < THREAD_CACHE_SLOTS; ++i)
+    {
+        Detach(m_slots[i]);
+    }
+}
+
+//! Отдает на склады блоки всех пулов из кэша потока. Ячейки остаются за пулами.
+void CMemoryPoolImpl::CThreadCache::FlushAll()
+{
+    for (size_t i = 0; i < THREAD_CACHE_SLOTS; ++i)
+    {
+        boost::shared_ptr<CPool::Data> pData = m_slots[i].pData.lock();
+
+        if (pData)
+        {
+            Flush(m_slots[i], *pData);
+        }
+    }
+}
+
+//! Возвращает ячейку кэша для пула, при необходимости освобождая одну из занятых.
+//! @param data - [in] данные пула.
+//! @return ячейка кэша.
+CMemoryPoolImpl::CThreadCache::Slot& CMemoryPoolImpl::CThreadCache::GetSlot(CPool::Data& data)
+{
+    Slot* pFree = NULL;
+
+    for (size_t i = 0; i < THREAD_CACHE_SLOTS; ++i)
+    {
+        if (m_slots[i].poolId == data.id)
+        {
+            return m_slots[i];
+        }
+
+        if (!pFree && ((m_slots[i].poolId == 0) || m_slots[i].pData.expired()))
+        {
+            pFree = &m_slots[i];
+        }
+    }
+
+    if (!pFree)
+    {
+        pFree = &m_slots[m_nextEvict++ % THREAD_CACHE_SLOTS];
+    }
+
+    Detach(*pFree);
+
+    pFree->poolId = data.id;
+    pFree->pData  = data.shared_from_this();
+
+    return *pFree;
+}
+
+//! Ищет ячейку кэша пула, не заводя новую.
+//! @param data - [in] данные пула.
+//! @return ячейка кэша или NULL, если поток не получал блоки из пула.
+CMemoryPoolImpl::CThreadCache::Slot* CMemoryPoolImpl::CThreadCache::FindSlot(const CPool::Data& data)
+{
+    for (size_t i = 0; i < THREAD_CACHE_SLOTS; ++i)
+    {
+        if (m_slots[i].poolId == data.id)
+        {
+            return &m_slots[i];
+        }
+    }
+
+    return NULL;
+}
+
+//! Отвязывает ячейку от пула и возвращает ее блоки на склад, если пул еще существует.
+//! @param slot - [in] ячейка кэша.
+void CMemoryPoolImpl::CThreadCache::Detach(Slot& slot)
+{
+    boost::shared_ptr<CPool::Data> pData = slot.pData.lock();
+
+    if (pData)
+    {
+        Flush(slot, *pData);
+    }
+
+    slot.poolId = 0;
+    slot.pData.reset();
+    slot.pHead  = NULL;
+    slot.pTail  = NULL;
+    slot.count  = 0;
+}
+
+//! Извлекает блок из кэша потока.
+//! @param slot - [in] ячейка кэша.
+//! @return блок или NULL, если кэш пуст.
+void* CMemoryPoolImpl::CThreadCache::Pop(Slot& slot)
+{
+    FreeNode* pNode = slot.pHead;
+
+    if (!pNode)
+    {
+        return NULL;
+    }
+
+    slot.pHead = pNode->pNext;
+
+    if (slot.pHead)
+    {
+        // Длина списка со склада неизвестна: счетчик не уходит ниже нуля
+        if (slot.count != 0)
+        {
+            --slot.count;
+        }
+    }
+    else
+    {
+        slot.pTail = NULL;
+        slot.count = 0;
+    }
+
+    return pNode;
+}
+
+//! Помещает в пустой кэш потока список блоков, снятый со склада.
+//! @param slot  - [in] ячейка кэша;
+//! @param pList - [in] список блоков.
+void CMemoryPoolImpl::CThreadCache::Put(Slot& slot, FreeNode* pList)
+{
+    // Длина и конец списка со склада неизвестны: список ограничен емкостью пула, конец
+    // ищется только при отдаче кэша на склад, а переполнение считается по блокам,
+    // возвращенным потоком
+    slot.pHead = pList;
+    slot.pTail = NULL;
+    slot.count = 0;
+}
+
+//! Кладет освобожденный блок в кэш потока.
+//! Переполненный кэш, а также кэш пула, блок которого кто-то ждет, целиком отдается
+//! на склад.
+//! @param slot  - [in] ячейка кэша;
+//! @param data  - [in] данные пула;
+//! @param pNode - [in] блок.
+void CMemoryPoolImpl::CThreadCache::Push(Slot& slot, CPool::Data& data, FreeNode* pNode)
+{
+    if (!slot.pHead)
+    {
+        slot.pTail = pNode;
+        slot.count = 0;
+    }
+
+    pNode->pNext = slot.pHead;
+    slot.pHead   = pNode;
+
+    if ((++slot.count >= THREAD_CACHE_LIMIT) ||
+        (data.cntWaiters.load(boost::memory_order_relaxed) != 0))
+    {
+        Flush(slot, data);
+    }
+}
+
+//! Отдает все блоки кэша потока на склад.
+//! @param slot - [in] ячейка кэша;
+//! @param data - [in] данные пула.
+void CMemoryPoolImpl::CThreadCache::Flush(Slot& slot, CPool::Data& data)
+{
+    FreeNode* pList = slot.pHead;
+
+    if (!pList)
+    {
+        return;
+    }
+
+    FreeNode* pLast = slot.pTail;
+
+    if (!pLast)
+    {
+        pLast = pList;
+
+        while (pLast->pNext)
+        {
+            pLast = pLast->pNext;
+        }
+    }
+
+    slot.pHead = NULL;
+    slot.pTail = NULL;
+    slot.count = 0;
+
+    data.Push(pList, pLast);
+}
+
+//! Ищет запомненный пул для блоков заданного размера.
+//! @param ownerId    - [in] идентификатор набора пулов;
+//! @param generation - [in] текущее поколение набора пулов;
+//! @param size       - [in] размер требуемого блока.
+//! @return пул или NULL, если соответствие не запомнено или устарело.
+CMemoryPoolImpl::CPool*
+CMemoryPoolImpl::CThreadCache::FindPool(uint64_t ownerId, uint64_t generation, size_t size) const
+{
+    for (size_t i = 0; i < THREAD_CACHE_LOOKUPS; ++i)
+    {
+        const Lookup& lookup = m_lookups[i];
+
+        if ((lookup.ownerId == ownerId) && (lookup.generation == generation) &&
+            (lookup.size == size))
+        {
+            return lookup.pPool;
+        }
+    }
+
+    return NULL;
+}
+
+//! Запоминает пул для блоков заданного размера.
+//! @param ownerId    - [in] идентификатор набора пулов;
+//! @param generation - [in] поколение набора пулов;
+//! @param size       - [in] размер требуемого блока;
+//! @param pPool      - [in] пул.
+void CMemoryPoolImpl::CThreadCache::RememberPool(uint64_t ownerId, uint64_t generation,
+                                                 size_t size, CPool* pPool)
+{
+    Lookup& lookup = m_lookups[m_nextLookup++ % THREAD_CACHE_LOOKUPS];
+
+    lookup.ownerId    = ownerId;
+    lookup.generation = generation;
+    lookup.size       = size;
+    lookup.pPool      = pPool;
+}
+
+//! Возвращает блок памяти из пула.
+//! Сначала блок берется из кэша потока, затем со склада, и только потом под блокировкой
+//! выделяется новый блок или (для фиксированного пула) ожидается возврат блока.
+//! @param size    - [in] размер требуемого блока;
+//! @param timeout - [in] максимальное время ожидания свободного блока.
+//! @return блок памяти из пула или NULL - если выделить память не удалось.
+CPoolBuffer CMemoryPoolImpl::CPool::Malloc(size_t size,
+                                           const boost::posix_time::time_duration& timeout)
+{
+    if (size > m_sizeChunk)
+    {
+        return CPoolBuffer();
+    }
+
+    assert(m_pData.get() != NULL);
+
+    CThreadCache::Slot& slot = CThreadCache::Instance().GetSlot(*m_pData);
+
+    void* p = CThreadCache::Pop(slot);
+
+    if (!p)
+    {
+        FreeNode* pList = m_pData->TakeAll();
+
+        if (pList)
+        {
+            CThreadCache::Put(slot, pList->pNext);
+            p = pList;
+        }
+        else
+        {
+            p = AllocateSlow(timeout);
+        }
+    }
+
+    if (p)
+    {
+        // Блоки, которые ждет другой поток, не должны оставаться в кэше этого
+        if (m_pData->cntWaiters.load(boost::memory_order_relaxed) != 0)
+        {
+            CThreadCache::Flush(slot, *m_pData);
+        }
+
+        return MakeBuffer(p, m_pData.get(), size);
+    }
+
+    if (m_type == CMemoryPool::POOL_FIXED_NEW_DELETE)
+    {
+        return MakeBuffer(new (std::nothrow) uint8_t[BUFFER_HEADER_SIZE + size], NULL, size);
+    }
+
+    return CPoolBuffer();
+}
+
+//! Получает блок под блокировкой пула: выделяет новый блок, если это допускает тип
+//! пула, или (для фиксированного пула) ждет возврата блока на склад не дольше timeout.
+//! Ожидающий поток учитывается в cntWaiters: увидев его, потоки отдают блоки из своих
+//! кэшей на склад при следующем обращении к пулу.
+//! @param timeout - [in] максимальное время ожидания свободного блока.
+//! @return блок или NULL.
+void* CMemoryPoolImpl::CPool::AllocateSlow(const boost::posix_time::time_duration& timeout)
+{
+    boost::unique_lock<boost::mutex> lock(m_pData->lock);
+
+    // Счетчик увеличивается до проверки склада, поэтому освобождающий поток
+    // либо увидит ожидающего и отдаст блок на склад, либо его блок будет найден здесь
+    ++m_pData->cntWaiters;
+
+    FreeNode* pList = m_pData->TakeAll();
+
+    if (!pList && ((m_type == CMemoryPool::POOL_EXPANDABLE) ||
+                   (m_pData->cntCreated < m_capacity)))
+    {
+        size_t cntBlocks = std::max<size_t>(SLAB_SIZE / m_pData->stride, 1);
+
+        if (m_type != CMemoryPool::POOL_EXPANDABLE)
+        {
+            cntBlocks = std::min(cntBlocks, m_capacity - m_pData->cntCreated);
+        }
+
+        FreeNode* pLast = NULL;
+        pList = m_pData->Grow(cntBlocks, pLast);
+    }
+    else if (m_type == CMemoryPool::POOL_FIXED)
+    {
+        const boost::system_time deadline = boost::get_system_time() + timeout;
+
+        while (!pList)
+        {
+            const bool signaled = m_pData->condVarFree.timed_wait(lock, deadline);
+
+            pList = m_pData->TakeAll();
+
+            if (!signaled)
+            {
+                break;
+            }
+        }
+    }
+
+    --m_pData->cntWaiters;
+
+    lock.unlock();
+
+    if (pList && pList->pNext)
+    {
+        CThreadCache::Slot& slot = CThreadCache::Instance().GetSlot(*m_pData);
+
+        // Кэш потока пуст: иначе блок был бы взят из него
+        CThreadCache::Put(slot, pList->pNext);
+    }
+
+    return pList;
+}
+
+//! Формирует блок для пользователя: заполняет заголовок и возвращает владеющий объект.
+//! @param pBlock - [in] память блока вместе с заголовком (NULL - выделить не удалось);
+//! @param pOwner - [in] пул блока, NULL - блок выделен через new;
+//! @param size   - [in] запрошенный размер.
+//! @return блок памяти.
+CPoolBuffer CMemoryPoolImpl::MakeBuffer(void* pBlock, CPool::Data* pOwner, size_t size)
+{
+    if (!pBlock)
+    {
+        return CPoolBuffer();
+    }
+
+    BufferHeader* pHeader = static_cast<BufferHeader*>(pBlock);
+    pHeader->pOwner = pOwner;
+    pHeader->size   = size;
+
+    return CPoolBuffer(static_cast<uint8_t*>(pBlock) + BUFFER_HEADER_SIZE);
+}
+
+//! Возвращает блок памяти в пул.
+//! Блок кладется в кэш освобождающего потока, если поток сам получает блоки из этого
+//! пула, иначе или если блок кто-то ждет - сразу на склад.
+//! @param pBuff - [in] данные блока.
+void CMemoryPoolImpl::Release(uint8_t* pBuff)
+{
+    uint8_t*      pBlock  = pBuff - BUFFER_HEADER_SIZE;
+    CPool::Data*  pOwner  = reinterpret_cast<BufferHeader*>(pBlock)->pOwner;
+
+    if (!pOwner)
+    {
+        delete [] pBlock;
+        return;
+    }
+
+    FreeNode* pNode = reinterpret_cast<FreeNode*>(pBlock);
+
+    CThreadCache::Slot* pSlot = NULL;
+
+    if (pOwner->cntWaiters.load(boost::memory_order_relaxed) == 0)
+    {
+        pSlot = CThreadCache::Instance().FindSlot(*pOwner);
+    }
+
+    if (!pSlot)
+    {
+        pOwner->Push(pNode, pNode);
+        return;
+    }
+
+    CThreadCache::Push(*pSlot, *pOwner, pNode);
+}
+
+//! Отдает на склады блоки из кэша текущего потока.
+void CMemoryPoolImpl::FlushThreadCache()
+{
+    CThreadCache::Instance().FlushAll();
+}
+
+//! Возвращает блок памяти в пул, из которого он был выделен.
+//! @param pBuff - [in] данные блока.
+void CPoolBuffer::Release(uint8_t* pBuff)
+{
+    CMemoryPoolImpl::Release(pBuff);
+}
+
 
 //! Констуктор.
 CMemoryPool::CMemoryPool()
@@ -172,7 +753,8 @@ CMemoryPool::CMemoryPool()
 
 //! Конструктор.
 CMemoryPoolImpl::CMemoryPoolImpl() :
-    m_chunkStep(DEFAULT_CHUNK_STEP)
+    m_id(s_nextPoolId.fetch_add(1)), m_type(CMemoryPool::POOL_FIXED), m_maxPoolChunk(0),
+    m_generation(0)
 {
 }
 
@@ -184,6 +766,13 @@ CMemoryPool::~CMemoryPool()
 //! Деструктор.
 CMemoryPoolImpl::~CMemoryPoolImpl()
 {
+    if (m_classes)
+    {
+        for (size_t i = 0; i < SIZE_CLASS_COUNT; ++i)
+        {
+            delete m_classes[i].load();
+        }
+    }
 }
 
 //! Инициализирует пул.
@@ -191,18 +780,19 @@ CMemoryPoolImpl::~CMemoryPoolImpl()
 //! @param poolParams    - [in] контейнер задает параметры пулов;
 //! @param doPreallocate - [in] true  - выделить память под заданые пулы сразу,
 //!                             false - выделять память только когда она понадобится;
-//! @param chunkStep     - [in] шаг увеличения размера блока для пулов с рамером блоков более тех,
-//!                             что заданы в poolParams.
+//! @param chunkStep     - [in] не используется, оставлен для совместимости;
+//! @param arenaParams   - [in] параметры размещения предвыделенной памяти пулов.
 //! @return true - если удалось инициализировать пул, false - в случае ошибки.
 bool CMemoryPool::Init(EType type, const PoolsParams& poolParams,
                        bool doPreallocate/* = true*/,
-                       size_t chunkStep/* = 0*/)
+                       size_t chunkStep/* = 0*/,
+                       const ArenaParams& arenaParams/* = ArenaParams()*/)
 {
     if (!m_pPoolImpl)
     {
         boost::shared_ptr<CMemoryPoolImpl> pPoolImpl(new CMemoryPoolImpl());
 
-        if (!pPoolImpl->Init(type, poolParams, doPreallocate, chunkStep))
+        if (!pPoolImpl->Init(type, poolParams, doPreallocate, chunkStep, arenaParams))
         {
             return false;
         }
@@ -218,11 +808,13 @@ bool CMemoryPool::Init(EType type, const PoolsParams& poolParams,
 //! @param poolParams    - [in] контейнер задает параметры пулов;
 //! @param doPreallocate - [in] true  - выделить память под заданые пулы сразу,
 //!                             false - выделять память только когда она понадобится;
-//! @param chunkStep     - [in] шаг увеличения размера блока для пулов с рамером блоков более тех,
-//!                             что заданы в poolParams.
+//! @param chunkStep     - [in] не используется: блоки более тех, что заданы в poolParams,
+//!                             выделяются из пулов классов размеров (см. SizeClassIndex());
+//! @param arenaParams   - [in] параметры размещения предвыделенной памяти пулов.
 //! @return true - если удалось инициализировать пул, false - в случае ошибки.
 bool CMemoryPoolImpl::Init(CMemoryPool::EType type, const CMemoryPool::PoolsParams& poolParams,
-                           bool doPreallocate, size_t chunkStep)
+                           bool doPreallocate, size_t chunkStep,
+                           const CMemoryPool::ArenaParams& arenaParams)
 {
     boost::unique_lock<boost::mutex> lock(m_lockPools);
     
@@ -231,6 +823,8 @@ bool CMemoryPoolImpl::Init(CMemoryPool::EType type, const CMemoryPool::PoolsPara
         return true;
     }
 
+    m_arenaParams = arenaParams;
+
     for (size_t i = 0; i < poolParams.size(); ++i)
     {
         if (!AddPool(poolParams[i].type, poolParams[i].chunkSize, poolParams[i].capacity,
@@ -240,15 +834,31 @@ bool CMemoryPoolImpl::Init(CMemoryPool::EType type, const CMemoryPool::PoolsPara
         }
     }
 
-    m_type      = type;
-    m_chunkStep = (chunkStep != 0) ? chunkStep : DEFAULT_CHUNK_STEP;
+    m_type = type;
+
+    if (!m_pools.empty())
+    {
+        m_maxPoolChunk = m_pools.rbegin()->first;
+    }
+
+    if (m_type == CMemoryPool::POOL_EXPANDABLE)
+    {
+        m_classes.reset(new boost::atomic<CPool*>[SIZE_CLASS_COUNT]);
+
+        for (size_t i = 0; i < SIZE_CLASS_COUNT; ++i)
+        {
+            m_classes[i].store(NULL, boost::memory_order_relaxed);
+        }
+    }
+
+    (void)chunkStep;
 
     return true;
 }
 
-//! Освобождает ссылки на пулы.
-//! Реальное освобождение пулов произойдет только тогда,
-//! когда будут возвращены все выделенныее блоки памяти.
+//! Убирает пулы: новые блоки из них больше не выделяются.
+//! Память пулов освобождается при разрушении CMemoryPool,
+//! к этому моменту все выделенные блоки памяти должны быть возвращены.
 void CMemoryPool::Clear()
 {
     if (m_pPoolImpl)
@@ -257,77 +867,351 @@ void CMemoryPool::Clear()
     }
 }
 
-//! Освобождает ссылки на пулы.
-//! Реальное освобождение пулов произойдет только тогда,
-//! когда будут возвращены все выделенныее блоки памяти.
+//! Убирает пулы: новые блоки из них больше не выделяются.
+//! Память пулов освобождается при разрушении CMemoryPool,
+//! к этому моменту все выделенные блоки памяти должны быть возвращены.
 void CMemoryPoolImpl::Clear()
 {
     boost::unique_lock<boost::mutex> lock(m_lockPools);
 
+    for (CPoolMap::iterator it = m_pools.begin(); it != m_pools.end(); ++it)
+    {
+        m_retired.push_back(it->second.GetData());
+    }
+
     m_pools.clear();
+
+    if (m_classes)
+    {
+        for (size_t i = 0; i < SIZE_CLASS_COUNT; ++i)
+        {
+            CPool* pPool = m_classes[i].exchange(NULL);
+
+            if (pPool)
+            {
+                m_retired.push_back(pPool->GetData());
+                delete pPool;
+            }
+        }
+    }
+
+    ++m_generation;
 }
 
-//! Возвращает блок памяти из пула.
-//! Для того чтобы вернуть блок памяти обратно в пул,
-//! нужно просто уменьшить счетчик ссылок блока памяти (используется делетер).
-//! @param size - [in] размер требуемого блока
-//! @return блок памяти из пула
-boost::shared_array<uint8_t> CMemoryPool::Get(size_t size)
+//! Возвращает статистику пула.
+//! @return статистика.
+CMemoryPool::Stats CMemoryPool::GetStats() const
 {
     if (!m_pPoolImpl)
     {
-        return boost::shared_array<uint8_t>();
+        return Stats();
     }
 
-    return m_pPoolImpl->Get(size);
+    return m_pPoolImpl->GetStats();
 }
 
-//! Возвращает блок памяти из пула.
-//! Для того чтобы вернуть блок памяти обратно в пул,
-//! нужно просто уменьшить счетчик ссылок блока памяти (используется делетер).
-//! @param size - [in] размер требуемого блока
-//! @return блок памяти из пула
-boost::shared_array<uint8_t> CMemoryPoolImpl::Get(size_t size)
+//! Возвращает статистику пула.
+//! @return статистика.
+CMemoryPool::Stats CMemoryPoolImpl::GetStats()
 {
     boost::unique_lock<boost::mutex> lock(m_lockPools);
-    CPoolMap::iterator itMap = m_pools.lower_bound(size);
 
-    if ((itMap == m_pools.end()) && (m_type == CMemoryPool::POOL_EXPANDABLE))
+    CMemoryPool::Stats stats;
+
+    for (CPoolMap::const_iterator it = m_pools.begin(); it != m_pools.end(); ++it)
     {
-        size_t s = 0;
+        it->second.AddStats(stats);
+    }
 
-        while (s < size)
+    if (m_classes)
+    {
+        for (size_t i = 0; i < SIZE_CLASS_COUNT; ++i)
         {
-            s += m_chunkStep;
+            CPool* pPool = m_classes[i].load();
+
+            if (pPool)
+            {
+                pPool->AddStats(stats);
+            }
+        }
+    }
+
+    return stats;
+}
+
+//! Возвращает ОС память простаивающих расширяемых пулов.
+//! Блоки из своих кэшей потоки должны предварительно вернуть через FlushThreadCache().
+//! @return объем освобожденной памяти в байтах.
+size_t CMemoryPool::Trim()
+{
+    if (!m_pPoolImpl)
+    {
+        return 0;
+    }
 
-            itMap = m_pools.lower_bound(s);
+    return m_pPoolImpl->Trim();
+}
+
+//! Отдает на склады свободные блоки всех пулов из кэша текущего потока, чтобы
+//! их учел Trim(). Вызывается потоком, который надолго перестает работать с пулами.
+void CMemoryPool::FlushThreadCache()
+{
+    CMemoryPoolImpl::FlushThreadCache();
+}
 
-            if (itMap == m_pools.end())
+//! Возвращает ОС память простаивающих расширяемых пулов.
+//! Пул считается простаивающим, если все его блоки свободны и отданы на склад (не лежат
+//! в кэшах потоков) при двух вызовах Trim() подряд,
+//! поэтому Trim() имеет смысл вызывать периодически.
+//! @return объем освобожденной памяти в байтах.
+size_t CMemoryPoolImpl::Trim()
+{
+    boost::unique_lock<boost::mutex> lock(m_lockPools);
+
+    size_t freed = 0;
+
+    for (CPoolMap::iterator it = m_pools.begin(); it != m_pools.end(); ++it)
+    {
+        freed += it->second.Trim();
+    }
+
+    if (m_classes)
+    {
+        for (size_t i = 0; i < SIZE_CLASS_COUNT; ++i)
+        {
+            CPool* pPool = m_classes[i].load();
+
+            if (pPool)
             {
-                AddPool(CMemoryPool::POOL_EXPANDABLE, s, 0, false);
+                freed += pPool->Trim();
             }
         }
+    }
+
+    return freed;
+}
+
+//! Возвращает ОС память пула, если он расширяемый и все его блоки свободны
+//! второй вызов подряд.
+//! @return объем освобожденной памяти в байтах.
+size_t CMemoryPoolImpl::CPool::Trim()
+{
+    if (m_type != CMemoryPool::POOL_EXPANDABLE)
+    {
+        return 0;
+    }
+
+    boost::unique_lock<boost::mutex> lock(m_pData->lock);
+
+    // Свободными считаются блоки на складе: блоки в кэшах потоков недоступны
+    FreeNode* pList   = m_pData->TakeAll();
+    FreeNode* pLast   = NULL;
+    size_t    cntFree = 0;
+
+    for (FreeNode* pNode = pList; pNode; pNode = pNode->pNext)
+    {
+        pLast = pNode;
+        ++cntFree;
+    }
+
+    if ((cntFree == m_pData->cntCreated) && (m_pData->cntCreated != 0) &&
+        (++m_pData->cntIdleTrims >= 2))
+    {
+        size_t freed = 0;
+
+        for (size_t i = 0; i < m_pData->arenas.size(); ++i)
+        {
+            freed += m_pData->arenas[i]->Size();
+        }
+
+        m_pData->arenas.clear();
+        m_pData->cntCreated   = 0;
+        m_pData->cntIdleTrims = 0;
 
-        itMap = m_pools.lower_bound(size);
+        return freed;
     }
 
+    if (cntFree != m_pData->cntCreated)
+    {
+        m_pData->cntIdleTrims = 0;
+    }
+
+    lock.unlock();
+
+    if (pList)
+    {
+        m_pData->Push(pList, pLast);
+    }
+
+    return 0;
+}
+
+//! Добавляет сведения о памяти пула к статистике.
+//! @param stats - [in/out] статистика.
+void CMemoryPoolImpl::CPool::AddStats(CMemoryPool::Stats& stats) const
+{
+    boost::unique_lock<boost::mutex> lock(m_pData->lock);
+
+    for (size_t i = 0; i < m_pData->arenas.size(); ++i)
+    {
+        m_pData->arenas[i]->AddStats(stats);
+    }
+}
+
+//! Возвращает номер класса размеров для блока заданного размера.
+//! Классы: 64 байта, далее по 4 класса на каждое удвоение (80, 96, 112, 128, 160, ...),
+//! поэтому неиспользуемый остаток блока не превышает 25% его размера.
+//! @param size - [in] размер блока.
+//! @return номер класса.
+size_t CMemoryPoolImpl::SizeClassIndex(size_t size)
+{
+    if (size <= (static_cast<size_t>(1) << MIN_SIZE_CLASS_SHIFT))
+    {
+        return 0;
+    }
+
+    const uint64_t value = size - 1;
+
+#ifdef _MSC_VER
+    unsigned long highBit = 0;
+    _BitScanReverse64(&highBit, value);
+#else
+    const size_t highBit = 63 - __builtin_clzll(value);
+#endif
+
+    const size_t sub = static_cast<size_t>(value >> (highBit - SIZE_CLASS_SUBDIV_SHIFT)) &
+                       ((1 << SIZE_CLASS_SUBDIV_SHIFT) - 1);
+
+    return ((highBit - MIN_SIZE_CLASS_SHIFT) << SIZE_CLASS_SUBDIV_SHIFT) + sub + 1;
+}
+
+//! Возвращает размер блоков класса.
+//! @param index - [in] номер класса.
+//! @return размер блоков.
+size_t CMemoryPoolImpl::SizeClassSize(size_t index)
+{
+    if (index == 0)
+    {
+        return static_cast<size_t>(1) << MIN_SIZE_CLASS_SHIFT;
+    }
+
+    const size_t shift = MIN_SIZE_CLASS_SHIFT + ((index - 1) >> SIZE_CLASS_SUBDIV_SHIFT);
+    const size_t sub   = (index - 1) & ((1 << SIZE_CLASS_SUBDIV_SHIFT) - 1);
+
+    return (static_cast<size_t>((1 << SIZE_CLASS_SUBDIV_SHIFT) + sub + 1)) <<
+           (shift - SIZE_CLASS_SUBDIV_SHIFT);
+}
+
+//! Возвращает пул класса размеров, при необходимости создавая его.
+//! @param index - [in] номер класса.
+//! @return пул или NULL, если его не удалось создать.
+CMemoryPoolImpl::CPool* CMemoryPoolImpl::GetClassPool(size_t index)
+{
+    CPool* pPool = m_classes[index].load(boost::memory_order_acquire);
+
+    if (pPool)
+    {
+        return pPool;
+    }
+
+    boost::unique_lock<boost::mutex> lock(m_lockPools);
+
+    pPool = m_classes[index].load(boost::memory_order_relaxed);
+
+    if (!pPool)
+    {
+        pPool = new CPool(CMemoryPool::POOL_EXPANDABLE, SizeClassSize(index), 0);
+
+        if (!pPool->Create(false, m_arenaParams))
+        {
+            delete pPool;
+            return NULL;
+        }
+
+        m_classes[index].store(pPool, boost::memory_order_release);
+    }
+
+    return pPool;
+}
+
+//! Возвращает блок памяти из пула.
+//! Блок возвращается в пул при разрушении CPoolBuffer (или вызове reset()).
+//! @param size - [in] размер требуемого блока
+//! @return блок памяти из пула
+CPoolBuffer CMemoryPool::Get(size_t size)
+{
+    return Get(size, boost::posix_time::time_duration());
+}
+
+//! Возвращает блок памяти из пула.
+//! Если фиксированный пул исчерпан, ожидает возврата блока в пул не дольше timeout.
+//! @param size    - [in] размер требуемого блока;
+//! @param timeout - [in] максимальное время ожидания свободного блока.
+//! @return блок памяти из пула или NULL - если за отведенное время блок не освободился.
+CPoolBuffer CMemoryPool::Get(size_t size, const boost::posix_time::time_duration& timeout)
+{
+    if (!m_pPoolImpl)
+    {
+        return CPoolBuffer();
+    }
+
+    return m_pPoolImpl->Get(size, timeout);
+}
+
+//! Возвращает блок памяти из пула.
+//! Блок возвращается в пул при разрушении CPoolBuffer (или вызове reset()).
+//! Пул для размера ищется сначала среди запомненных в кэше потока, без блокировки.
+//! @param size    - [in] размер требуемого блока;
+//! @param timeout - [in] максимальное время ожидания свободного блока.
+//! @return блок памяти из пула
+CPoolBuffer CMemoryPoolImpl::Get(size_t size, const boost::posix_time::time_duration& timeout)
+{
+    // Блоки, большие заданных пулов, расширяемый пул берет из пулов классов размеров
+    if ((m_type == CMemoryPool::POOL_EXPANDABLE) && (size > m_maxPoolChunk))
+    {
+        const size_t index = SizeClassIndex(size);
+
+        CPool* pPool = (index < SIZE_CLASS_COUNT) ? GetClassPool(index) : NULL;
+
+        if (!pPool)
+        {
+            return CPoolBuffer();
+        }
+
+        return pPool->Malloc(size, timeout);
+    }
+
+    CThreadCache& cache = CThreadCache::Instance();
+
+    CPool* pPool = cache.FindPool(m_id, m_generation.load(boost::memory_order_acquire), size);
+
+    if (pPool)
+    {
+        return pPool->Malloc(size, timeout);
+    }
+
+    boost::unique_lock<boost::mutex> lock(m_lockPools);
+    CPoolMap::iterator itMap = m_pools.lower_bound(size);
+
     if (itMap == m_pools.end())
     {
         if (m_type == CMemoryPool::POOL_FIXED_NEW_DELETE)
         {
-            return boost::shared_array<uint8_t>(new (std::nothrow) uint8_t[size]);
+            return MakeBuffer(new (std::nothrow) uint8_t[BUFFER_HEADER_SIZE + size], NULL, size);
         }
         else
         {
-            return boost::shared_array<uint8_t>();
+            return CPoolBuffer();
         }
     }
 
     CPool& pool = itMap->second;
 
+    cache.RememberPool(m_id, m_generation.load(), size, &pool);
+
     lock.unlock();
 
-    return pool.Malloc(size);    
+    return pool.Malloc(size, timeout);
 }
 
 //! Добавляет пул.
@@ -342,12 +1226,13 @@ bool CMemoryPoolImpl::AddPool(CMemoryPool::EType type, size_t chunkSize, size_t
 {
     CPool pool(type, chunkSize, capacity);
 
-    if (!pool.Create(doPreallocate))
+    if (!pool.Create(doPreallocate, m_arenaParams))
     {
         return false;
     }
 
     m_pools.insert(CPoolMap::value_type(chunkSize, pool));
+    ++m_generation;
 
     return true;
 }
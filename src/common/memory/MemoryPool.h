@@ -6,13 +6,94 @@
 
 #include <stdint.h>
 
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/move/core.hpp>
+#include <boost/move/utility_core.hpp>
 #include <boost/shared_ptr.hpp>
-#include <boost/shared_array.hpp>
 
+#include <stddef.h>
 #include <vector>
 
 class CMemoryPoolImpl;
 
+//! Блок памяти, выделенный из пула.
+//! Единственный владелец блока: только перемещается, при разрушении возвращает блок в пул.
+//! Сведения о пуле хранятся в заголовке перед данными блока, поэтому выделение блока
+//! не требует ни выделения памяти в куче, ни атомарного счетчика ссылок.
+//! Блоки должны быть возвращены до разрушения CMemoryPool.
+class CPoolBuffer
+{
+    BOOST_MOVABLE_BUT_NOT_COPYABLE(CPoolBuffer)
+
+    friend class CMemoryPoolImpl;
+
+public:
+    CPoolBuffer() : m_pBuff(NULL) {}
+
+    CPoolBuffer(BOOST_RV_REF(CPoolBuffer) other) : m_pBuff(other.m_pBuff)
+    {
+        other.m_pBuff = NULL;
+    }
+
+    CPoolBuffer& operator=(BOOST_RV_REF(CPoolBuffer) other)
+    {
+        if (this != &other)
+        {
+            reset();
+            m_pBuff       = other.m_pBuff;
+            other.m_pBuff = NULL;
+        }
+
+        return *this;
+    }
+
+    ~CPoolBuffer()
+    {
+        reset();
+    }
+
+    //! Возвращает указатель на данные блока или NULL, если блока нет.
+    uint8_t* get() const
+    {
+        return m_pBuff;
+    }
+
+    uint8_t& operator[](size_t i) const
+    {
+        return m_pBuff[i];
+    }
+
+    bool operator!() const
+    {
+        return m_pBuff == NULL;
+    }
+
+    //! Возвращает блок в пул.
+    void reset()
+    {
+        if (m_pBuff)
+        {
+            Release(m_pBuff);
+            m_pBuff = NULL;
+        }
+    }
+
+    void swap(CPoolBuffer& other)
+    {
+        uint8_t* pBuff = m_pBuff;
+        m_pBuff        = other.m_pBuff;
+        other.m_pBuff  = pBuff;
+    }
+
+private:
+    explicit CPoolBuffer(uint8_t* pBuff) : m_pBuff(pBuff) {}
+
+    static void Release(uint8_t* pBuff);
+
+private:
+    uint8_t* m_pBuff;
+};
+
 //! Класс предстваляющий пул памяти.
 class CMemoryPool
 {
@@ -34,16 +115,69 @@ public:
 
     typedef std::vector<PoolParams> PoolsParams;
 
+    //! Режим страниц памяти для предвыделенных пулов.
+    enum EPageMode
+    {
+        PAGES_DEFAULT,              //!< Обычные страницы
+        PAGES_HUGE_TRANSPARENT,     //!< Прозрачные большие страницы (madvise)
+        PAGES_HUGE_TLB              //!< Зарезервированные большие страницы (MAP_HUGETLB),
+                                    //!  при их нехватке - прозрачные
+    };
+
+    //! Параметры размещения предвыделенных пулов в памяти.
+    struct ArenaParams
+    {
+        ArenaParams() : pageMode(PAGES_DEFAULT), lockMemory(false), numaNode(-1) {}
+
+        EPageMode pageMode;
+        bool      lockMemory;   //!< Закрепить память пулов (mlock)
+        int       numaNode;     //!< Узел NUMA, на котором размещается память, -1 - любой
+    };
+
+    //! Статистика пула.
+    struct Stats
+    {
+        Stats() : arenaBytes(0), hugePageBytes(0), lockedBytes(0), numaBoundBytes(0),
+                  tlbEntries(0), prefaultMinorFaults(0), prefaultMajorFaults(0) {}
+
+        Stats& operator+=(const Stats& other)
+        {
+            arenaBytes          += other.arenaBytes;
+            hugePageBytes       += other.hugePageBytes;
+            lockedBytes         += other.lockedBytes;
+            numaBoundBytes      += other.numaBoundBytes;
+            tlbEntries          += other.tlbEntries;
+            prefaultMinorFaults += other.prefaultMinorFaults;
+            prefaultMajorFaults += other.prefaultMajorFaults;
+            return *this;
+        }
+
+        size_t   arenaBytes;            //!< Память предвыделенных пулов
+        size_t   hugePageBytes;         //!< Из нее на больших страницах
+        size_t   lockedBytes;           //!< Из нее закреплено в памяти
+        size_t   numaBoundBytes;        //!< Из нее привязано к узлу NUMA
+        size_t   tlbEntries;            //!< Кол-во страниц (записей TLB), покрывающих пулы
+        uint64_t prefaultMinorFaults;   //!< Ошибки страниц при предварительном заполнении
+        uint64_t prefaultMajorFaults;
+    };
+
 public:
     CMemoryPool();
     ~CMemoryPool();
 
     bool Init(EType type, const PoolsParams& poolParams, bool doPreallocate = true,
-              size_t chunkStep = 0);
+              size_t chunkStep = 0, const ArenaParams& arenaParams = ArenaParams());
 
     void Clear();
 
-    boost::shared_array<uint8_t> Get(size_t size);
+    Stats GetStats() const;
+
+    size_t Trim();
+
+    static void FlushThreadCache();
+
+    CPoolBuffer Get(size_t size);
+    CPoolBuffer Get(size_t size, const boost::posix_time::time_duration& timeout);
 
     static PoolParams ExpandablePoolParams(size_t chunkSize, size_t capacity);
     static PoolParams FixedPoolParams(size_t chunkSize, size_t capacity);
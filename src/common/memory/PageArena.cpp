@@ -0,0 +1,426 @@
+//! @file PageArena.cpp
+//! Реализация класса CPageArena
+
+#include "PageArena.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+//! Размер большой страницы, если его не удалось узнать у ОС.
+const size_t DEFAULT_HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+//! Политика mbind(): память только с заданных узлов (MPOL_BIND из numaif.h).
+const int    NUMA_POLICY_BIND       = 2;
+//! Наибольший номер узла NUMA, для которого строится маска mbind().
+const int    MAX_NUMA_NODE          = 1023;
+
+//! Возвращает размер обычной страницы.
+static size_t GetPageSize()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+//! Возвращает размер большой страницы.
+static size_t GetHugePageSize()
+{
+#ifdef _WIN32
+    size_t size = GetLargePageMinimum();
+    return (size != 0) ? size : DEFAULT_HUGE_PAGE_SIZE;
+#else
+    std::ifstream meminfo("/proc/meminfo");
+    std::string   name;
+
+    while (meminfo >> name)
+    {
+        if (name == "Hugepagesize:")
+        {
+            size_t sizeKb = 0;
+            meminfo >> sizeKb;
+            return (sizeKb != 0) ? sizeKb * 1024 : DEFAULT_HUGE_PAGE_SIZE;
+        }
+
+        meminfo.ignore(1024, '\n');
+    }
+
+    return DEFAULT_HUGE_PAGE_SIZE;
+#endif
+}
+
+//! Возвращает кол-во ошибок страниц текущего потока.
+//! @param minor - [out] ошибки без обращения к диску;
+//! @param major - [out] ошибки с обращением к диску.
+static void GetPageFaults(uint64_t& minor, uint64_t& major)
+{
+    minor = 0;
+    major = 0;
+
+#if defined(RUSAGE_THREAD)
+    rusage usage;
+
+    if (getrusage(RUSAGE_THREAD, &usage) == 0)
+    {
+        minor = usage.ru_minflt;
+        major = usage.ru_majflt;
+    }
+#endif
+}
+
+//! Возвращает объем прозрачных больших страниц в отображении, содержащем адрес.
+//! @param pAddr - [in] адрес внутри отображения.
+//! @return объем в байтах (для всего отображения, в которое ОС могла объединить область).
+static size_t GetTransparentHugeBytes(const void* pAddr)
+{
+#ifdef _WIN32
+    (void)pAddr;
+    return 0;
+#else
+    std::ifstream smaps("/proc/self/smaps");
+    std::string   line;
+    bool          inMapping = false;
+    const size_t  addr      = reinterpret_cast<size_t>(pAddr);
+
+    while (std::getline(smaps, line))
+    {
+        unsigned long long begin = 0;
+        unsigned long long end   = 0;
+
+        if (sscanf(line.c_str(), "%llx-%llx ", &begin, &end) == 2)
+        {
+            inMapping = (begin <= addr) && (addr < end);
+            continue;
+        }
+
+        size_t sizeKb = 0;
+
+        if (inMapping && (sscanf(line.c_str(), "AnonHugePages: %zu kB", &sizeKb) == 1))
+        {
+            return sizeKb * 1024;
+        }
+    }
+
+    return 0;
+#endif
+}
+
+#ifdef _WIN32
+//! Выделяет память, по возможности на заданном узле NUMA.
+//! @param size     - [in] размер;
+//! @param flags    - [in] флаги VirtualAlloc();
+//! @param numaNode - [in] узел NUMA, -1 - любой.
+//! @return память или NULL.
+static void* AllocPages(size_t size, DWORD flags, int numaNode)
+{
+    if (numaNode >= 0)
+    {
+        return VirtualAllocExNuma(GetCurrentProcess(), NULL, size, flags, PAGE_READWRITE,
+                                  static_cast<DWORD>(numaNode));
+    }
+
+    return VirtualAlloc(NULL, size, flags, PAGE_READWRITE);
+}
+#else
+//! Привязывает область к узлу NUMA (mbind). Вызывается до первого обращения к области,
+//! иначе уже выделенные страницы останутся на узле потока, который их коснулся.
+//! Библиотека libnuma не требуется: системный вызов выполняется напрямую.
+//! @param pData    - [in] начало области;
+//! @param size     - [in] размер области;
+//! @param numaNode - [in] узел NUMA.
+//! @return true - успех, false - если ядро не поддерживает NUMA или узел недоступен.
+static bool BindToNumaNode(void* pData, size_t size, int numaNode)
+{
+#if defined(SYS_mbind)
+    if ((numaNode < 0) || (numaNode > MAX_NUMA_NODE))
+    {
+        return false;
+    }
+
+    const size_t  BITS_IN_WORD = sizeof(unsigned long) * 8;
+    unsigned long nodeMask[(MAX_NUMA_NODE + 1) / (sizeof(unsigned long) * 8)] = { 0 };
+
+    nodeMask[numaNode / BITS_IN_WORD] |= 1UL << (numaNode % BITS_IN_WORD);
+
+    return syscall(SYS_mbind, pData, size, NUMA_POLICY_BIND, nodeMask,
+                   static_cast<unsigned long>(MAX_NUMA_NODE + 1), 0) == 0;
+#else
+    (void)pData;
+    (void)size;
+    (void)numaNode;
+    return false;
+#endif
+}
+#endif
+
+//! Округляет размер вверх до кратного align.
+static size_t AlignUp(size_t size, size_t align)
+{
+    return (size + align - 1) / align * align;
+}
+
+//! Конструктор.
+CPageArena::CPageArena() :
+    m_pData(NULL), m_size(0), m_mappedSize(0), m_pageSize(0),
+    m_pageMode(CMemoryPool::PAGES_DEFAULT), m_isLocked(false), m_isNumaBound(false),
+    m_hugeBytes(0), m_minorFaults(0), m_majorFaults(0)
+{
+}
+
+//! Деструктор.
+CPageArena::~CPageArena()
+{
+    Free();
+}
+
+//! Выделяет область памяти.
+//! Если большие страницы недоступны, используется следующий по списку режим:
+//! PAGES_HUGE_TLB -> PAGES_HUGE_TRANSPARENT -> PAGES_DEFAULT.
+//! Невозможность закрепить память ошибкой не считается (см. AddStats()).
+//! Невозможность разместить область на заданном узле NUMA ошибкой также не считается.
+//! @param size       - [in] размер области;
+//! @param pageMode   - [in] желаемый режим страниц;
+//! @param lockMemory - [in] true - закрепить область в физической памяти;
+//! @param numaNode   - [in] узел NUMA, на котором размещается область, -1 - любой.
+//! @return true - область выделена, false - в случае ошибки.
+bool CPageArena::Create(size_t size, CMemoryPool::EPageMode pageMode, bool lockMemory,
+                        int numaNode)
+{
+    Free();
+
+    const size_t hugePageSize = GetHugePageSize();
+
+#ifdef _WIN32
+    if (pageMode != CMemoryPool::PAGES_DEFAULT)
+    {
+        m_mappedSize = AlignUp(size, hugePageSize);
+        m_pData      = static_cast<uint8_t*>(AllocPages(m_mappedSize,
+                                                        MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+                                                        numaNode));
+        m_pageSize   = hugePageSize;
+        m_pageMode   = CMemoryPool::PAGES_HUGE_TLB;
+    }
+
+    if (!m_pData)
+    {
+        m_pageSize   = GetPageSize();
+        m_mappedSize = AlignUp(size, m_pageSize);
+        m_pData      = static_cast<uint8_t*>(AllocPages(m_mappedSize,
+                                                        MEM_RESERVE | MEM_COMMIT, numaNode));
+        m_pageMode   = CMemoryPool::PAGES_DEFAULT;
+    }
+
+    if (!m_pData)
+    {
+        return false;
+    }
+
+    m_isNumaBound = (numaNode >= 0);
+#else
+#ifdef MAP_HUGETLB
+    if (pageMode == CMemoryPool::PAGES_HUGE_TLB)
+    {
+        m_mappedSize = AlignUp(size, hugePageSize);
+
+        void* p = mmap(NULL, m_mappedSize, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+        if (p != MAP_FAILED)
+        {
+            m_pData    = static_cast<uint8_t*>(p);
+            m_pageSize = hugePageSize;
+            m_pageMode = CMemoryPool::PAGES_HUGE_TLB;
+        }
+        else
+        {
+            pageMode = CMemoryPool::PAGES_HUGE_TRANSPARENT;
+        }
+    }
+#endif
+
+    if (!m_pData)
+    {
+        m_pageSize   = GetPageSize();
+        m_mappedSize = AlignUp(size, m_pageSize);
+        m_pageMode   = CMemoryPool::PAGES_DEFAULT;
+
+#ifdef MADV_HUGEPAGE
+        // Прозрачные большие страницы требуют выравнивания области по их размеру
+        if (pageMode == CMemoryPool::PAGES_HUGE_TRANSPARENT)
+        {
+            m_mappedSize = AlignUp(size, hugePageSize);
+
+            const size_t reserve = m_mappedSize + hugePageSize;
+
+            void* p = mmap(NULL, reserve, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+            if (p == MAP_FAILED)
+            {
+                return false;
+            }
+
+            uint8_t* pBegin   = static_cast<uint8_t*>(p);
+            uint8_t* pAligned = reinterpret_cast<uint8_t*>(
+                AlignUp(reinterpret_cast<size_t>(pBegin), hugePageSize));
+            uint8_t* pEnd     = pBegin + reserve;
+
+            if (pAligned != pBegin)
+            {
+                munmap(pBegin, pAligned - pBegin);
+            }
+
+            if (pAligned + m_mappedSize != pEnd)
+            {
+                munmap(pAligned + m_mappedSize, pEnd - (pAligned + m_mappedSize));
+            }
+
+            m_pData = pAligned;
+
+            if (madvise(m_pData, m_mappedSize, MADV_HUGEPAGE) == 0)
+            {
+                m_pageSize = hugePageSize;
+                m_pageMode = CMemoryPool::PAGES_HUGE_TRANSPARENT;
+            }
+        }
+#endif
+
+        if (!m_pData)
+        {
+            void* p = mmap(NULL, m_mappedSize, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+            if (p == MAP_FAILED)
+            {
+                return false;
+            }
+
+            m_pData = static_cast<uint8_t*>(p);
+        }
+    }
+
+    if (numaNode >= 0)
+    {
+        m_isNumaBound = BindToNumaNode(m_pData, m_mappedSize, numaNode);
+    }
+#endif
+
+    m_size = size;
+
+    Prefault();
+
+    if (lockMemory)
+    {
+#ifdef _WIN32
+        m_isLocked = (VirtualLock(m_pData, m_mappedSize) != FALSE);
+#else
+        m_isLocked = (mlock(m_pData, m_mappedSize) == 0);
+#endif
+    }
+
+    return true;
+}
+
+//! Записывает по байту в каждую страницу, чтобы ОС выделила под них физическую память
+//! сейчас, а не при первом обращении из конвейера.
+void CPageArena::Prefault()
+{
+    uint64_t minorBefore = 0;
+    uint64_t majorBefore = 0;
+    GetPageFaults(minorBefore, majorBefore);
+
+    const size_t step = GetPageSize();
+
+    for (size_t offset = 0; offset < m_mappedSize; offset += step)
+    {
+        static_cast<volatile uint8_t*>(m_pData)[offset] = 0;
+    }
+
+    uint64_t minorAfter = 0;
+    uint64_t majorAfter = 0;
+    GetPageFaults(minorAfter, majorAfter);
+
+    m_minorFaults = minorAfter - minorBefore;
+    m_majorFaults = majorAfter - majorBefore;
+
+    // ОС могла отказать в прозрачных больших страницах, несмотря на madvise()
+    if (m_pageMode == CMemoryPool::PAGES_HUGE_TRANSPARENT)
+    {
+        m_hugeBytes = std::min(GetTransparentHugeBytes(m_pData), m_mappedSize);
+    }
+    else if (m_pageMode == CMemoryPool::PAGES_HUGE_TLB)
+    {
+        m_hugeBytes = m_mappedSize;
+    }
+}
+
+//! Освобождает область.
+void CPageArena::Free()
+{
+    if (m_pData)
+    {
+#ifdef _WIN32
+        if (m_isLocked)
+        {
+            VirtualUnlock(m_pData, m_mappedSize);
+        }
+
+        VirtualFree(m_pData, 0, MEM_RELEASE);
+#else
+        munmap(m_pData, m_mappedSize);
+#endif
+    }
+
+    m_pData       = NULL;
+    m_size        = 0;
+    m_mappedSize  = 0;
+    m_isLocked    = false;
+    m_isNumaBound = false;
+    m_hugeBytes   = 0;
+}
+
+//! Добавляет сведения об области к статистике пула.
+//! @param stats - [in/out] статистика пула.
+void CPageArena::AddStats(CMemoryPool::Stats& stats) const
+{
+    if (!m_pData)
+    {
+        return;
+    }
+
+    const size_t smallPageSize = GetPageSize();
+    const size_t hugePageSize  = (m_pageMode != CMemoryPool::PAGES_DEFAULT) ? m_pageSize
+                                                                             : smallPageSize;
+
+    stats.arenaBytes           += m_mappedSize;
+    stats.hugePageBytes        += m_hugeBytes;
+    stats.prefaultMinorFaults  += m_minorFaults;
+    stats.prefaultMajorFaults  += m_majorFaults;
+
+    // Кол-во записей TLB, необходимое для покрытия всей области
+    stats.tlbEntries += m_hugeBytes / hugePageSize +
+                        (m_mappedSize - m_hugeBytes) / smallPageSize;
+
+    if (m_isLocked)
+    {
+        stats.lockedBytes += m_mappedSize;
+    }
+
+    if (m_isNumaBound)
+    {
+        stats.numaBoundBytes += m_mappedSize;
+    }
+}
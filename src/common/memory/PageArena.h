@@ -0,0 +1,58 @@
+//! @file memory/PageArena.h
+//! Объявление класса CPageArena
+
+#ifndef _PAGE_ARENA_H
+#define _PAGE_ARENA_H
+
+#include "MemoryPool.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+//! Непрерывная область памяти, выделенная напрямую у ОС.
+//! По возможности размещается на больших страницах, заранее заполняется (все страницы
+//! получают физическую память сразу) и при необходимости закрепляется в памяти.
+class CPageArena
+{
+public:
+    CPageArena();
+    ~CPageArena();
+
+    bool Create(size_t size, CMemoryPool::EPageMode pageMode, bool lockMemory,
+                int numaNode = -1);
+
+    //! Возвращает начало области.
+    uint8_t* Data() const
+    {
+        return m_pData;
+    }
+
+    //! Возвращает размер области.
+    size_t Size() const
+    {
+        return m_size;
+    }
+
+    void AddStats(CMemoryPool::Stats& stats) const;
+
+private:
+    CPageArena(const CPageArena&);
+    CPageArena& operator=(const CPageArena&);
+
+    void Prefault();
+    void Free();
+
+private:
+    uint8_t*                m_pData;
+    size_t                  m_size;
+    size_t                  m_mappedSize;
+    size_t                  m_pageSize;     //!< Размер страницы, которой отображена область
+    CMemoryPool::EPageMode  m_pageMode;     //!< Фактически использованный режим страниц
+    bool                    m_isLocked;
+    bool                    m_isNumaBound;  //!< Область привязана к узлу NUMA
+    size_t                  m_hugeBytes;    //!< Объем, действительно размещенный на больших страницах
+    uint64_t                m_minorFaults;  //!< Ошибки страниц при заполнении области
+    uint64_t                m_majorFaults;
+};
+
+#endif // _PAGE_ARENA_H
@@ -0,0 +1,295 @@
+//! @file NumaTopology.cpp
+//! Реализация класса CNumaTopology
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "NumaTopology.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+//! Возвращает процессоры, на которых процессу разрешено выполняться.
+//! @param cpus - [out] список процессоров.
+//! @return true - успех, false - в случае ошибки.
+static bool GetAllowedCpus(CCpuList& cpus)
+{
+    cpus.clear();
+
+#ifdef _WIN32
+    DWORD_PTR processMask = 0;
+    DWORD_PTR systemMask  = 0;
+
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask))
+    {
+        return false;
+    }
+
+    for (unsigned cpu = 0; cpu < sizeof(DWORD_PTR) * 8; ++cpu)
+    {
+        if (processMask & (static_cast<DWORD_PTR>(1) << cpu))
+        {
+            cpus.push_back(cpu);
+        }
+    }
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    if (sched_getaffinity(0, sizeof(set), &set) != 0)
+    {
+        return false;
+    }
+
+    for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+        if (CPU_ISSET(cpu, &set))
+        {
+            cpus.push_back(cpu);
+        }
+    }
+#endif
+
+    return !cpus.empty();
+}
+
+//! Оставляет в списке процессоров только присутствующие в allowed.
+//! @param cpus    - [in/out] список процессоров;
+//! @param allowed - [in]     отсортированный список разрешенных процессоров.
+static void IntersectCpus(CCpuList& cpus, const CCpuList& allowed)
+{
+    CCpuList result;
+
+    for (size_t i = 0; i < cpus.size(); ++i)
+    {
+        if (std::binary_search(allowed.begin(), allowed.end(), cpus[i]))
+        {
+            result.push_back(cpus[i]);
+        }
+    }
+
+    cpus.swap(result);
+}
+
+#ifndef _WIN32
+//! Читает список в формате "0-3,8,10-11" из файла sysfs.
+//! @param path - [in]  путь к файлу;
+//! @param list - [out] номера.
+//! @return true - успех, false - в случае ошибки.
+static bool ReadSysList(const std::string& path, CCpuList& list)
+{
+    std::ifstream file(path.c_str());
+    std::string   line;
+
+    if (!std::getline(file, line))
+    {
+        return false;
+    }
+
+    return CNumaTopology::ParseCpuList(line, list);
+}
+#endif
+
+//! Определяет топологию.
+//! Если ОС не сообщает о NUMA, все процессоры считаются одним узлом.
+//! @param cpuFilter - [in] процессоры, которыми ограничивается работа (пустой - все доступные).
+//! @return true - успех, false - если не осталось ни одного доступного процессора.
+bool CNumaTopology::Detect(const CCpuList& cpuFilter)
+{
+    m_nodes.clear();
+
+    CCpuList allowed;
+
+    if (!GetAllowedCpus(allowed))
+    {
+        return false;
+    }
+
+    if (!cpuFilter.empty())
+    {
+        CCpuList filter(cpuFilter);
+        std::sort(filter.begin(), filter.end());
+
+        IntersectCpus(allowed, filter);
+    }
+
+#ifdef _WIN32
+    ULONG highestNode = 0;
+
+    if (GetNumaHighestNodeNumber(&highestNode))
+    {
+        for (ULONG id = 0; id <= highestNode; ++id)
+        {
+            ULONGLONG mask = 0;
+
+            if (!GetNumaNodeProcessorMask(static_cast<UCHAR>(id), &mask))
+            {
+                continue;
+            }
+
+            Node node;
+            node.id = static_cast<int>(id);
+
+            for (unsigned cpu = 0; cpu < sizeof(mask) * 8; ++cpu)
+            {
+                if (mask & (static_cast<ULONGLONG>(1) << cpu))
+                {
+                    node.cpus.push_back(cpu);
+                }
+            }
+
+            IntersectCpus(node.cpus, allowed);
+
+            if (!node.cpus.empty())
+            {
+                m_nodes.push_back(node);
+            }
+        }
+    }
+#else
+    CCpuList nodeIds;
+
+    if (ReadSysList("/sys/devices/system/node/online", nodeIds))
+    {
+        for (size_t i = 0; i < nodeIds.size(); ++i)
+        {
+            char path[64];
+            sprintf(path, "/sys/devices/system/node/node%u/cpulist", nodeIds[i]);
+
+            Node node;
+            node.id = static_cast<int>(nodeIds[i]);
+
+            // Узел без процессоров (только память) в файле содержит пустую строку
+            if (!ReadSysList(path, node.cpus))
+            {
+                continue;
+            }
+
+            IntersectCpus(node.cpus, allowed);
+
+            if (!node.cpus.empty())
+            {
+                m_nodes.push_back(node);
+            }
+        }
+    }
+#endif
+
+    if (m_nodes.empty() && !allowed.empty())
+    {
+        Node node;
+        node.cpus = allowed;
+        m_nodes.push_back(node);
+    }
+
+    return !m_nodes.empty();
+}
+
+//! Разбирает список процессоров в формате "0-3,8,10-11".
+//! @param str  - [in]  строка со списком;
+//! @param cpus - [out] номера процессоров по возрастанию.
+//! @return true - успех, false - в случае ошибки.
+bool CNumaTopology::ParseCpuList(const std::string& str, CCpuList& cpus)
+{
+    cpus.clear();
+
+    const char* p = str.c_str();
+
+    while (*p != '\0')
+    {
+        char* pEnd = NULL;
+        const unsigned long first = strtoul(p, &pEnd, 10);
+
+        if (pEnd == p)
+        {
+            return false;
+        }
+
+        unsigned long last = first;
+        p = pEnd;
+
+        if (*p == '-')
+        {
+            ++p;
+            last = strtoul(p, &pEnd, 10);
+
+            if ((pEnd == p) || (last < first))
+            {
+                return false;
+            }
+
+            p = pEnd;
+        }
+
+        for (unsigned long cpu = first; cpu <= last; ++cpu)
+        {
+            cpus.push_back(static_cast<unsigned>(cpu));
+        }
+
+        if (*p == ',')
+        {
+            ++p;
+        }
+        else if ((*p != '\0') && (*p != '\n'))
+        {
+            return false;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+
+    return !cpus.empty();
+}
+
+//! Разрешает текущему потоку выполняться только на заданных процессорах.
+//! @param cpus - [in] список процессоров.
+//! @return true - успех, false - в случае ошибки.
+bool CNumaTopology::BindCurrentThread(const CCpuList& cpus)
+{
+    if (cpus.empty())
+    {
+        return false;
+    }
+
+#ifdef _WIN32
+    DWORD_PTR mask = 0;
+
+    for (size_t i = 0; i < cpus.size(); ++i)
+    {
+        if (cpus[i] < sizeof(DWORD_PTR) * 8)
+        {
+            mask |= static_cast<DWORD_PTR>(1) << cpus[i];
+        }
+    }
+
+    return (mask != 0) && (SetThreadAffinityMask(GetCurrentThread(), mask) != 0);
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    for (size_t i = 0; i < cpus.size(); ++i)
+    {
+        if (cpus[i] < CPU_SETSIZE)
+        {
+            CPU_SET(cpus[i], &set);
+        }
+    }
+
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+}
@@ -0,0 +1,45 @@
+//! @file numa/NumaTopology.h
+//! Объявление класса CNumaTopology
+
+#ifndef _NUMA_TOPOLOGY_H
+#define _NUMA_TOPOLOGY_H
+
+#include <string>
+#include <vector>
+
+//! Список номеров процессоров.
+typedef std::vector<unsigned> CCpuList;
+
+//! Топология NUMA: узлы и доступные процессоры каждого узла.
+//! Учитываются только процессоры, на которых процессу разрешено выполняться.
+class CNumaTopology
+{
+public:
+    //! Узел NUMA.
+    struct Node
+    {
+        Node() : id(0) {}
+
+        int      id;    //!< Номер узла в ОС
+        CCpuList cpus;  //!< Доступные процессоры узла
+    };
+
+    typedef std::vector<Node> CNodes;
+
+public:
+    bool Detect(const CCpuList& cpuFilter = CCpuList());
+
+    //! Возвращает узлы, у которых есть доступные процессоры.
+    const CNodes& Nodes() const
+    {
+        return m_nodes;
+    }
+
+    static bool ParseCpuList(const std::string& str, CCpuList& cpus);
+    static bool BindCurrentThread(const CCpuList& cpus);
+
+private:
+    CNodes m_nodes;
+};
+
+#endif // _NUMA_TOPOLOGY_H
@@ -0,0 +1,204 @@
+//! @file PerfCounters.cpp
+//! Реализация класса CPerfCounters
+
+#include "PerfCounters.h"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstring>
+#endif
+
+//! Конструктор.
+CPerfCounters::Values::Values()
+{
+    for (size_t i = 0; i < COUNTER_COUNT; ++i)
+    {
+        values[i] = 0;
+    }
+}
+
+//! Прибавляет значения счетчиков.
+CPerfCounters::Values& CPerfCounters::Values::operator+=(const Values& other)
+{
+    for (size_t i = 0; i < COUNTER_COUNT; ++i)
+    {
+        values[i] += other.values[i];
+    }
+
+    return *this;
+}
+
+//! Возвращает разность значений счетчиков.
+CPerfCounters::Values CPerfCounters::Values::operator-(const Values& other) const
+{
+    Values result;
+
+    for (size_t i = 0; i < COUNTER_COUNT; ++i)
+    {
+        result.values[i] = values[i] - other.values[i];
+    }
+
+    return result;
+}
+
+//! Конструктор.
+CPerfCounters::CPerfCounters() : m_leaderFd(-1), m_cntOpen(0)
+{
+    for (size_t i = 0; i < COUNTER_COUNT; ++i)
+    {
+        m_fds[i]   = -1;
+        m_order[i] = 0;
+    }
+}
+
+//! Деструктор.
+CPerfCounters::~CPerfCounters()
+{
+    Close();
+}
+
+//! Возвращает название счетчика для отчета.
+//! @param counter - [in] счетчик.
+const char* CPerfCounters::CounterName(ECounter counter)
+{
+    switch (counter)
+    {
+    case COUNTER_CYCLES:        return "cycles";
+    case COUNTER_INSTRUCTIONS:  return "instructions";
+    case COUNTER_CACHE_MISSES:  return "cache_misses";
+    case COUNTER_BRANCH_MISSES: return "branch_misses";
+    default:                    return "unknown";
+    }
+}
+
+//! Открывает счетчики для текущего потока и запускает их.
+//! @return true - открыт хотя бы один счетчик, false - счетчики недоступны.
+bool CPerfCounters::Open()
+{
+    Close();
+
+#if defined(__linux__) && defined(SYS_perf_event_open)
+    const uint64_t configs[COUNTER_COUNT] =
+    {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES
+    };
+
+    for (size_t i = 0; i < COUNTER_COUNT; ++i)
+    {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+
+        attr.size           = sizeof(attr);
+        attr.type           = PERF_TYPE_HARDWARE;
+        attr.config         = configs[i];
+        attr.disabled       = (m_leaderFd < 0) ? 1 : 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        attr.read_format    = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                              PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        const int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1,
+                                                m_leaderFd, 0));
+
+        if (fd < 0)
+        {
+            continue;
+        }
+
+        if (m_leaderFd < 0)
+        {
+            m_leaderFd = fd;
+        }
+
+        m_fds[i]             = fd;
+        m_order[m_cntOpen++] = i;
+    }
+
+    if (m_leaderFd < 0)
+    {
+        return false;
+    }
+
+    ioctl(m_leaderFd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(m_leaderFd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+//! Закрывает счетчики.
+void CPerfCounters::Close()
+{
+#if defined(__linux__)
+    for (size_t i = 0; i < COUNTER_COUNT; ++i)
+    {
+        if (m_fds[i] >= 0)
+        {
+            close(m_fds[i]);
+        }
+    }
+#endif
+
+    for (size_t i = 0; i < COUNTER_COUNT; ++i)
+    {
+        m_fds[i] = -1;
+    }
+
+    m_leaderFd = -1;
+    m_cntOpen  = 0;
+}
+
+//! Читает текущие значения счетчиков.
+//! Если ОС делила аппаратные счетчики с другими задачами, значения масштабируются
+//! на долю времени, в течение которого группа действительно считала.
+//! @param values - [out] значения; неоткрытые счетчики равны нулю.
+//! @return true - успех, false - если счетчики не открыты или чтение не удалось.
+bool CPerfCounters::Read(Values& values) const
+{
+    values = Values();
+
+    if (m_leaderFd < 0)
+    {
+        return false;
+    }
+
+#if defined(__linux__)
+    // Формат PERF_FORMAT_GROUP: nr, time_enabled, time_running, values[nr]
+    uint64_t buffer[3 + COUNTER_COUNT];
+
+    const ssize_t size = read(m_leaderFd, buffer, sizeof(buffer));
+
+    if ((size < static_cast<ssize_t>(3 * sizeof(uint64_t))) || (buffer[0] != m_cntOpen))
+    {
+        return false;
+    }
+
+    const uint64_t timeEnabled = buffer[1];
+    const uint64_t timeRunning = buffer[2];
+
+    for (size_t i = 0; i < m_cntOpen; ++i)
+    {
+        uint64_t value = buffer[3 + i];
+
+        if ((timeRunning != 0) && (timeRunning < timeEnabled))
+        {
+            value = static_cast<uint64_t>(static_cast<double>(value) * timeEnabled / timeRunning);
+        }
+
+        values.values[m_order[i]] = value;
+    }
+
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,72 @@
+//! @file perf/PerfCounters.h
+//! Объявление класса CPerfCounters
+
+#ifndef _PERF_COUNTERS_H
+#define _PERF_COUNTERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//! Аппаратные счетчики производительности текущего потока (perf_event_open, только Linux).
+//! Счетчики открываются одной группой и считают только пользовательский режим, поэтому
+//! доступны без привилегий при perf_event_paranoid <= 2. Если ОС не дает открыть
+//! счетчик, он просто не учитывается; если не открылся ни один - Open() возвращает false.
+class CPerfCounters
+{
+public:
+    //! Счетчики.
+    enum ECounter
+    {
+        COUNTER_CYCLES,
+        COUNTER_INSTRUCTIONS,
+        COUNTER_CACHE_MISSES,
+        COUNTER_BRANCH_MISSES,
+        COUNTER_COUNT
+    };
+
+    //! Значения счетчиков.
+    struct Values
+    {
+        Values();
+
+        Values& operator+=(const Values& other);
+        Values  operator-(const Values& other) const;
+
+        uint64_t values[COUNTER_COUNT];
+    };
+
+public:
+    CPerfCounters();
+    ~CPerfCounters();
+
+    bool Open();
+    void Close();
+
+    //! Возвращает true, если открыт хотя бы один счетчик.
+    bool IsOpen() const
+    {
+        return m_leaderFd >= 0;
+    }
+
+    //! Возвращает true, если счетчик открыт.
+    bool IsCounterOpen(ECounter counter) const
+    {
+        return m_fds[counter] >= 0;
+    }
+
+    bool Read(Values& values) const;
+
+    static const char* CounterName(ECounter counter);
+
+private:
+    CPerfCounters(const CPerfCounters&);
+    CPerfCounters& operator=(const CPerfCounters&);
+
+private:
+    int    m_leaderFd;
+    int    m_fds[COUNTER_COUNT];
+    size_t m_order[COUNTER_COUNT];  //!< Счетчики в порядке их значений при чтении группы
+    size_t m_cntOpen;
+};
+
+#endif // _PERF_COUNTERS_H
@@ -0,0 +1,134 @@
+//! @file LatencyHistogram.cpp
+//! Реализация класса CLatencyHistogram
+
+#include "LatencyHistogram.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+//! Возвращает время монотонных часов в наносекундах.
+uint64_t GetMonotonicNs()
+{
+#ifdef _WIN32
+    static LARGE_INTEGER frequency = { 0 };
+
+    if (frequency.QuadPart == 0)
+    {
+        QueryPerformanceFrequency(&frequency);
+    }
+
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+
+    return static_cast<uint64_t>(counter.QuadPart / frequency.QuadPart * 1000000000 +
+                                 counter.QuadPart % frequency.QuadPart * 1000000000 /
+                                 frequency.QuadPart);
+#else
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+//! Возвращает номер интервала для длительности.
+static size_t BucketIndex(uint64_t ns)
+{
+    if (ns == 0)
+    {
+        return 0;
+    }
+
+#ifdef _MSC_VER
+    unsigned long highBit = 0;
+    _BitScanReverse64(&highBit, ns);
+    const size_t index = highBit + 1;
+#else
+    const size_t index = 64 - __builtin_clzll(ns);
+#endif
+
+    return (index < CLatencyHistogram::BUCKET_COUNT) ? index : CLatencyHistogram::BUCKET_COUNT - 1;
+}
+
+//! Конструктор.
+CLatencyHistogram::Snapshot::Snapshot() : count(0), totalNs(0), maxNs(0)
+{
+    for (size_t i = 0; i < BUCKET_COUNT; ++i)
+    {
+        buckets[i] = 0;
+    }
+}
+
+//! Возвращает оценку процентиля: верхнюю границу интервала, в котором он находится.
+//! @param percent - [in] процентиль (0..100).
+//! @return длительность в наносекундах.
+uint64_t CLatencyHistogram::Snapshot::Percentile(double percent) const
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    const uint64_t rank = static_cast<uint64_t>(count * percent / 100.0);
+    uint64_t       seen = 0;
+
+    for (size_t i = 0; i < BUCKET_COUNT; ++i)
+    {
+        seen += buckets[i];
+
+        if (seen > rank)
+        {
+            const uint64_t upper = (i == 0) ? 0 : (static_cast<uint64_t>(1) << i) - 1;
+            return (upper < maxNs) ? upper : maxNs;
+        }
+    }
+
+    return maxNs;
+}
+
+//! Конструктор.
+CLatencyHistogram::CLatencyHistogram() : m_count(0), m_totalNs(0), m_maxNs(0)
+{
+    for (size_t i = 0; i < BUCKET_COUNT; ++i)
+    {
+        m_buckets[i].store(0, boost::memory_order_relaxed);
+    }
+}
+
+//! Добавляет длительность.
+//! @param ns - [in] длительность в наносекундах.
+void CLatencyHistogram::Add(uint64_t ns)
+{
+    m_count.fetch_add(1, boost::memory_order_relaxed);
+    m_totalNs.fetch_add(ns, boost::memory_order_relaxed);
+    m_buckets[BucketIndex(ns)].fetch_add(1, boost::memory_order_relaxed);
+
+    uint64_t maxNs = m_maxNs.load(boost::memory_order_relaxed);
+
+    while ((ns > maxNs) &&
+           !m_maxNs.compare_exchange_weak(maxNs, ns, boost::memory_order_relaxed))
+    {
+    }
+}
+
+//! Возвращает состояние гистограммы.
+//! Поля читаются по отдельности, поэтому во время записи снимок может быть
+//! несогласованным на единицы последних добавлений.
+CLatencyHistogram::Snapshot CLatencyHistogram::GetSnapshot() const
+{
+    Snapshot snapshot;
+
+    snapshot.count   = m_count.load(boost::memory_order_relaxed);
+    snapshot.totalNs = m_totalNs.load(boost::memory_order_relaxed);
+    snapshot.maxNs   = m_maxNs.load(boost::memory_order_relaxed);
+
+    for (size_t i = 0; i < BUCKET_COUNT; ++i)
+    {
+        snapshot.buckets[i] = m_buckets[i].load(boost::memory_order_relaxed);
+    }
+
+    return snapshot;
+}
@@ -0,0 +1,53 @@
+//! @file stats/LatencyHistogram.h
+//! Объявление класса CLatencyHistogram
+
+#ifndef _LATENCY_HISTOGRAM_H
+#define _LATENCY_HISTOGRAM_H
+
+#include <boost/atomic.hpp>
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint64_t GetMonotonicNs();
+
+//! Гистограмма длительностей с интервалами по степеням двойки (в наносекундах).
+//! Запись - несколько атомарных сложений без блокировок, поэтому гистограмму
+//! могут одновременно пополнять несколько потоков.
+class CLatencyHistogram
+{
+public:
+    //! Кол-во интервалов: интервал i содержит длительности [2^(i-1), 2^i) нс.
+    static const size_t BUCKET_COUNT = 64;
+
+    //! Состояние гистограммы на момент вызова GetSnapshot().
+    struct Snapshot
+    {
+        Snapshot();
+
+        uint64_t Percentile(double percent) const;
+
+        uint64_t count;
+        uint64_t totalNs;
+        uint64_t maxNs;
+        uint64_t buckets[BUCKET_COUNT];
+    };
+
+public:
+    CLatencyHistogram();
+
+    void     Add(uint64_t ns);
+    Snapshot GetSnapshot() const;
+
+private:
+    CLatencyHistogram(const CLatencyHistogram&);
+    CLatencyHistogram& operator=(const CLatencyHistogram&);
+
+private:
+    boost::atomic<uint64_t> m_count;
+    boost::atomic<uint64_t> m_totalNs;
+    boost::atomic<uint64_t> m_maxNs;
+    boost::atomic<uint64_t> m_buckets[BUCKET_COUNT];
+};
+
+#endif // _LATENCY_HISTOGRAM_H
@@ -0,0 +1,330 @@
+//! @file sysinfo/ResourceLimits.cpp
+//! Определение ограничений ресурсов процесса: привязка к процессорам, квоты cgroup v1 и v2
+
+#include "ResourceLimits.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+//! Точка монтирования иерархий cgroup
+const char* const CGROUP_ROOT      = "/sys/fs/cgroup";
+//! Группы процесса
+const char* const PROC_CGROUP_PATH = "/proc/self/cgroup";
+
+//! Группа процесса в одной иерархии cgroup.
+struct CgroupEntry
+{
+    std::string controllers;   //!< Контроллеры через запятую, пусто - cgroup v2
+    std::string path;          //!< Путь группы относительно корня иерархии
+};
+
+//! Возвращает кол-во процессоров, которые процесс может занять: разрешенные процессоры,
+//! но не больше квоты cgroup.
+size_t ResourceLimits::EffectiveCpus() const
+{
+    size_t cpus = std::max<size_t>(allowedCpus, 1);
+
+    if (cpuQuota > 0)
+    {
+        // Дробная квота (например 2.5) позволяет занять еще один процессор частично
+        cpus = std::min(cpus, std::max<size_t>(static_cast<size_t>(std::ceil(cpuQuota)), 1));
+    }
+
+    return cpus;
+}
+
+//! Возвращает память, доступную процессу: меньшее из ограничения cgroup и памяти машины.
+//! @return размер в байтах, 0 - неизвестна.
+uint64_t ResourceLimits::EffectiveMemory() const
+{
+    if ((memoryLimit != 0) && (physicalMemory != 0))
+    {
+        return std::min(memoryLimit, physicalMemory);
+    }
+
+    return (memoryLimit != 0) ? memoryLimit : physicalMemory;
+}
+
+//! Читает первую строку файла.
+//! @param path - [in]  путь к файлу;
+//! @param line - [out] строка.
+//! @return true - успех, false - файла нет или он пуст.
+static bool ReadFirstLine(const std::string& path, std::string& line)
+{
+    std::ifstream file(path.c_str());
+
+    return std::getline(file, line) && !line.empty();
+}
+
+//! Разбирает /proc/self/cgroup: строки "номер:контроллеры:путь".
+//! @param path    - [in]  путь к файлу;
+//! @param entries - [out] группы процесса.
+static void ReadProcCgroup(const std::string& path, std::vector<CgroupEntry>& entries)
+{
+    std::ifstream file(path.c_str());
+    std::string   line;
+
+    while (std::getline(file, line))
+    {
+        const std::string::size_type posFirst  = line.find(':');
+        const std::string::size_type posSecond = (posFirst != std::string::npos) ? line.find(':', posFirst + 1)
+                                                                                : std::string::npos;
+
+        if (posSecond == std::string::npos)
+        {
+            continue;
+        }
+
+        CgroupEntry entry;
+        entry.controllers = line.substr(posFirst + 1, posSecond - posFirst - 1);
+        entry.path        = line.substr(posSecond + 1);
+
+        entries.push_back(entry);
+    }
+}
+
+//! Проверяет, что в списке контроллеров через запятую есть заданный.
+static bool HasController(const std::string& controllers, const std::string& name)
+{
+    std::istringstream stream(controllers);
+    std::string        item;
+
+    while (std::getline(stream, item, ','))
+    {
+        if (item == name)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//! Возвращает каталоги группы от самой группы до корня иерархии.
+//! Ограничение родителя действует и на потомков, поэтому проверяются все уровни.
+//! В контейнере без пространства имен cgroup путь группы - путь на машине, которого
+//! внутри контейнера может не быть; тогда проверяется только корень иерархии.
+//! @param mount - [in] каталог иерархии;
+//! @param path  - [in] путь группы в иерархии.
+static std::vector<std::string> GroupDirs(const std::string& mount, std::string path)
+{
+    std::vector<std::string> dirs;
+
+    while (!path.empty() && (path != "/"))
+    {
+        std::ifstream probe((mount + path + "/cgroup.procs").c_str());
+
+        if (probe.is_open())
+        {
+            dirs.push_back(mount + path);
+        }
+
+        path.erase(path.rfind('/'));
+    }
+
+    dirs.push_back(mount);
+
+    return dirs;
+}
+
+//! Ищет каталог иерархии cgroup v1 с контроллером: /sys/fs/cgroup/cpu,cpuacct или /sys/fs/cgroup/cpu.
+static std::string FindV1Mount(const std::string& root, const std::string& controllers,
+                               const std::string& name)
+{
+    const std::string candidates[] = { root + "/" + controllers, root + "/" + name };
+
+    for (size_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); ++i)
+    {
+        std::ifstream probe((candidates[i] + "/cgroup.procs").c_str());
+
+        if (probe.is_open())
+        {
+            return candidates[i];
+        }
+    }
+
+    return std::string();
+}
+
+//! Учитывает ограничения группы cgroup v2 (cpu.max, memory.max).
+static void ReadV2Limits(const std::vector<std::string>& dirs, ResourceLimits& limits)
+{
+    for (size_t i = 0; i < dirs.size(); ++i)
+    {
+        std::string line;
+
+        // cpu.max: "квота период" или "max период"
+        if (ReadFirstLine(dirs[i] + "/cpu.max", line))
+        {
+            std::istringstream stream(line);
+            std::string        quota;
+            double             period = 0;
+
+            if ((stream >> quota >> period) && (quota != "max") && (period > 0))
+            {
+                const double cpus = atof(quota.c_str()) / period;
+
+                limits.cpuQuota = (limits.cpuQuota > 0) ? std::min(limits.cpuQuota, cpus) : cpus;
+            }
+        }
+
+        if (ReadFirstLine(dirs[i] + "/memory.max", line) && (line != "max"))
+        {
+            const uint64_t memory = strtoull(line.c_str(), NULL, 10);
+
+            limits.memoryLimit = (limits.memoryLimit != 0) ? std::min(limits.memoryLimit, memory) : memory;
+        }
+    }
+}
+
+//! Учитывает ограничение процессора группы cgroup v1 (cpu.cfs_quota_us, -1 - нет).
+static void ReadV1CpuLimits(const std::vector<std::string>& dirs, ResourceLimits& limits)
+{
+    for (size_t i = 0; i < dirs.size(); ++i)
+    {
+        std::string quota;
+        std::string period;
+
+        if (!ReadFirstLine(dirs[i] + "/cpu.cfs_quota_us", quota) ||
+            !ReadFirstLine(dirs[i] + "/cpu.cfs_period_us", period))
+        {
+            continue;
+        }
+
+        const double quotaUs  = atof(quota.c_str());
+        const double periodUs = atof(period.c_str());
+
+        if ((quotaUs > 0) && (periodUs > 0))
+        {
+            const double cpus = quotaUs / periodUs;
+
+            limits.cpuQuota = (limits.cpuQuota > 0) ? std::min(limits.cpuQuota, cpus) : cpus;
+        }
+    }
+}
+
+//! Учитывает ограничение памяти группы cgroup v1 (memory.limit_in_bytes).
+//! Без ограничения там записано почти 2^63, поэтому значения не меньше памяти машины
+//! ограничением не считаются.
+static void ReadV1MemoryLimits(const std::vector<std::string>& dirs, ResourceLimits& limits)
+{
+    for (size_t i = 0; i < dirs.size(); ++i)
+    {
+        std::string line;
+
+        if (!ReadFirstLine(dirs[i] + "/memory.limit_in_bytes", line))
+        {
+            continue;
+        }
+
+        const uint64_t memory = strtoull(line.c_str(), NULL, 10);
+
+        if ((memory == 0) || ((limits.physicalMemory != 0) && (memory >= limits.physicalMemory)))
+        {
+            continue;
+        }
+
+        limits.memoryLimit = (limits.memoryLimit != 0) ? std::min(limits.memoryLimit, memory) : memory;
+    }
+}
+
+//! Определяет квоты cgroup процесса. Поддерживаются cgroup v1, v2 и смешанный режим:
+//! для каждого ресурса берется самое строгое ограничение из всех уровней группы.
+//! @param procCgroupPath - [in]     файл групп процесса (/proc/self/cgroup);
+//! @param cgroupRoot     - [in]     каталог иерархий (/sys/fs/cgroup);
+//! @param limits         - [in/out] ограничения; cpuQuota и memoryLimit уточняются,
+//!                                  physicalMemory должна быть уже заполнена.
+void DetectCgroupLimits(const std::string& procCgroupPath, const std::string& cgroupRoot,
+                        ResourceLimits& limits)
+{
+    std::vector<CgroupEntry> entries;
+    ReadProcCgroup(procCgroupPath, entries);
+
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        const CgroupEntry& entry = entries[i];
+
+        if (entry.controllers.empty())
+        {
+            // В смешанном режиме иерархия v2 смонтирована в unified
+            std::ifstream probe((cgroupRoot + "/cgroup.controllers").c_str());
+            const std::string mount = probe.is_open() ? cgroupRoot : cgroupRoot + "/unified";
+
+            ReadV2Limits(GroupDirs(mount, entry.path), limits);
+            continue;
+        }
+
+        if (HasController(entry.controllers, "cpu"))
+        {
+            const std::string mount = FindV1Mount(cgroupRoot, entry.controllers, "cpu");
+
+            if (!mount.empty())
+            {
+                ReadV1CpuLimits(GroupDirs(mount, entry.path), limits);
+            }
+        }
+
+        if (HasController(entry.controllers, "memory"))
+        {
+            const std::string mount = FindV1Mount(cgroupRoot, entry.controllers, "memory");
+
+            if (!mount.empty())
+            {
+                ReadV1MemoryLimits(GroupDirs(mount, entry.path), limits);
+            }
+        }
+    }
+}
+
+//! Определяет ограничения ресурсов процесса.
+//! @param limits    - [out] ограничения;
+//! @param cpuFilter - [in]  процессоры, которыми ограничивается работа (пустой - все доступные).
+//! @return true - успех, false - если не осталось ни одного доступного процессора.
+bool DetectResourceLimits(ResourceLimits& limits, const CCpuList& cpuFilter)
+{
+    limits = ResourceLimits();
+
+    CNumaTopology topology;
+
+    if (!topology.Detect(cpuFilter))
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < topology.Nodes().size(); ++i)
+    {
+        limits.allowedCpus += topology.Nodes()[i].cpus.size();
+    }
+
+#ifdef _WIN32
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+
+    if (GlobalMemoryStatusEx(&status))
+    {
+        limits.physicalMemory = status.ullTotalPhys;
+    }
+#else
+    const long pages    = sysconf(_SC_PHYS_PAGES);
+    const long pageSize = sysconf(_SC_PAGESIZE);
+
+    if ((pages > 0) && (pageSize > 0))
+    {
+        limits.physicalMemory = static_cast<uint64_t>(pages) * static_cast<uint64_t>(pageSize);
+    }
+
+    DetectCgroupLimits(PROC_CGROUP_PATH, CGROUP_ROOT, limits);
+#endif
+
+    return limits.allowedCpus != 0;
+}
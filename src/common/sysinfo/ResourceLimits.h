@@ -0,0 +1,33 @@
+//! @file sysinfo/ResourceLimits.h
+//! Объявление функций определения ограничений ресурсов процесса
+
+#ifndef _RESOURCE_LIMITS_H
+#define _RESOURCE_LIMITS_H
+
+#include "../numa/NumaTopology.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+//! Ограничения процессора и памяти, в которых работает процесс.
+//! В контейнере кол-во процессоров машины (hardware_concurrency) и ее память
+//! не отражают доступного процессу: его ограничивают квоты cgroup.
+struct ResourceLimits
+{
+    ResourceLimits() : allowedCpus(0), cpuQuota(0), memoryLimit(0), physicalMemory(0) {}
+
+    size_t   EffectiveCpus() const;
+    uint64_t EffectiveMemory() const;
+
+    size_t   allowedCpus;       //!< Процессоры, на которых процессу разрешено выполняться
+    double   cpuQuota;          //!< Квота cgroup в процессорах (quota / period), 0 - нет
+    uint64_t memoryLimit;       //!< Ограничение памяти cgroup, 0 - нет
+    uint64_t physicalMemory;    //!< Память машины, 0 - неизвестна
+};
+
+bool DetectResourceLimits(ResourceLimits& limits, const CCpuList& cpuFilter = CCpuList());
+void DetectCgroupLimits(const std::string& procCgroupPath, const std::string& cgroupRoot,
+                        ResourceLimits& limits);
+
+#endif // _RESOURCE_LIMITS_H
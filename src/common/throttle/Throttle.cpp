@@ -0,0 +1,160 @@
+//! @file throttle/Throttle.cpp
+//! Ограничение скорости чтения и доли процессора, понижение приоритетов процесса
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "Throttle.h"
+
+#include "../stats/LatencyHistogram.h"
+
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+//! Кол-во наносекунд в секунде
+const double   NS_IN_SECOND              = 1e9;
+//! Наименьшая длительность сна ограничения доли процессора
+const int64_t  CPU_THROTTLE_MIN_SLEEP_NS = 2 * 1000 * 1000;
+
+#ifdef __linux__
+//! Значения ioprio_set(2), заголовка с ними в glibc нет
+const int IOPRIO_WHO_PROCESS = 1;
+const int IOPRIO_CLASS_IDLE  = 3;
+const int IOPRIO_CLASS_SHIFT = 13;
+#endif
+
+//! Спит заданное время. Сон - точка прерывания потока boost.
+//! @param ns - [in] длительность сна.
+//! @return фактическая длительность сна.
+static uint64_t SleepNs(uint64_t ns)
+{
+    const uint64_t startNs = GetMonotonicNs();
+
+    boost::this_thread::sleep(boost::posix_time::microseconds(static_cast<int64_t>(ns / 1000)));
+
+    return GetMonotonicNs() - startNs;
+}
+
+//! Конструктор. Скорость не ограничена.
+CTokenBucket::CTokenBucket() : m_rate(0), m_burst(0), m_tokens(0), m_lastNs(0)
+{
+}
+
+//! Задает скорость. Корзина заполняется до размера всплеска.
+//! @param bytesPerSec - [in] скорость, 0 - без ограничения;
+//! @param burstBytes  - [in] размер всплеска.
+void CTokenBucket::SetRate(uint64_t bytesPerSec, uint64_t burstBytes)
+{
+    boost::mutex::scoped_lock lock(m_mutex);
+
+    m_rate   = bytesPerSec;
+    m_burst  = burstBytes;
+    m_tokens = static_cast<double>(burstBytes);
+    m_lastNs = GetMonotonicNs();
+}
+
+//! Берет жетоны на заданное кол-во байтов, при нехватке ждет.
+//! @param bytes - [in] кол-во байтов.
+//! @return время ожидания в наносекундах, 0 - жетонов хватило.
+uint64_t CTokenBucket::Consume(uint64_t bytes)
+{
+    uint64_t waitNs = 0;
+
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+
+        if (m_rate == 0)
+        {
+            return 0;
+        }
+
+        const uint64_t nowNs = GetMonotonicNs();
+
+        m_tokens = std::min(static_cast<double>(m_burst),
+                            m_tokens + (nowNs - m_lastNs) * static_cast<double>(m_rate) / NS_IN_SECOND);
+        m_lastNs = nowNs;
+
+        m_tokens -= static_cast<double>(bytes);
+
+        if (m_tokens < 0)
+        {
+            waitNs = static_cast<uint64_t>(-m_tokens * NS_IN_SECOND / m_rate);
+        }
+    }
+
+    // Долг уже учтен, поэтому другие потоки ждут своей очереди и без блокировки
+    return (waitNs != 0) ? SleepNs(waitNs) : 0;
+}
+
+//! Конструктор.
+//! @param sharePercent - [in] доля процессора в процентах (1-100), 100 - без ограничения.
+CCpuThrottle::CCpuThrottle(unsigned sharePercent) :
+    m_share(std::max(1u, std::min(sharePercent, 100u))), m_debtNs(0)
+{
+}
+
+//! Учитывает время работы и, если накопилось достаточно, засыпает.
+//! @param busyNs - [in] время работы потока.
+//! @return время сна в наносекундах, 0 - поток не спал.
+uint64_t CCpuThrottle::AddBusy(uint64_t busyNs)
+{
+    if (m_share >= 100)
+    {
+        return 0;
+    }
+
+    m_debtNs += static_cast<int64_t>(busyNs * (100 - m_share) / m_share);
+
+    if (m_debtNs < CPU_THROTTLE_MIN_SLEEP_NS)
+    {
+        return 0;
+    }
+
+    const uint64_t sleptNs = SleepNs(static_cast<uint64_t>(m_debtNs));
+
+    // Переспанное засчитывается следующим снам, но не больше одного короткого сна
+    m_debtNs = std::max(m_debtNs - static_cast<int64_t>(sleptNs), -CPU_THROTTLE_MIN_SLEEP_NS);
+
+    return sleptNs;
+}
+
+//! Переводит ввод-вывод процесса в класс idle: диск получает процесс, только когда
+//! его не используют другие. Потоки, созданные после вызова, наследуют класс.
+//! @return true - успех, false - ошибка или ОС не поддерживает классы ввода-вывода.
+bool SetIdleIoPriority()
+{
+#ifdef __linux__
+    return syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) == 0;
+#else
+    return false;
+#endif
+}
+
+//! Переводит процесс в самый низкий приоритет планировщика (SCHED_IDLE, в Windows -
+//! IDLE_PRIORITY_CLASS). Потоки, созданные после вызова, наследуют приоритет.
+//! @return true - успех, false - в случае ошибки.
+bool SetIdleCpuPriority()
+{
+#ifdef _WIN32
+    return SetPriorityClass(GetCurrentProcess(), IDLE_PRIORITY_CLASS) != 0;
+#elif defined(SCHED_IDLE)
+    sched_param param = { 0 };
+
+    return sched_setscheduler(0, SCHED_IDLE, &param) == 0;
+#else
+    return false;
+#endif
+}
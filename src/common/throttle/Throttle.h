@@ -0,0 +1,63 @@
+//! @file throttle/Throttle.h
+//! Ограничение скорости чтения и доли процессора, понижение приоритетов процесса
+
+#ifndef _THROTTLE_H
+#define _THROTTLE_H
+
+#include <boost/thread/mutex.hpp>
+
+#include <stddef.h>
+#include <stdint.h>
+
+//! Ограничение скорости ("корзина жетонов"): жетоны-байты поступают с заданной
+//! скоростью и накапливаются не больше чем до размера всплеска. Если жетонов не
+//! хватает, Consume() берет их в долг и ждет, пока долг не будет погашен, поэтому
+//! запросы больше всплеска тоже допустимы. Объект могут одновременно использовать
+//! несколько потоков: общая скорость не превышает заданную.
+class CTokenBucket
+{
+public:
+    CTokenBucket();
+
+    void SetRate(uint64_t bytesPerSec, uint64_t burstBytes);
+
+    //! Возвращает true, если скорость ограничена.
+    bool IsEnabled() const
+    {
+        return m_rate != 0;
+    }
+
+    uint64_t Consume(uint64_t bytes);
+
+private:
+    CTokenBucket(const CTokenBucket&);
+    CTokenBucket& operator=(const CTokenBucket&);
+
+private:
+    boost::mutex m_mutex;
+    uint64_t     m_rate;      //!< Байтов в секунду, 0 - без ограничения
+    uint64_t     m_burst;
+    double       m_tokens;    //!< Доступно байтов, отрицательное - долг
+    uint64_t     m_lastNs;    //!< Время последнего пополнения
+};
+
+//! Ограничение доли процессора одного потока: после работы поток засыпает так,
+//! чтобы работа занимала не больше заданной доли времени. Короткие сны копятся
+//! и выполняются одним, не короче CPU_THROTTLE_MIN_SLEEP_NS, чтобы точность
+//! таймера ОС не искажала долю. Объект принадлежит одному потоку.
+class CCpuThrottle
+{
+public:
+    explicit CCpuThrottle(unsigned sharePercent);
+
+    uint64_t AddBusy(uint64_t busyNs);
+
+private:
+    unsigned m_share;     //!< Доля в процентах, 100 - без ограничения
+    int64_t  m_debtNs;    //!< Недоспанное время, отрицательное - переспанное
+};
+
+bool SetIdleIoPriority();
+bool SetIdleCpuPriority();
+
+#endif // _THROTTLE_H
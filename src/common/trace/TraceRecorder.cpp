@@ -0,0 +1,140 @@
+//! @file TraceRecorder.cpp
+//! Реализация класса CTraceRecorder
+
+#include "TraceRecorder.h"
+
+#include "../stats/LatencyHistogram.h"
+
+#include <iomanip>
+
+//! Конструктор.
+CTraceRecorder::CTraceRecorder() :
+    m_isEnabled(false), m_maxEventsPerThread(0), m_startNs(0), m_pThreadBuffer(&NoCleanup)
+{
+}
+
+//! Буферы потоков принадлежат CTraceRecorder, при завершении потока не удаляются.
+void CTraceRecorder::NoCleanup(ThreadBuffer*)
+{
+}
+
+//! Включает запись. Вызывается до запуска потоков, события которых записываются.
+//! @param maxEventsPerThread - [in] емкость буфера каждого потока, лишние события отбрасываются.
+void CTraceRecorder::Enable(size_t maxEventsPerThread)
+{
+    m_maxEventsPerThread = maxEventsPerThread;
+    m_startNs            = GetMonotonicNs();
+    m_isEnabled          = true;
+}
+
+//! Возвращает буфер текущего потока, при первом обращении создает его.
+CTraceRecorder::ThreadBuffer& CTraceRecorder::GetThreadBuffer()
+{
+    ThreadBuffer* pBuffer = m_pThreadBuffer.get();
+
+    if (!pBuffer)
+    {
+        boost::shared_ptr<ThreadBuffer> pNew(new ThreadBuffer());
+        pNew->events.resize(m_maxEventsPerThread);
+
+        boost::unique_lock<boost::mutex> lock(m_lockBuffers);
+
+        pNew->tid = m_buffers.size() + 1;
+        m_buffers.push_back(pNew);
+
+        lock.unlock();
+
+        pBuffer = pNew.get();
+        m_pThreadBuffer.reset(pBuffer);
+    }
+
+    return *pBuffer;
+}
+
+//! Задает имя текущего потока, под которым его события показываются в трассе.
+//! @param name - [in] имя потока.
+void CTraceRecorder::SetThreadName(const std::string& name)
+{
+    if (m_isEnabled)
+    {
+        GetThreadBuffer().name = name;
+    }
+}
+
+//! Добавляет событие в буфер текущего потока.
+void CTraceRecorder::Add(char phase, const char* name, uint64_t timeNs, uint64_t durationNs,
+                         uint64_t blockNum)
+{
+    ThreadBuffer& buffer = GetThreadBuffer();
+
+    if (buffer.size == buffer.events.size())
+    {
+        ++buffer.dropped;
+        return;
+    }
+
+    Event& event     = buffer.events[buffer.size++];
+    event.name       = name;
+    event.timeNs     = timeNs;
+    event.durationNs = durationNs;
+    event.blockNum   = blockNum;
+    event.phase      = phase;
+}
+
+//! Выводит записанные события в формате Trace Event JSON.
+//! Вызывается после завершения потоков, события которых записывались.
+//! @param out - [in] поток вывода.
+//! @return true - успех, false - если запись не включена или произошла ошибка вывода.
+bool CTraceRecorder::WriteJson(std::ostream& out) const
+{
+    if (!m_isEnabled)
+    {
+        return false;
+    }
+
+    boost::unique_lock<boost::mutex> lock(m_lockBuffers);
+
+    out << std::fixed << std::setprecision(3) << "{\"traceEvents\":[" << std::endl;
+
+    bool   isFirst = true;
+    size_t dropped = 0;
+
+    for (size_t i = 0; i < m_buffers.size(); ++i)
+    {
+        const ThreadBuffer& buffer = *m_buffers[i];
+
+        out << (isFirst ? "" : ",\n")
+            << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << buffer.tid
+            << ",\"args\":{\"name\":\"" << buffer.name << "\"}}";
+
+        isFirst  = false;
+        dropped += buffer.dropped;
+
+        for (size_t j = 0; j < buffer.size; ++j)
+        {
+            const Event& event = buffer.events[j];
+
+            // Время в формате Trace Event - в микросекундах
+            out << ",\n{\"ph\":\"" << event.phase << "\",\"name\":\"" << event.name
+                << "\",\"cat\":\"pipeline\",\"pid\":1,\"tid\":" << buffer.tid
+                << ",\"ts\":" << (event.timeNs - m_startNs) / 1000.0;
+
+            switch (event.phase)
+            {
+            case 'X':
+                out << ",\"dur\":" << event.durationNs / 1000.0
+                    << ",\"args\":{\"block\":" << event.blockNum << "}}";
+                break;
+
+            default:
+                out << ",\"id\":" << event.blockNum << ",\"bp\":\"e\"}";
+                break;
+            }
+        }
+    }
+
+    out << "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped_events\":" << dropped
+        << "}}" << std::endl;
+
+    return out.good();
+}
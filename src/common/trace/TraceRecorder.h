@@ -0,0 +1,125 @@
+//! @file trace/TraceRecorder.h
+//! Объявление класса CTraceRecorder
+
+#ifndef _TRACE_RECORDER_H
+#define _TRACE_RECORDER_H
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+
+#include <ostream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//! Запись событий для просмотра в chrome://tracing или Perfetto (формат Trace Event JSON).
+//! Каждый поток пишет в собственный буфер фиксированного размера без блокировок;
+//! блокировка берется только при первом обращении потока, чтобы зарегистрировать буфер.
+//! Пока запись не включена, методы записи сводятся к проверке флага.
+class CTraceRecorder
+{
+public:
+    CTraceRecorder();
+
+    void Enable(size_t maxEventsPerThread);
+
+    //! Возвращает true, если запись включена.
+    bool IsEnabled() const
+    {
+        return m_isEnabled;
+    }
+
+    void SetThreadName(const std::string& name);
+
+    //! Записывает этап обработки блока.
+    //! @param name     - [in] название этапа (строковая константа);
+    //! @param startNs  - [in] начало этапа (GetMonotonicNs());
+    //! @param endNs    - [in] окончание этапа;
+    //! @param blockNum - [in] номер блока.
+    void Complete(const char* name, uint64_t startNs, uint64_t endNs, uint64_t blockNum)
+    {
+        if (m_isEnabled)
+        {
+            Add('X', name, startNs, endNs - startNs, blockNum);
+        }
+    }
+
+    //! Начинает связь событий одного блока в разных потоках (стрелка в просмотрщике).
+    //! Связь продолжается FlowStep() и завершается FlowEnd() с тем же номером блока;
+    //! каждая точка привязывается к этапу потока, внутри которого лежит ее время.
+    void FlowStart(uint64_t timeNs, uint64_t blockNum)
+    {
+        if (m_isEnabled)
+        {
+            Add('s', "block", timeNs, 0, blockNum);
+        }
+    }
+
+    //! Продолжает связь событий блока.
+    void FlowStep(uint64_t timeNs, uint64_t blockNum)
+    {
+        if (m_isEnabled)
+        {
+            Add('t', "block", timeNs, 0, blockNum);
+        }
+    }
+
+    //! Завершает связь событий блока.
+    void FlowEnd(uint64_t timeNs, uint64_t blockNum)
+    {
+        if (m_isEnabled)
+        {
+            Add('f', "block", timeNs, 0, blockNum);
+        }
+    }
+
+    bool WriteJson(std::ostream& out) const;
+
+private:
+    //! Событие.
+    struct Event
+    {
+        const char* name;       //!< Название (строковая константа)
+        uint64_t    timeNs;     //!< Начало
+        uint64_t    durationNs; //!< Длительность, для событий типа 'X'
+        uint64_t    blockNum;   //!< Номер блока, он же идентификатор связи событий
+        char        phase;      //!< Тип события Trace Event: 'X', 's', 't', 'f'
+    };
+
+    //! Буфер событий одного потока.
+    struct ThreadBuffer
+    {
+        ThreadBuffer() : tid(0), size(0), dropped(0) {}
+
+        std::string        name;
+        size_t             tid;
+        std::vector<Event> events;
+        size_t             size;
+        size_t             dropped;     //!< Событий, не поместившихся в буфер
+    };
+
+    typedef std::vector< boost::shared_ptr<ThreadBuffer> > CBuffers;
+
+private:
+    CTraceRecorder(const CTraceRecorder&);
+    CTraceRecorder& operator=(const CTraceRecorder&);
+
+    ThreadBuffer& GetThreadBuffer();
+    void          Add(char phase, const char* name, uint64_t timeNs, uint64_t durationNs,
+                      uint64_t blockNum);
+
+    static void NoCleanup(ThreadBuffer*);
+
+private:
+    bool                                     m_isEnabled;
+    size_t                                   m_maxEventsPerThread;
+    uint64_t                                 m_startNs;     //!< Начало отсчета времени событий
+
+    boost::thread_specific_ptr<ThreadBuffer> m_pThreadBuffer;
+
+    mutable boost::mutex                     m_lockBuffers;
+    CBuffers                                 m_buffers;
+};
+
+#endif // _TRACE_RECORDER_H
@@ -0,0 +1,62 @@
+//! @file util/ParseSize.cpp
+//! Разбор размеров с суффиксами K, M, G, T, P
+
+#include "ParseSize.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+//! Разбирает размер с необязательным суффиксом K, M, G, T или P (например 512M).
+//! Каждый суффикс умножает значение на 1024 относительно предыдущего.
+//! @param str     - [in]  строка с размером
+//! @param maxSize - [in]  наибольший допустимый размер
+//! @param size    - [out] размер в байтах
+//! @return true - успех, false - в случае ошибки или если размер больше maxSize.
+bool ParseSizeValue(const std::string& str, uint64_t maxSize, uint64_t& size)
+{
+    static const char SUFFIXES[] = "KMGTP";
+
+    if (str.empty() || !isdigit(static_cast<unsigned char>(str[0])))
+    {
+        return false;
+    }
+
+    char* pEnd = NULL;
+
+    errno = 0;
+    const unsigned long long value = strtoull(str.c_str(), &pEnd, 10);
+
+    if (errno == ERANGE)
+    {
+        return false;
+    }
+
+    uint64_t multiplier = 1;
+
+    if (*pEnd != '\0')
+    {
+        const char* pSuffix = strchr(SUFFIXES, toupper(static_cast<unsigned char>(*pEnd)));
+
+        if (!pSuffix)
+        {
+            return false;
+        }
+
+        for (const char* p = SUFFIXES; p <= pSuffix; ++p)
+        {
+            multiplier *= 1024;
+        }
+
+        ++pEnd;
+    }
+
+    if ((*pEnd != '\0') || (value > maxSize / multiplier))
+    {
+        return false;
+    }
+
+    size = static_cast<uint64_t>(value) * multiplier;
+    return true;
+}
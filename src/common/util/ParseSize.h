@@ -0,0 +1,31 @@
+//! @file util/ParseSize.h
+//! Объявление функций разбора размеров с суффиксами K, M, G, T, P
+
+#ifndef _PARSE_SIZE_H
+#define _PARSE_SIZE_H
+
+#include <limits>
+#include <stdint.h>
+#include <string>
+
+bool ParseSizeValue(const std::string& str, uint64_t maxSize, uint64_t& size);
+
+//! Разбирает размер с необязательным суффиксом K, M, G, T или P (например 512M).
+//! @param str  - [in]  строка с размером
+//! @param size - [out] размер в байтах
+//! @return true - успех, false - в случае ошибки или если размер не помещается в T.
+template <typename T>
+bool ParseSize(const std::string& str, T& size)
+{
+    uint64_t value = 0;
+
+    if (!ParseSizeValue(str, std::numeric_limits<T>::max(), value))
+    {
+        return false;
+    }
+
+    size = static_cast<T>(value);
+    return true;
+}
+
+#endif // _PARSE_SIZE_H
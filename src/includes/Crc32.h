@@ -1,24 +1,114 @@
 #ifndef CRC32_H
 #define CRC32_H
 
+#include <stddef.h>
 #include <stdint.h>
 
-#include <boost/crc.hpp>
+#include <boost/static_assert.hpp>
 
-//! Рассчитывает CRC32.
+//! Таблицы рассчета CRC32 (полином 0x04C11DB7, без отражения) по 8 байтов за шаг
+//! (slicing-by-8): table[k][b] - вклад байта b, за которым следуют k байтов.
+struct Crc32Tables
+{
+    Crc32Tables()
+    {
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t crc = i << 24;
+
+            for (int bit = 0; bit < 8; ++bit)
+            {
+                crc = (crc & 0x80000000) ? ((crc << 1) ^ 0x04C11DB7) : (crc << 1);
+            }
+
+            table[0][i] = crc;
+        }
+
+        for (size_t k = 1; k < 8; ++k)
+        {
+            for (size_t i = 0; i < 256; ++i)
+            {
+                table[k][i] = (table[k - 1][i] << 8) ^ table[0][table[k - 1][i] >> 24];
+            }
+        }
+    }
+
+    uint32_t table[8][256];
+};
+
+//! Возвращает таблицы CRC32, рассчитываемые при первом обращении.
+inline const Crc32Tables& GetCrc32Tables()
+{
+    static const Crc32Tables s_tables;
+
+    return s_tables;
+}
+
+//! Продолжает рассчет CRC32 по 8 байтов за шаг.
+//! @param crc      - [in] текущее значение;
+//! @param buff     - [in] буфер;
+//! @param numWords - [in] кол-во 8-байтовых слов.
+//! @return новое значение.
+inline uint32_t UpdateCrc32Words(uint32_t crc, const uint8_t* buff, size_t numWords)
+{
+    const Crc32Tables& tables = GetCrc32Tables();
+
+    for (size_t i = 0; i < numWords; ++i, buff += 8)
+    {
+        const uint32_t high = crc ^ ((static_cast<uint32_t>(buff[0]) << 24) | (static_cast<uint32_t>(buff[1]) << 16) |
+                                     (static_cast<uint32_t>(buff[2]) << 8)  |  static_cast<uint32_t>(buff[3]));
+        const uint32_t low  =        (static_cast<uint32_t>(buff[4]) << 24) | (static_cast<uint32_t>(buff[5]) << 16) |
+                                     (static_cast<uint32_t>(buff[6]) << 8)  |  static_cast<uint32_t>(buff[7]);
+
+        crc = tables.table[7][high >> 24] ^ tables.table[6][(high >> 16) & 0xFF] ^
+              tables.table[5][(high >> 8) & 0xFF] ^ tables.table[4][high & 0xFF] ^
+              tables.table[3][low >> 24] ^ tables.table[2][(low >> 16) & 0xFF] ^
+              tables.table[1][(low >> 8) & 0xFF] ^ tables.table[0][low & 0xFF];
+    }
+
+    return crc;
+}
+
+//! Продолжает рассчет CRC32 по буферу любого размера: данные можно подавать частями,
+//! результат не зависит от разбиения. Начальное значение - 0xFFFFFFFF, итоговое
+//! нужно инвертировать.
+//! @param crc  - [in] текущее значение;
 //! @param buff - [in] буфер;
 //! @param size - [in] размер буфера, в байтах.
-//! @return CRC32.
-inline uint32_t CalcCrc32(const uint8_t* buff, uint32_t size)
+//! @return новое значение.
+inline uint32_t UpdateCrc32(uint32_t crc, const uint8_t* buff, size_t size)
 {
-    boost::crc_optimal<32, 0x04C11DB7, 0xFFFFFFFF, 0xFFFFFFFF, false, false> crcCalculator;
+    const Crc32Tables& tables = GetCrc32Tables();
+
+    crc = UpdateCrc32Words(crc, buff, size / 8);
 
-    for (size_t i = 0; i < size; ++i)
+    for (size_t i = size - size % 8; i < size; ++i)
     {
-        crcCalculator.process_byte(buff[i]);
+        crc = (crc << 8) ^ tables.table[0][(crc >> 24) ^ buff[i]];
     }
 
-    return crcCalculator.checksum();
+    return crc;
+}
+
+//! Рассчитывает CRC32.
+//! @param buff - [in] буфер;
+//! @param size - [in] размер буфера, в байтах.
+//! @return CRC32.
+inline uint32_t CalcCrc32(const uint8_t* buff, size_t size)
+{
+    return UpdateCrc32(0xFFFFFFFF, buff, size) ^ 0xFFFFFFFF;
+}
+
+//! Рассчитывает CRC32 блока, размер которого известен при компиляции:
+//! кол-во шагов постоянно, обработки остатка нет.
+//! @param buff - [in] буфер размером BlockSize байтов.
+//! @return CRC32.
+template <size_t BlockSize>
+inline uint32_t CalcCrc32Fixed(const uint8_t* buff)
+{
+    BOOST_STATIC_ASSERT(BlockSize % 8 == 0);
+
+    return UpdateCrc32Words(0xFFFFFFFF, buff, BlockSize / 8) ^ 0xFFFFFFFF;
 }
 
 ////! Рассчитывает CRC32.
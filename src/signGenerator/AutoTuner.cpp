@@ -0,0 +1,244 @@
+//! @file AutoTuner.cpp
+//! Реализация класса CAutoTuner
+
+#include "AutoTuner.h"
+
+#include "../common/io/FileIo.h"
+#include "../common/stats/LatencyHistogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+//! Время замера скорости рассчета дайджестов
+const uint64_t HASH_CALIBRATION_NS         = 50 * 1000 * 1000;
+//! Объем чтения файла на замер одного размера чтения
+const uint64_t READ_CALIBRATION_BYTES      = 16 * 1024 * 1024;
+//! Размеры чтения, из которых выбирается лучший
+const size_t   IO_SIZE_CANDIDATES[]        = { 64 * 1024, 256 * 1024, 1024 * 1024, 4 * 1024 * 1024 };
+//! Выбирается наименьший размер чтения, скорость которого не ниже этой доли лучшей
+const double   IO_SIZE_RATE_SHARE          = 0.9;
+//! Запас производительности потоков рассчета относительно скорости чтения
+const double   HASH_HEADROOM               = 1.25;
+//! Под буферы чтения отводится не больше этой части доступной процессу памяти
+const uint64_t MEMORY_SHARE_DIVISOR        = 4;
+//! Наибольшая глубина очереди на поток рассчета
+const size_t   MAX_QUEUE_BLOCKS_PER_THREAD = 8;
+
+//! Конструктор.
+CAutoTuner::CAutoTuner() : m_digests(1, DIGEST_CRC32), m_memoryLimit(0)
+{
+}
+
+//! Задает дайджесты, скорость рассчета которых замеряется.
+void CAutoTuner::SetDigests(const CDigestList& digests)
+{
+    m_digests = digests;
+}
+
+//! Задает процессоры, которыми ограничена работа (пустой - все доступные).
+void CAutoTuner::SetCpuSet(const CCpuList& cpus)
+{
+    m_cpus = cpus;
+}
+
+//! Задает ограничение памяти под буферы чтения.
+//! @param memoryLimit - [in] ограничение в байтах, 0 - выбрать по доступной памяти.
+void CAutoTuner::SetMemoryLimit(size_t memoryLimit)
+{
+    m_memoryLimit = memoryLimit;
+}
+
+//! Замеряет скорость рассчета всех дайджестов блока одним потоком.
+//! @param blockSize - [in] размер блока.
+//! @return скорость, байт/с.
+double CAutoTuner::CalibrateHash(size_t blockSize) const
+{
+    std::vector<uint8_t> block(blockSize);
+
+    for (size_t i = 0; i < block.size(); ++i)
+    {
+        block[i] = static_cast<uint8_t>(i * 131 + (i >> 11));
+    }
+
+    uint8_t        digest[MAX_DIGEST_SIZE];
+    uint64_t       bytes   = 0;
+    const uint64_t startNs = GetMonotonicNs();
+    uint64_t       endNs   = startNs;
+
+    // Хотя бы один блок, даже если он рассчитывается дольше времени замера
+    do
+    {
+        for (size_t i = 0; i < m_digests.size(); ++i)
+        {
+            CalcDigest(m_digests[i], &block[0], block.size(), digest);
+        }
+
+        bytes += block.size();
+        endNs  = GetMonotonicNs();
+    }
+    while (endNs - startNs < HASH_CALIBRATION_NS);
+
+    return bytes * 1e9 / std::max<uint64_t>(endNs - startNs, 1);
+}
+
+//! Замеряет скорость чтения файла для нескольких размеров чтения не меньше блока.
+//! Каждый размер читает свой участок файла, участки разнесены по файлу, поэтому
+//! замеры не читают данные, закешированные предыдущими.
+//! @param fd        - [in]  дескриптор файла;
+//! @param blockSize - [in]  размер блока;
+//! @param ioSize    - [out] наименьший размер чтения с почти лучшей скоростью.
+//! @return лучшая скорость, байт/с; 0 - файл слишком мал или не читается.
+double CAutoTuner::CalibrateRead(int fd, size_t blockSize, size_t& ioSize) const
+{
+    ioSize = blockSize;
+
+    uint64_t fileSize = 0;
+
+    if (!GetRegularFileSize(fd, fileSize))
+    {
+        return 0;
+    }
+
+    std::vector<size_t> sizes;
+
+    for (size_t i = 0; i < sizeof(IO_SIZE_CANDIDATES) / sizeof(IO_SIZE_CANDIDATES[0]); ++i)
+    {
+        if (IO_SIZE_CANDIDATES[i] >= blockSize)
+        {
+            sizes.push_back(IO_SIZE_CANDIDATES[i]);
+        }
+    }
+
+    if (sizes.empty())
+    {
+        sizes.push_back(blockSize);
+    }
+
+    const uint64_t regionSize = std::min(READ_CALIBRATION_BYTES, fileSize / sizes.size());
+
+    std::vector<uint8_t> buffer(sizes.back());
+    std::vector<double>  rates(sizes.size(), 0);
+
+    for (size_t i = 0; i < sizes.size(); ++i)
+    {
+        const uint64_t size = regionSize - regionSize % sizes[i];
+
+        // Одно чтение скорость не показывает
+        if (size < 2 * static_cast<uint64_t>(sizes[i]))
+        {
+            continue;
+        }
+
+        const uint64_t offset  = fileSize / sizes.size() * i;
+        const uint64_t startNs = GetMonotonicNs();
+
+        for (uint64_t pos = 0; pos < size; pos += sizes[i])
+        {
+            if (!ReadFileAt(fd, &buffer[0], sizes[i], offset + pos))
+            {
+                return 0;
+            }
+        }
+
+        rates[i] = size * 1e9 / std::max<uint64_t>(GetMonotonicNs() - startNs, 1);
+    }
+
+    const double bestRate = *std::max_element(rates.begin(), rates.end());
+
+    for (size_t i = 0; i < sizes.size(); ++i)
+    {
+        if ((bestRate > 0) && (rates[i] >= bestRate * IO_SIZE_RATE_SHARE))
+        {
+            ioSize = sizes[i];
+            break;
+        }
+    }
+
+    return bestRate;
+}
+
+//! Выбирает параметры конвейера.
+//! @param fd        - [in]  дескриптор входного файла для замера чтения, -1 - не замерять
+//!                          (данные не из обычного файла или распаковываются);
+//! @param blockSize - [in]  размер блока;
+//! @param result    - [out] параметры и замеры.
+//! @return true - успех, false - не осталось ни одного доступного процессора.
+bool CAutoTuner::Tune(int fd, size_t blockSize, TuneResult& result) const
+{
+    result = TuneResult();
+
+    if (!DetectResourceLimits(result.limits, m_cpus))
+    {
+        return false;
+    }
+
+    const size_t cpus = result.limits.EffectiveCpus();
+
+    result.hashRate = CalibrateHash(blockSize);
+    result.ioSize   = blockSize;
+
+    if (fd >= 0)
+    {
+        result.readRate = CalibrateRead(fd, blockSize, result.ioSize);
+    }
+
+    // Потоков больше, чем нужно, чтобы успевать за чтением, - лишние переключения
+    result.threads = cpus;
+
+    if (result.readRate > 0)
+    {
+        const double needed = std::ceil(result.readRate * HASH_HEADROOM / result.hashRate);
+
+        result.threads = std::max<size_t>(1, std::min(cpus, static_cast<size_t>(needed)));
+    }
+
+    // Очередь до MAX_QUEUE_BLOCKS_PER_THREAD блоков на поток, но не больше доли памяти
+    const size_t   busyBlocks = result.threads + 1;
+    const uint64_t wanted     = static_cast<uint64_t>(result.threads * MAX_QUEUE_BLOCKS_PER_THREAD +
+                                                      busyBlocks) * blockSize;
+    const uint64_t available  = result.limits.EffectiveMemory() / MEMORY_SHARE_DIVISOR;
+
+    uint64_t memoryLimit = (m_memoryLimit != 0) ? m_memoryLimit : wanted;
+
+    // Выбранное самостоятельно ограничение не меньше двух блоков, без которых
+    // CSignatureGenerator::Init() не запустит конвейер; заданное - как есть
+    if ((m_memoryLimit == 0) && (available != 0))
+    {
+        memoryLimit = std::max<uint64_t>(std::min(memoryLimit, available), 2 * blockSize);
+    }
+
+    result.memoryLimit = static_cast<size_t>(memoryLimit);
+
+    // Так же пул и очередь рассчитывает CSignatureGenerator::CalcQueueLimits()
+    const size_t poolCapacity = std::max<size_t>(result.memoryLimit / blockSize, 2);
+
+    result.queueDepth    = (poolCapacity > busyBlocks) ? (poolCapacity - busyBlocks) : 1;
+    result.reorderWindow = poolCapacity;
+
+    return true;
+}
+
+//! Выводит выбранные параметры и замеры одной строкой.
+//! @param out - [in] поток вывода.
+void TuneResult::Write(std::ostream& out) const
+{
+    const double BYTES_IN_MEGABYTE = 1024.0 * 1024.0;
+
+    out << "Auto-tune: CPUs " << limits.EffectiveCpus() << " (allowed " << limits.allowedCpus;
+
+    if (limits.cpuQuota > 0)
+    {
+        out << ", cgroup quota " << limits.cpuQuota;
+    }
+
+    out << "), memory " << static_cast<uint64_t>(limits.EffectiveMemory() / BYTES_IN_MEGABYTE) << " MB"
+        << (limits.memoryLimit != 0 ? " (cgroup)" : "")
+        << ", read " << static_cast<uint64_t>(readRate / BYTES_IN_MEGABYTE) << " MB/s"
+        << ", hash " << static_cast<uint64_t>(hashRate / BYTES_IN_MEGABYTE) << " MB/s per thread"
+        << ", threads " << threads
+        << ", buffers " << memoryLimit / 1024 << " KB"
+        << ", queue depth " << queueDepth
+        << ", reorder window " << reorderWindow
+        << ", I/O size " << ioSize / 1024 << " KB" << std::endl;
+}
@@ -0,0 +1,62 @@
+//! @file AutoTuner.h
+//! Объявление класса CAutoTuner
+
+#ifndef _AUTO_TUNER_H
+#define _AUTO_TUNER_H
+
+#include "../common/hash/Digest.h"
+#include "../common/numa/NumaTopology.h"
+#include "../common/sysinfo/ResourceLimits.h"
+
+#include <ostream>
+#include <stddef.h>
+#include <stdint.h>
+
+//! Параметры конвейера CSignatureGenerator, выбранные CAutoTuner, и замеры, по которым
+//! они выбраны.
+struct TuneResult
+{
+    TuneResult() : readRate(0), hashRate(0), threads(1), memoryLimit(0), queueDepth(0),
+                   reorderWindow(0), ioSize(0) {}
+
+    void Write(std::ostream& out) const;
+
+    ResourceLimits limits;
+    double         readRate;       //!< Скорость чтения файла, байт/с, 0 - не измерялась
+    double         hashRate;       //!< Скорость рассчета всех дайджестов одним потоком, байт/с
+    size_t         threads;        //!< Потоков рассчета
+    size_t         memoryLimit;    //!< Ограничение памяти под буферы чтения
+    size_t         queueDepth;     //!< Наибольшая глубина очередей блоков всех узлов
+    size_t         reorderWindow;  //!< Окно переупорядочивания записей
+    size_t         ioSize;         //!< Размер чтения из источника
+};
+
+//! Выбор параметров конвейера при запуске.
+//! Учитываются ограничения процесса (привязка к процессорам, квоты cgroup контейнера),
+//! а за доли секунды замеряются скорость чтения файла и скорость рассчета дайджестов
+//! одним потоком. Потоков рассчета запускается столько, сколько нужно, чтобы успевать
+//! за чтением, но не больше доступных процессоров; память под буферы - доля доступной
+//! процессу. Глубину очереди в этих пределах затем подстраивает сам генератор
+//! (CSignatureGenerator::SetAdaptiveQueue()).
+class CAutoTuner
+{
+public:
+    CAutoTuner();
+
+    void SetDigests(const CDigestList& digests);
+    void SetCpuSet(const CCpuList& cpus);
+    void SetMemoryLimit(size_t memoryLimit);
+
+    bool Tune(int fd, size_t blockSize, TuneResult& result) const;
+
+private:
+    double CalibrateHash(size_t blockSize) const;
+    double CalibrateRead(int fd, size_t blockSize, size_t& ioSize) const;
+
+private:
+    CDigestList m_digests;
+    CCpuList    m_cpus;
+    size_t      m_memoryLimit;     //!< Заданное пользователем ограничение памяти, 0 - выбрать
+};
+
+#endif // _AUTO_TUNER_H
@@ -0,0 +1,354 @@
+//! @file ChunkSigner.cpp
+//! Реализация класса CChunkSigner
+
+#include "ChunkSigner.h"
+
+#include "../common/hash/Sha256.h"
+#include "../common/io/FileIo.h"
+
+#include <boost/scoped_array.hpp>
+
+#include <algorithm>
+#include <string.h>
+
+//! Размер сегмента порции по-умолчанию
+const size_t DEFAULT_SEGMENT_SIZE = 16 * 1024 * 1024;
+//! Сегмент не меньше стольких максимальных блоков, чтобы сшивание занимало малую его часть
+const size_t MIN_SEGMENT_CHUNKS   = 4;
+
+//! Конструктор.
+CChunkSigner::CChunkSigner() : m_recordSize(0), m_segmentSize(DEFAULT_SEGMENT_SIZE), m_pDedupIndex(NULL),
+                               m_dataSize(0), m_isDataEnd(false), m_dataOffset(0), m_firstChunk(0)
+{
+    SetDigests(CDigestList(1, DIGEST_CRC32));
+}
+
+//! Задает размеры блоков. Вызывается до Sign().
+//! @param minSize - [in] минимальный размер;
+//! @param avgSize - [in] средний размер;
+//! @param maxSize - [in] максимальный размер.
+//! @return true - успех, false - недопустимые размеры (см. CFastCdc::Init()).
+bool CChunkSigner::SetChunkSizes(size_t minSize, size_t avgSize, size_t maxSize)
+{
+    return m_cdc.Init(minSize, avgSize, maxSize);
+}
+
+//! Задает дайджесты блока (по-умолчанию только CRC32). Вызывается до Sign().
+//! @param digests - [in] дайджесты, без повторов.
+//! @return true - успех, false - пустой список или неизвестный дайджест.
+bool CChunkSigner::SetDigests(const CDigestList& digests)
+{
+    if (digests.empty())
+    {
+        return false;
+    }
+
+    size_t recordSize = CHUNK_RECORD_HEADER_SIZE;
+
+    for (size_t i = 0; i < digests.size(); ++i)
+    {
+        if (DigestSize(digests[i]) == 0)
+        {
+            return false;
+        }
+
+        recordSize += DigestSize(digests[i]);
+    }
+
+    m_digests    = digests;
+    m_recordSize = recordSize;
+
+    return true;
+}
+
+//! Задает размер сегмента, границы которого ищет один поток.
+//! Порция файла в памяти - по сегменту на поток. Вызывается до Sign().
+//! @param segmentSize - [in] размер, не меньше MIN_SEGMENT_CHUNKS максимальных блоков.
+void CChunkSigner::SetSegmentSize(size_t segmentSize)
+{
+    m_segmentSize = segmentSize;
+}
+
+//! Включает поиск повторяющихся блоков: SHA-256 каждого блока добавляется в индекс.
+//! Вызывается до Sign().
+//! @param pIndex - [in] индекс, NULL - выключить.
+void CChunkSigner::SetDedupIndex(CDedupIndex* pIndex)
+{
+    m_pDedupIndex = pIndex;
+}
+
+//! Рассчитывает сигнатуру файла и передает записи блоков в приемник по порядку.
+//! @param fd        - [in] дескриптор обычного файла, читается целиком с начала;
+//! @param sink      - [in] приемник записей блоков;
+//! @param threadCnt - [in] кол-во потоков.
+//! @return true - успех, false - размеры блоков не заданы, ошибка чтения файла или приемника.
+bool CChunkSigner::Sign(int fd, CSignatureSink& sink, size_t threadCnt)
+{
+    uint64_t fileSize = 0;
+
+    if ((m_cdc.MaxSize() == 0) || !GetRegularFileSize(fd, fileSize))
+    {
+        return false;
+    }
+
+    threadCnt = (threadCnt != 0) ? threadCnt : 1;
+
+    const size_t segmentSize = std::max(m_segmentSize, m_cdc.MaxSize() * MIN_SEGMENT_CHUNKS);
+    const size_t portionSize = static_cast<size_t>(std::min<uint64_t>(segmentSize * threadCnt, fileSize));
+
+    m_buffer.resize(portionSize);
+    m_dataOffset = 0;
+
+    uint64_t chunkNum = 0;
+
+    while (m_dataOffset < fileSize)
+    {
+        m_dataSize  = static_cast<size_t>(std::min<uint64_t>(portionSize, fileSize - m_dataOffset));
+        m_isDataEnd = (m_dataOffset + m_dataSize == fileSize);
+
+        const size_t numSegments = (m_dataSize + segmentSize - 1) / segmentSize;
+
+        // Каждый этап: сегменты, кроме первого, обрабатывают новые потоки, первый - текущий
+        boost::scoped_array<bool> isReadOk(new bool[numSegments]);
+        boost::thread_group       readThreads;
+
+        for (size_t seg = 1; seg < numSegments; ++seg)
+        {
+            readThreads.create_thread(boost::bind(&CChunkSigner::ThreadProcRead, this, fd,
+                                                  m_dataOffset + seg * segmentSize, seg * segmentSize,
+                                                  std::min(m_dataSize, (seg + 1) * segmentSize),
+                                                  &isReadOk[seg]));
+        }
+
+        ThreadProcRead(fd, m_dataOffset, 0, std::min(m_dataSize, segmentSize), &isReadOk[0]);
+        readThreads.join_all();
+
+        for (size_t seg = 0; seg < numSegments; ++seg)
+        {
+            if (!isReadOk[seg])
+            {
+                return false;
+            }
+        }
+
+        std::vector<CBoundList> segmentBounds(numSegments);
+        boost::thread_group     scanThreads;
+
+        for (size_t seg = 1; seg < numSegments; ++seg)
+        {
+            scanThreads.create_thread(boost::bind(&CChunkSigner::ThreadProcScan, this, seg * segmentSize,
+                                                  std::min(m_dataSize, (seg + 1) * segmentSize),
+                                                  &segmentBounds[seg]));
+        }
+
+        ThreadProcScan(0, std::min(m_dataSize, segmentSize), &segmentBounds[0]);
+        scanThreads.join_all();
+
+        const size_t processedSize = StitchBounds(segmentBounds, segmentSize);
+
+        if (processedSize == 0)
+        {
+            return false;
+        }
+
+        const size_t numChunks    = m_chunkEnds.size();
+        const size_t chunksPerThr = (numChunks + threadCnt - 1) / threadCnt;
+
+        m_records.resize(numChunks * m_recordSize);
+        m_firstChunk = chunkNum;
+
+        boost::thread_group digestThreads;
+
+        for (size_t first = chunksPerThr; first < numChunks; first += chunksPerThr)
+        {
+            digestThreads.create_thread(boost::bind(&CChunkSigner::ThreadProcDigest, this, first,
+                                                    std::min(numChunks, first + chunksPerThr)));
+        }
+
+        ThreadProcDigest(0, std::min(numChunks, chunksPerThr));
+        digestThreads.join_all();
+
+        for (size_t i = 0; i < numChunks; ++i)
+        {
+            if (!sink.Write(chunkNum++, &m_records[i * m_recordSize], m_recordSize))
+            {
+                return false;
+            }
+        }
+
+        // Следующая порция начинается с последней истинной границы
+        m_dataOffset += processedSize;
+    }
+
+    return true;
+}
+
+//! Ищет конец блока, начинающегося в позиции pos порции.
+//! @param pos - [in]  начало блока относительно начала порции;
+//! @param end - [out] конец блока относительно начала порции.
+//! @return true - конец найден, false - данные порции закончились, и конец блока
+//!                зависит от данных следующей порции.
+bool CChunkSigner::NextBoundary(size_t pos, size_t& end) const
+{
+    const size_t availSize = m_dataSize - pos;
+
+    if (availSize == 0)
+    {
+        return false;
+    }
+
+    const size_t chunkSize = m_cdc.FindBoundary(&m_buffer[pos], availSize);
+
+    if (!m_isDataEnd && (chunkSize == availSize) && (availSize < m_cdc.MaxSize()))
+    {
+        return false;
+    }
+
+    end = pos + chunkSize;
+
+    return true;
+}
+
+//! Тело потока чтения сегмента порции.
+//! @param fd     - [in]  дескриптор файла;
+//! @param offset - [in]  смещение сегмента в файле;
+//! @param begin  - [in]  начало сегмента в порции;
+//! @param end    - [in]  конец сегмента в порции;
+//! @param pIsOk  - [out] true - сегмент прочитан.
+void CChunkSigner::ThreadProcRead(int fd, uint64_t offset, size_t begin, size_t end, bool* pIsOk)
+{
+    *pIsOk = ReadFileAt(fd, &m_buffer[begin], end - begin, offset);
+}
+
+//! Тело потока поиска границ сегмента.
+//! Поиск начинается с начала сегмента, как будто там граница блока, и продолжается
+//! за конец сегмента до первой границы не раньше его конца.
+//! @param begin   - [in]  начало сегмента в порции;
+//! @param end     - [in]  конец сегмента в порции;
+//! @param pBounds - [out] предположительные концы блоков.
+void CChunkSigner::ThreadProcScan(size_t begin, size_t end, CBoundList* pBounds)
+{
+    size_t pos = begin;
+
+    while (pos < end)
+    {
+        size_t chunkEnd = 0;
+
+        if (!NextBoundary(pos, chunkEnd))
+        {
+            break;
+        }
+
+        pBounds->push_back(chunkEnd);
+        pos = chunkEnd;
+    }
+}
+
+//! Сшивает предположительные границы сегментов в истинные границы порции.
+//! Граница блока определяется только его началом, поэтому, как только истинная граница
+//! совпала с границей, найденной в сегменте, все следующие границы сегмента тоже истинные.
+//! @param segmentBounds - [in] концы блоков, найденные в сегментах;
+//! @param segmentSize   - [in] размер сегмента.
+//! @return размер обработанной части порции (конец последнего истинного блока).
+size_t CChunkSigner::StitchBounds(const std::vector<CBoundList>& segmentBounds, size_t segmentSize)
+{
+    m_chunkEnds.clear();
+
+    size_t pos = 0;
+
+    for (size_t seg = 0; seg < segmentBounds.size(); ++seg)
+    {
+        const CBoundList&          bounds = segmentBounds[seg];
+        CBoundList::const_iterator itSync = bounds.end();
+
+        if (pos == seg * segmentSize)
+        {
+            itSync = bounds.begin();
+        }
+        else
+        {
+            // Истинные границы продолжаются последовательно до совпадения с границей сегмента
+            while (!bounds.empty() && (pos < bounds.back()))
+            {
+                CBoundList::const_iterator it = std::lower_bound(bounds.begin(), bounds.end(), pos);
+
+                if (*it == pos)
+                {
+                    itSync = it + 1;
+                    break;
+                }
+
+                size_t chunkEnd = 0;
+
+                if (!NextBoundary(pos, chunkEnd))
+                {
+                    return pos;
+                }
+
+                m_chunkEnds.push_back(chunkEnd);
+                pos = chunkEnd;
+            }
+        }
+
+        if (itSync != bounds.end())
+        {
+            m_chunkEnds.insert(m_chunkEnds.end(), itSync, bounds.end());
+            pos = bounds.back();
+        }
+    }
+
+    // Сегменты закончились раньше, чем найдены все определенные границы порции
+    size_t chunkEnd = 0;
+
+    while (NextBoundary(pos, chunkEnd))
+    {
+        m_chunkEnds.push_back(chunkEnd);
+        pos = chunkEnd;
+    }
+
+    return pos;
+}
+
+//! Тело потока рассчета записей блоков порции.
+//! @param firstChunk - [in] первый блок;
+//! @param lastChunk  - [in] блок после последнего.
+void CChunkSigner::ThreadProcDigest(size_t firstChunk, size_t lastChunk)
+{
+    for (size_t i = firstChunk; i < lastChunk; ++i)
+    {
+        const size_t   begin     = (i != 0) ? m_chunkEnds[i - 1] : 0;
+        const uint64_t offset    = m_dataOffset + begin;
+        const uint32_t chunkSize = static_cast<uint32_t>(m_chunkEnds[i] - begin);
+
+        uint8_t* pRecord = &m_records[i * m_recordSize];
+
+        memcpy(pRecord, &offset, sizeof(offset));
+        memcpy(pRecord + sizeof(offset), &chunkSize, sizeof(chunkSize));
+
+        pRecord += CHUNK_RECORD_HEADER_SIZE;
+
+        const uint8_t* pSha256 = NULL;
+
+        for (size_t d = 0; d < m_digests.size(); ++d)
+        {
+            CalcDigest(m_digests[d], &m_buffer[begin], chunkSize, pRecord);
+
+            pSha256  = (m_digests[d] == DIGEST_SHA256) ? pRecord : pSha256;
+            pRecord += DigestSize(m_digests[d]);
+        }
+
+        if (m_pDedupIndex != NULL)
+        {
+            // SHA-256 для индекса рассчитывается отдельно, если его нет среди дайджестов
+            uint8_t sha256[SHA256_SIZE];
+
+            if (pSha256 == NULL)
+            {
+                CalcSha256(&m_buffer[begin], chunkSize, sha256);
+                pSha256 = sha256;
+            }
+
+            m_pDedupIndex->Insert(pSha256, m_firstChunk + i, chunkSize);
+        }
+    }
+}
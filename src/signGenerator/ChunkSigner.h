@@ -0,0 +1,69 @@
+//! @file ChunkSigner.h
+//! Объявление класса CChunkSigner
+
+#ifndef _CHUNK_SIGNER_H
+#define _CHUNK_SIGNER_H
+
+#include "../common/chunk/FastCdc.h"
+#include "../common/dedup/DedupIndex.h"
+#include "../common/hash/Digest.h"
+#include "SignatureSink.h"
+
+#include <boost/thread.hpp>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+//! Размер заголовка записи блока переменного размера: смещение (8 байтов) и размер (4 байта)
+const size_t CHUNK_RECORD_HEADER_SIZE = sizeof(uint64_t) + sizeof(uint32_t);
+
+//! Сигнатура файла из блоков переменного размера с границами по содержимому (FastCDC).
+//! Для каждого блока в приемник передается запись: смещение в файле и размер
+//! (в порядке байтов платформы), затем дайджесты блока.
+//! Файл обрабатывается порциями: порция читается в память один раз, делится на сегменты
+//! по потокам, и границы каждого сегмента ищутся параллельно, как если бы блок начинался
+//! с начала сегмента. Затем предположительные границы сегментов сшиваются: от последней
+//! истинной границы поиск продолжается последовательно до первой границы, совпавшей
+//! с найденной в сегменте, после которой границы сегмента уже верны.
+//! Дайджесты блоков порции также рассчитываются параллельно.
+class CChunkSigner
+{
+public:
+    CChunkSigner();
+
+    bool SetChunkSizes(size_t minSize, size_t avgSize, size_t maxSize);
+    bool SetDigests(const CDigestList& digests);
+    void SetSegmentSize(size_t segmentSize);
+    void SetDedupIndex(CDedupIndex* pIndex);
+
+    bool Sign(int fd, CSignatureSink& sink, size_t threadCnt = boost::thread::hardware_concurrency());
+
+private:
+    //! Концы блоков относительно начала порции
+    typedef std::vector<size_t> CBoundList;
+
+    bool NextBoundary(size_t pos, size_t& end) const;
+    void ThreadProcRead(int fd, uint64_t offset, size_t begin, size_t end, bool* pIsOk);
+    void ThreadProcScan(size_t begin, size_t end, CBoundList* pBounds);
+    void ThreadProcDigest(size_t firstChunk, size_t lastChunk);
+    size_t StitchBounds(const std::vector<CBoundList>& segmentBounds, size_t segmentSize);
+
+private:
+    CFastCdc             m_cdc;
+    CDigestList          m_digests;
+    size_t               m_recordSize;
+    size_t               m_segmentSize;
+    CDedupIndex*         m_pDedupIndex;
+
+    std::vector<uint8_t> m_buffer;      //!< Данные порции
+    size_t               m_dataSize;    //!< Прочитано в порцию, байтов
+    bool                 m_isDataEnd;   //!< Порция заканчивается концом файла
+    uint64_t             m_dataOffset;  //!< Смещение порции в файле
+
+    CBoundList           m_chunkEnds;   //!< Истинные концы блоков порции
+    uint64_t             m_firstChunk;  //!< Номер первого блока порции
+    std::vector<uint8_t> m_records;     //!< Записи блоков порции
+};
+
+#endif // _CHUNK_SIGNER_H
@@ -0,0 +1,571 @@
+//! @file DecompressSource.cpp
+//! Реализация класса CDecompressSource
+
+#include "DecompressSource.h"
+
+#include <boost/bind/bind.hpp>
+#include <boost/iostreams/categories.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filter/zstd.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/scoped_array.hpp>
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string.h>
+
+//! Размер порции, распаковываемой последовательным потоком
+const size_t   DECODE_CHUNK_SIZE       = 1024 * 1024;
+//! Наибольшее кол-во распакованных порций в очереди
+const size_t   MAX_QUEUED_CHUNKS       = 4;
+//! Кол-во членов BGZF порции на поток распаковки (около 1 Мб данных)
+const size_t   BGZF_MEMBERS_PER_THREAD = 16;
+//! Наибольший размер члена BGZF, сжатого и распакованного
+const size_t   BGZF_MAX_MEMBER_SIZE    = 64 * 1024;
+//! Размер постоянной части заголовка gzip
+const size_t   GZIP_HEADER_SIZE        = 12;
+//! Размер заключения gzip: CRC32 и размер распакованных данных
+const size_t   GZIP_FOOTER_SIZE        = 8;
+//! Флаг дополнительных полей в заголовке gzip
+const uint8_t  GZIP_FLAG_EXTRA         = 0x04;
+//! Сколько байтов читается для определения формата: заголовок gzip с полем BGZF
+const size_t   DETECT_PREFIX_SIZE      = 18;
+
+//! Проверяет, что данные начинаются заголовком gzip.
+static bool IsGzipHeader(const uint8_t* pData, size_t size)
+{
+    return (size >= 3) && (pData[0] == 0x1F) && (pData[1] == 0x8B) && (pData[2] == Z_DEFLATED);
+}
+
+//! Проверяет, что данные начинаются заголовком кадра zstd.
+static bool IsZstdHeader(const uint8_t* pData, size_t size)
+{
+    return (size >= 4) && (pData[0] == 0x28) && (pData[1] == 0xB5) && (pData[2] == 0x2F) &&
+           (pData[3] == 0xFD);
+}
+
+//! Проверяет, что заголовок gzip - заголовок члена BGZF: единственный флаг - доп. поля,
+//! первое поле - BC с размером члена.
+static bool IsBgzfHeader(const uint8_t* pData, size_t size)
+{
+    return IsGzipHeader(pData, size) && (size >= DETECT_PREFIX_SIZE) && (pData[3] == GZIP_FLAG_EXTRA) &&
+           (pData[12] == 'B') && (pData[13] == 'C') && (pData[14] == 2) && (pData[15] == 0);
+}
+
+//! Читает 16- или 32-битное число младшим байтом вперед.
+static uint32_t ReadLe(const uint8_t* pData, size_t size)
+{
+    uint32_t value = 0;
+
+    for (size_t i = size; i > 0; --i)
+    {
+        value = (value << 8) | pData[i - 1];
+    }
+
+    return value;
+}
+
+//! Устройство boost::iostreams, читающее сжатые данные из источника.
+class CDecompressSource::CInputDevice
+{
+public:
+    typedef char                           char_type;
+    typedef boost::iostreams::source_tag   category;
+
+    explicit CInputDevice(CDecompressSource* pOwner) : m_pOwner(pOwner) {}
+
+    std::streamsize read(char* pBuffer, std::streamsize size)
+    {
+        size_t readSize = 0;
+
+        if (!m_pOwner->ReadInput(reinterpret_cast<uint8_t*>(pBuffer), static_cast<size_t>(size), readSize))
+        {
+            throw std::runtime_error("Source read error");
+        }
+
+        return (readSize != 0) ? static_cast<std::streamsize>(readSize) : -1;
+    }
+
+private:
+    CDecompressSource* m_pOwner;
+};
+
+//! Конструктор.
+//! @param source      - [in] источник сжатых данных, должен существовать до разрушения объекта;
+//! @param compression - [in] формат сжатия;
+//! @param threadCnt   - [in] кол-во потоков распаковки BGZF.
+CDecompressSource::CDecompressSource(CSignatureSource& source, ECompression compression,
+                                     size_t threadCnt) :
+    m_source(source), m_compression(compression), m_threadCnt((threadCnt != 0) ? threadCnt : 1),
+    m_prefixOffset(0), m_isStarted(false), m_chunkOffset(0), m_isDecodeEnd(false), m_isStopped(false)
+{
+}
+
+//! Деструктор. Останавливает распаковку, если данные прочитаны не до конца.
+CDecompressSource::~CDecompressSource()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+
+        m_isStopped = true;
+        m_condVarFreeChunk.notify_all();
+    }
+
+    if (m_decodeThread.joinable())
+    {
+        m_decodeThread.join();
+    }
+}
+
+//! Читает распакованные данные. Поток распаковки запускается при первом чтении.
+bool CDecompressSource::Read(uint8_t* pBuffer, size_t size, size_t& readSize)
+{
+    if (!m_isStarted)
+    {
+        boost::thread thread(boost::bind(&CDecompressSource::ThreadProcDecode, this));
+        m_decodeThread.swap(thread);
+        m_isStarted = true;
+    }
+
+    readSize = 0;
+
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+
+    while (m_chunks.empty() && !m_isDecodeEnd)
+    {
+        m_condVarHaveChunk.wait(lock);
+    }
+
+    if (!m_error.empty())
+    {
+        return false;
+    }
+
+    while ((readSize < size) && !m_chunks.empty())
+    {
+        const CChunk& chunk    = *m_chunks.front();
+        const size_t  copySize = std::min(size - readSize, chunk.size() - m_chunkOffset);
+
+        memcpy(pBuffer + readSize, &chunk[m_chunkOffset], copySize);
+
+        readSize      += copySize;
+        m_chunkOffset += copySize;
+
+        if (m_chunkOffset == chunk.size())
+        {
+            m_chunks.pop_front();
+            m_chunkOffset = 0;
+            m_condVarFreeChunk.notify_all();
+        }
+    }
+
+    return true;
+}
+
+//! Возвращает описание ошибки распаковки, пустое - ошибки не было.
+std::string CDecompressSource::GetError() const
+{
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+
+    return m_error;
+}
+
+//! Разбирает формат сжатия: auto, gzip или zstd.
+//! @param str         - [in]  строка с форматом, пустая - auto;
+//! @param compression - [out] формат.
+//! @return true - успех, false - неизвестный формат.
+bool CDecompressSource::ParseCompression(const std::string& str, ECompression& compression)
+{
+    if (str.empty() || (str == "auto"))
+    {
+        compression = COMPRESSION_AUTO;
+    }
+    else if (str == "gzip")
+    {
+        compression = COMPRESSION_GZIP;
+    }
+    else if (str == "zstd")
+    {
+        compression = COMPRESSION_ZSTD;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+//! Читает сжатые данные: сначала прочитанные для определения формата, затем из источника.
+//! @param pBuffer  - [in]  буфер;
+//! @param size     - [in]  размер буфера;
+//! @param readSize - [out] прочитано, 0 - данные закончились.
+//! @return true - успех, false - ошибка чтения источника.
+bool CDecompressSource::ReadInput(uint8_t* pBuffer, size_t size, size_t& readSize)
+{
+    if (m_prefixOffset < m_prefix.size())
+    {
+        readSize = std::min(size, m_prefix.size() - m_prefixOffset);
+
+        memcpy(pBuffer, &m_prefix[m_prefixOffset], readSize);
+        m_prefixOffset += readSize;
+
+        return true;
+    }
+
+    return m_source.Read(pBuffer, size, readSize);
+}
+
+//! Читает сжатые данные до заполнения буфера или до конца данных.
+//! @param pBuffer  - [in]  буфер;
+//! @param size     - [in]  размер буфера;
+//! @param readSize - [out] прочитано, меньше size - данные закончились.
+//! @return true - успех, false - ошибка чтения источника.
+bool CDecompressSource::ReadInputFull(uint8_t* pBuffer, size_t size, size_t& readSize)
+{
+    readSize = 0;
+
+    while (readSize < size)
+    {
+        size_t partSize = 0;
+
+        if (!ReadInput(pBuffer + readSize, size - readSize, partSize))
+        {
+            return false;
+        }
+
+        if (partSize == 0)
+        {
+            break;
+        }
+
+        readSize += partSize;
+    }
+
+    return true;
+}
+
+//! Помещает распакованную порцию в очередь, дожидаясь места.
+//! @param pChunk - [in] порция.
+//! @return true - успех, false - чтение прекращено.
+bool CDecompressSource::PushChunk(const CChunkPtr& pChunk)
+{
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+
+    while ((m_chunks.size() >= MAX_QUEUED_CHUNKS) && !m_isStopped)
+    {
+        m_condVarFreeChunk.wait(lock);
+    }
+
+    if (m_isStopped)
+    {
+        return false;
+    }
+
+    m_chunks.push_back(pChunk);
+    m_condVarHaveChunk.notify_all();
+
+    return true;
+}
+
+//! Запоминает первую ошибку распаковки.
+//! @param error - [in] описание ошибки.
+void CDecompressSource::SetError(const std::string& error)
+{
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+
+    if (m_error.empty())
+    {
+        m_error = error;
+    }
+}
+
+//! Тело потока распаковки: определяет формат и распаковывает данные до конца.
+void CDecompressSource::ThreadProcDecode()
+{
+    try
+    {
+        uint8_t prefix[DETECT_PREFIX_SIZE];
+        size_t  prefixSize = 0;
+
+        if (!ReadInputFull(prefix, sizeof(prefix), prefixSize))
+        {
+            throw std::runtime_error("Source read error");
+        }
+
+        // Прочитанное для определения формата затем читается повторно через ReadInput()
+        m_prefix.assign(prefix, prefix + prefixSize);
+
+        const uint8_t* pPrefix     = prefix;
+        ECompression   compression = m_compression;
+
+        if (compression == COMPRESSION_AUTO)
+        {
+            compression = IsGzipHeader(pPrefix, prefixSize) ? COMPRESSION_GZIP
+                        : IsZstdHeader(pPrefix, prefixSize) ? COMPRESSION_ZSTD
+                                                            : COMPRESSION_NONE;
+        }
+
+        if (compression == COMPRESSION_NONE)
+        {
+            CopyInput();
+        }
+        else if ((compression == COMPRESSION_GZIP) && IsBgzfHeader(pPrefix, prefixSize))
+        {
+            DecodeBgzf();
+        }
+        else
+        {
+            DecodeStream(compression);
+        }
+    }
+    catch (std::exception& error)
+    {
+        SetError(std::string("Decompression error: ") + error.what());
+    }
+
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+
+    m_isDecodeEnd = true;
+    m_condVarHaveChunk.notify_all();
+}
+
+//! Передает несжатые данные как есть.
+void CDecompressSource::CopyInput()
+{
+    while (true)
+    {
+        CChunkPtr pChunk(new CChunk(DECODE_CHUNK_SIZE));
+        size_t    readSize = 0;
+
+        if (!ReadInputFull(&(*pChunk)[0], pChunk->size(), readSize))
+        {
+            throw std::runtime_error("Source read error");
+        }
+
+        if (readSize == 0)
+        {
+            return;
+        }
+
+        pChunk->resize(readSize);
+
+        if (!PushChunk(pChunk) || (readSize < DECODE_CHUNK_SIZE))
+        {
+            return;
+        }
+    }
+}
+
+//! Последовательно распаковывает gzip (в т.ч. из нескольких членов) или zstd.
+//! @param compression - [in] формат сжатия.
+void CDecompressSource::DecodeStream(ECompression compression)
+{
+    boost::iostreams::filtering_istream in;
+
+    if (compression == COMPRESSION_GZIP)
+    {
+        in.push(boost::iostreams::gzip_decompressor());
+    }
+    else
+    {
+        in.push(boost::iostreams::zstd_decompressor());
+    }
+
+    in.push(CInputDevice(this));
+
+    // Ошибки фильтров и источника передаются исключениями
+    in.exceptions(std::ios::badbit);
+
+    while (true)
+    {
+        CChunkPtr pChunk(new CChunk(DECODE_CHUNK_SIZE));
+
+        in.read(reinterpret_cast<char*>(&(*pChunk)[0]), static_cast<std::streamsize>(pChunk->size()));
+
+        const size_t readSize = static_cast<size_t>(in.gcount());
+
+        if (readSize == 0)
+        {
+            return;
+        }
+
+        pChunk->resize(readSize);
+
+        if (!PushChunk(pChunk) || !in)
+        {
+            return;
+        }
+    }
+}
+
+//! Параллельно распаковывает BGZF.
+//! Порция из BGZF_MEMBERS_PER_THREAD членов на поток читается последовательно,
+//! размеры распакованных членов известны из заключений, поэтому каждый поток
+//! распаковывает свои члены сразу на место в общем буфере порции.
+void CDecompressSource::DecodeBgzf()
+{
+    std::vector<BgzfMember> members(m_threadCnt * BGZF_MEMBERS_PER_THREAD);
+
+    bool isEnd = false;
+
+    while (!isEnd)
+    {
+        size_t numMembers = 0;
+        size_t outputSize = 0;
+
+        while ((numMembers < members.size()) && ReadBgzfMember(members[numMembers], isEnd) && !isEnd)
+        {
+            members[numMembers].offset = outputSize;
+            outputSize += members[numMembers].size;
+            ++numMembers;
+        }
+
+        if (outputSize == 0)
+        {
+            continue;
+        }
+
+        CChunkPtr pChunk(new CChunk(outputSize));
+
+        const size_t              membersPerThr = (numMembers + m_threadCnt - 1) / m_threadCnt;
+        const size_t              numThreads    = (numMembers + membersPerThr - 1) / membersPerThr;
+        boost::scoped_array<bool> isOk(new bool[numThreads]);
+        boost::thread_group       threads;
+
+        for (size_t t = 1; t < numThreads; ++t)
+        {
+            threads.create_thread(boost::bind(&CDecompressSource::ThreadProcBgzf, this, &members,
+                                              t * membersPerThr,
+                                              std::min(numMembers, (t + 1) * membersPerThr),
+                                              &(*pChunk)[0], &isOk[t]));
+        }
+
+        ThreadProcBgzf(&members, 0, std::min(numMembers, membersPerThr), &(*pChunk)[0], &isOk[0]);
+        threads.join_all();
+
+        for (size_t t = 0; t < numThreads; ++t)
+        {
+            if (!isOk[t])
+            {
+                throw std::runtime_error("corrupted BGZF member");
+            }
+        }
+
+        if (!PushChunk(pChunk))
+        {
+            return;
+        }
+    }
+}
+
+//! Читает очередной член BGZF.
+//! @param member - [out] член: сжатые данные с заключением и размер распакованных;
+//! @param isEnd  - [out] true - данные закончились, член не прочитан.
+//! @return true - успех; при ошибке бросает исключение.
+bool CDecompressSource::ReadBgzfMember(BgzfMember& member, bool& isEnd)
+{
+    uint8_t header[GZIP_HEADER_SIZE];
+    size_t  readSize = 0;
+
+    if (!ReadInputFull(header, sizeof(header), readSize))
+    {
+        throw std::runtime_error("Source read error");
+    }
+
+    isEnd = (readSize == 0);
+
+    if (isEnd)
+    {
+        return true;
+    }
+
+    if ((readSize != sizeof(header)) || !IsGzipHeader(header, readSize) || (header[3] != GZIP_FLAG_EXTRA))
+    {
+        throw std::runtime_error("not a BGZF member");
+    }
+
+    // Поле BC с размером члена ищется среди доп. полей
+    std::vector<uint8_t> extra(ReadLe(header + 10, 2));
+    size_t               memberSize = 0;
+
+    if (!extra.empty() && (!ReadInputFull(&extra[0], extra.size(), readSize) || (readSize != extra.size())))
+    {
+        throw std::runtime_error("truncated BGZF member");
+    }
+
+    for (size_t pos = 0; pos + 4 <= extra.size(); pos += 4 + ReadLe(&extra[pos + 2], 2))
+    {
+        if ((extra[pos] == 'B') && (extra[pos + 1] == 'C') && (ReadLe(&extra[pos + 2], 2) == 2) &&
+            (pos + 6 <= extra.size()))
+        {
+            memberSize = ReadLe(&extra[pos + 4], 2) + 1;
+        }
+    }
+
+    if (memberSize < sizeof(header) + extra.size() + GZIP_FOOTER_SIZE)
+    {
+        throw std::runtime_error("not a BGZF member");
+    }
+
+    member.data.resize(memberSize - sizeof(header) - extra.size());
+
+    if (!ReadInputFull(&member.data[0], member.data.size(), readSize) || (readSize != member.data.size()))
+    {
+        throw std::runtime_error("truncated BGZF member");
+    }
+
+    member.size = ReadLe(&member.data[member.data.size() - 4], 4);
+
+    if (member.size > BGZF_MAX_MEMBER_SIZE)
+    {
+        throw std::runtime_error("corrupted BGZF member");
+    }
+
+    return true;
+}
+
+//! Тело потока распаковки членов BGZF порции.
+//! @param pMembers - [in]  члены порции;
+//! @param first    - [in]  первый член;
+//! @param last     - [in]  член после последнего;
+//! @param pOutput  - [in]  буфер распакованных данных порции;
+//! @param pIsOk    - [out] true - члены распакованы, CRC32 совпали.
+void CDecompressSource::ThreadProcBgzf(std::vector<BgzfMember>* pMembers, size_t first, size_t last,
+                                       uint8_t* pOutput, bool* pIsOk)
+{
+    *pIsOk = true;
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+
+    // Данные члена - deflate без заголовка zlib
+    if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+    {
+        *pIsOk = false;
+        return;
+    }
+
+    for (size_t i = first; (i < last) && *pIsOk; ++i)
+    {
+        BgzfMember&  member   = (*pMembers)[i];
+        const size_t dataSize = member.data.size() - GZIP_FOOTER_SIZE;
+
+        stream.next_in   = &member.data[0];
+        stream.avail_in  = static_cast<uInt>(dataSize);
+        stream.next_out  = pOutput + member.offset;
+        stream.avail_out = member.size;
+
+        const int result = inflate(&stream, Z_FINISH);
+
+        *pIsOk = (result == Z_STREAM_END) && (stream.avail_out == 0) &&
+                 (crc32(crc32(0, Z_NULL, 0), pOutput + member.offset, member.size) ==
+                  ReadLe(&member.data[dataSize], 4));
+
+        inflateReset(&stream);
+    }
+
+    inflateEnd(&stream);
+}
@@ -0,0 +1,100 @@
+//! @file DecompressSource.h
+//! Объявление класса CDecompressSource
+
+#ifndef _DECOMPRESS_SOURCE_H
+#define _DECOMPRESS_SOURCE_H
+
+#include "SignatureSource.h"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <deque>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//! Источник распакованных данных сжатого источника (gzip, zstd).
+//! Распаковка - отдельная стадия конвейера: поток распаковки читает сжатые данные
+//! и складывает распакованные порции в ограниченную очередь, из которой их забирают
+//! потоки чтения CSignatureGenerator. Сигнатура рассчитывается за один проход, без
+//! временного файла.
+//! gzip в формате BGZF (независимые члены не больше 64 Кб с размером в заголовке)
+//! распаковывается параллельно: члены порции распаковываются несколькими потоками
+//! сразу на свои места в общем буфере. Обычный gzip и zstd распаковываются
+//! последовательно одним потоком.
+class CDecompressSource : public CSignatureSource
+{
+public:
+    //! Формат сжатия
+    enum ECompression
+    {
+        COMPRESSION_AUTO,   //!< Определяется по первым байтам, без сжатия - данные как есть
+        COMPRESSION_NONE,
+        COMPRESSION_GZIP,
+        COMPRESSION_ZSTD
+    };
+
+public:
+    CDecompressSource(CSignatureSource& source, ECompression compression,
+                      size_t threadCnt = boost::thread::hardware_concurrency());
+    virtual ~CDecompressSource();
+
+    virtual bool Read(uint8_t* pBuffer, size_t size, size_t& readSize);
+
+    std::string GetError() const;
+
+    static bool ParseCompression(const std::string& str, ECompression& compression);
+
+private:
+    typedef std::vector<uint8_t>   CChunk;
+    typedef boost::shared_ptr<CChunk> CChunkPtr;
+
+    //! Член BGZF: сжатые данные и место распакованных в буфере порции
+    struct BgzfMember
+    {
+        std::vector<uint8_t> data;      //!< Сжатые данные и заключение (CRC32, размер)
+        size_t               offset;    //!< Смещение распакованных данных в буфере порции
+        uint32_t             size;      //!< Размер распакованных данных
+    };
+
+    //! Устройство boost::iostreams, читающее сжатые данные из источника
+    class CInputDevice;
+    friend class CInputDevice;
+
+    bool ReadInput(uint8_t* pBuffer, size_t size, size_t& readSize);
+    bool ReadInputFull(uint8_t* pBuffer, size_t size, size_t& readSize);
+    bool PushChunk(const CChunkPtr& pChunk);
+    void SetError(const std::string& error);
+
+    void ThreadProcDecode();
+    void CopyInput();
+    void DecodeStream(ECompression compression);
+    void DecodeBgzf();
+    bool ReadBgzfMember(BgzfMember& member, bool& isEnd);
+    void ThreadProcBgzf(std::vector<BgzfMember>* pMembers, size_t first, size_t last,
+                        uint8_t* pOutput, bool* pIsOk);
+
+private:
+    CSignatureSource&         m_source;
+    ECompression              m_compression;
+    size_t                    m_threadCnt;
+
+    std::vector<uint8_t>      m_prefix;         //!< Прочитанное для определения формата
+    size_t                    m_prefixOffset;
+
+    boost::thread             m_decodeThread;
+    bool                      m_isStarted;
+
+    mutable boost::mutex      m_mutex;          //!< Защищает поля ниже
+    boost::condition_variable m_condVarHaveChunk;
+    boost::condition_variable m_condVarFreeChunk;
+    std::deque<CChunkPtr>     m_chunks;         //!< Распакованные порции по порядку
+    size_t                    m_chunkOffset;    //!< Прочитано из первой порции
+    bool                      m_isDecodeEnd;
+    bool                      m_isStopped;      //!< Чтение прекращено, распаковка не нужна
+    std::string               m_error;          //!< Ошибка распаковки, пусто - нет
+};
+
+#endif // _DECOMPRESS_SOURCE_H
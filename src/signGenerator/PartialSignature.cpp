@@ -0,0 +1,258 @@
+//! @file PartialSignature.cpp
+//! Реализация частичных сигнатур
+
+#include "PartialSignature.h"
+
+#include <boost/shared_ptr.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string.h>
+
+//! Признак частичной сигнатуры в начале заголовка
+const char   PARTIAL_MAGIC[8]       = { 'S', 'G', 'P', 'A', 'R', 'T', '0', '1' };
+//! Наибольшее кол-во дайджестов в заголовке
+const size_t PARTIAL_MAX_DIGESTS    = 8;
+//! Размер буфера копирования записей при объединении
+const size_t MERGE_COPY_BUFFER_SIZE = 1024 * 1024;
+
+//! Смещения полей заголовка
+enum EPartialField
+{
+    FIELD_MAGIC       = 0,
+    FIELD_FILE_SIZE   = 8,
+    FIELD_BLOCK_SIZE  = 16,
+    FIELD_FIRST_BLOCK = 24,
+    FIELD_LAST_BLOCK  = 32,
+    FIELD_RECORD_SIZE = 40,
+    FIELD_NUM_DIGESTS = 44,
+    FIELD_DIGESTS     = 48
+};
+
+//! Частичная сигнатура, открытая для объединения.
+struct PartialInput
+{
+    std::string                      path;
+    PartialHeader                    header;
+    boost::shared_ptr<std::ifstream> pFile;
+};
+
+//! Упорядочивает части по диапазону блоков.
+static bool IsRangeLess(const PartialInput& left, const PartialInput& right)
+{
+    return (left.header.firstBlock != right.header.firstBlock)
+           ? (left.header.firstBlock < right.header.firstBlock)
+           : (left.header.lastBlock < right.header.lastBlock);
+}
+
+//! Пишет заголовок частичной сигнатуры.
+//! @param out    - [in] поток вывода, заголовок пишется с текущей позиции;
+//! @param header - [in] заголовок.
+//! @return true - успех, false - слишком много дайджестов или ошибка записи.
+bool WritePartialHeader(std::ostream& out, const PartialHeader& header)
+{
+    if (header.digests.size() > PARTIAL_MAX_DIGESTS)
+    {
+        return false;
+    }
+
+    uint8_t        buff[PARTIAL_HEADER_SIZE] = { 0 };
+    const uint32_t numDigests                = static_cast<uint32_t>(header.digests.size());
+
+    memcpy(buff + FIELD_MAGIC,       PARTIAL_MAGIC,      sizeof(PARTIAL_MAGIC));
+    memcpy(buff + FIELD_FILE_SIZE,   &header.fileSize,   sizeof(header.fileSize));
+    memcpy(buff + FIELD_BLOCK_SIZE,  &header.blockSize,  sizeof(header.blockSize));
+    memcpy(buff + FIELD_FIRST_BLOCK, &header.firstBlock, sizeof(header.firstBlock));
+    memcpy(buff + FIELD_LAST_BLOCK,  &header.lastBlock,  sizeof(header.lastBlock));
+    memcpy(buff + FIELD_RECORD_SIZE, &header.recordSize, sizeof(header.recordSize));
+    memcpy(buff + FIELD_NUM_DIGESTS, &numDigests,        sizeof(numDigests));
+
+    for (size_t i = 0; i < header.digests.size(); ++i)
+    {
+        buff[FIELD_DIGESTS + i] = static_cast<uint8_t>(header.digests[i]);
+    }
+
+    out.write(reinterpret_cast<const char*>(buff), sizeof(buff));
+
+    return out.good();
+}
+
+//! Читает и проверяет заголовок частичной сигнатуры.
+//! @param in     - [in]  поток ввода, заголовок читается с текущей позиции;
+//! @param header - [out] заголовок.
+//! @return true - успех, false - не частичная сигнатура или заголовок поврежден.
+bool ReadPartialHeader(std::istream& in, PartialHeader& header)
+{
+    uint8_t buff[PARTIAL_HEADER_SIZE];
+
+    if (in.read(reinterpret_cast<char*>(buff), sizeof(buff)).gcount() != sizeof(buff))
+    {
+        return false;
+    }
+
+    if (memcmp(buff + FIELD_MAGIC, PARTIAL_MAGIC, sizeof(PARTIAL_MAGIC)) != 0)
+    {
+        return false;
+    }
+
+    uint32_t numDigests = 0;
+
+    memcpy(&header.fileSize,   buff + FIELD_FILE_SIZE,   sizeof(header.fileSize));
+    memcpy(&header.blockSize,  buff + FIELD_BLOCK_SIZE,  sizeof(header.blockSize));
+    memcpy(&header.firstBlock, buff + FIELD_FIRST_BLOCK, sizeof(header.firstBlock));
+    memcpy(&header.lastBlock,  buff + FIELD_LAST_BLOCK,  sizeof(header.lastBlock));
+    memcpy(&header.recordSize, buff + FIELD_RECORD_SIZE, sizeof(header.recordSize));
+    memcpy(&numDigests,        buff + FIELD_NUM_DIGESTS, sizeof(numDigests));
+
+    if ((numDigests == 0) || (numDigests > PARTIAL_MAX_DIGESTS) || (header.blockSize == 0) ||
+        (header.recordSize == 0) || (header.firstBlock > header.lastBlock))
+    {
+        return false;
+    }
+
+    header.digests.clear();
+
+    for (uint32_t i = 0; i < numDigests; ++i)
+    {
+        if (buff[FIELD_DIGESTS + i] >= DIGEST_TYPE_COUNT)
+        {
+            return false;
+        }
+
+        header.digests.push_back(static_cast<EDigestType>(buff[FIELD_DIGESTS + i]));
+    }
+
+    return true;
+}
+
+//! Объединяет частичные сигнатуры одного файла в полную сигнатуру.
+//! Части задаются в любом порядке. Сначала читаются только заголовки: части должны
+//! быть рассчитаны с одинаковыми параметрами и покрывать все блоки файла ровно
+//! по одному разу. Затем записи частей по порядку копируются в поток вывода, поэтому
+//! время объединения пропорционально размеру полной сигнатуры.
+//! @param inPaths - [in]  файлы частичных сигнатур;
+//! @param out     - [in]  поток вывода полной сигнатуры;
+//! @param error   - [out] описание ошибки.
+//! @return true - успех, false - части не согласованы, не покрывают файл или ошибка ввода-вывода.
+bool MergePartialSignatures(const std::vector<std::string>& inPaths, std::ostream& out,
+                            std::string& error)
+{
+    std::ostringstream        message;
+    std::vector<PartialInput> inputs(inPaths.size());
+
+    if (inPaths.empty())
+    {
+        error = "No partial signatures";
+        return false;
+    }
+
+    for (size_t i = 0; i < inPaths.size(); ++i)
+    {
+        PartialInput& input = inputs[i];
+
+        input.path = inPaths[i];
+        input.pFile.reset(new std::ifstream(input.path.c_str(), std::ios::in | std::ios::binary));
+
+        if (!input.pFile->is_open() || !ReadPartialHeader(*input.pFile, input.header))
+        {
+            error = "Not a partial signature: " + input.path;
+            return false;
+        }
+
+        const PartialHeader& header = input.header;
+        const PartialHeader& first  = inputs[0].header;
+
+        if ((header.fileSize != first.fileSize) || (header.blockSize != first.blockSize) ||
+            (header.recordSize != first.recordSize) || (header.digests != first.digests))
+        {
+            error = "Partial signature parameters differ: " + input.path + ", " + inputs[0].path;
+            return false;
+        }
+
+        // Размер записей проверяется до копирования, чтобы не записать неполную сигнатуру
+        input.pFile->seekg(0, std::ios::end);
+
+        const uint64_t payloadSize = static_cast<uint64_t>(input.pFile->tellg()) - PARTIAL_HEADER_SIZE;
+
+        if (!input.pFile->good() ||
+            (payloadSize != (header.lastBlock - header.firstBlock) * header.recordSize))
+        {
+            error = "Partial signature is truncated: " + input.path;
+            return false;
+        }
+
+        input.pFile->seekg(PARTIAL_HEADER_SIZE);
+    }
+
+    std::sort(inputs.begin(), inputs.end(), IsRangeLess);
+
+    const uint64_t blockSize = inputs[0].header.blockSize;
+    const uint64_t numBlocks = (inputs[0].header.fileSize + blockSize - 1) / blockSize;
+    uint64_t       nextBlock = 0;
+
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        const PartialHeader& header = inputs[i].header;
+
+        // Пустые части ничего не покрывают
+        if (header.firstBlock == header.lastBlock)
+        {
+            continue;
+        }
+
+        if (header.lastBlock > numBlocks)
+        {
+            error = "Partial signature covers blocks past the end of file: " + inputs[i].path;
+            return false;
+        }
+
+        if (header.firstBlock > nextBlock)
+        {
+            message << "Blocks " << nextBlock << "-" << header.firstBlock - 1 << " are missing";
+            error = message.str();
+            return false;
+        }
+
+        if (header.firstBlock < nextBlock)
+        {
+            message << "Blocks " << header.firstBlock << "-" << nextBlock - 1
+                    << " are covered more than once (" << inputs[i].path << ")";
+            error = message.str();
+            return false;
+        }
+
+        nextBlock = header.lastBlock;
+    }
+
+    if (nextBlock != numBlocks)
+    {
+        message << "Blocks " << nextBlock << "-" << numBlocks - 1 << " are missing";
+        error = message.str();
+        return false;
+    }
+
+    std::vector<char> buffer(MERGE_COPY_BUFFER_SIZE);
+
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        std::ifstream& file = *inputs[i].pFile;
+
+        while (file.read(&buffer[0], buffer.size()).gcount() > 0)
+        {
+            if (!out.write(&buffer[0], file.gcount()))
+            {
+                error = "Unable to write merged signature";
+                return false;
+            }
+        }
+
+        if (file.bad())
+        {
+            error = "Unable to read partial signature: " + inputs[i].path;
+            return false;
+        }
+    }
+
+    return true;
+}
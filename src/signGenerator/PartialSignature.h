@@ -0,0 +1,41 @@
+//! @file PartialSignature.h
+//! Частичные сигнатуры диапазонов блоков и их объединение
+
+#ifndef _PARTIAL_SIGNATURE_H
+#define _PARTIAL_SIGNATURE_H
+
+#include "../common/hash/Digest.h"
+
+#include <istream>
+#include <ostream>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//! Размер заголовка частичной сигнатуры
+const size_t PARTIAL_HEADER_SIZE = 64;
+
+//! Заголовок частичной сигнатуры: чем и какая часть файла подписана.
+//! За заголовком следуют записи блоков [firstBlock, lastBlock) в том же виде, что
+//! и в полной сигнатуре, поэтому объединение - это проверка покрытия и конкатенация.
+//! Поля пишутся в порядке байтов платформы, как и записи блоков.
+struct PartialHeader
+{
+    PartialHeader() : fileSize(0), blockSize(0), firstBlock(0), lastBlock(0), recordSize(0) {}
+
+    uint64_t    fileSize;     //!< Размер всего файла, в байтах
+    uint64_t    blockSize;
+    uint64_t    firstBlock;
+    uint64_t    lastBlock;    //!< Номер блока после последнего
+    uint32_t    recordSize;   //!< Размер записи блока, в байтах
+    CDigestList digests;      //!< Дайджесты записи по порядку
+};
+
+bool WritePartialHeader(std::ostream& out, const PartialHeader& header);
+bool ReadPartialHeader(std::istream& in, PartialHeader& header);
+
+bool MergePartialSignatures(const std::vector<std::string>& inPaths, std::ostream& out,
+                            std::string& error);
+
+#endif // _PARTIAL_SIGNATURE_H
@@ -0,0 +1,135 @@
+//! @file PipelinePerf.cpp
+//! Реализация класса CPipelinePerf
+
+#include "PipelinePerf.h"
+
+#include <iomanip>
+
+//! Конструктор.
+CPipelinePerf::CPipelinePerf() : m_isEnabled(false)
+{
+}
+
+//! Включает сбор счетчиков. Вызывается до запуска потоков конвейера.
+void CPipelinePerf::Enable()
+{
+    m_isEnabled = true;
+}
+
+//! Возвращает название этапа для отчета.
+//! @param stage - [in] этап.
+const char* CPipelinePerf::StageName(EStage stage)
+{
+    switch (stage)
+    {
+    case STAGE_POOL: return "pool";
+    case STAGE_READ: return "read";
+    case STAGE_HASH: return "hash";
+    default:         return "unknown";
+    }
+}
+
+//! Регистрирует текущий поток и открывает для него счетчики.
+//! Недоступность счетчиков ошибкой не считается: поток регистрируется с isAvailable == false.
+//! @param role - [in] роль потока в конвейере.
+//! @return запись потока или NULL, если сбор счетчиков выключен.
+CPipelinePerf::ThreadCounters* CPipelinePerf::RegisterThread(const std::string& role)
+{
+    if (!m_isEnabled)
+    {
+        return NULL;
+    }
+
+    boost::shared_ptr<ThreadCounters> pThread(new ThreadCounters());
+    pThread->role        = role;
+    pThread->isAvailable = pThread->counters.Open();
+
+    boost::unique_lock<boost::mutex> lock(m_lockThreads);
+    m_threads.push_back(pThread);
+
+    return pThread.get();
+}
+
+//! Выводит счетчики одной строкой JSON: по объекту на поток, с абсолютными значениями
+//! по этапам и значениями на байт (на килобайт для промахов) обработанных данных.
+//! Вызывается после завершения потоков конвейера.
+//! @param out - [in] поток вывода.
+void CPipelinePerf::WriteJson(std::ostream& out) const
+{
+    boost::unique_lock<boost::mutex> lock(m_lockThreads);
+
+    out << std::fixed << std::setprecision(3) << "{\"perf\":[";
+
+    for (size_t t = 0; t < m_threads.size(); ++t)
+    {
+        const ThreadCounters& thread = *m_threads[t];
+
+        out << ((t != 0) ? "," : "")
+            << "{\"thread\":\"" << thread.role << "\",\"available\":"
+            << (thread.isAvailable ? "true" : "false") << ",\"stages\":{";
+
+        bool isFirstStage = true;
+
+        for (size_t s = 0; s < STAGE_COUNT; ++s)
+        {
+            if (thread.ops[s] == 0)
+            {
+                continue;
+            }
+
+            const CPerfCounters::Values& values = thread.stages[s];
+            const double bytes = static_cast<double>(thread.bytes[s]);
+
+            out << (isFirstStage ? "" : ",")
+                << "\"" << StageName(static_cast<EStage>(s)) << "\":{"
+                << "\"ops\":"    << thread.ops[s]
+                << ",\"bytes\":" << thread.bytes[s];
+
+            isFirstStage = false;
+
+            for (size_t c = 0; c < CPerfCounters::COUNTER_COUNT; ++c)
+            {
+                const CPerfCounters::ECounter counter = static_cast<CPerfCounters::ECounter>(c);
+
+                if (!thread.counters.IsCounterOpen(counter))
+                {
+                    continue;
+                }
+
+                out << ",\"" << CPerfCounters::CounterName(counter) << "\":" << values.values[c];
+
+                if (bytes == 0)
+                {
+                    continue;
+                }
+
+                if ((counter == CPerfCounters::COUNTER_CACHE_MISSES) ||
+                    (counter == CPerfCounters::COUNTER_BRANCH_MISSES))
+                {
+                    out << ",\"" << CPerfCounters::CounterName(counter) << "_per_kb\":"
+                        << values.values[c] * 1024.0 / bytes;
+                }
+                else
+                {
+                    out << ",\"" << CPerfCounters::CounterName(counter) << "_per_byte\":"
+                        << values.values[c] / bytes;
+                }
+            }
+
+            if (thread.counters.IsCounterOpen(CPerfCounters::COUNTER_CYCLES) &&
+                thread.counters.IsCounterOpen(CPerfCounters::COUNTER_INSTRUCTIONS) &&
+                (values.values[CPerfCounters::COUNTER_CYCLES] != 0))
+            {
+                out << ",\"ipc\":"
+                    << static_cast<double>(values.values[CPerfCounters::COUNTER_INSTRUCTIONS]) /
+                       values.values[CPerfCounters::COUNTER_CYCLES];
+            }
+
+            out << "}";
+        }
+
+        out << "}}";
+    }
+
+    out << "]}" << std::endl;
+}
@@ -0,0 +1,128 @@
+//! @file PipelinePerf.h
+//! Объявление класса CPipelinePerf
+
+#ifndef _PIPELINE_PERF_H
+#define _PIPELINE_PERF_H
+
+#include "../common/perf/PerfCounters.h"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <ostream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//! Аппаратные счетчики производительности этапов конвейера по потокам.
+//! Каждый поток регистрируется один раз и дальше пишет только в свою запись.
+class CPipelinePerf
+{
+public:
+    //! Этапы, для которых собираются счетчики.
+    enum EStage
+    {
+        STAGE_POOL,     //!< Получение блока из пула
+        STAGE_READ,     //!< Чтение блока из файла
+        STAGE_HASH,     //!< Рассчет CRC блока
+        STAGE_COUNT
+    };
+
+    //! Счетчики одного потока.
+    struct ThreadCounters
+    {
+        ThreadCounters() : isAvailable(false)
+        {
+            for (size_t i = 0; i < STAGE_COUNT; ++i)
+            {
+                ops[i]   = 0;
+                bytes[i] = 0;
+            }
+        }
+
+        std::string           role;
+        bool                  isAvailable;  //!< Счетчики удалось открыть
+        CPerfCounters         counters;
+        CPerfCounters::Values stages[STAGE_COUNT];
+        uint64_t              ops[STAGE_COUNT];
+        uint64_t              bytes[STAGE_COUNT];
+    };
+
+public:
+    CPipelinePerf();
+
+    void Enable();
+
+    //! Возвращает true, если сбор счетчиков включен.
+    bool IsEnabled() const
+    {
+        return m_isEnabled;
+    }
+
+    ThreadCounters* RegisterThread(const std::string& role);
+
+    void WriteJson(std::ostream& out) const;
+
+    static const char* StageName(EStage stage);
+
+private:
+    CPipelinePerf(const CPipelinePerf&);
+    CPipelinePerf& operator=(const CPipelinePerf&);
+
+private:
+    typedef std::vector< boost::shared_ptr<ThreadCounters> > CThreads;
+
+    bool                 m_isEnabled;
+    mutable boost::mutex m_lockThreads;
+    CThreads             m_threads;
+};
+
+//! Замер счетчиков этапа: от создания объекта до Stop() или разрушения.
+//! При pThread == NULL (сбор выключен) ничего не делает.
+class CPerfScope
+{
+public:
+    CPerfScope(CPipelinePerf::ThreadCounters* pThread, CPipelinePerf::EStage stage) :
+        m_pThread((pThread && pThread->isAvailable) ? pThread : NULL), m_stage(stage)
+    {
+        if (m_pThread)
+        {
+            m_pThread->counters.Read(m_start);
+        }
+    }
+
+    ~CPerfScope()
+    {
+        Stop(0);
+    }
+
+    //! Завершает замер.
+    //! @param bytes - [in] объем данных, обработанных на этапе.
+    void Stop(uint64_t bytes)
+    {
+        if (m_pThread)
+        {
+            CPerfCounters::Values end;
+
+            if (m_pThread->counters.Read(end))
+            {
+                m_pThread->stages[m_stage] += end - m_start;
+                m_pThread->ops[m_stage]    += 1;
+                m_pThread->bytes[m_stage]  += bytes;
+            }
+
+            m_pThread = NULL;
+        }
+    }
+
+private:
+    CPerfScope(const CPerfScope&);
+    CPerfScope& operator=(const CPerfScope&);
+
+private:
+    CPipelinePerf::ThreadCounters* m_pThread;
+    CPipelinePerf::EStage          m_stage;
+    CPerfCounters::Values          m_start;
+};
+
+#endif // _PIPELINE_PERF_H
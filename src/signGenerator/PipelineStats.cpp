@@ -0,0 +1,91 @@
+//! @file PipelineStats.cpp
+//! Реализация класса CPipelineStats
+
+#include "PipelineStats.h"
+
+#include <iomanip>
+
+//! Кол-во наносекунд в микросекунде.
+const double NS_IN_MICROSECOND = 1000.0;
+
+//! Конструктор.
+CPipelineStats::CPipelineStats() :
+    m_poolHits(0), m_poolWaits(0), m_poolFallbacks(0), m_blocksRead(0), m_bytesRead(0),
+    m_blocksWritten(0), m_queueDepth(0), m_queueDepthChanges(0), m_startNs(GetMonotonicNs())
+{
+}
+
+//! Отмечает начало работы конвейера, от которого отсчитывается время в отчете.
+void CPipelineStats::Start()
+{
+    m_startNs = GetMonotonicNs();
+}
+
+//! Возвращает название этапа для отчета.
+//! @param stage - [in] этап.
+const char* CPipelineStats::StageName(EStage stage)
+{
+    switch (stage)
+    {
+    case STAGE_WAIT_POOL:       return "wait_pool";
+    case STAGE_READ:            return "read";
+    case STAGE_WAIT_QUEUE_FREE: return "wait_queue_free";
+    case STAGE_WAIT_QUEUE_DATA: return "wait_queue_data";
+    case STAGE_HASH:            return "hash";
+    case STAGE_WAIT_MAP:        return "wait_map";
+    case STAGE_WAIT_WRITE_DATA: return "wait_write_data";
+    case STAGE_WRITE:           return "write";
+    case STAGE_THROTTLE_IO:     return "throttle_io";
+    case STAGE_THROTTLE_CPU:    return "throttle_cpu";
+    default:                    return "unknown";
+    }
+}
+
+//! Выводит счетчики одной строкой JSON.
+//! Длительности этапов - суммарная (мс), средняя, максимальная и процентили (мкс);
+//! процентили оцениваются по интервалам гистограммы с точностью до степени двойки.
+//! throttled_ms - суммарное время ожидания ограничений скорости чтения и доли процессора.
+//! @param out     - [in] поток вывода;
+//! @param isFinal - [in] true - отчет по завершении работы, false - промежуточный.
+void CPipelineStats::WriteJson(std::ostream& out, bool isFinal) const
+{
+    const double elapsedSec = (GetMonotonicNs() - m_startNs.load()) / 1e9;
+
+    const uint64_t throttledNs = m_stages[STAGE_THROTTLE_IO].GetSnapshot().totalNs +
+                                 m_stages[STAGE_THROTTLE_CPU].GetSnapshot().totalNs;
+
+    out << std::fixed << std::setprecision(3)
+        << "{\"final\":"         << (isFinal ? "true" : "false")
+        << ",\"elapsed_s\":"     << elapsedSec
+        << ",\"blocks_read\":"   << m_blocksRead.load(boost::memory_order_relaxed)
+        << ",\"bytes_read\":"    << m_bytesRead.load(boost::memory_order_relaxed)
+        << ",\"blocks_written\":" << m_blocksWritten.load(boost::memory_order_relaxed)
+        << ",\"throttled_ms\":"  << throttledNs / NS_IN_MICROSECOND / 1000.0
+        << ",\"queue\":{\"depth\":" << m_queueDepth.load(boost::memory_order_relaxed)
+        << ",\"adjustments\":"   << m_queueDepthChanges.load(boost::memory_order_relaxed) << "}"
+        << ",\"pool\":{\"hits\":" << m_poolHits.load(boost::memory_order_relaxed)
+        << ",\"waits\":"         << m_poolWaits.load(boost::memory_order_relaxed)
+        << ",\"fallbacks\":"     << m_poolFallbacks.load(boost::memory_order_relaxed) << "}"
+        << ",\"stages\":{";
+
+    for (size_t i = 0; i < STAGE_COUNT; ++i)
+    {
+        const CLatencyHistogram::Snapshot snapshot = m_stages[i].GetSnapshot();
+
+        const double avgUs = (snapshot.count != 0)
+                           ? snapshot.totalNs / NS_IN_MICROSECOND / snapshot.count : 0;
+
+        out << ((i != 0) ? "," : "")
+            << "\"" << StageName(static_cast<EStage>(i)) << "\":{"
+            << "\"count\":"      << snapshot.count
+            << ",\"total_ms\":"  << snapshot.totalNs / NS_IN_MICROSECOND / 1000.0
+            << ",\"avg_us\":"    << avgUs
+            << ",\"max_us\":"    << snapshot.maxNs / NS_IN_MICROSECOND
+            << ",\"p50_us\":"    << snapshot.Percentile(50) / NS_IN_MICROSECOND
+            << ",\"p90_us\":"    << snapshot.Percentile(90) / NS_IN_MICROSECOND
+            << ",\"p99_us\":"    << snapshot.Percentile(99) / NS_IN_MICROSECOND
+            << "}";
+    }
+
+    out << "}}" << std::endl;
+}
@@ -0,0 +1,160 @@
+//! @file PipelineStats.h
+//! Объявление класса CPipelineStats
+
+#ifndef _PIPELINE_STATS_H
+#define _PIPELINE_STATS_H
+
+#include "../common/stats/LatencyHistogram.h"
+
+#include <boost/atomic.hpp>
+
+#include <ostream>
+#include <stdint.h>
+
+//! Счетчики и гистограммы длительностей этапов конвейера CSignatureGenerator.
+class CPipelineStats
+{
+public:
+    //! Этапы конвейера.
+    enum EStage
+    {
+        STAGE_WAIT_POOL,        //!< Поток чтения ждет свободный блок пула
+        STAGE_READ,             //!< Чтение блока из файла
+        STAGE_WAIT_QUEUE_FREE,  //!< Поток чтения ждет места в очереди (m_condVarFreeRead)
+        STAGE_WAIT_QUEUE_DATA,  //!< Поток рассчета CRC ждет блок (m_conVarHaveDataRead)
+        STAGE_HASH,             //!< Рассчет CRC блока
+        STAGE_WAIT_MAP,         //!< Поток рассчета CRC ждет места в карте (окно переупорядочивания)
+        STAGE_WAIT_WRITE_DATA,  //!< Поток записи ждет очередной по порядку CRC
+        STAGE_WRITE,            //!< Запись CRC в файл
+        STAGE_THROTTLE_IO,      //!< Поток чтения ждет из-за ограничения скорости чтения
+        STAGE_THROTTLE_CPU,     //!< Поток рассчета CRC спит из-за ограничения доли процессора
+        STAGE_COUNT
+    };
+
+public:
+    CPipelineStats();
+
+    void Start();
+
+    //! Добавляет длительность этапа.
+    void AddStage(EStage stage, uint64_t ns)
+    {
+        m_stages[stage].Add(ns);
+    }
+
+    //! Учитывает блок, полученный из пула без ожидания.
+    void AddPoolHit()
+    {
+        m_poolHits.fetch_add(1, boost::memory_order_relaxed);
+    }
+
+    //! Учитывает истечение времени ожидания свободного блока пула.
+    void AddPoolWait()
+    {
+        m_poolWaits.fetch_add(1, boost::memory_order_relaxed);
+    }
+
+    //! Учитывает блок, полученный из непредвыделенного пула.
+    void AddPoolFallback()
+    {
+        m_poolFallbacks.fetch_add(1, boost::memory_order_relaxed);
+    }
+
+    //! Учитывает прочитанный блок.
+    void AddBlockRead(uint64_t bytes)
+    {
+        m_blocksRead.fetch_add(1, boost::memory_order_relaxed);
+        m_bytesRead.fetch_add(bytes, boost::memory_order_relaxed);
+    }
+
+    //! Учитывает записанный CRC.
+    void AddBlockWritten()
+    {
+        m_blocksWritten.fetch_add(1, boost::memory_order_relaxed);
+    }
+
+    //! Задает суммарную глубину очередей узлов в начале работы.
+    void SetQueueDepth(uint64_t depth)
+    {
+        m_queueDepth.store(static_cast<int64_t>(depth), boost::memory_order_relaxed);
+    }
+
+    //! Учитывает подстройку глубины очереди узла.
+    void AdjustQueueDepth(int64_t delta)
+    {
+        m_queueDepth.fetch_add(delta, boost::memory_order_relaxed);
+        m_queueDepthChanges.fetch_add(1, boost::memory_order_relaxed);
+    }
+
+    void WriteJson(std::ostream& out, bool isFinal) const;
+
+    static const char* StageName(EStage stage);
+
+private:
+    CPipelineStats(const CPipelineStats&);
+    CPipelineStats& operator=(const CPipelineStats&);
+
+private:
+    CLatencyHistogram       m_stages[STAGE_COUNT];
+
+    boost::atomic<uint64_t> m_poolHits;
+    boost::atomic<uint64_t> m_poolWaits;
+    boost::atomic<uint64_t> m_poolFallbacks;
+    boost::atomic<uint64_t> m_blocksRead;
+    boost::atomic<uint64_t> m_bytesRead;
+    boost::atomic<uint64_t> m_blocksWritten;
+    boost::atomic<int64_t>  m_queueDepth;
+    boost::atomic<uint64_t> m_queueDepthChanges;
+    boost::atomic<uint64_t> m_startNs;
+};
+
+//! Замер длительности этапа: от создания объекта до Stop() или разрушения.
+class CStageTimer
+{
+public:
+    CStageTimer(CPipelineStats& stats, CPipelineStats::EStage stage) :
+        m_stats(stats), m_stage(stage), m_startNs(GetMonotonicNs()), m_endNs(0), m_isStopped(false)
+    {
+    }
+
+    ~CStageTimer()
+    {
+        Stop();
+    }
+
+    //! Завершает замер.
+    void Stop()
+    {
+        if (!m_isStopped)
+        {
+            m_endNs = GetMonotonicNs();
+            m_stats.AddStage(m_stage, m_endNs - m_startNs);
+            m_isStopped = true;
+        }
+    }
+
+    //! Возвращает начало замера.
+    uint64_t StartNs() const
+    {
+        return m_startNs;
+    }
+
+    //! Возвращает окончание замера (после Stop()).
+    uint64_t EndNs() const
+    {
+        return m_endNs;
+    }
+
+private:
+    CStageTimer(const CStageTimer&);
+    CStageTimer& operator=(const CStageTimer&);
+
+private:
+    CPipelineStats&        m_stats;
+    CPipelineStats::EStage m_stage;
+    uint64_t               m_startNs;
+    uint64_t               m_endNs;
+    bool                   m_isStopped;
+};
+
+#endif // _PIPELINE_STATS_H
@@ -0,0 +1,551 @@
+//! @file SignDaemon.cpp
+//! Реализация класса CSignDaemon
+
+#include "SignDaemon.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdlib.h>
+#include <vector>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+//! Наибольшая длина строки запроса
+const size_t MAX_REQUEST_LINE = 16 * 1024;
+//! Период проверки признака остановки в Run(), мс
+const int    STOP_POLL_INTERVAL_MS = 100;
+
+//! Конструктор.
+//! @param scheduler        - [in] планировщик, выполняющий задания;
+//! @param defaultBlockSize - [in] размер блока запросов без параметра block;
+//! @param maxBlockSize     - [in] наибольший допустимый размер блока.
+CSignDaemon::CSignDaemon(CSignScheduler& scheduler, size_t defaultBlockSize, size_t maxBlockSize) :
+    m_scheduler(scheduler), m_defaultBlockSize(defaultBlockSize), m_maxBlockSize(maxBlockSize),
+    m_listenFd(-1), m_pCache(NULL)
+{
+}
+
+//! Задает кеш сигнатур, в котором ищутся сигнатуры файлов до их подписи.
+//! @param pCache - [in] кеш, NULL - без кеша; должен жить дольше сервера.
+void CSignDaemon::SetCache(CSignatureCache* pCache)
+{
+    m_pCache = pCache;
+}
+
+#ifndef _WIN32
+
+//! Деструктор.
+CSignDaemon::~CSignDaemon()
+{
+    if (m_listenFd >= 0)
+    {
+        close(m_listenFd);
+        unlink(m_socketPath.c_str());
+    }
+}
+
+//! Создает сокет и начинает прием подключений.
+//! Подключаться к сокету может только владелец процесса: сервер читает и пишет файлы
+//! с его правами.
+//! @param socketPath - [in] путь к сокету; оставшийся от прошлого запуска файл удаляется.
+//! @return true - успех, false - в случае ошибки.
+bool CSignDaemon::Listen(const std::string& socketPath)
+{
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+
+    if (socketPath.empty() || (socketPath.size() >= sizeof(addr.sun_path)))
+    {
+        std::cerr << "Invalid socket path: " << socketPath << std::endl;
+        return false;
+    }
+
+    memcpy(addr.sun_path, socketPath.c_str(), socketPath.size());
+
+    m_listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (m_listenFd < 0)
+    {
+        std::cerr << "Unable to create socket: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    unlink(socketPath.c_str());
+
+    const mode_t oldMask = umask(0177);
+    const int    result  = bind(m_listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    umask(oldMask);
+
+    if ((result != 0) || (listen(m_listenFd, SOMAXCONN) != 0))
+    {
+        std::cerr << "Unable to listen on " << socketPath << ": " << strerror(errno) << std::endl;
+
+        close(m_listenFd);
+        m_listenFd = -1;
+
+        return false;
+    }
+
+    m_socketPath = socketPath;
+
+    return true;
+}
+
+//! Принимает подключения, пока не выставлен признак остановки.
+//! Затем закрывает подключения и ждет завершения их потоков.
+//! @param abStop - [in] признак остановки, может выставляться из обработчика сигнала.
+void CSignDaemon::Run(const boost::atomic<bool>& abStop)
+{
+    while (!abStop)
+    {
+        pollfd pfd;
+        pfd.fd      = m_listenFd;
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
+
+        if (poll(&pfd, 1, STOP_POLL_INTERVAL_MS) <= 0)
+        {
+            continue;
+        }
+
+        const int clientFd = accept4(m_listenFd, NULL, NULL, SOCK_CLOEXEC);
+
+        if (clientFd < 0)
+        {
+            continue;
+        }
+
+        boost::unique_lock<boost::mutex> lock(m_clientsMutex);
+        m_clientFds.insert(clientFd);
+        lock.unlock();
+
+        boost::thread thread(boost::bind(&CSignDaemon::ThreadProcClient, this, clientFd));
+        thread.detach();
+    }
+
+    boost::unique_lock<boost::mutex> lock(m_clientsMutex);
+
+    for (std::set<int>::const_iterator it = m_clientFds.begin(); it != m_clientFds.end(); ++it)
+    {
+        shutdown(*it, SHUT_RDWR);
+    }
+
+    while (!m_clientFds.empty())
+    {
+        m_condVarNoClients.wait(lock);
+    }
+}
+
+//! Тело потока подключения: запросы выполняются по очереди до отключения клиента.
+//! @param clientFd - [in] сокет подключения.
+void CSignDaemon::ThreadProcClient(int clientFd)
+{
+    try
+    {
+        std::string buffer;
+        std::string line;
+        int         passedFd = -1;
+
+        while (ReadRequest(clientFd, buffer, line, passedFd))
+        {
+            const bool isOk = HandleRequest(clientFd, line, passedFd);
+
+            if (passedFd >= 0)
+            {
+                close(passedFd);
+                passedFd = -1;
+            }
+
+            if (!isOk)
+            {
+                break;
+            }
+        }
+
+        if (passedFd >= 0)
+        {
+            close(passedFd);
+        }
+    }
+    catch (...)
+    {
+    }
+
+    // Сокет закрывается под блокировкой, чтобы Run() не закрыл повторно занятый номер
+    boost::unique_lock<boost::mutex> lock(m_clientsMutex);
+
+    close(clientFd);
+    m_clientFds.erase(clientFd);
+
+    m_condVarNoClients.notify_all();
+}
+
+//! Читает строку запроса и переданный с ней дескриптор.
+//! @param clientFd - [in]     сокет подключения;
+//! @param buffer   - [in/out] прочитанные, но еще не разобранные данные;
+//! @param line     - [out]    строка запроса без перевода строки;
+//! @param passedFd - [out]    переданный дескриптор, -1 - не передан.
+//! @return true - успех, false - клиент отключился или нарушил протокол.
+bool CSignDaemon::ReadRequest(int clientFd, std::string& buffer, std::string& line, int& passedFd)
+{
+    std::string::size_type posEnd = buffer.find('\n');
+
+    while (posEnd == std::string::npos)
+    {
+        if (buffer.size() > MAX_REQUEST_LINE)
+        {
+            return false;
+        }
+
+        char data[4096];
+
+        iovec iov;
+        iov.iov_base = data;
+        iov.iov_len  = sizeof(data);
+
+        union
+        {
+            cmsghdr header;
+            char    space[CMSG_SPACE(sizeof(int))];
+        } control;
+
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov        = &iov;
+        msg.msg_iovlen     = 1;
+        msg.msg_control    = control.space;
+        msg.msg_controllen = sizeof(control.space);
+
+        const ssize_t size = recvmsg(clientFd, &msg, MSG_CMSG_CLOEXEC);
+
+        if (size < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            return false;
+        }
+
+        for (cmsghdr* pCmsg = CMSG_FIRSTHDR(&msg); pCmsg; pCmsg = CMSG_NXTHDR(&msg, pCmsg))
+        {
+            if ((pCmsg->cmsg_level == SOL_SOCKET) && (pCmsg->cmsg_type == SCM_RIGHTS) &&
+                (pCmsg->cmsg_len == CMSG_LEN(sizeof(int))))
+            {
+                if (passedFd >= 0)
+                {
+                    close(passedFd);
+                }
+
+                memcpy(&passedFd, CMSG_DATA(pCmsg), sizeof(int));
+            }
+        }
+
+        if (size == 0)
+        {
+            return false;
+        }
+
+        buffer.append(data, static_cast<size_t>(size));
+        posEnd = buffer.find('\n');
+    }
+
+    line.assign(buffer, 0, posEnd);
+    buffer.erase(0, posEnd + 1);
+
+    return true;
+}
+
+//! Выполняет запрос и отправляет ответ.
+//! @param clientFd - [in] сокет подключения;
+//! @param line     - [in] строка запроса;
+//! @param passedFd - [in] переданный дескриптор, -1 - не передан.
+//! @return true - можно принимать следующий запрос, false - подключение нужно закрыть.
+bool CSignDaemon::HandleRequest(int clientFd, const std::string& line, int passedFd)
+{
+    std::vector<std::string> fields;
+    std::string::size_type   posStart = 0;
+
+    while (true)
+    {
+        const std::string::size_type posTab = line.find('\t', posStart);
+
+        fields.push_back(line.substr(posStart, posTab - posStart));
+
+        if (posTab == std::string::npos)
+        {
+            break;
+        }
+
+        posStart = posTab + 1;
+    }
+
+    const std::string& command = fields[0];
+
+    if (command == "STATS")
+    {
+        const CLatencyHistogram::Snapshot snapshot = m_latency.GetSnapshot();
+
+        std::ostringstream out;
+        out << "OK requests=" << snapshot.count
+            << " p50_us=" << snapshot.Percentile(50) / 1000.0
+            << " p99_us=" << snapshot.Percentile(99) / 1000.0
+            << " max_us=" << snapshot.maxNs / 1000.0;
+
+        return SendLine(clientFd, out.str());
+    }
+
+    if ((command != "SIGN") && (command != "SIGNFD"))
+    {
+        return SendLine(clientFd, "ERR unknown command");
+    }
+
+    const bool   isPath    = (command == "SIGN");
+    const size_t firstOpt  = isPath ? 2 : 1;
+    size_t       blockSize = m_defaultBlockSize;
+    std::string  outPath;
+
+    if (isPath && (fields.size() < 2))
+    {
+        return SendLine(clientFd, "ERR path expected");
+    }
+
+    if (!isPath && (passedFd < 0))
+    {
+        return SendLine(clientFd, "ERR no file descriptor passed");
+    }
+
+    for (size_t i = firstOpt; i < fields.size(); ++i)
+    {
+        const std::string& field = fields[i];
+
+        if (field.compare(0, 6, "block=") == 0)
+        {
+            char* pEnd = NULL;
+            blockSize  = static_cast<size_t>(strtoull(field.c_str() + 6, &pEnd, 10));
+
+            if ((*pEnd != '\0') || (blockSize == 0) || (blockSize > m_maxBlockSize))
+            {
+                return SendLine(clientFd, "ERR invalid block size");
+            }
+        }
+        else if (field.compare(0, 4, "out=") == 0)
+        {
+            outPath = field.substr(4);
+        }
+        else
+        {
+            return SendLine(clientFd, "ERR unknown option " + field);
+        }
+    }
+
+    if (!isPath)
+    {
+        return SignFile(clientFd, passedFd, blockSize, outPath);
+    }
+
+    const int fd = open(fields[1].c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+    {
+        return SendLine(clientFd, std::string("ERR ") + strerror(errno));
+    }
+
+    const bool isOk = SignFile(clientFd, fd, blockSize, outPath);
+
+    close(fd);
+
+    return isOk;
+}
+
+//! Рассчитывает сигнатуру файла и отправляет ответ.
+//! @param clientFd  - [in] сокет подключения;
+//! @param fd        - [in] дескриптор файла;
+//! @param blockSize - [in] размер блока;
+//! @param outPath   - [in] файл сигнатуры, пусто - CRC отправляются в ответе.
+//! @return true - ответ отправлен, false - ошибка отправки.
+bool CSignDaemon::SignFile(int clientFd, int fd, size_t blockSize, const std::string& outPath)
+{
+    const uint64_t startNs = GetMonotonicNs();
+
+    bool     isOk      = false;
+    uint64_t numBlocks = 0;
+
+    CMemorySink                     memorySink;
+    const CMemorySink::CRecordList* pRecords = &memorySink.Records();
+    std::vector<uint8_t>            cachedRecords;
+    SignatureCacheKey               cacheKey;
+
+    if ((m_pCache != NULL) && cacheKey.Init(fd, blockSize, DigestName(DIGEST_CRC32)))
+    {
+        // С кешем записи нужны целиком: из кеша или для сохранения в него
+        if (m_pCache->Find(fd, cacheKey, CDigestList(1, DIGEST_CRC32), cachedRecords))
+        {
+            isOk     = true;
+            pRecords = &cachedRecords;
+        }
+        else
+        {
+            isOk = m_scheduler.Sign(fd, blockSize, memorySink);
+
+            SignatureCacheKey signedKey;
+
+            // Файл, измененный во время подписи, не сохраняется
+            if (isOk && signedKey.Init(fd, blockSize, cacheKey.algorithm) &&
+                (signedKey.ToString() == cacheKey.ToString()))
+            {
+                m_pCache->Store(cacheKey, memorySink.Records());
+            }
+        }
+
+        numBlocks = pRecords->size() / sizeof(uint32_t);
+
+        if (isOk && !outPath.empty())
+        {
+            std::ofstream outFile(outPath.c_str(), std::ios::binary | std::ios::trunc);
+
+            if (!pRecords->empty())
+            {
+                outFile.write(reinterpret_cast<const char*>(&(*pRecords)[0]), pRecords->size());
+            }
+
+            if (!outFile)
+            {
+                return SendLine(clientFd, "ERR unable to write output file");
+            }
+        }
+    }
+    else if (outPath.empty())
+    {
+        isOk      = m_scheduler.Sign(fd, blockSize, memorySink);
+        numBlocks = memorySink.Records().size() / sizeof(uint32_t);
+    }
+    else
+    {
+        std::ofstream outFile(outPath.c_str(), std::ios::binary | std::ios::trunc);
+
+        if (!outFile.is_open())
+        {
+            return SendLine(clientFd, "ERR unable to open output file");
+        }
+
+        CStreamSink fileSink(outFile);
+
+        isOk      = m_scheduler.Sign(fd, blockSize, fileSink);
+        numBlocks = isOk ? static_cast<uint64_t>(outFile.tellp()) / sizeof(uint32_t) : 0;
+    }
+
+    if (!isOk)
+    {
+        return SendLine(clientFd, "ERR signing failed");
+    }
+
+    std::ostringstream header;
+    header << "OK " << numBlocks;
+
+    bool isSent = SendLine(clientFd, header.str());
+
+    if (isSent && outPath.empty() && (numBlocks != 0))
+    {
+        isSent = SendAll(clientFd, &(*pRecords)[0], pRecords->size());
+    }
+
+    m_latency.Add(GetMonotonicNs() - startNs);
+
+    return isSent;
+}
+
+//! Отправляет данные целиком.
+//! @return true - успех, false - клиент отключился.
+bool CSignDaemon::SendAll(int fd, const void* pData, size_t size)
+{
+    const char* pBytes = static_cast<const char*>(pData);
+
+    while (size != 0)
+    {
+        const ssize_t sent = send(fd, pBytes, size, MSG_NOSIGNAL);
+
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            return false;
+        }
+
+        pBytes += sent;
+        size   -= static_cast<size_t>(sent);
+    }
+
+    return true;
+}
+
+//! Отправляет строку ответа с переводом строки.
+bool CSignDaemon::SendLine(int fd, const std::string& line)
+{
+    const std::string data = line + "\n";
+
+    return SendAll(fd, data.data(), data.size());
+}
+
+#else // _WIN32
+
+CSignDaemon::~CSignDaemon()
+{
+}
+
+//! Сокеты домена Unix в этой сборке не поддерживаются.
+bool CSignDaemon::Listen(const std::string&)
+{
+    std::cerr << "Daemon mode is not supported on this platform" << std::endl;
+    return false;
+}
+
+void CSignDaemon::Run(const boost::atomic<bool>&)
+{
+}
+
+void CSignDaemon::ThreadProcClient(int)
+{
+}
+
+bool CSignDaemon::ReadRequest(int, std::string&, std::string&, int&)
+{
+    return false;
+}
+
+bool CSignDaemon::HandleRequest(int, const std::string&, int)
+{
+    return false;
+}
+
+bool CSignDaemon::SignFile(int, int, size_t, const std::string&)
+{
+    return false;
+}
+
+bool CSignDaemon::SendAll(int, const void*, size_t)
+{
+    return false;
+}
+
+bool CSignDaemon::SendLine(int, const std::string&)
+{
+    return false;
+}
+
+#endif // _WIN32
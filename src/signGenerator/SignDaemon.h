@@ -0,0 +1,69 @@
+//! @file SignDaemon.h
+//! Объявление класса CSignDaemon
+
+#ifndef _SIGN_DAEMON_H
+#define _SIGN_DAEMON_H
+
+#include "../common/stats/LatencyHistogram.h"
+#include "SignScheduler.h"
+#include "SignatureCache.h"
+
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+
+#include <set>
+#include <stddef.h>
+#include <string>
+
+//! Сервер рассчета сигнатур на сокете домена Unix (только POSIX).
+//! Каждое подключение обслуживает свой поток, задания всех подключений выполняет общий
+//! CSignScheduler. Запросы - строки с полями, разделенными табуляцией:
+//!   SIGN<TAB>путь[<TAB>block=байты][<TAB>out=путь]
+//!   SIGNFD[<TAB>block=байты][<TAB>out=путь]   - дескриптор файла передается в том же
+//!                                               сообщении (SCM_RIGHTS)
+//!   STATS
+//! Ответ - строка "OK кол-во_блоков", за которой (если out не задан) следуют CRC блоков
+//! в формате файла сигнатур, или строка "ERR текст". STATS отвечает строкой
+//! "OK requests=N p50_us=... p99_us=... max_us=..." с задержками выполненных запросов.
+//! С кешем (SetCache()) сигнатуры неизменных файлов берутся из него без чтения файлов.
+class CSignDaemon
+{
+public:
+    CSignDaemon(CSignScheduler& scheduler, size_t defaultBlockSize, size_t maxBlockSize);
+    ~CSignDaemon();
+
+    void SetCache(CSignatureCache* pCache);
+
+    bool Listen(const std::string& socketPath);
+    void Run(const boost::atomic<bool>& abStop);
+
+private:
+    void ThreadProcClient(int clientFd);
+    bool ReadRequest(int clientFd, std::string& buffer, std::string& line, int& passedFd);
+    bool HandleRequest(int clientFd, const std::string& line, int passedFd);
+    bool SignFile(int clientFd, int fd, size_t blockSize, const std::string& outPath);
+
+    static bool SendAll(int fd, const void* pData, size_t size);
+    static bool SendLine(int fd, const std::string& line);
+
+private:
+    CSignDaemon(const CSignDaemon&);
+    CSignDaemon& operator=(const CSignDaemon&);
+
+private:
+    CSignScheduler&           m_scheduler;
+    size_t                    m_defaultBlockSize;
+    size_t                    m_maxBlockSize;
+
+    int                       m_listenFd;
+    std::string               m_socketPath;
+
+    std::set<int>             m_clientFds;      //!< Открытые подключения, под m_clientsMutex
+    boost::mutex              m_clientsMutex;
+    boost::condition_variable m_condVarNoClients;
+
+    CLatencyHistogram         m_latency;        //!< Задержки запросов SIGN/SIGNFD
+    CSignatureCache*          m_pCache;         //!< Кеш сигнатур, NULL - нет
+};
+
+#endif // _SIGN_DAEMON_H
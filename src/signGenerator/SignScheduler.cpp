@@ -0,0 +1,242 @@
+//! @file SignScheduler.cpp
+//! Реализация класса CSignScheduler
+
+#include "SignScheduler.h"
+
+#include "../common/io/FileIo.h"
+#include "../includes/Crc32.h"
+
+#include <algorithm>
+#include <string.h>
+
+//! Период, с которым простаивающий поток возвращает ОС память неиспользуемых классов
+//! размеров пула. Память возвращается после двух периодов простоя подряд.
+const boost::posix_time::seconds IDLE_TRIM_INTERVAL(1);
+
+//! Конструктор.
+CSignScheduler::CSignScheduler()
+{
+}
+
+//! Деструктор.
+CSignScheduler::~CSignScheduler()
+{
+    Stop();
+}
+
+//! Задает размещение памяти пула (большие страницы, закрепление в памяти).
+//! Вызывается до Start().
+//! @param arenaParams - [in] параметры размещения.
+void CSignScheduler::SetArenaParams(const CMemoryPool::ArenaParams& arenaParams)
+{
+    m_arenaParams = arenaParams;
+}
+
+//! Ограничивает работу потоков заданными процессорами.
+//! Вызывается до Start().
+//! @param cpus - [in] список процессоров, пустой - не закреплять потоки.
+void CSignScheduler::SetCpuSet(const CCpuList& cpus)
+{
+    m_cpuSet = cpus;
+}
+
+//! Создает пул памяти и запускает потоки.
+//! Пул предвыделяется по блоку на поток; блоки других размеров выделяются из классов
+//! размеров расширяемого пула и после первого задания тоже переиспользуются.
+//! Память пула, не нужная в течение двух IDLE_TRIM_INTERVAL простоя, возвращается ОС.
+//! @param blockSize - [in] основной размер блока;
+//! @param threadCnt - [in] кол-во потоков рассчета CRC.
+//! @return true - успех, false - в случае ошибки.
+bool CSignScheduler::Start(size_t blockSize, size_t threadCnt)
+{
+    threadCnt = (threadCnt != 0) ? threadCnt : 1;
+
+    CMemoryPool::PoolsParams poolParams;
+    poolParams.push_back(CMemoryPool::ExpandablePoolParams(blockSize, threadCnt));
+
+    if (!m_pool.Init(CMemoryPool::POOL_EXPANDABLE, poolParams, true, 0, m_arenaParams))
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < threadCnt; ++i)
+    {
+        m_workerThreads.create_thread(boost::bind(&CSignScheduler::ThreadProcWorker, this));
+    }
+
+    return true;
+}
+
+//! Останавливает потоки. Вызывается, когда не осталось выполняющихся заданий.
+void CSignScheduler::Stop()
+{
+    m_workerThreads.interrupt_all();
+    m_workerThreads.join_all();
+}
+
+//! Рассчитывает сигнатуру файла и передает CRC блоков в приемник.
+//! Вызывающий поток ждет завершения задания, задания разных потоков выполняются совместно.
+//! @param fd         - [in] дескриптор обычного файла, читается с блока firstBlock до конца;
+//! @param blockSize  - [in] размер блока;
+//! @param sink       - [in] приемник CRC блоков, номера блоков отсчитываются от начала файла;
+//! @param firstBlock - [in] первый рассчитываемый блок, CRC предыдущих известны вызывающему.
+//! @return true - успех, false - ошибка чтения файла или приемника.
+bool CSignScheduler::Sign(int fd, size_t blockSize, CSignatureSink& sink, uint64_t firstBlock)
+{
+    uint64_t fileSize = 0;
+
+    if (!GetRegularFileSize(fd, fileSize) || (blockSize == 0))
+    {
+        return false;
+    }
+
+    Job job;
+    job.fd            = fd;
+    job.fileSize      = fileSize;
+    job.blockSize     = blockSize;
+    job.numBlocks     = (job.fileSize + blockSize - 1) / blockSize;
+    job.firstBlock    = std::min(firstBlock, job.numBlocks);
+    job.nextBlock     = job.firstBlock;
+    job.pendingBlocks = job.numBlocks - job.firstBlock;
+
+    // CRC всех блоков задания собираются в памяти
+    if (job.pendingBlocks > job.crcs.max_size())
+    {
+        return false;
+    }
+
+    if (job.pendingBlocks != 0)
+    {
+        job.crcs.resize(static_cast<size_t>(job.pendingBlocks));
+
+        boost::unique_lock<boost::mutex> lockJobs(m_jobsMutex);
+
+        m_jobs.push_back(&job);
+        m_condVarHaveJob.notify_all();
+
+        lockJobs.unlock();
+
+        boost::unique_lock<boost::mutex> lockJob(job.mutex);
+
+        while (job.pendingBlocks != 0)
+        {
+            job.condVarDone.wait(lockJob);
+        }
+    }
+
+    if (job.abError)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < job.crcs.size(); ++i)
+    {
+        if (!sink.Write(job.firstBlock + i, reinterpret_cast<const uint8_t*>(&job.crcs[i]), sizeof(uint32_t)))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//! Тело потока рассчета CRC.
+void CSignScheduler::ThreadProcWorker()
+{
+    try
+    {
+        if (!m_cpuSet.empty())
+        {
+            CNumaTopology::BindCurrentThread(m_cpuSet);
+        }
+
+        while (true)
+        {
+            boost::unique_lock<boost::mutex> lockJobs(m_jobsMutex);
+
+            while (m_jobs.empty())
+            {
+                if (!m_condVarHaveJob.timed_wait(lockJobs, IDLE_TRIM_INTERVAL) && m_jobs.empty())
+                {
+                    lockJobs.unlock();
+
+                    // Блоки простаивающего потока отдаются на склад, иначе пул не освободить
+                    CMemoryPool::FlushThreadCache();
+                    m_pool.Trim();
+
+                    lockJobs.lock();
+                }
+            }
+
+            Job* pJob = m_jobs.front();
+            m_jobs.pop_front();
+
+            const uint64_t blockNum = pJob->nextBlock++;
+
+            // Задание с непрочитанными блоками уходит в конец очереди
+            if (pJob->nextBlock < pJob->numBlocks)
+            {
+                m_jobs.push_back(pJob);
+            }
+
+            lockJobs.unlock();
+
+            try
+            {
+                ProcessBlock(*pJob, blockNum);
+            }
+            catch (std::exception&)
+            {
+                pJob->abError = true;
+            }
+
+            boost::unique_lock<boost::mutex> lockJob(pJob->mutex);
+
+            // После последнего блока задание может быть сразу удалено ожидающим его потоком
+            if (--pJob->pendingBlocks == 0)
+            {
+                pJob->condVarDone.notify_all();
+            }
+        }
+    }
+    catch (boost::thread_interrupted&)
+    {
+    }
+}
+
+//! Читает блок задания и рассчитывает его CRC.
+//! Последний неполный блок дополняется нулями, как и в CSignatureGenerator.
+//! @param job      - [in] задание;
+//! @param blockNum - [in] номер блока.
+void CSignScheduler::ProcessBlock(Job& job, uint64_t blockNum)
+{
+    if (job.abError)
+    {
+        return;
+    }
+
+    CPoolBuffer buff = m_pool.Get(job.blockSize);
+
+    if (!buff)
+    {
+        job.abError = true;
+        return;
+    }
+
+    const uint64_t offset   = blockNum * job.blockSize;
+    const size_t   readSize = static_cast<size_t>(
+                                  std::min<uint64_t>(job.blockSize, job.fileSize - offset));
+
+    if (!ReadFileAt(job.fd, buff.get(), readSize, offset))
+    {
+        job.abError = true;
+        return;
+    }
+
+    if (readSize < job.blockSize)
+    {
+        memset(buff.get() + readSize, 0, job.blockSize - readSize);
+    }
+
+    job.crcs[static_cast<size_t>(blockNum - job.firstBlock)] = CalcCrc32(buff.get(), job.blockSize);
+}
@@ -0,0 +1,78 @@
+//! @file SignScheduler.h
+//! Объявление класса CSignScheduler
+
+#ifndef _SIGN_SCHEDULER_H
+#define _SIGN_SCHEDULER_H
+
+#include "../common/memory/MemoryPool.h"
+#include "../common/numa/NumaTopology.h"
+#include "SignatureSink.h"
+
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+
+#include <list>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+//! Постоянный пул потоков рассчета CRC для множества одновременных заданий.
+//! Потоки и память пула создаются один раз в Start() и остаются "теплыми" между заданиями.
+//! Задания выполняются по блокам в порядке круговой очереди: каждый поток берет один блок
+//! очередного задания и возвращает задание в конец очереди, поэтому небольшое задание
+//! ждет не больше одного блока от каждого из выполняющихся, а не их завершения.
+class CSignScheduler
+{
+public:
+    CSignScheduler();
+    ~CSignScheduler();
+
+    void SetArenaParams(const CMemoryPool::ArenaParams& arenaParams);
+    void SetCpuSet(const CCpuList& cpus);
+
+    bool Start(size_t blockSize, size_t threadCnt = boost::thread::hardware_concurrency());
+    void Stop();
+
+    bool Sign(int fd, size_t blockSize, CSignatureSink& sink, uint64_t firstBlock = 0);
+
+private:
+    //! Задание: рассчет CRC блоков одного файла.
+    struct Job
+    {
+        Job() : fileSize(0), blockSize(0), firstBlock(0), numBlocks(0), nextBlock(0),
+                pendingBlocks(0), abError(false) {}
+
+        int                       fd;
+        uint64_t                  fileSize;
+        size_t                    blockSize;
+        uint64_t                  firstBlock;       //!< Блоки до него не рассчитываются
+        uint64_t                  numBlocks;
+        uint64_t                  nextBlock;        //!< Под m_jobsMutex
+        uint64_t                  pendingBlocks;    //!< Под mutex
+        std::vector<uint32_t>     crcs;             //!< CRC блоков с firstBlock
+        boost::atomic<bool>       abError;
+
+        boost::mutex              mutex;
+        boost::condition_variable condVarDone;
+    };
+
+    void ThreadProcWorker();
+    void ProcessBlock(Job& job, uint64_t blockNum);
+
+private:
+    CSignScheduler(const CSignScheduler&);
+    CSignScheduler& operator=(const CSignScheduler&);
+
+private:
+    CMemoryPool::ArenaParams  m_arenaParams;
+    CCpuList                  m_cpuSet;
+
+    CMemoryPool               m_pool;
+    boost::thread_group       m_workerThreads;
+
+    std::list<Job*>           m_jobs;           //!< Круговая очередь заданий с непрочитанными блоками
+    boost::mutex              m_jobsMutex;
+    boost::condition_variable m_condVarHaveJob;
+};
+
+#endif // _SIGN_SCHEDULER_H
@@ -0,0 +1,673 @@
+//! @file SignWatcher.cpp
+//! Реализация класса CSignWatcher
+
+#include "SignWatcher.h"
+
+#include "../common/io/FileIo.h"
+#include "../common/stats/LatencyHistogram.h"
+#include "../includes/Crc32.h"
+
+#include <boost/bind/bind.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//! Задержка подписи после последней записи в файл по умолчанию, мс
+const unsigned    DEFAULT_WATCH_DELAY_MS  = 200;
+//! При непрерывной записи файл подписывается не реже, чем раз в столько задержек
+const uint64_t    WATCH_MAX_DELAY_FACTOR  = 10;
+//! Период проверки признака остановки и готовности файлов в Run(), мс
+const int         WATCH_POLL_INTERVAL_MS  = 50;
+//! Размер буфера чтения событий inotify
+const size_t      INOTIFY_BUFFER_SIZE     = 64 * 1024;
+//! Расширение файлов сигнатур
+const char* const SIGNATURE_SUFFIX        = ".sig";
+//! Расширение временных файлов сигнатур
+const char* const SIGNATURE_TEMP_SUFFIX   = ".tmp";
+
+//! Конструктор.
+//! @param scheduler   - [in] планировщик, выполняющий подпись файлов;
+//! @param blockSize   - [in] размер блока;
+//! @param signThreads - [in] кол-во файлов, подписываемых одновременно.
+CSignWatcher::CSignWatcher(CSignScheduler& scheduler, size_t blockSize, size_t signThreads) :
+    m_scheduler(scheduler), m_blockSize(blockSize), m_signThreads(std::max<size_t>(signThreads, 1)),
+    m_delayNs(static_cast<uint64_t>(DEFAULT_WATCH_DELAY_MS) * 1000 * 1000), m_isAppendOnly(false),
+    m_inotifyFd(-1), m_isStopping(false)
+{
+}
+
+//! Задает задержку подписи после последней записи в файл.
+//! @param delayMs - [in] задержка, мс.
+void CSignWatcher::SetDelay(unsigned delayMs)
+{
+    m_delayNs = static_cast<uint64_t>(delayMs) * 1000 * 1000;
+}
+
+//! Задает режим только дописывания: файлы не перезаписываются, а только растут.
+void CSignWatcher::SetAppendOnly(bool isAppendOnly)
+{
+    m_isAppendOnly = isAppendOnly;
+}
+
+#ifdef __linux__
+
+//! Отслеживаемые события каталогов
+const uint32_t WATCH_EVENTS = IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+                              IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+
+//! Возвращает путь name внутри относительного каталога dir ("" - корень).
+static std::string JoinPath(const std::string& dir, const std::string& name)
+{
+    return dir.empty() ? name : dir + "/" + name;
+}
+
+//! Создает каталог со всеми недостающими родительскими.
+//! @return true - каталог существует, false - в случае ошибки.
+static bool MakeDirs(const std::string& path)
+{
+    for (std::string::size_type pos = 1; pos <= path.size(); ++pos)
+    {
+        if ((pos != path.size()) && (path[pos] != '/'))
+        {
+            continue;
+        }
+
+        if ((mkdir(path.substr(0, pos).c_str(), 0755) != 0) && (errno != EEXIST))
+        {
+            return false;
+        }
+    }
+
+    return !path.empty();
+}
+
+//! Сравнивает время изменения файлов: true - a не позже b.
+static bool IsNotLater(const struct stat& a, const struct stat& b)
+{
+    return (a.st_mtim.tv_sec < b.st_mtim.tv_sec) ||
+           ((a.st_mtim.tv_sec == b.st_mtim.tv_sec) && (a.st_mtim.tv_nsec <= b.st_mtim.tv_nsec));
+}
+
+//! Деструктор.
+CSignWatcher::~CSignWatcher()
+{
+    boost::unique_lock<boost::mutex> lock(m_queueMutex);
+    m_isStopping = true;
+    m_condVarHaveFile.notify_all();
+    lock.unlock();
+
+    m_threads.join_all();
+
+    if (m_inotifyFd >= 0)
+    {
+        close(m_inotifyFd);
+    }
+}
+
+//! Начинает отслеживание каталога и подписывает устаревшие сигнатуры.
+//! @param dir    - [in] отслеживаемый каталог;
+//! @param outDir - [in] каталог сигнатур, создается при необходимости; может лежать
+//!                      внутри отслеживаемого, тогда он сам не отслеживается.
+//! @return true - успех, false - в случае ошибки.
+bool CSignWatcher::Watch(const std::string& dir, const std::string& outDir)
+{
+    char rootPath[PATH_MAX];
+    char outPath[PATH_MAX];
+
+    if (realpath(dir.c_str(), rootPath) == NULL)
+    {
+        std::cerr << "Unable to open directory " << dir << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    if (!MakeDirs(outDir) || (realpath(outDir.c_str(), outPath) == NULL))
+    {
+        std::cerr << "Unable to create directory " << outDir << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    m_root   = rootPath;
+    m_outDir = outPath;
+
+    if (m_outDir == m_root)
+    {
+        std::cerr << "Signature directory must differ from the watched one" << std::endl;
+        return false;
+    }
+
+    if (m_outDir.compare(0, m_root.size() + 1, m_root + "/") == 0)
+    {
+        m_outRelDir = m_outDir.substr(m_root.size() + 1);
+    }
+
+    m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (m_inotifyFd < 0)
+    {
+        std::cerr << "Unable to initialize inotify: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    if (!AddWatchTree(""))
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < m_signThreads; ++i)
+    {
+        m_threads.create_thread(boost::bind(&CSignWatcher::ThreadProcSign, this));
+    }
+
+    return true;
+}
+
+//! Обрабатывает события и ставит файлы в очередь подписи, пока не выставлен признак
+//! остановки. Затем дожидается файлов, подписываемых сейчас; очередь отбрасывается.
+//! @param abStop - [in] признак остановки, может выставляться из обработчика сигнала.
+void CSignWatcher::Run(const boost::atomic<bool>& abStop)
+{
+    while (!abStop)
+    {
+        pollfd pfd;
+        pfd.fd      = m_inotifyFd;
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
+
+        if (poll(&pfd, 1, WATCH_POLL_INTERVAL_MS) > 0)
+        {
+            HandleEvents();
+        }
+
+        ScheduleReady(GetMonotonicNs());
+    }
+
+    boost::unique_lock<boost::mutex> lock(m_queueMutex);
+    m_isStopping = true;
+    m_ready.clear();
+    m_condVarHaveFile.notify_all();
+    lock.unlock();
+
+    m_threads.join_all();
+}
+
+//! Начинает отслеживать каталог и его подкаталоги, отмечает файлы с устаревшими
+//! сигнатурами. Повторный вызов для того же каталога безопасен: inotify возвращает
+//! прежний номер, поэтому после переполнения очереди событий дерево просто
+//! просматривается заново.
+//! @param relDir - [in] каталог относительно отслеживаемого, "" - он сам.
+//! @return true - каталог отслеживается, false - в случае ошибки (ошибки подкаталогов
+//!         выводятся, но не прерывают просмотр).
+bool CSignWatcher::AddWatchTree(const std::string& relDir)
+{
+    if (IsIgnored(relDir))
+    {
+        return true;
+    }
+
+    const std::string path = relDir.empty() ? m_root : m_root + "/" + relDir;
+    const int         wd   = inotify_add_watch(m_inotifyFd, path.c_str(), WATCH_EVENTS);
+
+    if (wd < 0)
+    {
+        std::cerr << "Unable to watch " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    m_watchDirs[wd] = relDir;
+
+    // Файлы, созданные между inotify_add_watch() и просмотром, попадут и в событие,
+    // и в просмотр - повторная отметка безвредна
+    DIR* pDir = opendir(path.c_str());
+
+    if (pDir == NULL)
+    {
+        return true;
+    }
+
+    std::vector<std::string> subDirs;
+    const uint64_t           nowNs = GetMonotonicNs();
+
+    while (const dirent* pEntry = readdir(pDir))
+    {
+        if ((strcmp(pEntry->d_name, ".") == 0) || (strcmp(pEntry->d_name, "..") == 0))
+        {
+            continue;
+        }
+
+        const std::string rel = JoinPath(relDir, pEntry->d_name);
+        struct stat       st;
+
+        // Символические ссылки не отслеживаются
+        if (lstat((path + "/" + pEntry->d_name).c_str(), &st) != 0)
+        {
+            continue;
+        }
+
+        if (S_ISDIR(st.st_mode))
+        {
+            subDirs.push_back(rel);
+        }
+        else if (S_ISREG(st.st_mode) && !IsSignatureCurrent(rel))
+        {
+            MarkDirty(rel, true, nowNs);
+        }
+    }
+
+    closedir(pDir);
+
+    for (size_t i = 0; i < subDirs.size(); ++i)
+    {
+        AddWatchTree(subDirs[i]);
+    }
+
+    return true;
+}
+
+//! Читает накопившиеся события inotify.
+void CSignWatcher::HandleEvents()
+{
+    std::vector<char> buffer(INOTIFY_BUFFER_SIZE);
+
+    for (;;)
+    {
+        const ssize_t size = read(m_inotifyFd, &buffer[0], buffer.size());
+
+        if (size <= 0)
+        {
+            break;
+        }
+
+        const uint64_t nowNs = GetMonotonicNs();
+
+        for (ssize_t pos = 0; pos < size; )
+        {
+            const inotify_event* pEvent = reinterpret_cast<const inotify_event*>(&buffer[pos]);
+            pos += sizeof(inotify_event) + pEvent->len;
+
+            if (pEvent->mask & IN_Q_OVERFLOW)
+            {
+                std::cerr << "inotify event queue overflow, rescanning " << m_root << std::endl;
+                AddWatchTree("");
+                continue;
+            }
+
+            const std::map<int, std::string>::iterator itDir = m_watchDirs.find(pEvent->wd);
+
+            if (itDir == m_watchDirs.end())
+            {
+                continue;
+            }
+
+            if (pEvent->mask & IN_IGNORED)
+            {
+                m_watchDirs.erase(itDir);
+                continue;
+            }
+
+            if (pEvent->len == 0)
+            {
+                continue;
+            }
+
+            const std::string rel = JoinPath(itDir->second, pEvent->name);
+
+            if (IsIgnored(rel))
+            {
+                continue;
+            }
+
+            if (pEvent->mask & IN_ISDIR)
+            {
+                if (pEvent->mask & (IN_CREATE | IN_MOVED_TO))
+                {
+                    AddWatchTree(rel);
+                }
+                else if (pEvent->mask & IN_MOVED_FROM)
+                {
+                    // Пути перенесенного дерева устарели; если оно перенесено внутрь
+                    // отслеживаемого каталога, IN_MOVED_TO добавит его заново
+                    const std::string prefix = rel + "/";
+
+                    for (std::map<int, std::string>::iterator it = m_watchDirs.begin(); it != m_watchDirs.end(); ++it)
+                    {
+                        if ((it->second == rel) || (it->second.compare(0, prefix.size(), prefix) == 0))
+                        {
+                            inotify_rm_watch(m_inotifyFd, it->first);
+                        }
+                    }
+                }
+
+                continue;
+            }
+
+            if (pEvent->mask & (IN_DELETE | IN_MOVED_FROM))
+            {
+                m_dirty.erase(rel);
+                RemoveSignature(rel);
+            }
+            else if (pEvent->mask & (IN_MODIFY | IN_CREATE | IN_MOVED_TO | IN_CLOSE_WRITE))
+            {
+                MarkDirty(rel, (pEvent->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) != 0, nowNs);
+            }
+        }
+    }
+}
+
+//! Отмечает изменение файла.
+//! @param relPath  - [in] путь файла относительно отслеживаемого каталога;
+//! @param isClosed - [in] файл закрыт после записи или перенесен, ждать не нужно;
+//! @param nowNs    - [in] время события.
+void CSignWatcher::MarkDirty(const std::string& relPath, bool isClosed, uint64_t nowNs)
+{
+    DirtyFile& file = m_dirty[relPath];
+
+    if (file.firstNs == 0)
+    {
+        file.firstNs = nowNs;
+    }
+
+    file.lastNs   = nowNs;
+    file.isClosed = file.isClosed || isClosed;
+}
+
+//! Удаляет сигнатуру удаленного или перенесенного файла.
+void CSignWatcher::RemoveSignature(const std::string& relPath)
+{
+    const std::string sigPath = m_outDir + "/" + relPath + SIGNATURE_SUFFIX;
+
+    if (unlink(sigPath.c_str()) == 0)
+    {
+        std::cout << "Removed " << sigPath << std::endl;
+    }
+}
+
+//! Переносит в очередь подписи файлы, записи в которые закончились.
+//! Файл, который подписывается сейчас, остается отмеченным и попадет в очередь после
+//! окончания подписи: пока она идет, изменения копятся в одну следующую подпись.
+//! @param nowNs - [in] текущее время.
+void CSignWatcher::ScheduleReady(uint64_t nowNs)
+{
+    boost::unique_lock<boost::mutex> lock(m_queueMutex);
+
+    for (std::map<std::string, DirtyFile>::iterator it = m_dirty.begin(); it != m_dirty.end(); )
+    {
+        const DirtyFile& file    = it->second;
+        const bool       isReady = file.isClosed || (nowNs - file.lastNs >= m_delayNs) ||
+                                   (nowNs - file.firstNs >= m_delayNs * WATCH_MAX_DELAY_FACTOR);
+
+        if (!isReady || (m_busy.count(it->first) != 0))
+        {
+            ++it;
+            continue;
+        }
+
+        m_busy.insert(it->first);
+        m_ready.push_back(it->first);
+        m_dirty.erase(it++);
+
+        m_condVarHaveFile.notify_one();
+    }
+}
+
+//! Функция потока подписи файлов из очереди.
+void CSignWatcher::ThreadProcSign()
+{
+    for (;;)
+    {
+        boost::unique_lock<boost::mutex> lock(m_queueMutex);
+
+        while (m_ready.empty() && !m_isStopping)
+        {
+            m_condVarHaveFile.wait(lock);
+        }
+
+        if (m_isStopping)
+        {
+            return;
+        }
+
+        const std::string relPath = m_ready.front();
+        m_ready.pop_front();
+        lock.unlock();
+
+        const uint64_t startNs      = GetMonotonicNs();
+        uint64_t       signedBlocks = 0;
+        uint64_t       reusedBlocks = 0;
+        const bool     isOk         = SignFile(relPath, signedBlocks, reusedBlocks);
+
+        lock.lock();
+        m_busy.erase(relPath);
+        lock.unlock();
+
+        if (isOk)
+        {
+            // Одной записью, чтобы строки потоков не перемешивались
+            std::ostringstream line;
+            line << "Signed " << relPath << ": " << signedBlocks << " blocks, " << reusedBlocks
+                 << " reused, " << (GetMonotonicNs() - startNs) / (1000 * 1000) << " ms\n";
+
+            std::cout << line.str() << std::flush;
+        }
+    }
+}
+
+//! Подписывает файл и атомарно заменяет его сигнатуру.
+//! @param relPath      - [in]  путь файла относительно отслеживаемого каталога;
+//! @param signedBlocks - [out] кол-во рассчитанных блоков;
+//! @param reusedBlocks - [out] кол-во блоков, взятых из прошлой сигнатуры.
+//! @return true - успех, false - файл исчез, не читается или сигнатура не записана.
+bool CSignWatcher::SignFile(const std::string& relPath, uint64_t& signedBlocks, uint64_t& reusedBlocks)
+{
+    const std::string path    = m_root + "/" + relPath;
+    const std::string sigPath = m_outDir + "/" + relPath + SIGNATURE_SUFFIX;
+    const std::string tmpPath = sigPath + SIGNATURE_TEMP_SUFFIX;
+
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+
+    if (fd < 0)
+    {
+        // Удален до подписи - событие удаления уже обработано
+        return false;
+    }
+
+    struct stat st;
+
+    if ((fstat(fd, &st) != 0) || !S_ISREG(st.st_mode))
+    {
+        close(fd);
+        return false;
+    }
+
+    std::vector<uint8_t> records;
+    const uint64_t       firstBlock = m_isAppendOnly ? FindAppendStart(fd, st.st_size, sigPath, records) : 0;
+
+    CMemorySink sink;
+    const bool  isSigned = m_scheduler.Sign(fd, m_blockSize, sink, firstBlock);
+
+    close(fd);
+
+    if (!isSigned)
+    {
+        std::cerr << "Unable to sign " << path << std::endl;
+        return false;
+    }
+
+    records.resize(static_cast<size_t>(firstBlock * sizeof(uint32_t)));
+    records.insert(records.end(), sink.Records().begin(), sink.Records().end());
+
+    const std::string::size_type posSlash = sigPath.rfind('/');
+    MakeDirs(sigPath.substr(0, posSlash));
+
+    std::ofstream outFile(tmpPath.c_str(), std::ios::binary | std::ios::trunc);
+
+    if (!records.empty())
+    {
+        outFile.write(reinterpret_cast<const char*>(&records[0]), records.size());
+    }
+
+    outFile.close();
+
+    if (!outFile || (rename(tmpPath.c_str(), sigPath.c_str()) != 0))
+    {
+        std::cerr << "Unable to write " << sigPath << std::endl;
+        unlink(tmpPath.c_str());
+        return false;
+    }
+
+    signedBlocks = sink.Records().size() / sizeof(uint32_t);
+    reusedBlocks = firstBlock;
+
+    return true;
+}
+
+//! Определяет, с какого блока пересчитывать дописанный файл.
+//! Все блоки прошлой сигнатуры, кроме последнего, были полными; предпоследний
+//! перечитывается и сверяется, чтобы перезапись файла не оставила старых CRC.
+//! @param fd       - [in]  дескриптор файла;
+//! @param fileSize - [in]  текущий размер файла;
+//! @param sigPath  - [in]  файл прошлой сигнатуры;
+//! @param records  - [out] записи прошлой сигнатуры.
+//! @return номер первого пересчитываемого блока, 0 - пересчитать весь файл.
+uint64_t CSignWatcher::FindAppendStart(int fd, uint64_t fileSize, const std::string& sigPath,
+                                       std::vector<uint8_t>& records) const
+{
+    std::ifstream sigFile(sigPath.c_str(), std::ios::binary);
+
+    records.assign(std::istreambuf_iterator<char>(sigFile), std::istreambuf_iterator<char>());
+
+    const uint64_t oldBlocks = records.size() / sizeof(uint32_t);
+
+    if ((records.size() % sizeof(uint32_t) != 0) || (oldBlocks < 2))
+    {
+        return 0;
+    }
+
+    const uint64_t firstBlock = oldBlocks - 1;
+    const uint64_t checkBlock = oldBlocks - 2;
+
+    if (fileSize < firstBlock * m_blockSize)
+    {
+        return 0;
+    }
+
+    std::vector<uint8_t> block(m_blockSize);
+
+    if (!ReadFileAt(fd, &block[0], block.size(), checkBlock * m_blockSize))
+    {
+        return 0;
+    }
+
+    const uint32_t crc = CalcCrc32(&block[0], block.size());
+
+    if (memcmp(&records[static_cast<size_t>(checkBlock * sizeof(uint32_t))], &crc, sizeof(crc)) != 0)
+    {
+        return 0;
+    }
+
+    return firstBlock;
+}
+
+//! Проверяет, что сигнатура файла не старше его и рассчитана с тем же размером блока.
+bool CSignWatcher::IsSignatureCurrent(const std::string& relPath) const
+{
+    struct stat fileStat;
+    struct stat sigStat;
+
+    if ((stat((m_root + "/" + relPath).c_str(), &fileStat) != 0) ||
+        (stat((m_outDir + "/" + relPath + SIGNATURE_SUFFIX).c_str(), &sigStat) != 0))
+    {
+        return false;
+    }
+
+    const uint64_t numBlocks = (static_cast<uint64_t>(fileStat.st_size) + m_blockSize - 1) / m_blockSize;
+
+    return IsNotLater(fileStat, sigStat) &&
+           (static_cast<uint64_t>(sigStat.st_size) == numBlocks * sizeof(uint32_t));
+}
+
+//! Проверяет, что путь лежит в каталоге сигнатур.
+bool CSignWatcher::IsIgnored(const std::string& relPath) const
+{
+    return !m_outRelDir.empty() &&
+           ((relPath == m_outRelDir) || (relPath.compare(0, m_outRelDir.size() + 1, m_outRelDir + "/") == 0));
+}
+
+#else // __linux__
+
+CSignWatcher::~CSignWatcher()
+{
+}
+
+bool CSignWatcher::Watch(const std::string&, const std::string&)
+{
+    std::cerr << "Watch mode is supported on Linux only" << std::endl;
+    return false;
+}
+
+void CSignWatcher::Run(const boost::atomic<bool>&)
+{
+}
+
+bool CSignWatcher::AddWatchTree(const std::string&)
+{
+    return false;
+}
+
+void CSignWatcher::HandleEvents()
+{
+}
+
+void CSignWatcher::MarkDirty(const std::string&, bool, uint64_t)
+{
+}
+
+void CSignWatcher::RemoveSignature(const std::string&)
+{
+}
+
+void CSignWatcher::ScheduleReady(uint64_t)
+{
+}
+
+void CSignWatcher::ThreadProcSign()
+{
+}
+
+bool CSignWatcher::SignFile(const std::string&, uint64_t&, uint64_t&)
+{
+    return false;
+}
+
+uint64_t CSignWatcher::FindAppendStart(int, uint64_t, const std::string&, std::vector<uint8_t>&) const
+{
+    return 0;
+}
+
+bool CSignWatcher::IsSignatureCurrent(const std::string&) const
+{
+    return false;
+}
+
+bool CSignWatcher::IsIgnored(const std::string&) const
+{
+    return false;
+}
+
+#endif // __linux__
@@ -0,0 +1,96 @@
+//! @file SignWatcher.h
+//! Объявление класса CSignWatcher
+
+#ifndef _SIGN_WATCHER_H
+#define _SIGN_WATCHER_H
+
+#include "SignScheduler.h"
+
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+
+#include <deque>
+#include <map>
+#include <set>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//! Поддержание сигнатур файлов каталога в актуальном состоянии (inotify, только Linux).
+//! При запуске подписываются файлы, сигнатуры которых старше самих файлов, затем
+//! изменения каталога и его подкаталогов отслеживаются через inotify. Записи в файл
+//! объединяются: файл подписывается, когда его закрыли после записи, когда запись
+//! затихла на время задержки или, при непрерывной записи, не реже чем раз в
+//! WATCH_MAX_DELAY_FACTOR задержек. Сигнатура файла dir/path пишется в outDir/path.sig
+//! (в формате выходного файла signGen) через временный файл и переименование.
+//! Файлы подписывает общий постоянный CSignScheduler; несколько файлов подписываются
+//! одновременно, один файл - не больше чем одним заданием за раз.
+//! В режиме только дописывания (SetAppendOnly()) CRC блоков, которые были в прошлой
+//! сигнатуре целиком, не пересчитываются: пересчет начинается с последнего блока
+//! прошлой сигнатуры (он мог быть неполным), а предпоследний блок перечитывается
+//! для проверки. Если он изменился или файл стал короче, файл подписывается целиком.
+class CSignWatcher
+{
+public:
+    CSignWatcher(CSignScheduler& scheduler, size_t blockSize, size_t signThreads);
+    ~CSignWatcher();
+
+    void SetDelay(unsigned delayMs);
+    void SetAppendOnly(bool isAppendOnly);
+
+    bool Watch(const std::string& dir, const std::string& outDir);
+    void Run(const boost::atomic<bool>& abStop);
+
+private:
+    //! Измененный файл, ожидающий подписи.
+    struct DirtyFile
+    {
+        DirtyFile() : firstNs(0), lastNs(0), isClosed(false) {}
+
+        uint64_t firstNs;   //!< Первое изменение после прошлой подписи
+        uint64_t lastNs;    //!< Последнее изменение
+        bool     isClosed;  //!< Файл закрыт после записи
+    };
+
+    bool AddWatchTree(const std::string& relDir);
+    void HandleEvents();
+    void MarkDirty(const std::string& relPath, bool isClosed, uint64_t nowNs);
+    void RemoveSignature(const std::string& relPath);
+    void ScheduleReady(uint64_t nowNs);
+    void ThreadProcSign();
+    bool SignFile(const std::string& relPath, uint64_t& signedBlocks, uint64_t& reusedBlocks);
+    uint64_t FindAppendStart(int fd, uint64_t fileSize, const std::string& sigPath,
+                             std::vector<uint8_t>& records) const;
+    bool IsSignatureCurrent(const std::string& relPath) const;
+    bool IsIgnored(const std::string& relPath) const;
+
+private:
+    CSignWatcher(const CSignWatcher&);
+    CSignWatcher& operator=(const CSignWatcher&);
+
+private:
+    CSignScheduler&                  m_scheduler;
+    size_t                           m_blockSize;
+    size_t                           m_signThreads;
+    uint64_t                         m_delayNs;
+    bool                             m_isAppendOnly;
+
+    int                              m_inotifyFd;
+    std::string                      m_root;
+    std::string                      m_outDir;
+    std::string                      m_outRelDir;   //!< Каталог сигнатур внутри m_root, пусто - вне
+
+    std::map<int, std::string>       m_watchDirs;   //!< Отслеживаемые каталоги по номеру inotify
+    std::map<std::string, DirtyFile> m_dirty;       //!< Только в потоке Run()
+
+    boost::mutex                     m_queueMutex;  //!< Защищает поля ниже
+    boost::condition_variable        m_condVarHaveFile;
+    std::deque<std::string>          m_ready;       //!< Файлы к подписи по порядку
+    std::set<std::string>            m_busy;        //!< Файлы в очереди или подписываемые сейчас
+    bool                             m_isStopping;
+
+    boost::thread_group              m_threads;
+};
+
+#endif // _SIGN_WATCHER_H
@@ -0,0 +1,622 @@
+//! @file SignatureCache.cpp
+//! Реализация класса CSignatureCache
+
+#include "SignatureCache.h"
+
+#include "../common/io/FileIo.h"
+#include "../includes/Crc32.h"
+
+#include <boost/atomic.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <errno.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#include <sys/utime.h>
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+//! Кол-во подкаталогов записей
+const unsigned          CACHE_SHARDS        = 256;
+//! Первая строка файла записи
+const char* const       CACHE_ENTRY_MAGIC   = "SIGNCACHE1";
+//! Кол-во блоков, перечитываемых при проверке VERIFY_SAMPLE
+const uint64_t          CACHE_SAMPLE_BLOCKS = 8;
+//! Расширение временных файлов записей
+const char* const       CACHE_TEMP_SUFFIX   = ".tmp";
+//! Параметры хеша FNV-1a имени записи
+const uint64_t          FNV_OFFSET_BASIS    = 14695981039346656037ULL;
+const uint64_t          FNV_PRIME           = 1099511628211ULL;
+
+//! Заполняет ключ по открытому файлу.
+//! @param fd        - [in] дескриптор файла;
+//! @param blockSize - [in] размер блока;
+//! @param algorithm - [in] дайджесты и прочие параметры сигнатуры.
+//! @return true - успех, false - дескриптор не обычного файла или ошибка.
+bool SignatureCacheKey::Init(int fd, size_t blockSize, const std::string& algorithm)
+{
+#ifdef _WIN32
+    // На Windows номера inode нет, а время - с точностью до секунды
+    struct _stat64 st;
+
+    if ((_fstat64(fd, &st) != 0) || !(st.st_mode & _S_IFREG))
+    {
+        return false;
+    }
+
+    mtimeNs = static_cast<uint64_t>(st.st_mtime) * 1000000000ULL;
+    ctimeNs = static_cast<uint64_t>(st.st_ctime) * 1000000000ULL;
+#else
+    struct stat st;
+
+    if ((fstat(fd, &st) != 0) || !S_ISREG(st.st_mode))
+    {
+        return false;
+    }
+
+    mtimeNs = static_cast<uint64_t>(st.st_mtim.tv_sec) * 1000000000ULL + st.st_mtim.tv_nsec;
+    ctimeNs = static_cast<uint64_t>(st.st_ctim.tv_sec) * 1000000000ULL + st.st_ctim.tv_nsec;
+#endif
+
+    device          = static_cast<uint64_t>(st.st_dev);
+    inode           = static_cast<uint64_t>(st.st_ino);
+    size            = static_cast<uint64_t>(st.st_size);
+    this->blockSize = blockSize;
+    this->algorithm = algorithm;
+
+    return true;
+}
+
+//! Возвращает ключ одной строкой, как он хранится в заголовке записи.
+std::string SignatureCacheKey::ToString() const
+{
+    std::ostringstream stream;
+    stream << device << ' ' << inode << ' ' << size << ' ' << mtimeNs << ' ' << ctimeNs << ' '
+           << blockSize << ' ' << algorithm;
+
+    return stream.str();
+}
+
+//! Создает каталог, если его нет.
+static bool MakeDir(const std::string& path)
+{
+#ifdef _WIN32
+    return (_mkdir(path.c_str()) == 0) || (errno == EEXIST);
+#else
+    return (mkdir(path.c_str(), 0755) == 0) || (errno == EEXIST);
+#endif
+}
+
+//! Отмечает обращение к записи: время изменения файла - время последнего обращения.
+static void TouchEntry(const std::string& path)
+{
+#ifdef _WIN32
+    _utime(path.c_str(), NULL);
+#else
+    utime(path.c_str(), NULL);
+#endif
+}
+
+//! Пишет строку заголовка записи с размером и CRC32 сигнатуры. Поля постоянной
+//! ширины: при сохранении строка пишется заранее и заполняется после подписи.
+static void WriteSizeAndCrc(std::ostream& file, uint64_t size, uint32_t crc)
+{
+    file << std::setfill('0') << std::setw(20) << size << ' ' << std::setw(10) << crc << '\n';
+}
+
+//! Читает заголовок записи до начала сигнатуры и сверяет ключ.
+//! @param file    - [in]  файл записи;
+//! @param keyLine - [in]  ключ строкой;
+//! @param size    - [out] размер сигнатуры;
+//! @param crc     - [out] CRC32 сигнатуры.
+//! @return true - заголовок цел и ключ совпал, false - нет.
+static bool ReadEntryHeader(std::istream& file, const std::string& keyLine, uint64_t& size, uint32_t& crc)
+{
+    std::string magic;
+    std::string line;
+
+    return std::getline(file, magic) && (magic == CACHE_ENTRY_MAGIC) &&
+           std::getline(file, line) && (line == keyLine) &&
+           (file >> size >> crc) && (file.get() == '\n');
+}
+
+//! Конструктор.
+CSignatureCacheWriter::CSignatureCacheWriter() : m_sizeOffset(0), m_size(0), m_crc(0xFFFFFFFF)
+{
+}
+
+//! Деструктор: незавершенная запись удаляется.
+CSignatureCacheWriter::~CSignatureCacheWriter()
+{
+    Abort();
+}
+
+//! Возвращает true, если запись начата и еще не завершена.
+bool CSignatureCacheWriter::IsOpen() const
+{
+    return m_file.is_open();
+}
+
+//! Дописывает часть сигнатуры.
+//! @param pData - [in] данные;
+//! @param size  - [in] размер данных.
+//! @return true - успех, false - ошибка записи или запись не начата.
+bool CSignatureCacheWriter::Write(const uint8_t* pData, size_t size)
+{
+    if (!m_file.is_open())
+    {
+        return false;
+    }
+
+    m_file.write(reinterpret_cast<const char*>(pData), static_cast<std::streamsize>(size));
+
+    m_crc   = UpdateCrc32(m_crc, pData, size);
+    m_size += size;
+
+    return m_file.good();
+}
+
+//! Закрывает и удаляет временный файл, запись становится пустой.
+void CSignatureCacheWriter::Abort()
+{
+    if (m_file.is_open())
+    {
+        m_file.close();
+    }
+
+    m_file.clear();
+
+    if (!m_tmpPath.empty())
+    {
+        std::remove(m_tmpPath.c_str());
+    }
+
+    m_path.clear();
+    m_tmpPath.clear();
+    m_keyLine.clear();
+    m_sizeOffset = 0;
+    m_size       = 0;
+    m_crc        = 0xFFFFFFFF;
+}
+
+//! Конструктор.
+CSignatureCache::CSignatureCache() : m_maxSize(0), m_verifyMode(VERIFY_METADATA)
+{
+}
+
+//! Задает проверку найденных записей.
+void CSignatureCache::SetVerifyMode(EVerifyMode verifyMode)
+{
+    m_verifyMode = verifyMode;
+}
+
+//! Открывает кеш, создавая каталог при необходимости.
+//! @param dir     - [in] каталог кеша;
+//! @param maxSize - [in] наибольший размер записей, 0 - без ограничения.
+//! @return true - успех, false - каталог не создается.
+bool CSignatureCache::Open(const std::string& dir, uint64_t maxSize)
+{
+    if (dir.empty() || !MakeDir(dir))
+    {
+        std::cerr << "Unable to create cache directory " << dir << std::endl;
+        return false;
+    }
+
+    m_dir     = dir;
+    m_maxSize = maxSize;
+
+    return true;
+}
+
+//! Ищет сигнатуру файла и проверяет ее по режиму проверки.
+//! @param fd        - [in]  дескриптор файла для перечитывания блоков, -1 - блоки не
+//!                          перечитываются (сигнатура распакованных данных);
+//! @param key       - [in]  ключ;
+//! @param digests   - [in]  дайджесты записи блока;
+//! @param signature - [out] сигнатура.
+//! @return true - найдена, false - нет, файл нужно подписать и сохранить сигнатуру.
+bool CSignatureCache::Find(int fd, const SignatureCacheKey& key, const CDigestList& digests,
+                           std::vector<uint8_t>& signature)
+{
+    if ((m_verifyMode == VERIFY_FULL) || !Load(key, signature))
+    {
+        return false;
+    }
+
+    if ((m_verifyMode == VERIFY_SAMPLE) && (fd >= 0) &&
+        !VerifySample(fd, static_cast<size_t>(key.blockSize), digests, signature))
+    {
+        std::cerr << "Cached signature does not match the file, re-signing" << std::endl;
+        return false;
+    }
+
+    TouchEntry(EntryPath(key));
+
+    return true;
+}
+
+//! Сохраняет сигнатуру файла целиком (см. BeginStore(), CommitStore()).
+//! @param key       - [in] ключ;
+//! @param signature - [in] сигнатура.
+//! @return true - успех, false - запись не сохранена.
+bool CSignatureCache::Store(const SignatureCacheKey& key, const std::vector<uint8_t>& signature)
+{
+    CSignatureCacheWriter writer;
+
+    return BeginStore(key, writer) &&
+           (signature.empty() || writer.Write(&signature[0], signature.size())) &&
+           CommitStore(writer);
+}
+
+//! Начинает сохранение сигнатуры файла: создает временный файл записи с заголовком,
+//! размер и CRC32 в котором заполняются при CommitStore().
+//! @param key    - [in]  ключ;
+//! @param writer - [out] запись, в которую дописывается сигнатура.
+//! @return true - успех, false - временный файл не создан.
+bool CSignatureCache::BeginStore(const SignatureCacheKey& key, CSignatureCacheWriter& writer) const
+{
+    writer.Abort();
+
+    const std::string path     = EntryPath(key);
+    const std::string shardDir = path.substr(0, path.rfind('/'));
+
+    if (!MakeDir(shardDir))
+    {
+        return false;
+    }
+
+    // Свой временный файл у каждого процесса и вызова, переименование заменяет запись целиком
+    static boost::atomic<unsigned> s_tmpCounter(0);
+
+    std::ostringstream tmpPath;
+#ifdef _WIN32
+    tmpPath << path << '.' << _getpid() << '.' << s_tmpCounter++ << CACHE_TEMP_SUFFIX;
+#else
+    tmpPath << path << '.' << getpid() << '.' << s_tmpCounter++ << CACHE_TEMP_SUFFIX;
+#endif
+
+    writer.m_file.open(tmpPath.str().c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+
+    if (!writer.m_file.is_open())
+    {
+        return false;
+    }
+
+    writer.m_path    = path;
+    writer.m_tmpPath = tmpPath.str();
+    writer.m_keyLine = key.ToString();
+
+    writer.m_file << CACHE_ENTRY_MAGIC << '\n' << writer.m_keyLine << '\n';
+
+    writer.m_sizeOffset = writer.m_file.tellp();
+
+    WriteSizeAndCrc(writer.m_file, 0, 0);
+
+    if (!writer.m_file)
+    {
+        writer.Abort();
+        return false;
+    }
+
+    return true;
+}
+
+//! Завершает сохранение: заполняет размер и CRC32 в заголовке, переименовывает
+//! временный файл в запись и вытесняет старые записи при превышении размера.
+//! В режиме VERIFY_FULL сообщает, если прежняя запись с тем же ключом отличалась.
+//! @param writer - [in] запись, начатая BeginStore().
+//! @return true - успех, false - запись не сохранена, временный файл удален.
+bool CSignatureCache::CommitStore(CSignatureCacheWriter& writer) const
+{
+    if (!writer.IsOpen())
+    {
+        return false;
+    }
+
+    const uint32_t crc = writer.m_crc ^ 0xFFFFFFFF;
+
+    writer.m_file.seekp(writer.m_sizeOffset);
+
+    WriteSizeAndCrc(writer.m_file, writer.m_size, crc);
+
+    writer.m_file.close();
+
+    if (!writer.m_file)
+    {
+        writer.Abort();
+        return false;
+    }
+
+    if (m_verifyMode == VERIFY_FULL)
+    {
+        std::ifstream oldFile(writer.m_path.c_str(), std::ios::in | std::ios::binary);
+        uint64_t      oldSize = 0;
+        uint32_t      oldCrc  = 0;
+
+        if (ReadEntryHeader(oldFile, writer.m_keyLine, oldSize, oldCrc) &&
+            ((oldSize != writer.m_size) || (oldCrc != crc)))
+        {
+            std::cerr << "Cached signature was stale, replaced" << std::endl;
+        }
+    }
+
+#ifdef _WIN32
+    // rename() на Windows не заменяет существующий файл
+    std::remove(writer.m_path.c_str());
+#endif
+
+    if (std::rename(writer.m_tmpPath.c_str(), writer.m_path.c_str()) != 0)
+    {
+        writer.Abort();
+        return false;
+    }
+
+    const std::string path = writer.m_path;
+
+    writer.m_tmpPath.clear();
+    writer.Abort();
+
+    if (m_maxSize != 0)
+    {
+        Evict(path);
+    }
+
+    return true;
+}
+
+//! Разбирает режим проверки: meta, sample или full.
+//! @param str        - [in]  строка режима, пусто - meta;
+//! @param verifyMode - [out] режим.
+//! @return true - успех, false - неизвестный режим.
+bool CSignatureCache::ParseVerifyMode(const std::string& str, EVerifyMode& verifyMode)
+{
+    if (str.empty() || (str == "meta"))
+    {
+        verifyMode = VERIFY_METADATA;
+    }
+    else if (str == "sample")
+    {
+        verifyMode = VERIFY_SAMPLE;
+    }
+    else if (str == "full")
+    {
+        verifyMode = VERIFY_FULL;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+//! Перечитывает CACHE_SAMPLE_BLOCKS блоков, разнесенных по файлу (первый и последний
+//! всегда), и сравнивает их дайджесты с сигнатурой.
+//! @param fd        - [in] дескриптор файла;
+//! @param blockSize - [in] размер блока;
+//! @param digests   - [in] дайджесты записи блока;
+//! @param signature - [in] сигнатура.
+//! @return true - блоки совпали, false - расхождение или ошибка чтения.
+bool CSignatureCache::VerifySample(int fd, size_t blockSize, const CDigestList& digests,
+                                   const std::vector<uint8_t>& signature)
+{
+    uint64_t fileSize = 0;
+
+    if (!GetRegularFileSize(fd, fileSize) || (blockSize == 0))
+    {
+        return false;
+    }
+
+    size_t recordSize = 0;
+
+    for (size_t i = 0; i < digests.size(); ++i)
+    {
+        recordSize += DigestSize(digests[i]);
+    }
+
+    const uint64_t numBlocks = (fileSize + blockSize - 1) / blockSize;
+
+    if (signature.size() != numBlocks * recordSize)
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> block(blockSize);
+    std::vector<uint8_t> record(recordSize);
+
+    for (uint64_t i = 0; i < std::min(numBlocks, CACHE_SAMPLE_BLOCKS); ++i)
+    {
+        const uint64_t blockNum = (CACHE_SAMPLE_BLOCKS >= numBlocks) ? i
+                                  : i * (numBlocks - 1) / (CACHE_SAMPLE_BLOCKS - 1);
+        const uint64_t offset   = blockNum * blockSize;
+        const size_t   readSize = static_cast<size_t>(std::min<uint64_t>(blockSize, fileSize - offset));
+
+        if (!ReadFileAt(fd, &block[0], readSize, offset))
+        {
+            return false;
+        }
+
+        // Последний неполный блок дополняется нулями, как и при подписи
+        std::fill(block.begin() + readSize, block.end(), 0);
+
+        uint8_t* pDigest = &record[0];
+
+        for (size_t j = 0; j < digests.size(); ++j)
+        {
+            CalcDigest(digests[j], &block[0], block.size(), pDigest);
+            pDigest += DigestSize(digests[j]);
+        }
+
+        if (memcmp(&record[0], &signature[static_cast<size_t>(blockNum * recordSize)], recordSize) != 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//! Читает запись и сверяет ключ и CRC32 сигнатуры.
+//! @return true - запись есть и цела, false - нет, другой ключ с тем же хешем или
+//!         запись повреждена.
+bool CSignatureCache::Load(const SignatureCacheKey& key, std::vector<uint8_t>& signature) const
+{
+    std::ifstream file(EntryPath(key).c_str(), std::ios::in | std::ios::binary);
+    uint64_t      size = 0;
+    uint32_t      crc  = 0;
+
+    if (!ReadEntryHeader(file, key.ToString(), size, crc))
+    {
+        return false;
+    }
+
+    signature.resize(static_cast<size_t>(size));
+
+    if (size != 0)
+    {
+        file.read(reinterpret_cast<char*>(&signature[0]), static_cast<std::streamsize>(size));
+    }
+
+    if (!file || ((size != 0) && (CalcCrc32(&signature[0], signature.size()) != crc)))
+    {
+        return false;
+    }
+
+    return true;
+}
+
+//! Возвращает путь записи: подкаталог по первому байту хеша ключа, имя - хеш.
+std::string CSignatureCache::EntryPath(const SignatureCacheKey& key) const
+{
+    const std::string str  = key.ToString();
+    uint64_t          hash = FNV_OFFSET_BASIS;
+
+    for (size_t i = 0; i < str.size(); ++i)
+    {
+        hash = (hash ^ static_cast<uint8_t>(str[i])) * FNV_PRIME;
+    }
+
+    std::ostringstream path;
+    path << m_dir << '/' << std::hex << std::setfill('0') << std::setw(2) << (hash % CACHE_SHARDS)
+         << '/' << std::setw(16) << hash;
+
+    return path.str();
+}
+
+//! Запись кеша при вытеснении.
+struct CacheEntryInfo
+{
+    bool operator<(const CacheEntryInfo& other) const
+    {
+        return lastUse < other.lastUse;
+    }
+
+    std::string path;
+    uint64_t    size;
+    int64_t     lastUse;   //!< Время изменения записи, нс
+};
+
+//! Вытесняет давно не нужные записи подкаталога, пока он больше своей доли размера кеша.
+//! Просматривается только подкаталог, поэтому запись не замедляется с ростом кеша.
+//! @param keepPath - [in] только что сохраненная запись, она не вытесняется.
+void CSignatureCache::Evict(const std::string& keepPath) const
+{
+    const std::string shardDir = keepPath.substr(0, keepPath.rfind('/'));
+
+    std::vector<CacheEntryInfo> entries;
+    uint64_t                    totalSize = 0;
+
+#ifdef _WIN32
+    WIN32_FIND_DATAA findData;
+    HANDLE           hFind = FindFirstFileA((shardDir + "/*").c_str(), &findData);
+
+    if (hFind == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+
+    do
+    {
+        const std::string name = findData.cFileName;
+#else
+    DIR* pDir = opendir(shardDir.c_str());
+
+    if (pDir == NULL)
+    {
+        return;
+    }
+
+    while (const dirent* pEntry = readdir(pDir))
+    {
+        const std::string name = pEntry->d_name;
+#endif
+        // Временные файлы других процессов не трогаются
+        if ((name[0] == '.') || (name.find('.') != std::string::npos))
+        {
+            continue;
+        }
+
+        CacheEntryInfo entry;
+        entry.path = shardDir + "/" + name;
+
+        struct stat st;
+
+        if (stat(entry.path.c_str(), &st) != 0)
+        {
+            continue;
+        }
+
+        entry.size = static_cast<uint64_t>(st.st_size);
+#ifdef _WIN32
+        entry.lastUse = static_cast<int64_t>(st.st_mtime) * 1000000000LL;
+#else
+        entry.lastUse = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+        totalSize += entry.size;
+
+        if (entry.path != keepPath)
+        {
+            entries.push_back(entry);
+        }
+#ifdef _WIN32
+    }
+    while (FindNextFileA(hFind, &findData));
+
+    FindClose(hFind);
+#else
+    }
+
+    closedir(pDir);
+#endif
+
+    const uint64_t shardLimit = std::max<uint64_t>(m_maxSize / CACHE_SHARDS, 1);
+
+    if (totalSize <= shardLimit)
+    {
+        return;
+    }
+
+    std::sort(entries.begin(), entries.end());
+
+    for (size_t i = 0; (i < entries.size()) && (totalSize > shardLimit); ++i)
+    {
+        if (std::remove(entries[i].path.c_str()) == 0)
+        {
+            totalSize -= entries[i].size;
+        }
+    }
+}
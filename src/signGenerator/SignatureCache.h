@@ -0,0 +1,109 @@
+//! @file SignatureCache.h
+//! Объявление класса CSignatureCache
+
+#ifndef _SIGNATURE_CACHE_H
+#define _SIGNATURE_CACHE_H
+
+#include "../common/hash/Digest.h"
+
+#include <fstream>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//! Ключ записи кеша: идентичность файла и параметры сигнатуры.
+//! Изменение содержимого файла меняет mtime или ctime (ctime нельзя выставить
+//! вручную), замена файла другим - номер inode.
+struct SignatureCacheKey
+{
+    SignatureCacheKey() : device(0), inode(0), size(0), mtimeNs(0), ctimeNs(0), blockSize(0) {}
+
+    bool        Init(int fd, size_t blockSize, const std::string& algorithm);
+    std::string ToString() const;
+
+    uint64_t    device;
+    uint64_t    inode;
+    uint64_t    size;
+    uint64_t    mtimeNs;
+    uint64_t    ctimeNs;
+    uint64_t    blockSize;
+    std::string algorithm;   //!< Дайджесты и прочие параметры, влияющие на сигнатуру
+};
+
+//! Запись кеша, сохраняемая по мере подписи: сигнатура пишется во временный файл
+//! частями, CRC32 считается по пути. Запись появляется в кеше только после
+//! CSignatureCache::CommitStore(), иначе временный файл удаляется деструктором.
+class CSignatureCacheWriter
+{
+public:
+    CSignatureCacheWriter();
+    ~CSignatureCacheWriter();
+
+    bool IsOpen() const;
+    bool Write(const uint8_t* pData, size_t size);
+
+private:
+    // Копирование открытого временного файла не имеет смысла
+    CSignatureCacheWriter(const CSignatureCacheWriter&);
+    CSignatureCacheWriter& operator=(const CSignatureCacheWriter&);
+
+    void Abort();
+
+    friend class CSignatureCache;
+
+private:
+    std::ofstream  m_file;
+    std::string    m_path;          //!< Путь записи
+    std::string    m_tmpPath;       //!< Путь временного файла
+    std::string    m_keyLine;       //!< Ключ записи строкой
+    std::streamoff m_sizeOffset;    //!< Смещение размера и CRC32 в заголовке
+    uint64_t       m_size;          //!< Записано байтов сигнатуры
+    uint32_t       m_crc;           //!< Текущее значение CRC32 (не инвертированное)
+};
+
+//! Постоянный кеш сигнатур на диске: сигнатура неизменного файла возвращается без
+//! его чтения. Запись - отдельный файл в одном из CACHE_SHARDS подкаталогов, имя -
+//! хеш ключа; в заголовке записи хранятся ключ целиком и CRC32 сигнатуры. Записи
+//! заменяются через временный файл и переименование, поэтому кешем могут
+//! одновременно пользоваться несколько процессов. Время изменения записи - время
+//! последнего обращения: при превышении размера вытесняются давно не нужные записи
+//! подкаталога, в который идет запись (каждому подкаталогу - равная доля размера).
+class CSignatureCache
+{
+public:
+    //! Проверка найденной записи.
+    enum EVerifyMode
+    {
+        VERIFY_METADATA,   //!< Только ключ
+        VERIFY_SAMPLE,     //!< Ключ и несколько блоков файла, перечитанных заново
+        VERIFY_FULL        //!< Файл подписывается заново, расхождение с записью выводится
+    };
+
+    CSignatureCache();
+
+    void SetVerifyMode(EVerifyMode verifyMode);
+    bool Open(const std::string& dir, uint64_t maxSize);
+
+    bool Find(int fd, const SignatureCacheKey& key, const CDigestList& digests,
+              std::vector<uint8_t>& signature);
+    bool Store(const SignatureCacheKey& key, const std::vector<uint8_t>& signature);
+    bool BeginStore(const SignatureCacheKey& key, CSignatureCacheWriter& writer) const;
+    bool CommitStore(CSignatureCacheWriter& writer) const;
+
+    static bool ParseVerifyMode(const std::string& str, EVerifyMode& verifyMode);
+    static bool VerifySample(int fd, size_t blockSize, const CDigestList& digests,
+                             const std::vector<uint8_t>& signature);
+
+private:
+    bool        Load(const SignatureCacheKey& key, std::vector<uint8_t>& signature) const;
+    std::string EntryPath(const SignatureCacheKey& key) const;
+    void        Evict(const std::string& keepPath) const;
+
+private:
+    std::string m_dir;
+    uint64_t    m_maxSize;      //!< Наибольший размер кеша, 0 - без ограничения
+    EVerifyMode m_verifyMode;
+};
+
+#endif // _SIGNATURE_CACHE_H
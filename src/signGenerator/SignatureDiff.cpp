@@ -0,0 +1,183 @@
+//! @file SignatureDiff.cpp
+//! Сравнение сигнатур двух версий файла
+
+#include "SignatureDiff.h"
+
+#include "../common/io/MappedFile.h"
+
+#include <boost/bind/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <string.h>
+
+//! Размер группы записей, сравниваемой одним memcmp(): равные группы пропускаются
+//! векторизованным сравнением libc, записи по одной сравниваются только в группах
+//! с отличиями
+const size_t   DIFF_GROUP_BYTES     = 256;
+//! Наименьший объем записей на поток: меньшие сигнатуры сравнивает один поток
+const uint64_t DIFF_MIN_THREAD_BYTES = 4 * 1024 * 1024;
+
+//! Добавляет измененный блок, продолжая последний участок, если блок следует за ним.
+static void AddChangedBlocks(CChangedRangeList& ranges, uint64_t firstBlock, uint64_t lastBlock)
+{
+    if (!ranges.empty() && (ranges.back().lastBlock == firstBlock))
+    {
+        ranges.back().lastBlock = lastBlock;
+    }
+    else
+    {
+        ranges.push_back(ChangedRange(firstBlock, lastBlock));
+    }
+}
+
+//! Сравнивает записи блоков [firstBlock, lastBlock) двух сигнатур.
+//! @param pOld       - [in]  записи старой сигнатуры;
+//! @param pNew       - [in]  записи новой сигнатуры;
+//! @param recordSize - [in]  размер записи блока;
+//! @param firstBlock - [in]  первый блок;
+//! @param lastBlock  - [in]  блок после последнего;
+//! @param pRanges    - [out] измененные участки по порядку.
+static void DiffRecords(const uint8_t* pOld, const uint8_t* pNew, size_t recordSize,
+                        uint64_t firstBlock, uint64_t lastBlock, CChangedRangeList* pRanges)
+{
+    const uint64_t groupBlocks = std::max<uint64_t>(DIFF_GROUP_BYTES / recordSize, 1);
+
+    for (uint64_t group = firstBlock; group < lastBlock; group += groupBlocks)
+    {
+        const uint64_t groupEnd = std::min(group + groupBlocks, lastBlock);
+        const size_t   offset   = static_cast<size_t>(group * recordSize);
+
+        if (memcmp(pOld + offset, pNew + offset, static_cast<size_t>((groupEnd - group) * recordSize)) == 0)
+        {
+            continue;
+        }
+
+        for (uint64_t block = group; block < groupEnd; ++block)
+        {
+            const size_t blockOffset = static_cast<size_t>(block * recordSize);
+
+            // Запись CRC32 сравнивается словом, без вызова memcmp()
+            bool isChanged = false;
+
+            if (recordSize == sizeof(uint32_t))
+            {
+                uint32_t oldCrc = 0;
+                uint32_t newCrc = 0;
+                memcpy(&oldCrc, pOld + blockOffset, sizeof(oldCrc));
+                memcpy(&newCrc, pNew + blockOffset, sizeof(newCrc));
+
+                isChanged = (oldCrc != newCrc);
+            }
+            else
+            {
+                isChanged = (memcmp(pOld + blockOffset, pNew + blockOffset, recordSize) != 0);
+            }
+
+            if (isChanged)
+            {
+                AddChangedBlocks(*pRanges, block, block + 1);
+            }
+        }
+    }
+}
+
+//! Сравнивает сигнатуры двух версий файла с одним размером блока и дайджестами.
+//! Файлы отображаются в память, записи делятся на равные части по потокам; участки
+//! частей объединяются на границах. Блоки, которые есть только в одной из сигнатур
+//! (файл вырос или укоротился), считаются измененными.
+//! @param oldPath    - [in]  старая сигнатура;
+//! @param newPath    - [in]  новая сигнатура;
+//! @param recordSize - [in]  размер записи блока;
+//! @param threadCnt  - [in]  кол-во потоков сравнения;
+//! @param ranges     - [out] измененные участки по порядку, соседние объединены;
+//! @param numBlocks  - [out] кол-во блоков большей из сигнатур;
+//! @param error      - [out] описание ошибки.
+//! @return true - успех, false - в случае ошибки.
+bool DiffSignatures(const std::string& oldPath, const std::string& newPath, size_t recordSize,
+                    size_t threadCnt, CChangedRangeList& ranges, uint64_t& numBlocks,
+                    std::string& error)
+{
+    ranges.clear();
+    numBlocks = 0;
+
+    CMappedFile oldFile;
+    CMappedFile newFile;
+
+    if (!oldFile.Open(oldPath))
+    {
+        error = "Unable to open signature file " + oldPath;
+        return false;
+    }
+
+    if (!newFile.Open(newPath))
+    {
+        error = "Unable to open signature file " + newPath;
+        return false;
+    }
+
+    if ((recordSize == 0) || (oldFile.Size() % recordSize != 0) || (newFile.Size() % recordSize != 0))
+    {
+        error = "Signature size is not a multiple of the block record size";
+        return false;
+    }
+
+    const uint64_t oldBlocks    = oldFile.Size() / recordSize;
+    const uint64_t newBlocks    = newFile.Size() / recordSize;
+    const uint64_t commonBlocks = std::min(oldBlocks, newBlocks);
+
+    numBlocks = std::max(oldBlocks, newBlocks);
+
+    // Части по потокам не меньше DIFF_MIN_THREAD_BYTES: запуск потока дороже сравнения
+    const uint64_t maxThreads = std::max<uint64_t>(commonBlocks * recordSize / DIFF_MIN_THREAD_BYTES, 1);
+    const size_t   partCnt    = static_cast<size_t>(std::min<uint64_t>(std::max<size_t>(threadCnt, 1), maxThreads));
+
+    std::vector<CChangedRangeList> partRanges(partCnt);
+
+    if (partCnt == 1)
+    {
+        DiffRecords(oldFile.Data(), newFile.Data(), recordSize, 0, commonBlocks, &partRanges[0]);
+    }
+    else
+    {
+        boost::thread_group threads;
+
+        for (size_t i = 0; i < partCnt; ++i)
+        {
+            threads.create_thread(boost::bind(&DiffRecords, oldFile.Data(), newFile.Data(), recordSize,
+                                              commonBlocks * i / partCnt, commonBlocks * (i + 1) / partCnt,
+                                              &partRanges[i]));
+        }
+
+        threads.join_all();
+    }
+
+    for (size_t i = 0; i < partRanges.size(); ++i)
+    {
+        for (size_t j = 0; j < partRanges[i].size(); ++j)
+        {
+            AddChangedBlocks(ranges, partRanges[i][j].firstBlock, partRanges[i][j].lastBlock);
+        }
+    }
+
+    if (commonBlocks < numBlocks)
+    {
+        AddChangedBlocks(ranges, commonBlocks, numBlocks);
+    }
+
+    return true;
+}
+
+//! Выводит измененные участки исходного файла строками "смещение длина" в байтах.
+//! Участок с последним блоком может выходить за конец файла на неполный блок.
+//! @param out       - [in] поток вывода;
+//! @param ranges    - [in] измененные участки;
+//! @param blockSize - [in] размер блока.
+void WriteChangedRanges(std::ostream& out, const CChangedRangeList& ranges, uint64_t blockSize)
+{
+    for (size_t i = 0; i < ranges.size(); ++i)
+    {
+        out << ranges[i].firstBlock * blockSize << ' '
+            << (ranges[i].lastBlock - ranges[i].firstBlock) * blockSize << '\n';
+    }
+}
@@ -0,0 +1,31 @@
+//! @file SignatureDiff.h
+//! Сравнение сигнатур двух версий файла
+
+#ifndef _SIGNATURE_DIFF_H
+#define _SIGNATURE_DIFF_H
+
+#include <ostream>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//! Измененный участок: блоки [firstBlock, lastBlock).
+struct ChangedRange
+{
+    ChangedRange() : firstBlock(0), lastBlock(0) {}
+    ChangedRange(uint64_t first, uint64_t last) : firstBlock(first), lastBlock(last) {}
+
+    uint64_t firstBlock;
+    uint64_t lastBlock;     //!< Номер блока после последнего
+};
+
+typedef std::vector<ChangedRange> CChangedRangeList;
+
+bool DiffSignatures(const std::string& oldPath, const std::string& newPath, size_t recordSize,
+                    size_t threadCnt, CChangedRangeList& ranges, uint64_t& numBlocks,
+                    std::string& error);
+
+void WriteChangedRanges(std::ostream& out, const CChangedRangeList& ranges, uint64_t blockSize);
+
+#endif // _SIGNATURE_DIFF_H
@@ -1,49 +1,433 @@
-//! @file MemoryPool.cpp
-//! Реализация класса CMemoryPool
+//! @file SignatureGenerator.cpp
+//! Реализация класса CSignatureGenerator
 #include "SignatureGenerator.h"
 
-//! Максимальный размер карты рассчитанных значний CRC
+//! Максимальный размер карты рассчитанных значний CRC по-умолчанию
 const uint32_t MAX_MAP_SIZE = 50;
+//! Глубина очереди подстраивается после каждых стольких прочитанных узлом блоков
+const size_t   QUEUE_ADAPT_INTERVAL = 32;
+//! Наибольшее кол-во событий трассы, которое один поток записывает на блок
+const size_t   TRACE_EVENTS_PER_BLOCK = 4;
+//! Время ожидания свободного блока в пуле, после которого проверяется состояние конвейера
+const boost::posix_time::milliseconds POOL_WAIT_TIMEOUT(100);
+//! Доля скорости чтения, которую можно прочитать всплеском после простоя (1/20 - 50 мс)
+const uint64_t IO_BURST_DIVISOR = 20;
+//! Наименьшая емкость пула узла: один блок читается, пока другой обрабатывается
+const size_t   MIN_POOL_BLOCKS = 2;
 
 //! Конструктор.
 CSignatureGenerator::CSignatureGenerator() : 
-            m_currentReadBlockNum(0), m_abReadFinished(0),    m_abError(0), 
-            m_calkCrcThreadsNum(0),   m_inFileSize(0),        m_blockSize(0),
-            m_maxQueueSize(0),        m_currentWriteBlock(0), m_numBlocksInFile(0)
+            m_pSource(NULL),          m_recordSize(0),        m_numTasks(0),
+            m_dedupTask(0),           m_pDedupIndex(NULL),    m_blockSize(0),
+            m_pfnCrcCalcProc(&CSignatureGenerator::ThreadProcCrcCalc<0>),
+            m_isNumaEnabled(true),    m_isNodesValid(false),
+            m_pCrcProcessorsThreads(new boost::thread_group()),
+            m_pReaderThreads(new boost::thread_group()),
+            m_abReadFinished(0),      m_abError(0),           m_aActiveReaders(0),
+            m_memoryLimit(0),         m_traceMaxEvents(0),    m_ioSize(0),
+            m_ioPos(0),               m_ioFill(0),            m_maxMapSize(MAX_MAP_SIZE),
+            m_isAdaptiveQueue(false), m_ioLimit(0),           m_cpuShare(100),
+            m_firstBlock(0),          m_lastBlock(NO_LAST_BLOCK),
+            m_currentReadBlockNum(0), m_currentWriteBlock(0), m_numBlocksInFile(0),
+            m_isSourceEnd(false),     m_calkCrcThreadsNum(0)
 {
+    SetDigests(CDigestList(1, DIGEST_CRC32));
+}
+
+//! Деструктор. Останавливает потоки незавершенного рассчета.
+CSignatureGenerator::~CSignatureGenerator()
+{
+    DeInit();
+}
+
+//! Задает ограничение памяти под буферы чтения.
+//! Вызывается до Init(). Исходя из него рассчитываются емкость пула и глубина очереди.
+//! @param memoryLimit - [in] ограничение в байтах, 0 - без ограничения.
+void CSignatureGenerator::SetMemoryLimit(size_t memoryLimit)
+{
+    m_memoryLimit  = memoryLimit;
+    m_isNodesValid = false;
+}
+
+//! Задает размещение памяти пула (большие страницы, закрепление в памяти).
+//! Вызывается до Init().
+//! @param arenaParams - [in] параметры размещения.
+void CSignatureGenerator::SetArenaParams(const CMemoryPool::ArenaParams& arenaParams)
+{
+    m_arenaParams  = arenaParams;
+    m_isNodesValid = false;
+}
+
+//! Ограничивает работу заданными процессорами.
+//! Вызывается до Init().
+//! @param cpus - [in] список процессоров, пустой - все доступные процессу.
+void CSignatureGenerator::SetCpuSet(const CCpuList& cpus)
+{
+    m_cpuSet       = cpus;
+    m_isNodesValid = false;
+}
+
+//! Включает или выключает разделение конвейера по узлам NUMA.
+//! Вызывается до Init().
+//! @param isEnabled - [in] true - по конвейеру на узел (по-умолчанию), false - один конвейер.
+void CSignatureGenerator::SetNumaEnabled(bool isEnabled)
+{
+    m_isNumaEnabled = isEnabled;
+    m_isNodesValid  = false;
+}
+
+//! Включает запись трассы обработки блоков.
+//! Вызывается до StartProcessing().
+//! @param maxEventsPerThread - [in] наибольшая емкость буфера событий каждого потока; буферы
+//!                                  не больше, чем нужно для всех блоков файла.
+void CSignatureGenerator::EnableTrace(size_t maxEventsPerThread)
+{
+    m_traceMaxEvents = maxEventsPerThread;
+}
+
+//! Выводит трассу в формате Trace Event JSON (chrome://tracing, Perfetto).
+//! Вызывается после WaitFinished().
+//! @param out - [in] поток вывода.
+//! @return true - успех, false - если трасса не записывалась или произошла ошибка вывода.
+bool CSignatureGenerator::WriteTrace(std::ostream& out) const
+{
+    return m_trace.WriteJson(out);
+}
+
+//! Включает сбор аппаратных счетчиков производительности потоков чтения и рассчета CRC.
+//! Вызывается до StartProcessing().
+void CSignatureGenerator::EnablePerfCounters()
+{
+    m_perf.Enable();
+}
+
+//! Задает дайджесты, рассчитываемые для каждого блока (по-умолчанию только CRC32).
+//! Вызывается до Init(). Запись блока состоит из дайджестов в заданном порядке.
+//! @param digests - [in] дайджесты, без повторов.
+//! @return true - успех, false - пустой список или неизвестный дайджест.
+bool CSignatureGenerator::SetDigests(const CDigestList& digests)
+{
+    if (digests.empty())
+    {
+        return false;
+    }
+
+    std::vector<size_t> offsets;
+    size_t              recordSize = 0;
+
+    for (size_t i = 0; i < digests.size(); ++i)
+    {
+        const size_t digestSize = DigestSize(digests[i]);
+
+        if ((digestSize == 0) || (recordSize + digestSize > MAX_DIGEST_RECORD_SIZE))
+        {
+            return false;
+        }
+
+        offsets.push_back(recordSize);
+        recordSize += digestSize;
+    }
+
+    m_digests       = digests;
+    m_digestOffsets = offsets;
+    m_recordSize    = recordSize;
+
+    return true;
+}
+
+//! Включает поиск повторяющихся блоков: SHA-256 каждого блока добавляется в индекс.
+//! Если SHA-256 нет среди дайджестов, он рассчитывается отдельной задачей и не выводится.
+//! Вызывается до Init(). Индекс должен существовать до завершения WaitFinished().
+//! @param pIndex - [in] индекс, NULL - выключить.
+void CSignatureGenerator::SetDedupIndex(CDedupIndex* pIndex)
+{
+    m_pDedupIndex = pIndex;
+}
+
+//! Ограничивает рассчет диапазоном блоков [firstBlock, lastBlock) (по-умолчанию весь
+//! источник). Вызывается до Init().
+//! Источник должен начинаться с блока firstBlock: генератор данные не пропускает,
+//! а номера блоков, передаваемые в приемники и индекс повторов, отсчитывает от начала
+//! файла. Чтение прекращается после блока lastBlock - 1 или в конце данных.
+//! @param firstBlock - [in] номер блока, с которого начинается источник;
+//! @param lastBlock  - [in] номер блока после последнего, NO_LAST_BLOCK - до конца данных.
+void CSignatureGenerator::SetBlockRange(uint64_t firstBlock, uint64_t lastBlock)
+{
+    m_firstBlock = firstBlock;
+    m_lastBlock  = std::max(firstBlock, lastBlock);
+}
+
+//! Ограничивает скорость чтения из источника (общую для потоков чтения всех узлов).
+//! Вызывается до StartProcessing(). После простоя можно прочитать всплеском не больше
+//! 1/IO_BURST_DIVISOR скорости (но не меньше блока), поэтому нагрузка на диск ровная.
+//! Время ожидания учитывается в статистике этапом throttle_io.
+//! @param bytesPerSec - [in] скорость в байтах в секунду, 0 - без ограничения.
+void CSignatureGenerator::SetIoLimit(uint64_t bytesPerSec)
+{
+    m_ioLimit = bytesPerSec;
+}
+
+//! Ограничивает долю процессора каждого потока рассчета: после рассчета поток спит
+//! так, чтобы рассчет занимал не больше sharePercent его времени.
+//! Вызывается до StartProcessing(). Время сна учитывается этапом throttle_cpu.
+//! @param sharePercent - [in] доля в процентах (1-100), 100 - без ограничения.
+void CSignatureGenerator::SetCpuShare(unsigned sharePercent)
+{
+    m_cpuShare = std::max(1u, std::min(sharePercent, 100u));
+}
+
+//! Задает размер чтения из источника. Если он больше блока, данные читаются
+//! впрок порциями ioSize и раздаются по блокам, иначе - по блоку за чтение.
+//! Вызывается до Init().
+//! @param ioSize - [in] размер чтения, 0 - размер блока.
+void CSignatureGenerator::SetIoSize(size_t ioSize)
+{
+    m_ioSize = ioSize;
+}
+
+//! Задает окно переупорядочивания: сколько записей блоков, рассчитанных раньше
+//! предыдущих, может ждать записи. Когда окно заполнено, потоки рассчета ждут.
+//! Вызывается до StartProcessing().
+//! @param maxRecords - [in] размер окна, 0 - по-умолчанию (MAX_MAP_SIZE).
+void CSignatureGenerator::SetReorderWindow(size_t maxRecords)
+{
+    m_maxMapSize = (maxRecords != 0) ? maxRecords : MAX_MAP_SIZE;
+}
+
+//! Включает подстройку глубины очереди во время рассчета.
+//! Глубина начинается с двух блоков на поток рассчета и меняется в пределах от блока
+//! на поток до рассчитанной по ограничению памяти (см. AdaptQueueDepth()).
+//! Вызывается до StartProcessing().
+//! @param isEnabled - [in] true - подстраивать, false - глубина постоянна.
+void CSignatureGenerator::SetAdaptiveQueue(bool isEnabled)
+{
+    m_isAdaptiveQueue = isEnabled;
+}
+
+//! Выводит аппаратные счетчики по потокам и этапам в JSON.
+//! Вызывается после WaitFinished().
+//! @param out - [in] поток вывода.
+void CSignatureGenerator::WritePerfCounters(std::ostream& out) const
+{
+    m_perf.WriteJson(out);
+}
+
+//! Возвращает суммарную статистику пулов памяти всех узлов.
+//! @return статистика.
+CMemoryPool::Stats CSignatureGenerator::GetPoolStats() const
+{
+    CMemoryPool::Stats stats;
+
+    for (size_t i = 0; i < m_nodes.size(); ++i)
+    {
+        stats += m_nodes[i]->pool.GetStats();
+    }
+
+    return stats;
+}
+
+//! Возвращает счетчики этапов конвейера.
+//! Их можно читать во время работы конвейера.
+const CPipelineStats& CSignatureGenerator::GetPipelineStats() const
+{
+    return m_stats;
+}
+
+//! Возвращает кол-во узлов NUMA, между которыми разделен конвейер.
+size_t CSignatureGenerator::GetNodeCount() const
+{
+    return m_nodes.size();
 }
 
 //! Инициализация CSignatureGenerator
-//! @param hInnerFile        - [in] входной файл
-//! @param hOuterFile        - [in] выходной файл
+//! Источник и приемник должны существовать до завершения WaitFinished().
+//! @param source            - [in] источник данных
+//! @param sink              - [in] приемник записей блоков
 //! @param blockSize         - [in] размер блока чтения 
 //! @param numCrcCalcThreads - [in] кол-во потоков для рассчета CRC
 //! @return true - инициализация успешна, false - в случае ошибки.
-bool CSignatureGenerator::Init(std::ifstream& hInnerFile, std::ofstream& hOuterFile, 
+bool CSignatureGenerator::Init(CSignatureSource& source, CSignatureSink& sink, 
+                               size_t blockSize, size_t numCrcCalcThreads)
+{
+    return Init(source, CSinkList(1, &sink), blockSize, numCrcCalcThreads);
+}
+
+//! Инициализация CSignatureGenerator с приемником на каждый дайджест.
+//! Источник и приемники должны существовать до завершения WaitFinished().
+//! @param source            - [in] источник данных
+//! @param sinks             - [in] один приемник записей блоков целиком или по приемнику
+//!                                 на каждый дайджест в порядке SetDigests()
+//! @param blockSize         - [in] размер блока чтения 
+//! @param numCrcCalcThreads - [in] кол-во потоков для рассчета дайджестов
+//! @return true - инициализация успешна, false - в случае ошибки.
+bool CSignatureGenerator::Init(CSignatureSource& source, const CSinkList& sinks, 
                                size_t blockSize, size_t numCrcCalcThreads)
 {  
-    m_pHInnerFile = &hInnerFile;
-    m_pHOuterFile = &hOuterFile;
-    m_blockSize   = blockSize;
+    if ((blockSize == 0) || ((sinks.size() != 1) && (sinks.size() != m_digests.size())))
+    {
+        return false;
+    }
+
+    numCrcCalcThreads = (numCrcCalcThreads != 0) ? numCrcCalcThreads : 1;
 
-    m_pHInnerFile->seekg(0, m_pHInnerFile->end);
-    m_inFileSize = static_cast<size_t>(m_pHInnerFile->tellg());
-    m_pHInnerFile->seekg(0, m_pHInnerFile->beg);
+    m_pSource = &source;
+    m_sinks   = sinks;
 
-    m_numBlocksInFile = m_inFileSize / m_blockSize;
-    if (m_inFileSize % m_blockSize)
+    m_numTasks  = m_digests.size();
+    m_dedupTask = std::find(m_digests.begin(), m_digests.end(), DIGEST_SHA256) - m_digests.begin();
+
+    if ((m_pDedupIndex != NULL) && (m_dedupTask == m_digests.size()))
     {
-        ++m_numBlocksInFile;
+        ++m_numTasks;
+    }
+
+    m_currentReadBlockNum = m_firstBlock;
+    m_currentWriteBlock   = m_firstBlock;
+    m_numBlocksInFile     = m_firstBlock;
+    m_isSourceEnd         = false;
+    m_ioPos               = 0;
+    m_ioFill              = 0;
+    m_abReadFinished      = false;
+    m_abError             = false;
+
+    m_ioBuffer.resize((m_ioSize > blockSize) ? m_ioSize : 0);
+
+    if (m_isNodesValid && (m_blockSize == blockSize) && (m_calkCrcThreadsNum == numCrcCalcThreads))
+    {
+        return true;
+    }
+
+    m_isNodesValid      = false;
+    m_blockSize         = blockSize;
+
+    // Для распространенных размеров блока поток рассчета собран с размером-константой
+    switch (blockSize)
+    {
+    case 4 * 1024:
+        m_pfnCrcCalcProc = &CSignatureGenerator::ThreadProcCrcCalc<4 * 1024>;
+        break;
+    case 64 * 1024:
+        m_pfnCrcCalcProc = &CSignatureGenerator::ThreadProcCrcCalc<64 * 1024>;
+        break;
+    case 1024 * 1024:
+        m_pfnCrcCalcProc = &CSignatureGenerator::ThreadProcCrcCalc<1024 * 1024>;
+        break;
+    default:
+        m_pfnCrcCalcProc = &CSignatureGenerator::ThreadProcCrcCalc<0>;
+        break;
     }
 
     m_calkCrcThreadsNum = numCrcCalcThreads;
 
-    m_maxQueueSize = m_calkCrcThreadsNum * 2;
+    if (!InitNodes())
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < m_nodes.size(); ++i)
+    {
+        if (!CalcQueueLimits(*m_nodes[i], m_memoryLimit / m_nodes.size()))
+        {
+            return false;
+        }
+
+        if (!InitPool(*m_nodes[i]))
+        {
+            return false;
+        }
+    }
+
+    m_isNodesValid = true;
+
+    return true;
+}
 
-    if (!InitPool())
+//! Рассчитывает сигнатуру: Init(), StartProcessing() и WaitFinished() одним вызовом.
+//! @param source    - [in] источник данных
+//! @param sink      - [in] приемник CRC блоков
+//! @param blockSize - [in] размер блока чтения 
+//! @param threadCnt - [in] кол-во потоков для рассчета CRC
+//! @return true - сигнатура рассчитана, false - в случае ошибки.
+bool CSignatureGenerator::Sign(CSignatureSource& source, CSignatureSink& sink, 
+                               size_t blockSize, size_t threadCnt)
+{
+    if (!Init(source, sink, blockSize, threadCnt))
     {
         return false;
-    }    
+    }
+
+    StartProcessing();
+
+    return WaitFinished();
+}
+
+//! Разделяет конвейер по узлам NUMA.
+//! На каждый узел, где есть доступные процессоры, приходится свой поток чтения и пул,
+//! потоки рассчета CRC распределяются пропорционально кол-ву процессоров узла.
+//! Потоки закрепляются за процессорами узла, если узлов несколько или задан набор процессоров.
+//! @return true - успех, false - если не осталось ни одного доступного процессора.
+bool CSignatureGenerator::InitNodes()
+{
+    m_nodes.clear();
+
+    CNumaTopology topology;
+
+    if (!topology.Detect(m_cpuSet))
+    {
+        std::cerr << "No available CPUs in the CPU set" << std::endl;
+        return false;
+    }
+
+    CNumaTopology::CNodes nodes = topology.Nodes();
+
+    if (!m_isNumaEnabled && (nodes.size() > 1))
+    {
+        for (size_t i = 1; i < nodes.size(); ++i)
+        {
+            nodes[0].cpus.insert(nodes[0].cpus.end(), nodes[i].cpus.begin(), nodes[i].cpus.end());
+        }
+
+        nodes.resize(1);
+    }
+
+    // Узел без потоков рассчета CRC не нужен
+    nodes.resize(std::min(nodes.size(), m_calkCrcThreadsNum));
+
+    const bool isMultiNode   = (nodes.size() > 1);
+    const bool doBindThreads = isMultiNode || !m_cpuSet.empty();
+
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        boost::shared_ptr<NodePipeline> pNode(new NodePipeline());
+
+        pNode->numaNode = isMultiNode ? nodes[i].id : -1;
+
+        if (doBindThreads)
+        {
+            pNode->cpus = nodes[i].cpus;
+        }
+
+        m_nodes.push_back(pNode);
+    }
+
+    // Очередной поток отдается узлу с наименьшим кол-вом потоков на процессор
+    for (size_t thread = 0; thread < m_calkCrcThreadsNum; ++thread)
+    {
+        size_t best = 0;
+
+        for (size_t i = 1; i < nodes.size(); ++i)
+        {
+            if (m_nodes[i]->calkCrcThreadsNum * nodes[best].cpus.size() <
+                m_nodes[best]->calkCrcThreadsNum * nodes[i].cpus.size())
+            {
+                best = i;
+            }
+        }
+
+        ++m_nodes[best]->calkCrcThreadsNum;
+    }
+
+    m_writerCpus = m_nodes[0]->cpus;
 
     return true;
 }
@@ -51,26 +435,69 @@ bool CSignatureGenerator::Init(std::ifstream& hInnerFile, std::ofstream& hOuterF
 //! Запуск потоков обработки, рассчета сигнатуры
 void CSignatureGenerator::StartProcessing()
 {
-    boost::thread threadRead(boost::bind(&CSignatureGenerator::ThreadProcRead, this));
-    m_ReaderThread.swap(threadRead);
+    m_aActiveReaders = m_nodes.size();
+    m_stats.Start();
+    m_ioBucket.SetRate(m_ioLimit, std::max<uint64_t>(m_blockSize, m_ioLimit / IO_BURST_DIVISOR));
 
-    boost::thread threadWrite(boost::bind(&CSignatureGenerator::ThreadProcWrite, this));
-    m_WriterThread.swap(threadWrite);
+    size_t queueDepth = 0;
+
+    for (size_t i = 0; i < m_nodes.size(); ++i)
+    {
+        NodePipeline& node = *m_nodes[i];
+
+        node.queueDepth   = m_isAdaptiveQueue ? std::min(node.calkCrcThreadsNum * 2, node.maxQueueSize)
+                                              : node.maxQueueSize;
+        node.starvedWaits = 0;
+        node.fullWaits    = 0;
+        node.adaptBlocks  = 0;
 
-    for (size_t i = 0; i < m_calkCrcThreadsNum; ++i)
+        queueDepth += node.queueDepth;
+    }
+
+    m_stats.SetQueueDepth(queueDepth);
+
+    if (m_traceMaxEvents != 0)
     {
-        m_crcProcessorsThreads.create_thread(boost::bind(&CSignatureGenerator::ThreadProcCrcCalc, this));
+        size_t   maxEvents  = m_traceMaxEvents;
+        uint64_t sourceSize = 0;
+
+        // Если размер данных известен, буферы трассы не больше, чем нужно для всех блоков
+        if (m_pSource->GetSize(sourceSize))
+        {
+            const uint64_t numBlocks = (sourceSize + m_blockSize - 1) / m_blockSize;
+
+            // Потоки рассчета записывают события на каждый дайджест блока
+            maxEvents = static_cast<size_t>(std::min<uint64_t>(maxEvents,
+                                                               (numBlocks + 1) * TRACE_EVENTS_PER_BLOCK *
+                                                               m_numTasks));
+        }
+
+        m_trace.Enable(maxEvents);
     }
+
+    for (size_t i = 0; i < m_nodes.size(); ++i)
+    {
+        NodePipeline* pNode = m_nodes[i].get();
+
+        m_pReaderThreads->create_thread(boost::bind(&CSignatureGenerator::ThreadProcRead, this, pNode));
+
+        for (size_t j = 0; j < pNode->calkCrcThreadsNum; ++j)
+        {
+            m_pCrcProcessorsThreads->create_thread(boost::bind(m_pfnCrcCalcProc, this, pNode));
+        }
+    }
+
+    boost::thread threadWrite(boost::bind(&CSignatureGenerator::ThreadProcWrite, this));
+    m_WriterThread.swap(threadWrite);
 }
 
-//! Завершение потоков обработки
+//! Завершение потоков обработки.
+//! После него объект готов к следующему Init(): очереди узлов и карта записей очищаются,
+//! блоки возвращаются в пулы.
 void CSignatureGenerator::DeInit()
 {
-    if (m_ReaderThread.get_id() != boost::thread::id())
-    {
-        m_ReaderThread.interrupt();
-        m_ReaderThread.join();
-    }
+    m_pReaderThreads->interrupt_all();
+    m_pReaderThreads->join_all();
 
     if (m_WriterThread.get_id() != boost::thread::id())
     {
@@ -78,178 +505,556 @@ void CSignatureGenerator::DeInit()
         m_WriterThread.join();
     }
 
-    m_crcProcessorsThreads.interrupt_all();
-    m_crcProcessorsThreads.join_all();
+    m_pCrcProcessorsThreads->interrupt_all();
+    m_pCrcProcessorsThreads->join_all();
+
+    m_pReaderThreads.reset(new boost::thread_group());
+    m_pCrcProcessorsThreads.reset(new boost::thread_group());
+
+    // Блоки прерванного рассчета возвращаются в пул
+    for (size_t i = 0; i < m_nodes.size(); ++i)
+    {
+        NodePipeline& node = *m_nodes[i];
+
+        DataChackQueue().swap(node.queue);
+
+        for (size_t j = 0; node.chunks && (j < node.poolCapacity); ++j)
+        {
+            node.chunks[j].buff.reset();
+            node.chunks[j].isBusy.store(false, boost::memory_order_relaxed);
+        }
+
+        node.nextChunk = 0;
+    }
+
+    m_recordMap.clear();
 }
 
 //! Ожидание завершения потоков обработки
-void CSignatureGenerator::WaitFinished()
+//! @return true - записи всех блоков переданы в приемники, false - в случае ошибки.
+bool CSignatureGenerator::WaitFinished()
 {
-    while (!m_abError && !m_abReadFinished)
+    boost::unique_lock<boost::mutex> lockWriteMap(m_writeMutex);
+
+    // Кол-во блоков известно только после окончания чтения. Карта может оказаться пустой,
+    // пока последние блоки еще в рассчете, поэтому ждем записи всех блоков.
+    // Об ошибке потоки сообщают не всегда, поэтому ожидание ограничено по времени.
+    while (!m_abError && !(m_abReadFinished && (m_currentWriteBlock >= m_numBlocksInFile)))
     {
-        boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+        m_condVarFreeWrite.timed_wait(lockWriteMap, POOL_WAIT_TIMEOUT);
     }
 
-    if (!m_abError && m_abReadFinished)
+    lockWriteMap.unlock();
+
+    const bool isOk = !m_abError;
+
+    DeInit();
+
+    return isOk;
+}
+
+//! Рассчитывает емкость пула и глубину очереди чтения узла.
+//! Без ограничения памяти очередь вмещает по два блока на поток, пул - вдвое больше.
+//! При заданном ограничении емкость пула равна кол-ву блоков, помещающихся в бюджет,
+//! а в очереди остается то, что не занято потоками рассчета CRC.
+//! @param node        - [in/out] узел;
+//! @param memoryLimit - [in]     доля ограничения памяти, приходящаяся на узел, 0 - нет.
+//! @return true - успех, false - в бюджет не помещается MIN_POOL_BLOCKS блоков.
+bool CSignatureGenerator::CalcQueueLimits(NodePipeline& node, size_t memoryLimit)
+{
+    if (m_memoryLimit == 0)
     {
-        boost::unique_lock<boost::mutex> lockReadQueue(m_readMutex);
+        node.maxQueueSize = node.calkCrcThreadsNum * 2;
+        node.poolCapacity = node.maxQueueSize * 2;
+        return true;
+    }
 
-        while (!m_queue.empty() && !m_abError)
-        {
-            m_condVarFreeRead.wait(lockReadQueue);
-        }
+    node.poolCapacity = memoryLimit / m_blockSize;
 
-        lockReadQueue.unlock();
+    if (node.poolCapacity < MIN_POOL_BLOCKS)
+    {
+        std::cerr << "Memory limit is too small: at least " << MIN_POOL_BLOCKS * m_blockSize
+                  << " bytes per NUMA node are required" << std::endl;
+        return false;
+    }
+
+    // Один блок заполняет поток чтения, по одному обрабатывают потоки рассчета CRC
+    const size_t busyBlocks = node.calkCrcThreadsNum + 1;
 
-        boost::unique_lock<boost::mutex> lockWriteMap(m_writeMutex);
+    node.maxQueueSize = (node.poolCapacity > busyBlocks) ? (node.poolCapacity - busyBlocks) : 1;
+
+    return true;
+}
+
+//! Инициализация пула пямяти узла.
+//! Если предвыделить пул не удалось (не хватило больших или закрепляемых страниц,
+//! памяти узла NUMA), блоки выделяются по мере надобности обычными страницами,
+//! но не более емкости пула.
+//! @param node - [in/out] узел.
+//! @return true - если удалось инициализировать пул, false - в случае ошибки.
+bool CSignatureGenerator::InitPool(NodePipeline& node)
+{
+    CMemoryPool::ArenaParams arenaParams = m_arenaParams;
+    arenaParams.numaNode = node.numaNode;
+
+    node.chunks.reset(new FileDataChunk[node.poolCapacity]);
+    node.nextChunk = 0;
+
+    CMemoryPool::PoolsParams poolParams;
+    poolParams.push_back(CMemoryPool::FixedPoolParams(m_blockSize, node.poolCapacity));
 
-        while (!m_crcMap.empty() && !m_abError)
+    if (!node.pool.Init(CMemoryPool::POOL_FIXED, poolParams, true, 0, arenaParams))
+    {
+        if (!node.pool.Init(CMemoryPool::POOL_FIXED, poolParams, false))
         {
-            m_condVarFreeWrite.wait(lockWriteMap); 
+            return false;
         }
 
-        lockWriteMap.unlock();
+        node.isPoolFallback = true;
+    }
 
-        std::cout << "Signatures file generation complited" << std::endl;
+    return true;
+}
+
+//! Находит свободное место для прочитанного блока узла. Вызывается потоком чтения узла.
+//! Мест столько же, сколько блоков в пуле, и место освобождается раньше возврата блока
+//! в пул, поэтому, пока поток чтения держит полученный из пула блок, свободное место есть.
+//! @param node - [in] узел.
+//! @return место, помеченное занятым.
+CSignatureGenerator::FileDataChunk& CSignatureGenerator::AcquireChunk(NodePipeline& node)
+{
+    while (node.chunks[node.nextChunk].isBusy.load(boost::memory_order_acquire))
+    {
+        node.nextChunk = (node.nextChunk + 1) % node.poolCapacity;
     }
 
-    DeInit();
+    FileDataChunk& chunk = node.chunks[node.nextChunk];
+
+    chunk.isBusy.store(true, boost::memory_order_relaxed);
+    node.nextChunk = (node.nextChunk + 1) % node.poolCapacity;
+
+    return chunk;
 }
 
-//! Инициализация пула пямяти
-//! @return true - если удалось инициализировать пул, false - в случае ошибки.
-bool CSignatureGenerator::InitPool()
+//! Отмечает рассчет одного дайджеста блока. После последнего дайджеста место
+//! освобождается, а блок возвращается в пул. При единственной задаче на блок
+//! счетчик задач не нужен.
+//! @param chunk - [in] блок.
+void CSignatureGenerator::ReleaseChunk(FileDataChunk& chunk)
 {
-    CMemoryPool::PoolsParams poolParams;
-    poolParams.push_back(CMemoryPool::FixedPoolParams(m_blockSize,
-                                                      m_maxQueueSize * 2));
+    if ((m_numTasks > 1) && (chunk.pendingTasks.fetch_sub(1, boost::memory_order_acq_rel) != 1))
+    {
+        return;
+    }
 
-    if (!m_pool.Init(CMemoryPool::POOL_FIXED, poolParams))
+    CPoolBuffer buff(boost::move(chunk.buff));
+
+    chunk.isBusy.store(false, boost::memory_order_release);
+}
+
+//! Читает данные из источника, при m_ioSize больше блока - через буфер чтения впрок.
+//! Вызывается под m_fileMutex.
+//! @param pBuffer  - [in]  буфер;
+//! @param size     - [in]  размер буфера;
+//! @param readSize - [out] кол-во прочитанных байтов, 0 - данные закончились.
+//! @return true - успех, false - ошибка чтения.
+bool CSignatureGenerator::ReadSource(uint8_t* pBuffer, size_t size, size_t& readSize)
+{
+    if (m_ioBuffer.empty())
     {
-        poolParams.clear();
+        return m_pSource->Read(pBuffer, size, readSize);
+    }
 
-        if (!m_pool.Init(CMemoryPool::POOL_FIXED_NEW_DELETE, poolParams))
+    if (m_ioPos == m_ioFill)
+    {
+        m_ioPos  = 0;
+        m_ioFill = 0;
+
+        if (!m_pSource->Read(&m_ioBuffer[0], m_ioBuffer.size(), m_ioFill))
         {
             return false;
         }
     }
 
+    readSize = std::min(size, m_ioFill - m_ioPos);
+
+    memcpy(pBuffer, &m_ioBuffer[m_ioPos], readSize);
+    m_ioPos += readSize;
+
     return true;
 }
 
-//! Тело потока чтения из файла
-void CSignatureGenerator::ThreadProcRead()
+//! Подстраивает глубину очереди узла по ожиданиям за последние QUEUE_ADAPT_INTERVAL блоков.
+//! Если ждали и потоки рассчета (очередь пустела), и поток чтения (очередь заполнялась),
+//! чтение неравномерно и глубина увеличивается в полтора раза, чтобы сгладить его.
+//! Если ждал только поток чтения, не успевает рассчет и блоки в очереди лишь занимают
+//! память и кеш - глубина уменьшается на блок. Если ждал только рассчет, не успевает
+//! чтение, и глубина не важна. Вызывается под readMutex узла.
+//! @param node - [in] узел.
+void CSignatureGenerator::AdaptQueueDepth(NodePipeline& node)
+{
+    const size_t minDepth = std::min(std::max<size_t>(node.calkCrcThreadsNum, 1), node.maxQueueSize);
+    size_t       depth    = node.queueDepth;
+
+    if ((node.starvedWaits != 0) && (node.fullWaits != 0))
+    {
+        depth = std::min(depth + std::max<size_t>(depth / 2, 1), node.maxQueueSize);
+    }
+    else if ((node.fullWaits != 0) && (depth > minDepth))
+    {
+        --depth;
+    }
+
+    if (depth != node.queueDepth)
+    {
+        m_stats.AdjustQueueDepth(static_cast<int64_t>(depth) - static_cast<int64_t>(node.queueDepth));
+        node.queueDepth = depth;
+
+        // При увеличении глубины поток чтения может больше не ждать
+        node.condVarFreeRead.notify_all();
+    }
+
+    node.starvedWaits = 0;
+    node.fullWaits    = 0;
+    node.adaptBlocks  = 0;
+}
+
+//! Читает из источника очередной блок. Вызывается под m_fileMutex.
+//! Источник может отдавать данные частями, поэтому блок дочитывается до полного размера
+//! или до конца данных. Последний неполный блок дополняется нулями.
+//! @param pBuffer - [in] буфер размером m_blockSize.
+//! @return кол-во прочитанных байтов, 0 - данные закончились.
+size_t CSignatureGenerator::ReadBlock(uint8_t* pBuffer)
 {
-    if (!m_pHInnerFile->is_open())
+    size_t readblockSize = 0;
+
+    m_isSourceEnd = m_isSourceEnd || (m_currentReadBlockNum == m_lastBlock);
+
+    while (!m_isSourceEnd && (readblockSize < m_blockSize))
     {
-        std::cerr << "Input file is close" << std::endl;
+        size_t readSize = 0;
+
+        if (!ReadSource(pBuffer + readblockSize, m_blockSize - readblockSize, readSize))
+        {
+            throw std::ios::failure("Source read error");
+        }
+
+        m_isSourceEnd   = (readSize == 0);
+        readblockSize  += readSize;
     }
-    else
+
+    if (m_isSourceEnd)
     {
-        try
+        m_numBlocksInFile = m_currentReadBlockNum + ((readblockSize != 0) ? 1 : 0);
+    }
+
+    return readblockSize;
+}
+
+//! Тело потока чтения из источника.
+//! Потоки чтения узлов по очереди забирают из источника следующий блок, каждый в буфер
+//! пула своего узла, поэтому блоки распределяются по узлам по мере их обработки.
+//! @param pNode - [in] узел, для которого читаются блоки.
+void CSignatureGenerator::ThreadProcRead(NodePipeline* pNode)
+{
+    try
+    {
+        if (!pNode->cpus.empty())
+        {
+            CNumaTopology::BindCurrentThread(pNode->cpus);
+        }
+
+        m_trace.SetThreadName("reader");
+
+        CPipelinePerf::ThreadCounters* pPerf = m_perf.RegisterThread("reader");
+
+        while (true)
         {
-            while ((m_currentReadBlockNum + 1) <= m_numBlocksInFile)
+            boost::this_thread::interruption_point();
+
+            CStageTimer timerPool(m_stats, CPipelineStats::STAGE_WAIT_POOL);
+            CPerfScope  perfPool(pPerf, CPipelinePerf::STAGE_POOL);
+
+            // Пока все блоки пула заняты, поток чтения ждет их возврата
+            CPoolBuffer readBuff = pNode->pool.Get(m_blockSize, POOL_WAIT_TIMEOUT);
+
+            if (pNode->isPoolFallback)
             {
-                boost::this_thread::interruption_point();
+                m_stats.AddPoolFallback();
+            }
+            else if (readBuff.get())
+            {
+                m_stats.AddPoolHit();
+            }
 
-                boost::shared_array<uint8_t> readBuff = m_pool.Get(m_blockSize);
+            while (!readBuff.get())
+            {
+                m_stats.AddPoolWait();
 
-                if (!readBuff.get())
+                boost::this_thread::interruption_point();
+
+                if (m_abError)
                 {
-                    std::cerr << "Unable allocate memory " << std::endl;
-                    throw "Unable allocate memory ";
+                    return;
                 }
 
-                uint32_t readblockSize = m_blockSize;
+                readBuff = pNode->pool.Get(m_blockSize, POOL_WAIT_TIMEOUT);
+            }
 
-                if ((m_currentReadBlockNum + 1) == m_numBlocksInFile)
-                {
-                    if (m_inFileSize % m_blockSize)
-                    {
-                        readblockSize = m_inFileSize - (m_numBlocksInFile - 1) *  m_blockSize;
-                    }
-                }
+            timerPool.Stop();
+            perfPool.Stop(m_blockSize);
 
-                m_pHInnerFile->read(reinterpret_cast<char*>(readBuff.get()), readblockSize);
+            boost::unique_lock<boost::mutex> lockFile(m_fileMutex);
 
-                if (readblockSize < m_blockSize)
-                {
-                    memset((readBuff.get() + (m_blockSize - readblockSize)),
-                           0,
-                          (m_blockSize - readblockSize));
-                }
+            if (m_isSourceEnd)
+            {
+                break;
+            }
 
-                boost::unique_lock<boost::mutex> lock(m_readMutex);
+            // Ожидание ограничения скорости под m_fileMutex: потоки чтения других узлов
+            // тоже ждут, и общая скорость не превышает заданную
+            if (m_ioBucket.IsEnabled())
+            {
+                const uint64_t throttleStartNs = GetMonotonicNs();
+                const uint64_t throttledNs     = m_ioBucket.Consume(m_blockSize);
 
-                while (m_queue.size() > m_maxQueueSize)
+                if (throttledNs != 0)
                 {
-                    m_condVarFreeRead.wait(lock);
+                    m_stats.AddStage(CPipelineStats::STAGE_THROTTLE_IO, throttledNs);
+                    m_trace.Complete("throttle_io", throttleStartNs, throttleStartNs + throttledNs,
+                                     m_currentReadBlockNum);
                 }
+            }
 
-                FileDataChunk chunk;
-                chunk.num = m_currentReadBlockNum++;
-                chunk.buff = readBuff;
+            CStageTimer timerRead(m_stats, CPipelineStats::STAGE_READ);
+            CPerfScope  perfRead(pPerf, CPipelinePerf::STAGE_READ);
 
-                m_queue.push(chunk);
+            const size_t readblockSize = ReadBlock(readBuff.get());
 
-                m_conVarHaveDataRead.notify_all();
+            if (readblockSize == 0)
+            {
+                break;
             }
 
-            m_abReadFinished = true;
-            return;
-        }
-        catch (boost::thread_interrupted&)
-        {
+            const uint64_t blockNum = m_currentReadBlockNum++;
+
+            lockFile.unlock();
+            timerRead.Stop();
+            perfRead.Stop(readblockSize);
+
+            m_stats.AddBlockRead(readblockSize);
+
+            m_trace.Complete("read", timerRead.StartNs(), timerRead.EndNs(), blockNum);
+            m_trace.FlowStart(timerRead.StartNs(), blockNum);
+
+            if (readblockSize < m_blockSize)
+            {
+                memset((readBuff.get() + readblockSize),
+                       0,
+                      (m_blockSize - readblockSize));
+            }
+
+            boost::unique_lock<boost::mutex> lock(pNode->readMutex);
+
+            CStageTimer timerQueue(m_stats, CPipelineStats::STAGE_WAIT_QUEUE_FREE);
+
+            // Каждый блок занимает в очереди по задаче на дайджест
+            if (pNode->queue.size() > pNode->queueDepth * m_numTasks)
+            {
+                ++pNode->fullWaits;
+            }
+
+            while (pNode->queue.size() > pNode->queueDepth * m_numTasks)
+            {
+                pNode->condVarFreeRead.wait(lock);
+            }
+
+            timerQueue.Stop();
+
+            m_trace.Complete("wait_queue_free", timerQueue.StartNs(), timerQueue.EndNs(),
+                             blockNum);
+
+            FileDataChunk& chunk = AcquireChunk(*pNode);
+
+            chunk.buff = boost::move(readBuff);
+            chunk.pendingTasks.store(m_numTasks, boost::memory_order_relaxed);
+
+            DigestTask task;
+            task.num    = blockNum;
+            task.pChunk = &chunk;
+
+            for (task.digest = 0; task.digest < m_numTasks; ++task.digest)
+            {
+                pNode->queue.push(task);
+            }
+
+            pNode->conVarHaveDataRead.notify_all();
+
+            if (m_isAdaptiveQueue && (++pNode->adaptBlocks == QUEUE_ADAPT_INTERVAL))
+            {
+                AdaptQueueDepth(*pNode);
+            }
         }
-        catch (std::ios::ios_base::failure &)
+
+        // Чтение завершено, когда все узлы дочитали свои блоки
+        if (--m_aActiveReaders == 0)
         {
-            std::cerr << "File read error" << std::endl;
-        }
-        catch (...)
-        {            
+            boost::unique_lock<boost::mutex> lockWriteMap(m_writeMutex);
+
+            m_abReadFinished = true;
+
+            // Все блоки могли быть записаны раньше, чем стало известно их кол-во
+            m_condVarFreeWrite.notify_all();
+            m_conVarHaveDataWrite.notify_all();
         }
+
+        return;
+    }
+    catch (boost::thread_interrupted&)
+    {
+    }
+    catch (std::ios::ios_base::failure &)
+    {
+        std::cerr << "File read error" << std::endl;
+    }
+    catch (...)
+    {            
     }
 
     m_abError = true;
+    m_condVarFreeWrite.notify_all();
 }
 
-//! Тело потока рассчета CRC
-void CSignatureGenerator::ThreadProcCrcCalc()
+//! Тело потока рассчета CRC и других дайджестов.
+//! Поток берет из очереди по одному дайджесту блока, поэтому дайджесты одного блока
+//! рассчитываются разными потоками параллельно.
+//! BlockSize - размер блока, известный при компиляции, 0 - размер задан в Init().
+//! @param pNode - [in] узел, блоки которого обрабатывает поток.
+template <size_t BlockSize>
+void CSignatureGenerator::ThreadProcCrcCalc(NodePipeline* pNode)
 {
     try
     {
+        if (!pNode->cpus.empty())
+        {
+            CNumaTopology::BindCurrentThread(pNode->cpus);
+        }
+
+        m_trace.SetThreadName("crc worker");
+
+        CPipelinePerf::ThreadCounters* pPerf = m_perf.RegisterThread("crc worker");
+        CCpuThrottle                   cpuThrottle(m_cpuShare);
+
         while (true)
         {
             boost::this_thread::interruption_point();
 
-            boost::unique_lock<boost::mutex> lockReadQueue(m_readMutex);       
+            boost::unique_lock<boost::mutex> lockReadQueue(pNode->readMutex);       
 
-            while (m_queue.empty())
+            CStageTimer timerQueue(m_stats, CPipelineStats::STAGE_WAIT_QUEUE_DATA);
+
+            if (pNode->queue.empty())
+            {
+                ++pNode->starvedWaits;
+            }
+
+            while (pNode->queue.empty())
             {                
-                m_conVarHaveDataRead.wait(lockReadQueue);
+                pNode->conVarHaveDataRead.wait(lockReadQueue);
             }
 
-            FileDataChunk chunk = m_queue.front();
+            timerQueue.Stop();
+
+            DigestTask task = pNode->queue.front();
 
-            m_queue.pop();
+            pNode->queue.pop();
 
-            m_condVarFreeRead.notify_all();
+            pNode->condVarFreeRead.notify_all();
 
             lockReadQueue.unlock();
 
-            uint32_t crc32 = CalcCrc32(chunk.buff.get(), m_blockSize);
+            const uint64_t    blockNum   = task.num;
+            const EDigestType digestType = (task.digest < m_digests.size()) ? m_digests[task.digest]
+                                                                            : DIGEST_SHA256;
+
+            CStageTimer timerHash(m_stats, CPipelineStats::STAGE_HASH);
+            CPerfScope  perfHash(pPerf, CPipelinePerf::STAGE_HASH);
+
+            const size_t blockSize = (BlockSize != 0) ? BlockSize : m_blockSize;
+
+            uint8_t digest[MAX_DIGEST_SIZE];
+
+            if (BlockSize != 0)
+            {
+                CalcDigestFixed<BlockSize>(digestType, task.pChunk->buff.get(), digest);
+            }
+            else
+            {
+                CalcDigest(digestType, task.pChunk->buff.get(), blockSize, digest);
+            }
+
+            timerHash.Stop();
+            perfHash.Stop(blockSize);
+
+            m_trace.Complete("wait_queue_data", timerQueue.StartNs(), timerQueue.EndNs(), blockNum);
+            m_trace.Complete(DigestName(digestType), timerHash.StartNs(), timerHash.EndNs(), blockNum);
+            m_trace.FlowStep(timerHash.StartNs(), blockNum);
+
+            if ((m_pDedupIndex != NULL) && (task.digest == m_dedupTask))
+            {
+                m_pDedupIndex->Insert(digest, blockNum, blockSize);
+            }
+
+            // Дайджест блока больше не нужен этому потоку; после последнего дайджеста блок
+            // возвращается в пул до ожидания места в карте
+            ReleaseChunk(*task.pChunk);
 
             boost::unique_lock<boost::mutex> lockWriteMap(m_writeMutex);
 
-            while (m_crcMap.size() > MAX_MAP_SIZE)
+            RecordMap::iterator itRecord = m_recordMap.find(blockNum);
+
+            // Блок, которого ждет поток записи, и уже начатая запись помещаются в карту всегда,
+            // иначе при заполненной карте конвейер остановится
+            CStageTimer timerMap(m_stats, CPipelineStats::STAGE_WAIT_MAP);
+
+            while ((itRecord == m_recordMap.end()) && (m_recordMap.size() > m_maxMapSize) &&
+                   (blockNum != m_currentWriteBlock))
             {
                 m_condVarFreeWrite.wait(lockWriteMap);
+
+                itRecord = m_recordMap.find(blockNum);
             }
 
-            m_crcMap[chunk.num] = crc32;
-            m_conVarHaveDataWrite.notify_all();
+            timerMap.Stop();
+
+            m_trace.Complete("wait_map", timerMap.StartNs(), timerMap.EndNs(), blockNum);
+
+            if (itRecord == m_recordMap.end())
+            {
+                itRecord = m_recordMap.insert(std::make_pair(blockNum, BlockRecord(m_numTasks))).first;
+            }
+
+            if (task.digest < m_digests.size())
+            {
+                memcpy(itRecord->second.data + m_digestOffsets[task.digest], digest, DigestSize(digestType));
+            }
+
+            if (--itRecord->second.pendingDigests == 0)
+            {
+                m_conVarHaveDataWrite.notify_all();
+            }
 
             lockWriteMap.unlock();
+
+            // Поток спит, не удерживая ни блок пула, ни блокировок
+            const uint64_t throttleStartNs = GetMonotonicNs();
+            const uint64_t throttledNs     = cpuThrottle.AddBusy(timerHash.EndNs() - timerHash.StartNs());
+
+            if (throttledNs != 0)
+            {
+                m_stats.AddStage(CPipelineStats::STAGE_THROTTLE_CPU, throttledNs);
+                m_trace.Complete("throttle_cpu", throttleStartNs, throttleStartNs + throttledNs, blockNum);
+            }
         }
 
         return;
@@ -257,71 +1062,112 @@ void CSignatureGenerator::ThreadProcCrcCalc()
     catch (...)
     {
         m_abError = true;
-        m_condVarFreeRead.notify_all();
+        pNode->condVarFreeRead.notify_all();
     }    
 }
 
-//! Тело потока записи в файл
+//! Тело потока записи в приемник
 void CSignatureGenerator::ThreadProcWrite()
 {
-    if (!m_pHOuterFile->is_open())
-    {
-        std::cerr << "Output file is close" << std::endl;
-    }
-    else
+    try
     {
-        try
+        if (!m_writerCpus.empty())
         {
-            while (true)
-            {
-                boost::this_thread::interruption_point();
+            CNumaTopology::BindCurrentThread(m_writerCpus);
+        }
 
-                boost::unique_lock<boost::mutex> lockWriteMap(m_writeMutex);
+        m_trace.SetThreadName("writer");
 
-                while (m_crcMap.empty())
-                {
-                    m_conVarHaveDataWrite.wait(lockWriteMap);
-                }
+        // Ожидание очередного CRC отсчитывается от записи предыдущего
+        uint64_t waitStartNs = GetMonotonicNs();
 
-                if (m_crcMap.begin()->first != m_currentWriteBlock)
+        while (true)
+        {
+            boost::this_thread::interruption_point();
+
+            boost::unique_lock<boost::mutex> lockWriteMap(m_writeMutex);
+
+            // Потоки рассчета будят поток записи на каждую собранную запись блока,
+            // поэтому очередной по порядку блок дожидается без опроса
+            while (m_recordMap.empty() || (m_recordMap.begin()->first != m_currentWriteBlock) ||
+                   (m_recordMap.begin()->second.pendingDigests != 0))
+            {
+                if (m_abReadFinished && (m_currentWriteBlock >= m_numBlocksInFile))
                 {
-                    boost::this_thread::sleep(boost::posix_time::milliseconds(20));
-                    continue;
+                    return;
                 }
 
-                uint32_t crc32 = m_crcMap.begin()->second;    
+                m_conVarHaveDataWrite.wait(lockWriteMap);
+            }
 
-                m_crcMap.erase(m_crcMap.begin());
+            const uint64_t blockNum  = m_recordMap.begin()->first;
+            const uint64_t waitEndNs = GetMonotonicNs();
 
-                m_condVarFreeWrite.notify_all();
+            m_stats.AddStage(CPipelineStats::STAGE_WAIT_WRITE_DATA, waitEndNs - waitStartNs);
+            m_trace.Complete("wait_write_data", waitStartNs, waitEndNs, blockNum);
 
-                m_currentWriteBlock++;
+            uint8_t record[MAX_DIGEST_RECORD_SIZE];
+            memcpy(record, m_recordMap.begin()->second.data, m_recordSize);
 
-                lockWriteMap.unlock();
+            m_recordMap.erase(m_recordMap.begin());
 
-                m_pHOuterFile->write(reinterpret_cast<char*>(&crc32), sizeof(uint32_t));
+            m_condVarFreeWrite.notify_all();
 
-                if (m_currentWriteBlock == m_numBlocksInFile) 
-                {
-                    break;
-                }
-            }           
+            m_currentWriteBlock++;
+
+            lockWriteMap.unlock();
+
+            CStageTimer timerWrite(m_stats, CPipelineStats::STAGE_WRITE);
+
+            WriteRecord(blockNum, record);
+
+            timerWrite.Stop();
 
-            return;
+            m_trace.Complete("write", timerWrite.StartNs(), timerWrite.EndNs(), blockNum);
+            m_trace.FlowEnd(timerWrite.StartNs(), blockNum);
+
+            m_stats.AddBlockWritten();
+
+            waitStartNs = GetMonotonicNs();
         }
-        catch (boost::thread_interrupted&)
+    }
+    catch (boost::thread_interrupted&)
+    {
+        
+    }
+    catch (std::ios::ios_base::failure&)
+    {
+        std::cerr << "File write error" << std::endl;    
+    }
+    catch (...)
+    {            
+    }
+
+    m_condVarFreeWrite.notify_all();
+    m_abError = true;
+}
+
+//! Передает запись блока в приемники: целиком в единственный приемник
+//! или по дайджесту в приемник каждого дайджеста.
+//! @param blockNum - [in] номер блока;
+//! @param pRecord  - [in] запись блока, m_recordSize байтов.
+void CSignatureGenerator::WriteRecord(uint64_t blockNum, const uint8_t* pRecord)
+{
+    if (m_sinks.size() == 1)
+    {
+        if (!m_sinks[0]->Write(blockNum, pRecord, m_recordSize))
         {
-            
+            throw std::ios::failure("Sink write error");
         }
-        catch (std::ios::ios_base::failure&)
+
+        return;
+    }
+
+    for (size_t i = 0; i < m_sinks.size(); ++i)
+    {
+        if (!m_sinks[i]->Write(blockNum, pRecord + m_digestOffsets[i], DigestSize(m_digests[i])))
         {
-            std::cerr << "File write error" << std::endl;    
-        }
-        catch (...)
-        {            
+            throw std::ios::failure("Sink write error");
         }
     }
-
-    m_condVarFreeWrite.notify_all();
-    m_abError = true;
-}
\ No newline at end of file
+}
@@ -1,18 +1,27 @@
-//! @file memory/MemoryPool.h
-//! Объявление класса CMemoryPool
+//! @file SignatureGenerator.h
+//! Объявление класса CSignatureGenerator
 #ifndef _SIG_GEN
 #define _SIG_GEN
 
-#define INT64_MAX    _I64_MAX
-#define INTMAX_MAX   INT64_MAX
-
+#include "../common/dedup/DedupIndex.h"
+#include "../common/hash/Digest.h"
 #include "../common/memory/MemoryPool.h"
+#include "../common/numa/NumaTopology.h"
+#include "../common/throttle/Throttle.h"
+#include "../common/trace/TraceRecorder.h"
 #include "../includes/Crc32.h"
+#include "PipelinePerf.h"
+#include "PipelineStats.h"
+#include "SignatureSink.h"
+#include "SignatureSource.h"
 
 #include <boost/atomic.hpp>
-#include <boost/shared_array.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/thread.hpp>
 
+#include <algorithm>
 #include <exception>
 #include <fstream>
 #include <iostream>
@@ -21,71 +30,211 @@
 #include <stdexcept>
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 
 //! Класс предстваляющий генератор сигнатур.
+//! Данные читаются из CSignatureSource, дайджесты блоков по порядку передаются в CSignatureSink.
+//! Каждый блок читается один раз, все дайджесты рассчитываются по одному буферу пула.
+//! Объект можно использовать для нескольких рассчетов подряд: если параметры не менялись,
+//! узлы и пулы памяти предыдущего рассчета используются повторно.
 class CSignatureGenerator
 {
+public:
+    typedef std::vector<CSignatureSink*> CSinkList;
+
+    //! Диапазон блоков не ограничен сверху
+    static const uint64_t NO_LAST_BLOCK = static_cast<uint64_t>(-1);
+
 public:
     CSignatureGenerator();
+    ~CSignatureGenerator();
 public:
-    bool Init(std::ifstream&  hInnerFile, std::ofstream& hOuterFile, size_t blockSize,
+    void SetMemoryLimit(size_t memoryLimit);
+    void SetArenaParams(const CMemoryPool::ArenaParams& arenaParams);
+    void SetCpuSet(const CCpuList& cpus);
+    void SetNumaEnabled(bool isEnabled);
+    void EnableTrace(size_t maxEventsPerThread);
+    void EnablePerfCounters();
+    bool SetDigests(const CDigestList& digests);
+    void SetDedupIndex(CDedupIndex* pIndex);
+    void SetBlockRange(uint64_t firstBlock, uint64_t lastBlock = NO_LAST_BLOCK);
+    void SetIoLimit(uint64_t bytesPerSec);
+    void SetCpuShare(unsigned sharePercent);
+    void SetIoSize(size_t ioSize);
+    void SetReorderWindow(size_t maxRecords);
+    void SetAdaptiveQueue(bool isEnabled);
+
+    bool Init(CSignatureSource& source, CSignatureSink& sink, size_t blockSize,
+              size_t threadCnt = boost::thread::hardware_concurrency());
+    bool Init(CSignatureSource& source, const CSinkList& sinks, size_t blockSize,
               size_t threadCnt = boost::thread::hardware_concurrency());
     void DeInit();
     void StartProcessing();    
-    void WaitFinished();
+    bool WaitFinished();
+
+    bool Sign(CSignatureSource& source, CSignatureSink& sink, size_t blockSize,
+              size_t threadCnt = boost::thread::hardware_concurrency());
+
+    CMemoryPool::Stats    GetPoolStats() const;
+    size_t                GetNodeCount() const;
+    const CPipelineStats& GetPipelineStats() const;
+    bool                  WriteTrace(std::ostream& out) const;
+    void                  WritePerfCounters(std::ostream& out) const;
 
 private:
-    bool InitPool();
+    struct NodePipeline;
+    struct FileDataChunk;
+
+    bool InitNodes();
+    bool InitPool(NodePipeline& node);
+    bool CalcQueueLimits(NodePipeline& node, size_t memoryLimit);
+    size_t ReadBlock(uint8_t* pBuffer);
+    bool ReadSource(uint8_t* pBuffer, size_t size, size_t& readSize);
+    void AdaptQueueDepth(NodePipeline& node);
+    FileDataChunk& AcquireChunk(NodePipeline& node);
+    void ReleaseChunk(FileDataChunk& chunk);
 
 private:
-    void ThreadProcRead();
-    void ThreadProcCrcCalc();
+    void ThreadProcRead(NodePipeline* pNode);
+    template <size_t BlockSize>
+    void ThreadProcCrcCalc(NodePipeline* pNode);
     void ThreadProcWrite();
+    void WriteRecord(uint64_t blockNum, const uint8_t* pRecord);
 
 private:    
+    //! Прочитанный блок, дайджесты которого рассчитываются. Места под блоки заводятся
+    //! в узле заранее, по одному на блок пула, поэтому блок не выделяется в куче.
     struct FileDataChunk
     {
-        uint32_t                     num;  //! номер куска в файле
-        boost::shared_array<uint8_t> buff; //! данные
+        FileDataChunk() : pendingTasks(0), isBusy(false) {}
+
+        CPoolBuffer                  buff;          //!< данные
+        boost::atomic<size_t>        pendingTasks;  //!< Еще не рассчитано дайджестов,
+                                                    //!  если задач на блок несколько
+        boost::atomic<bool>          isBusy;        //!< Место занято блоком
+    };
+
+    //! Рассчет одного дайджеста блока. Блок возвращается в пул после рассчета
+    //! всех его дайджестов.
+    struct DigestTask
+    {
+        uint64_t                     num;     //!< номер блока в файле
+        FileDataChunk*               pChunk;
+        size_t                       digest;  //!< индекс в m_digests, m_digests.size() -
+                                              //!  SHA-256 только для индекса повторов
+    };
+
+    //! Запись блока, собираемая из дайджестов, рассчитанных разными потоками.
+    struct BlockRecord
+    {
+        explicit BlockRecord(size_t numDigests) : pendingDigests(numDigests) {}
+
+        size_t                       pendingDigests;    //!< Еще не рассчитано дайджестов
+        uint8_t                      data[MAX_DIGEST_RECORD_SIZE];
     };
 
 private:
-    typedef std::map<uint32_t, uint32_t> CrcMap;
-    typedef std::queue<FileDataChunk>    DataChackQueue;
+    typedef std::map<uint64_t, BlockRecord> RecordMap;
+    typedef std::queue<DigestTask>          DataChackQueue;
+
+    //! Часть конвейера, работающая на одном узле NUMA: поток чтения, потоки рассчета CRC,
+    //! пул, память которого размещена на узле, и очередь между ними.
+    //! Блок читается, обрабатывается и возвращается в пул на одном узле.
+    struct NodePipeline
+    {
+        NodePipeline() : numaNode(-1), calkCrcThreadsNum(0), poolCapacity(0), maxQueueSize(0),
+                         queueDepth(0), starvedWaits(0), fullWaits(0), adaptBlocks(0),
+                         nextChunk(0), isPoolFallback(false) {}
+
+        int                          numaNode;      //!< Узел NUMA, -1 - размещение не задается
+        CCpuList                     cpus;          //!< Процессоры узла, пусто - не закреплять
+
+        CMemoryPool                  pool;
+        DataChackQueue               queue;
+        boost::scoped_array<FileDataChunk> chunks;  //!< Места блоков, poolCapacity штук
+
+        boost::mutex                 readMutex;
+        boost::condition_variable    condVarFreeRead;
+        boost::condition_variable    conVarHaveDataRead;
+
+        size_t                       calkCrcThreadsNum;
+        size_t                       poolCapacity;
+        size_t                       maxQueueSize;
+        size_t                       queueDepth;    //!< Текущая глубина очереди, блоков,
+                                                    //!  не больше maxQueueSize
+        size_t                       starvedWaits;  //!< Потоки рассчета ждали блок (пустая очередь)
+        size_t                       fullWaits;     //!< Поток чтения ждал места (полная очередь)
+        size_t                       adaptBlocks;   //!< Прочитано блоков с последней подстройки
+        size_t                       nextChunk;     //!< С какого места искать свободное
+        bool                         isPoolFallback;    //!< Пул не удалось предвыделить,
+                                                        //!  блоки выделяются по мере надобности
+    };
+
+    typedef std::vector< boost::shared_ptr<NodePipeline> > CNodePipelines;
+
+    //! Тело потока рассчета, выбранное под размер блока
+    typedef void (CSignatureGenerator::*CCrcCalcProc)(NodePipeline* pNode);
 
 private:
-    std::ifstream*               m_pHInnerFile;
-    std::ofstream*               m_pHOuterFile;
+    CSignatureSource*            m_pSource;
+    CSinkList                    m_sinks;           //!< Один - записи целиком, иначе по дайджесту
+
+    CDigestList                  m_digests;
+    std::vector<size_t>          m_digestOffsets;   //!< Смещения дайджестов в записи блока
+    size_t                       m_recordSize;
+    size_t                       m_numTasks;        //!< Задач рассчета на блок
+    size_t                       m_dedupTask;       //!< Задача, SHA-256 которой идет в индекс
+    CDedupIndex*                 m_pDedupIndex;
 
     size_t                       m_blockSize;
+    CCrcCalcProc                 m_pfnCrcCalcProc;
 
-    CMemoryPool                  m_pool;
+    CMemoryPool::ArenaParams     m_arenaParams;
+    CCpuList                     m_cpuSet;
+    bool                         m_isNumaEnabled;
+    bool                         m_isNodesValid;    //!< Узлы и пулы годятся для след. рассчета
 
-    CrcMap                       m_crcMap;
-    DataChackQueue               m_queue;
+    CNodePipelines               m_nodes;
+    CCpuList                     m_writerCpus;
 
-    boost::thread_group          m_crcProcessorsThreads;
-    boost::thread                m_ReaderThread;
+    RecordMap                    m_recordMap;
+    CPipelineStats               m_stats;
+    CTraceRecorder               m_trace;
+    CPipelinePerf                m_perf;
+
+    boost::scoped_ptr<boost::thread_group> m_pCrcProcessorsThreads;
+    boost::scoped_ptr<boost::thread_group> m_pReaderThreads;
     boost::thread                m_WriterThread;
 
-    boost::mutex                 m_readMutex;
+    boost::mutex                 m_fileMutex;
     boost::mutex                 m_writeMutex;
 
-    boost::condition_variable    m_condVarFreeRead;
-    boost::condition_variable    m_conVarHaveDataRead;
-
     boost::condition_variable    m_condVarFreeWrite;
     boost::condition_variable    m_conVarHaveDataWrite;    
 
     boost::atomic<bool>          m_abReadFinished;
     boost::atomic<bool>          m_abError;
-
-    size_t                       m_maxQueueSize;
-    size_t                       m_currentReadBlockNum;
-    size_t                       m_currentWriteBlock;
-    size_t                       m_numBlocksInFile;
-    size_t                       m_inFileSize;
+    boost::atomic<size_t>        m_aActiveReaders;
+
+    size_t                       m_memoryLimit;
+    size_t                       m_traceMaxEvents;
+    size_t                       m_ioSize;              //!< Размер чтения из источника
+    std::vector<uint8_t>         m_ioBuffer;            //!< Прочитанное впрок, если m_ioSize > блока
+    size_t                       m_ioPos;
+    size_t                       m_ioFill;
+    size_t                       m_maxMapSize;          //!< Окно переупорядочивания записей
+    bool                         m_isAdaptiveQueue;
+    uint64_t                     m_ioLimit;             //!< Скорость чтения, байт/с, 0 - без ограничения
+    CTokenBucket                 m_ioBucket;
+    unsigned                     m_cpuShare;            //!< Доля процессора потока рассчета, %
+    uint64_t                     m_firstBlock;          //!< Номер первого блока источника
+    uint64_t                     m_lastBlock;           //!< Номер блока после последнего в диапазоне
+    uint64_t                     m_currentReadBlockNum;
+    uint64_t                     m_currentWriteBlock;
+    uint64_t                     m_numBlocksInFile;     //!< Номер блока после последнего,
+                                                        //!  известен после окончания чтения
+    bool                         m_isSourceEnd;
     size_t                       m_calkCrcThreadsNum;
 };
 
@@ -0,0 +1,132 @@
+//! @file SignatureSink.cpp
+//! Реализация приемников сигнатур CSignatureGenerator
+
+#include "SignatureSink.h"
+
+#include "../includes/Crc32.h"
+
+#include <string.h>
+
+//! Конструктор.
+//! @param stream - [in] поток вывода.
+CStreamSink::CStreamSink(std::ostream& stream) : m_stream(stream)
+{
+}
+
+bool CStreamSink::Write(uint64_t, const uint8_t* pRecord, size_t size)
+{
+    m_stream.write(reinterpret_cast<const char*>(pRecord), static_cast<std::streamsize>(size));
+
+    return m_stream.good();
+}
+
+bool CMemorySink::Write(uint64_t, const uint8_t* pRecord, size_t size)
+{
+    m_records.insert(m_records.end(), pRecord, pRecord + size);
+
+    return true;
+}
+
+//! Конструктор.
+//! @param writeFunc - [in] функция приема.
+CCallbackSink::CCallbackSink(const CWriteFunc& writeFunc) : m_writeFunc(writeFunc)
+{
+}
+
+bool CCallbackSink::Write(uint64_t blockNum, const uint8_t* pRecord, size_t size)
+{
+    return m_writeFunc(blockNum, pRecord, size);
+}
+
+//! Конструктор.
+//! @param sink      - [in] приемник CRC32 мелких блоков;
+//! @param blockSize - [in] мелкий размер блока.
+CMultiResolutionSink::CMultiResolutionSink(CSignatureSink& sink, size_t blockSize) :
+    m_sink(sink), m_blockSize(blockSize), m_shift(blockSize)
+{
+    const std::vector<uint8_t> zeroBlock(blockSize, 0);
+
+    m_zeroCrc = CalcCrc32(&zeroBlock[0], zeroBlock.size());
+}
+
+//! Добавляет крупный размер блока.
+//! @param blockSize - [in] размер блока, кратный мелкому и больше него;
+//! @param sink      - [in] приемник CRC32 блоков этого размера.
+//! @return true - успех, false - размер не кратен мелкому.
+bool CMultiResolutionSink::AddLevel(size_t blockSize, CSignatureSink& sink)
+{
+    if ((blockSize <= m_blockSize) || (blockSize % m_blockSize != 0))
+    {
+        return false;
+    }
+
+    Level level;
+    level.factor   = blockSize / m_blockSize;
+    level.pSink    = &sink;
+    level.crc      = 0;
+    level.count    = 0;
+    level.blockNum = 0;
+
+    m_levels.push_back(level);
+
+    return true;
+}
+
+bool CMultiResolutionSink::Write(uint64_t blockNum, const uint8_t* pRecord, size_t size)
+{
+    if ((size != sizeof(uint32_t)) || !m_sink.Write(blockNum, pRecord, size))
+    {
+        return false;
+    }
+
+    uint32_t crc = 0;
+    memcpy(&crc, pRecord, sizeof(crc));
+
+    for (size_t i = 0; i < m_levels.size(); ++i)
+    {
+        if (!Append(m_levels[i], crc))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//! Дописывает последние неполные крупные блоки, дополняя их нулями.
+//! @return true - успех, false - ошибка приемника.
+bool CMultiResolutionSink::Finish()
+{
+    for (size_t i = 0; i < m_levels.size(); ++i)
+    {
+        Level& level = m_levels[i];
+
+        while (level.count != 0)
+        {
+            if (!Append(level, m_zeroCrc))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+//! Добавляет CRC32 мелкого блока к крупному и передает крупный, когда он набран.
+bool CMultiResolutionSink::Append(Level& level, uint32_t crc)
+{
+    level.crc = (level.count == 0) ? crc : m_shift.Combine(level.crc, crc);
+
+    if (++level.count < level.factor)
+    {
+        return true;
+    }
+
+    uint8_t record[sizeof(uint32_t)];
+    memcpy(record, &level.crc, sizeof(record));
+
+    level.count = 0;
+
+    return level.pSink->Write(level.blockNum++, record, sizeof(record));
+}
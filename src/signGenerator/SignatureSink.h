@@ -0,0 +1,115 @@
+//! @file SignatureSink.h
+//! Объявление приемников сигнатур CSignatureGenerator
+
+#ifndef _SIGNATURE_SINK_H
+#define _SIGNATURE_SINK_H
+
+#include "../common/hash/Crc32Combine.h"
+
+#include <boost/function.hpp>
+
+#include <ostream>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+//! Приемник сигнатур блоков.
+//! Вызывается из одного потока записи, блоки передаются строго по порядку.
+//! Запись блока - дайджесты блока подряд (см. hash/Digest.h), для сигнатуры CRC32 - 4 байта CRC.
+class CSignatureSink
+{
+public:
+    virtual ~CSignatureSink() {}
+
+    //! Принимает запись очередного блока.
+    //! @param blockNum - [in] номер блока;
+    //! @param pRecord  - [in] запись блока;
+    //! @param size     - [in] размер записи, в байтах.
+    //! @return true - успех, false - ошибка, рассчет прерывается.
+    virtual bool Write(uint64_t blockNum, const uint8_t* pRecord, size_t size) = 0;
+};
+
+//! Запись в поток вывода в формате файла сигнатур: записи блоков подряд.
+class CStreamSink : public CSignatureSink
+{
+public:
+    explicit CStreamSink(std::ostream& stream);
+
+    virtual bool Write(uint64_t blockNum, const uint8_t* pRecord, size_t size);
+
+private:
+    std::ostream& m_stream;
+};
+
+//! Накопление записей блоков в памяти.
+class CMemorySink : public CSignatureSink
+{
+public:
+    typedef std::vector<uint8_t> CRecordList;
+
+    virtual bool Write(uint64_t blockNum, const uint8_t* pRecord, size_t size);
+
+    //! Возвращает записи блоков по порядку, подряд.
+    const CRecordList& Records() const
+    {
+        return m_records;
+    }
+
+private:
+    CRecordList m_records;
+};
+
+//! Передача записей блоков функции пользователя.
+class CCallbackSink : public CSignatureSink
+{
+public:
+    //! Функция приема, аргументы и результат - как у CSignatureSink::Write().
+    typedef boost::function<bool (uint64_t blockNum, const uint8_t* pRecord, size_t size)> CWriteFunc;
+
+    explicit CCallbackSink(const CWriteFunc& writeFunc);
+
+    virtual bool Write(uint64_t blockNum, const uint8_t* pRecord, size_t size);
+
+private:
+    CWriteFunc m_writeFunc;
+};
+
+//! Сигнатуры CRC32 нескольких размеров блока за один проход.
+//! Принимает CRC32 самых мелких блоков, передает их своему приемнику, а CRC32 более
+//! крупных блоков (кратных мелкому) получает объединением CRC32 мелких блоков
+//! (CCrc32Shift) - без повторного чтения и рассчета. Последний неполный крупный блок
+//! дополняется нулями, как и при подписи с крупным блоком: к нему дописываются CRC32
+//! нулевых мелких блоков. После окончания подписи нужно вызвать Finish().
+class CMultiResolutionSink : public CSignatureSink
+{
+public:
+    CMultiResolutionSink(CSignatureSink& sink, size_t blockSize);
+
+    bool AddLevel(size_t blockSize, CSignatureSink& sink);
+
+    virtual bool Write(uint64_t blockNum, const uint8_t* pRecord, size_t size);
+
+    bool Finish();
+
+private:
+    //! Крупный размер блока.
+    struct Level
+    {
+        size_t          factor;     //!< Мелких блоков в крупном
+        CSignatureSink* pSink;
+        uint32_t        crc;        //!< CRC32 накопленных мелких блоков
+        size_t          count;      //!< Накоплено мелких блоков
+        uint64_t        blockNum;   //!< Номер следующего крупного блока
+    };
+
+    bool Append(Level& level, uint32_t crc);
+
+private:
+    CSignatureSink&    m_sink;
+    size_t             m_blockSize;
+    CCrc32Shift        m_shift;      //!< Сдвиг на мелкий блок
+    uint32_t           m_zeroCrc;    //!< CRC32 нулевого мелкого блока
+    std::vector<Level> m_levels;
+};
+
+#endif // _SIGNATURE_SINK_H
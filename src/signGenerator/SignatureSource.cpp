@@ -0,0 +1,186 @@
+//! @file SignatureSource.cpp
+//! Реализация источников данных CSignatureGenerator
+
+#include "SignatureSource.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+//! Конструктор.
+//! @param pData - [in] данные;
+//! @param size  - [in] размер данных, в байтах.
+CMemorySource::CMemorySource(const uint8_t* pData, size_t size) :
+    m_pData(pData), m_size(size), m_offset(0)
+{
+}
+
+bool CMemorySource::Read(uint8_t* pBuffer, size_t size, size_t& readSize)
+{
+    readSize = std::min(size, m_size - m_offset);
+
+    memcpy(pBuffer, m_pData + m_offset, readSize);
+    m_offset += readSize;
+
+    return true;
+}
+
+bool CMemorySource::GetSize(uint64_t& size) const
+{
+    size = m_size;
+    return true;
+}
+
+//! Конструктор.
+//! @param fd - [in] дескриптор.
+CFdSource::CFdSource(int fd) : m_fd(fd)
+{
+}
+
+bool CFdSource::Read(uint8_t* pBuffer, size_t size, size_t& readSize)
+{
+    while (true)
+    {
+#ifdef _WIN32
+        const int result = _read(m_fd, pBuffer,
+                                 static_cast<unsigned int>(std::min<size_t>(size, INT_MAX)));
+#else
+        const ssize_t result = read(m_fd, pBuffer, size);
+#endif
+
+        if (result >= 0)
+        {
+            readSize = static_cast<size_t>(result);
+            return true;
+        }
+
+        if (errno != EINTR)
+        {
+            return false;
+        }
+    }
+}
+
+//! Размер известен только для обычного файла: остаток от текущей позиции до конца.
+bool CFdSource::GetSize(uint64_t& size) const
+{
+#ifdef _WIN32
+    struct _stat64 st;
+
+    if ((_fstat64(m_fd, &st) != 0) || !(st.st_mode & _S_IFREG))
+    {
+        return false;
+    }
+
+    const int64_t offset = _telli64(m_fd);
+#else
+    struct stat st;
+
+    if ((fstat(m_fd, &st) != 0) || !S_ISREG(st.st_mode))
+    {
+        return false;
+    }
+
+    const int64_t offset = lseek(m_fd, 0, SEEK_CUR);
+#endif
+
+    if ((offset < 0) || (offset > st.st_size))
+    {
+        return false;
+    }
+
+    size = static_cast<uint64_t>(st.st_size - offset);
+    return true;
+}
+
+//! Конструктор.
+//! @param stream - [in] поток ввода.
+CStreamSource::CStreamSource(std::istream& stream) :
+    m_stream(stream), m_oldExceptions(stream.exceptions())
+{
+    // Короткое чтение в конце данных выставляет failbit, ошибкой считается только badbit
+    m_stream.exceptions(std::ios::goodbit);
+}
+
+//! Деструктор. Восстанавливает исключения потока.
+CStreamSource::~CStreamSource()
+{
+    if (m_stream.eof() && !m_stream.bad())
+    {
+        m_stream.clear();
+    }
+
+    m_stream.exceptions(m_oldExceptions);
+}
+
+bool CStreamSource::Read(uint8_t* pBuffer, size_t size, size_t& readSize)
+{
+    m_stream.read(reinterpret_cast<char*>(pBuffer), static_cast<std::streamsize>(size));
+    readSize = static_cast<size_t>(m_stream.gcount());
+
+    return !m_stream.bad();
+}
+
+//! Размер известен, если поток поддерживает позиционирование.
+bool CStreamSource::GetSize(uint64_t& size) const
+{
+    std::istream& stream = m_stream;
+
+    if (!stream.good())
+    {
+        return false;
+    }
+
+    const std::streampos pos = stream.tellg();
+
+    if (pos == std::streampos(-1))
+    {
+        return false;
+    }
+
+    stream.seekg(0, std::ios::end);
+    const std::streampos end = stream.tellg();
+    stream.seekg(pos);
+
+    if ((end == std::streampos(-1)) || !stream.good())
+    {
+        stream.clear();
+        stream.seekg(pos);
+        return false;
+    }
+
+    size = static_cast<uint64_t>(end - pos);
+    return true;
+}
+
+//! Конструктор.
+CCallbackSource::CCallbackSource(const CReadFunc& readFunc, int64_t size) :
+    m_readFunc(readFunc), m_size(size)
+{
+}
+
+bool CCallbackSource::Read(uint8_t* pBuffer, size_t size, size_t& readSize)
+{
+    readSize = 0;
+    return m_readFunc(pBuffer, size, readSize);
+}
+
+bool CCallbackSource::GetSize(uint64_t& size) const
+{
+    if (m_size < 0)
+    {
+        return false;
+    }
+
+    size = static_cast<uint64_t>(m_size);
+    return true;
+}
@@ -0,0 +1,100 @@
+//! @file SignatureSource.h
+//! Объявление источников данных CSignatureGenerator
+
+#ifndef _SIGNATURE_SOURCE_H
+#define _SIGNATURE_SOURCE_H
+
+#include <boost/function.hpp>
+
+#include <istream>
+#include <stddef.h>
+#include <stdint.h>
+
+//! Источник данных, сигнатура которых рассчитывается.
+//! Данные читаются последовательно одним потоком за раз (под блокировкой CSignatureGenerator).
+class CSignatureSource
+{
+public:
+    virtual ~CSignatureSource() {}
+
+    //! Читает очередную порцию данных.
+    //! @param pBuffer  - [in]  буфер;
+    //! @param size     - [in]  размер буфера, в байтах;
+    //! @param readSize - [out] кол-во прочитанных байтов, 0 - данные закончились.
+    //! @return true - успех, false - ошибка чтения.
+    virtual bool Read(uint8_t* pBuffer, size_t size, size_t& readSize) = 0;
+
+    //! Возвращает размер данных, если он известен заранее.
+    //! @param size - [out] размер, в байтах, 0 - если он неизвестен.
+    //! @return true - размер известен, false - данные читаются до конца.
+    virtual bool GetSize(uint64_t& size) const
+    {
+        size = 0;
+        return false;
+    }
+};
+
+//! Данные в памяти. Буфер должен существовать до конца рассчета.
+class CMemorySource : public CSignatureSource
+{
+public:
+    CMemorySource(const uint8_t* pData, size_t size);
+
+    virtual bool Read(uint8_t* pBuffer, size_t size, size_t& readSize);
+    virtual bool GetSize(uint64_t& size) const;
+
+private:
+    const uint8_t* m_pData;
+    size_t         m_size;
+    size_t         m_offset;
+};
+
+//! Открытый файловый дескриптор, читается с текущей позиции. Дескриптор не закрывается.
+class CFdSource : public CSignatureSource
+{
+public:
+    explicit CFdSource(int fd);
+
+    virtual bool Read(uint8_t* pBuffer, size_t size, size_t& readSize);
+    virtual bool GetSize(uint64_t& size) const;
+
+private:
+    int m_fd;
+};
+
+//! Поток ввода, читается с текущей позиции.
+//! На время чтения исключения потока при достижении конца данных отключаются.
+class CStreamSource : public CSignatureSource
+{
+public:
+    explicit CStreamSource(std::istream& stream);
+    virtual ~CStreamSource();
+
+    virtual bool Read(uint8_t* pBuffer, size_t size, size_t& readSize);
+    virtual bool GetSize(uint64_t& size) const;
+
+private:
+    std::istream&     m_stream;
+    std::ios::iostate m_oldExceptions;
+};
+
+//! Данные, которые отдает функция пользователя.
+class CCallbackSource : public CSignatureSource
+{
+public:
+    //! Функция чтения, аргументы и результат - как у CSignatureSource::Read().
+    typedef boost::function<bool (uint8_t* pBuffer, size_t size, size_t& readSize)> CReadFunc;
+
+    //! @param readFunc - [in] функция чтения;
+    //! @param size     - [in] размер данных, если известен; иначе данные читаются до конца.
+    explicit CCallbackSource(const CReadFunc& readFunc, int64_t size = -1);
+
+    virtual bool Read(uint8_t* pBuffer, size_t size, size_t& readSize);
+    virtual bool GetSize(uint64_t& size) const;
+
+private:
+    CReadFunc m_readFunc;
+    int64_t   m_size;
+};
+
+#endif // _SIGNATURE_SOURCE_H
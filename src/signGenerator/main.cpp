@@ -1,24 +1,57 @@
 //! @file main.cpp
-//!     main().
+//! Точка входа в приложение main().
 
-#include "signatureGenerator.h"
+#include "../common/util/ParseSize.h"
+#include "AutoTuner.h"
+#include "ChunkSigner.h"
+#include "DecompressSource.h"
+#include "PartialSignature.h"
+#include "SignDaemon.h"
+#include "SignWatcher.h"
+#include "SignatureCache.h"
+#include "SignatureDiff.h"
+#include "SignatureGenerator.h"
+#include <boost/bind/bind.hpp>
+#include <fcntl.h>
+#include <fstream>
+#include <signal.h>
+#include <sstream>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
 
-//!    - 1
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+//! Размер блока чтения по-умолчанию 1Мб
 const size_t DEFAULT_READ_BLOCK_SIZE      = 1024 * 1024;
-//! -   
+//! Кол-во байтов в килобайте
 const size_t BYTES_IN_KYLOBYTE            = 1024;
-//!     
+//! Максимальный раззмер блока чтения 
 const size_t MAX_READ_BLOCK_SIZE_KB       = DEFAULT_READ_BLOCK_SIZE * 64;
-//!    -
+//! Имя выходного файла по-умолчанию
 const std::string DEFAULTOUTPUT_FILE_NAME = "./output.bin";
+//! Максимальный размер блока запроса в режиме сервера
+const size_t MAX_DAEMON_BLOCK_SIZE        = DEFAULT_READ_BLOCK_SIZE * 64;
+//! Наибольшее кол-во событий трассы на поток
+const size_t MAX_TRACE_EVENTS_PER_THREAD  = 4 * 1024 * 1024;
+//! Ограничение памяти индекса повторяющихся блоков по-умолчанию
+const size_t DEFAULT_DEDUP_MEMORY         = 256 * 1024 * 1024;
+//! Наибольший размер кеша сигнатур по-умолчанию
+const size_t DEFAULT_CACHE_SIZE           = 1024 * 1024 * 1024;
+//! Кол-во самых больших групп повторяющихся блоков в отчете
+const size_t DEDUP_REPORT_GROUPS          = 10;
 
 
-//!  header  
-//! @param inFileNamem        - [in]      argc
-//! @param hInputFile         - [out] header  
-//! @return true - , false -   .
-bool SetInputFile(std::string inFileNamem, std::ifstream& hInputFile)
+//! Возвращает header входного файла
+//! @param inFileNamem        - [in/out] имя входного файла из argc или введенное
+//! @param hInputFile         - [out]    header входного файла
+//! @return true - успех, false - в случае ошибки.
+bool SetInputFile(std::string& inFileNamem, std::ifstream& hInputFile)
 {
     std::ios::iostate oldExIn = hInputFile.exceptions();
     hInputFile.exceptions(std::ios::failbit | std::ios::badbit);
@@ -55,10 +88,10 @@ bool SetInputFile(std::string inFileNamem, std::ifstream& hInputFile)
 }
 
 
-//!  header  
-//! @param inFileNamem        - [in]      argc
-//! @param hInputFile         - [out] header  
-//! @return true - , false -   .
+//! Возвращает header выходного файла
+//! @param inFileNamem        - [in]  имя выходного файла из argc
+//! @param hInputFile         - [out] header выходного файла
+//! @return true - успех, false - в случае ошибки.
 bool SetOutputFile(std::string& outFileName, std::ofstream& hOuteputFile)
 {
     std::ios::iostate oldExOut = hOuteputFile.exceptions();
@@ -94,9 +127,9 @@ bool SetOutputFile(std::string& outFileName, std::ofstream& hOuteputFile)
 }
 
 
-//!    
-//! @param blockSize        - [in/out]   
-//! @return true - , false -   .
+//! Возвращает размер блока чтения
+//! @param blockSize        - [in/out] размер блока чтения
+//! @return true - успех, false - в случае ошибки.
 bool SetBlockSize(size_t& blockSize)
 {
     blockSize = blockSize * BYTES_IN_KYLOBYTE;
@@ -134,9 +167,9 @@ bool SetBlockSize(size_t& blockSize)
 }
 
 
-//!     
-//! @param str        - [in]  
-//! @return true - , false - .
+//! Запрашивает у пользователя повтор ввода
+//! @param str        - [in] текст сообщения
+//! @return true - повтор, false - выход.
 bool isRepeatInput(std::string str)
 {
     std::cout << "Do you want to enter " << str << " again? YES/NO " << std::endl;
@@ -153,68 +186,1498 @@ bool isRepeatInput(std::string str)
 }
 
 
-//!  
-int main(int argc, char *argv[])
+//! Параметры командной строки
+struct CmdLineOptions
 {
-    std::string inputFileName;
-    std::string outputFileName;
-    size_t      blockSize = 0;
+    CmdLineOptions() : memoryLimit(0), isNumaEnabled(true), showPoolStats(false),
+                       showStats(false), showPerf(false), statsInterval(0),
+                       digests(1, DIGEST_CRC32), isSeparateOutputs(false),
+                       cdcMinSize(0), cdcAvgSize(0), cdcMaxSize(0), isDedup(false),
+                       dedupMemory(DEFAULT_DEDUP_MEMORY), isRange(false), rangeFirst(0),
+                       rangeLast(CSignatureGenerator::NO_LAST_BLOCK), isDecompress(false),
+                       compression(CDecompressSource::COMPRESSION_AUTO), ioLimit(0), cpuShare(100),
+                       isIoIdle(false), isSchedIdle(false), isAutoTune(false), watchDelayMs(200),
+                       isAppendOnly(false), cacheSize(DEFAULT_CACHE_SIZE),
+                       cacheVerify(CSignatureCache::VERIFY_METADATA), isSigDiff(false) {}
+
+    std::vector<std::string> positional;  //!< позиционные аргументы
+    size_t                   memoryLimit; //!< ограничение памяти под буферы, 0 - нет
+    CMemoryPool::ArenaParams arenaParams; //!< размещение памяти пула
+    CCpuList                 cpus;        //!< процессоры, которыми ограничена работа, пусто - все
+    bool                     isNumaEnabled;
+    bool                     showPoolStats;
+    bool                     showStats;     //!< выводить счетчики конвейера в JSON
+    std::string              statsPath;     //!< файл для счетчиков, пусто - stderr
+    std::string              tracePath;     //!< файл трассы обработки блоков, пусто - нет
+    std::string              daemonSocket;  //!< сокет режима сервера, пусто - обычный режим
+    bool                     showPerf;      //!< выводить аппаратные счетчики в stderr
+    size_t                   statsInterval; //!< период промежуточного вывода (с), 0 - нет
+    CDigestList              digests;       //!< дайджесты блока, по-умолчанию CRC32
+    bool                     isSeparateOutputs; //!< по файлу <output>.<дайджест> на дайджест
+    size_t                   cdcMinSize;    //!< размеры блоков по содержимому,
+    size_t                   cdcAvgSize;    //!< 0 - блоки фиксированного размера
+    size_t                   cdcMaxSize;
+    bool                     isDedup;       //!< искать повторяющиеся блоки
+    std::string              dedupPath;     //!< файл отчета о повторах, пусто - stderr
+    size_t                   dedupMemory;   //!< ограничение памяти индекса повторов
+    std::string              dedupDir;      //!< каталог файлов индекса, пусто - временный
+    bool                     isRange;       //!< частичная сигнатура диапазона блоков
+    uint64_t                 rangeFirst;    //!< первый блок диапазона
+    uint64_t                 rangeLast;     //!< блок после последнего, NO_LAST_BLOCK - до конца
+    std::string              mergeOutput;   //!< файл объединения частичных сигнатур, пусто - нет
+    bool                     isDecompress;  //!< подписывать распакованные данные
+    CDecompressSource::ECompression compression; //!< формат сжатия входного файла
+    size_t                   ioLimit;       //!< скорость чтения, байт/с, 0 - без ограничения
+    unsigned                 cpuShare;      //!< доля процессора потока рассчета, %
+    bool                     isIoIdle;      //!< ввод-вывод в классе idle
+    bool                     isSchedIdle;   //!< планирование SCHED_IDLE
+    bool                     isAutoTune;    //!< подобрать параметры конвейера при запуске
+    std::string              watchDir;      //!< отслеживаемый каталог, пусто - обычный режим
+    unsigned                 watchDelayMs;  //!< задержка подписи после последней записи, мс
+    bool                     isAppendOnly;  //!< файлы каталога только дописываются
+    std::string              cacheDir;      //!< каталог кеша сигнатур, пусто - без кеша
+    size_t                   cacheSize;     //!< наибольший размер кеша, 0 - без ограничения
+    CSignatureCache::EVerifyMode cacheVerify; //!< проверка записей кеша
+    std::vector<size_t>      resolutions;   //!< крупные размеры блока сигнатур CRC32 за тот же проход
+    bool                     isSigDiff;     //!< сравнить две сигнатуры (позиционные аргументы)
+};
+
+
+//! Разбирает размеры блоков по содержимому в виде min,avg,max (например 2K,8K,64K).
+//! @param str        - [in]  строка с размерами
+//! @param options    - [out] параметры командной строки
+//! @return true - успех, false - в случае ошибки.
+bool ParseChunkSizes(const std::string& str, CmdLineOptions& options)
+{
+    const std::string::size_type posFirst  = str.find(',');
+    const std::string::size_type posSecond = (posFirst != std::string::npos) ? str.find(',', posFirst + 1)
+                                                                            : std::string::npos;
 
-    if (argc > 1)
+    if (posSecond == std::string::npos)
     {
-        inputFileName = argv[1];
+        return false;
     }
-    if (argc > 2)
-    {        
-        outputFileName = argv[2];        
+
+    return ParseSize(str.substr(0, posFirst), options.cdcMinSize) &&
+           ParseSize(str.substr(posFirst + 1, posSecond - posFirst - 1), options.cdcAvgSize) &&
+           ParseSize(str.substr(posSecond + 1), options.cdcMaxSize);
+}
+
+
+//! Разбирает диапазон блоков в виде first:last (last не входит, пустой - до конца файла).
+//! @param str        - [in]  строка с диапазоном
+//! @param options    - [out] параметры командной строки
+//! @return true - успех, false - в случае ошибки.
+bool ParseBlockRange(const std::string& str, CmdLineOptions& options)
+{
+    const std::string::size_type posColon = str.find(':');
+
+    if ((posColon == std::string::npos) || (posColon == 0))
+    {
+        return false;
     }
-    if (argc > 3) 
-    {        
-        blockSize      = atoi(argv[3]);
+
+    char* pEnd = NULL;
+    options.rangeFirst = strtoull(str.c_str(), &pEnd, 10);
+
+    if (pEnd != str.c_str() + posColon)
+    {
+        return false;
     }
 
-    std::ifstream hInFile;
+    if (posColon + 1 < str.size())
+    {
+        options.rangeLast = strtoull(str.c_str() + posColon + 1, &pEnd, 10);
 
-    while (!SetInputFile(inputFileName, hInFile))
+        if ((*pEnd != '\0') || (options.rangeLast <= options.rangeFirst))
+        {
+            return false;
+        }
+    }
+
+    options.isRange = true;
+
+    return true;
+}
+
+
+//! Разбирает список крупных размеров блока (--resolutions 64,1024) в Кб.
+//! @param str     - [in]  строка со списком
+//! @param options - [out] параметры командной строки
+//! @return true - успех, false - в случае ошибки.
+bool ParseResolutions(const std::string& str, CmdLineOptions& options)
+{
+    std::istringstream stream(str);
+    std::string        item;
+
+    options.resolutions.clear();
+
+    while (std::getline(stream, item, ','))
     {
-        if (!isRepeatInput("input filename"))
+        char* pEnd = NULL;
+        const unsigned long sizeKb = strtoul(item.c_str(), &pEnd, 10);
+
+        if (item.empty() || (*pEnd != '\0') || (sizeKb == 0))
         {
-            return 0;
+            return false;
         }
+
+        options.resolutions.push_back(static_cast<size_t>(sizeKb) * BYTES_IN_KYLOBYTE);
     }
 
-    std::ofstream hOutFile;
+    return !options.resolutions.empty();
+}
 
-    while (!SetOutputFile(outputFileName, hOutFile))
+
+//! Разбирает режим больших страниц.
+//! @param str        - [in]  строка с режимом (пустая - режим по-умолчанию hugetlb)
+//! @param pageMode   - [out] режим страниц
+//! @return true - успех, false - в случае ошибки.
+bool ParsePageMode(const std::string& str, CMemoryPool::EPageMode& pageMode)
+{
+    if (str.empty() || (str == "hugetlb"))
     {
-        if (!isRepeatInput("output filename"))
+        pageMode = CMemoryPool::PAGES_HUGE_TLB;
+    }
+    else if (str == "thp")
+    {
+        pageMode = CMemoryPool::PAGES_HUGE_TRANSPARENT;
+    }
+    else if (str == "off")
+    {
+        pageMode = CMemoryPool::PAGES_DEFAULT;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+
+//! Выводит статистику пула памяти.
+//! @param stats        - [in] статистика пула
+void PrintPoolStats(const CMemoryPool::Stats& stats)
+{
+    const size_t BYTES_IN_MEGABYTE = 1024 * 1024;
+
+    std::cout << "Memory pool: "    << stats.arenaBytes / BYTES_IN_MEGABYTE << " MB"
+              << ", huge pages: "   << stats.hugePageBytes / BYTES_IN_MEGABYTE << " MB"
+              << ", locked: "       << stats.lockedBytes / BYTES_IN_MEGABYTE << " MB"
+              << ", NUMA bound: "   << stats.numaBoundBytes / BYTES_IN_MEGABYTE << " MB"
+              << ", TLB entries: "  << stats.tlbEntries
+              << ", prefault page faults: " << stats.prefaultMinorFaults
+              << " minor, "         << stats.prefaultMajorFaults << " major" << std::endl;
+}
+
+
+//! Тело потока промежуточного вывода счетчиков конвейера.
+//! @param pSignGen    - [in] генератор сигнатур
+//! @param pOut        - [in] поток вывода
+//! @param intervalSec - [in] период вывода в секундах
+void StatsDumpProc(const CSignatureGenerator* pSignGen, std::ostream* pOut, size_t intervalSec)
+{
+    try
+    {
+        while (true)
         {
-            return 0;
+            boost::this_thread::sleep(boost::posix_time::seconds(static_cast<long>(intervalSec)));
+            pSignGen->GetPipelineStats().WriteJson(*pOut, false);
         }
     }
+    catch (boost::thread_interrupted&)
+    {
+    }
+}
 
-    while (!SetBlockSize(blockSize))
+
+//! Разбирает командную строку.
+//! Опции задаются в виде --name=value или --name value, остальные аргументы позиционные.
+//! Опции-флаги значения не принимают, кроме --huge-pages, --stats и --dedup, значение
+//! которых задается только через '='.
+//! @param argc        - [in]  кол-во аргументов
+//! @param argv        - [in]  аргументы
+//! @param options     - [out] параметры командной строки
+//! @return true - успех, false - в случае ошибки.
+bool ParseCmdLine(int argc, char *argv[], CmdLineOptions& options)
+{
+    for (int i = 1; i < argc; ++i)
     {
-        if (!isRepeatInput("blockSize"))
+        std::string arg = argv[i];
+
+        if (arg.compare(0, 2, "--") != 0)
         {
-            return 0;
+            options.positional.push_back(arg);
+            continue;
+        }
+
+        std::string name = arg.substr(2);
+        std::string value;
+        std::string::size_type posEq = name.find('=');
+
+        if (posEq != std::string::npos)
+        {
+            value = name.substr(posEq + 1);
+            name.erase(posEq);
+        }
+
+        if (name == "huge-pages")
+        {
+            if (!ParsePageMode(value, options.arenaParams.pageMode))
+            {
+                std::cerr << "Invalid huge pages mode: " << value << std::endl;
+                return false;
+            }
+
+            options.showPoolStats = true;
+            continue;
+        }
+        else if (name == "mlock")
+        {
+            options.arenaParams.lockMemory = true;
+            options.showPoolStats          = true;
+            continue;
+        }
+        else if (name == "no-numa")
+        {
+            options.isNumaEnabled = false;
+            continue;
+        }
+        else if (name == "perf")
+        {
+            options.showPerf = true;
+            continue;
+        }
+        else if (name == "separate-outputs")
+        {
+            options.isSeparateOutputs = true;
+            continue;
+        }
+        else if (name == "io-idle")
+        {
+            options.isIoIdle = true;
+            continue;
+        }
+        else if (name == "sched-idle")
+        {
+            options.isSchedIdle = true;
+            continue;
+        }
+        else if (name == "auto-tune")
+        {
+            options.isAutoTune = true;
+            continue;
+        }
+        else if (name == "sigdiff")
+        {
+            options.isSigDiff = true;
+            continue;
+        }
+        else if (name == "append-only")
+        {
+            options.isAppendOnly = true;
+            continue;
+        }
+        else if (name == "stats")
+        {
+            options.showStats = true;
+            options.statsPath = value;
+            continue;
+        }
+        else if (name == "dedup")
+        {
+            options.isDedup   = true;
+            options.dedupPath = value;
+            continue;
+        }
+        else if (name == "decompress")
+        {
+            if (!CDecompressSource::ParseCompression(value, options.compression))
+            {
+                std::cerr << "Invalid compression format: " << value << std::endl;
+                return false;
+            }
+
+            options.isDecompress = true;
+            continue;
+        }
+
+        if ((posEq == std::string::npos) && (i + 1 < argc))
+        {
+            value = argv[++i];
+        }
+
+        if (name == "memory-limit")
+        {
+            if (!ParseSize(value, options.memoryLimit))
+            {
+                std::cerr << "Invalid memory limit: " << value << std::endl;
+                return false;
+            }
+        }
+        else if (name == "io-limit")
+        {
+            if (!ParseSize(value, options.ioLimit) || (options.ioLimit == 0))
+            {
+                std::cerr << "Invalid I/O limit: " << value << std::endl;
+                return false;
+            }
+        }
+        else if (name == "watch")
+        {
+            if (value.empty())
+            {
+                std::cerr << "Watch directory is not set" << std::endl;
+                return false;
+            }
+
+            options.watchDir = value;
+        }
+        else if (name == "resolutions")
+        {
+            if (!ParseResolutions(value, options))
+            {
+                std::cerr << "Invalid resolution list: " << value << std::endl;
+                return false;
+            }
+        }
+        else if (name == "cache")
+        {
+            if (value.empty())
+            {
+                std::cerr << "Cache directory is not set" << std::endl;
+                return false;
+            }
+
+            options.cacheDir = value;
+        }
+        else if (name == "cache-size")
+        {
+            if (!ParseSize(value, options.cacheSize))
+            {
+                std::cerr << "Invalid cache size: " << value << std::endl;
+                return false;
+            }
+        }
+        else if (name == "cache-verify")
+        {
+            if (!CSignatureCache::ParseVerifyMode(value, options.cacheVerify))
+            {
+                std::cerr << "Invalid cache verify mode: " << value << std::endl;
+                return false;
+            }
+        }
+        else if (name == "watch-delay")
+        {
+            char* pEnd = NULL;
+            options.watchDelayMs = strtoul(value.c_str(), &pEnd, 10);
+
+            if (value.empty() || (*pEnd != '\0'))
+            {
+                std::cerr << "Invalid watch delay: " << value << std::endl;
+                return false;
+            }
+        }
+        else if (name == "cpu-limit")
+        {
+            char* pEnd = NULL;
+            options.cpuShare = strtoul(value.c_str(), &pEnd, 10);
+
+            if (value.empty() || (*pEnd != '\0') || (options.cpuShare == 0) || (options.cpuShare > 100))
+            {
+                std::cerr << "Invalid CPU limit: " << value << std::endl;
+                return false;
+            }
+        }
+        else if (name == "dedup-memory")
+        {
+            if (!ParseSize(value, options.dedupMemory))
+            {
+                std::cerr << "Invalid dedup memory limit: " << value << std::endl;
+                return false;
+            }
+
+            options.isDedup = true;
+        }
+        else if (name == "dedup-dir")
+        {
+            if (value.empty())
+            {
+                std::cerr << "Dedup directory is not set" << std::endl;
+                return false;
+            }
+
+            options.dedupDir = value;
+            options.isDedup  = true;
+        }
+        else if (name == "stats-interval")
+        {
+            char* pEnd = NULL;
+            options.statsInterval = strtoul(value.c_str(), &pEnd, 10);
+
+            if (value.empty() || (*pEnd != '\0'))
+            {
+                std::cerr << "Invalid stats interval: " << value << std::endl;
+                return false;
+            }
+
+            options.showStats = true;
+        }
+        else if (name == "trace")
+        {
+            if (value.empty())
+            {
+                std::cerr << "Trace file is not set" << std::endl;
+                return false;
+            }
+
+            options.tracePath = value;
+        }
+        else if (name == "daemon")
+        {
+            if (value.empty())
+            {
+                std::cerr << "Daemon socket is not set" << std::endl;
+                return false;
+            }
+
+            options.daemonSocket = value;
+        }
+        else if (name == "digests")
+        {
+            if (!ParseDigestList(value, options.digests))
+            {
+                std::cerr << "Invalid digest list: " << value << std::endl;
+                return false;
+            }
+        }
+        else if (name == "range")
+        {
+            if (!ParseBlockRange(value, options))
+            {
+                std::cerr << "Invalid block range: " << value << std::endl;
+                return false;
+            }
+        }
+        else if (name == "merge")
+        {
+            if (value.empty())
+            {
+                std::cerr << "Merge output file is not set" << std::endl;
+                return false;
+            }
+
+            options.mergeOutput = value;
+        }
+        else if (name == "cdc")
+        {
+            if (!ParseChunkSizes(value, options))
+            {
+                std::cerr << "Invalid chunk sizes: " << value << std::endl;
+                return false;
+            }
+        }
+        else if (name == "cpus")
+        {
+            if (!CNumaTopology::ParseCpuList(value, options.cpus))
+            {
+                std::cerr << "Invalid CPU list: " << value << std::endl;
+                return false;
+            }
+        }
+        else
+        {
+            std::cerr << "Unknown option: --" << name << std::endl;
+            return false;
         }
     }
 
-    CSignatureGenerator signGen;
+    return true;
+}
+
+
+//! Возвращает кол-во потоков рассчета по-умолчанию: по потоку на каждый процессор,
+//! которым ограничена работа, но не больше квоты cgroup контейнера.
+//! @param options - [in] параметры командной строки
+//! @return кол-во потоков.
+size_t DefaultThreadCount(const CmdLineOptions& options)
+{
+    ResourceLimits limits;
 
-    while (!signGen.Init(hInFile, hOutFile, blockSize))
+    if (DetectResourceLimits(limits, options.cpus))
     {
-        return 0;     
+        return limits.EffectiveCpus();
     }
 
-    signGen.StartProcessing();
-    signGen.WaitFinished();
+    return options.cpus.empty() ? boost::thread::hardware_concurrency() : options.cpus.size();
+}
 
-    hInFile.close();
-    hOutFile.close();
 
-    std::cin.ignore();
+//! Открывает входной файл для чтения по смещению.
+//! @return дескриптор, -1 - в случае ошибки.
+int OpenInputFd(const std::string& inputFileName)
+{
+#ifdef _WIN32
+    return _open(inputFileName.c_str(), _O_RDONLY | _O_BINARY);
+#else
+    return open(inputFileName.c_str(), O_RDONLY);
+#endif
+}
 
-    return 0;
+
+//! Закрывает дескриптор, открытый OpenInputFd(); -1 пропускается.
+void CloseInputFd(int fd)
+{
+    if (fd >= 0)
+    {
+#ifdef _WIN32
+        _close(fd);
+#else
+        close(fd);
+#endif
+    }
+}
+
+
+//! Подбирает параметры конвейера (--auto-tune) и задает их генератору.
+//! @param options       - [in]  параметры командной строки
+//! @param inputFileName - [in]  имя входного файла, скорость чтения которого замеряется
+//! @param blockSize     - [in]  размер блока
+//! @param signGen       - [in]  генератор сигнатур
+//! @param threadCnt     - [out] кол-во потоков рассчета
+//! @return true - успех, false - в случае ошибки.
+bool AutoTune(const CmdLineOptions& options, const std::string& inputFileName, size_t blockSize,
+              CSignatureGenerator& signGen, size_t& threadCnt)
+{
+    CAutoTuner tuner;
+    tuner.SetDigests(options.digests);
+    tuner.SetCpuSet(options.cpus);
+    tuner.SetMemoryLimit(options.memoryLimit);
+
+    // Скорость чтения сжатых данных не говорит о скорости поступления блоков
+    const int fd = options.isDecompress ? -1 : OpenInputFd(inputFileName);
+
+    TuneResult result;
+
+    const bool isTuned = tuner.Tune(fd, blockSize, result);
+
+    CloseInputFd(fd);
+
+    if (!isTuned)
+    {
+        std::cerr << "Auto-tune failed: no available CPUs" << std::endl;
+        return false;
+    }
+
+    result.Write(std::cout);
+
+    threadCnt = result.threads;
+
+    signGen.SetMemoryLimit(result.memoryLimit);
+    signGen.SetIoSize(result.ioSize);
+    signGen.SetReorderWindow(result.reorderWindow);
+    signGen.SetAdaptiveQueue(true);
+
+    return true;
+}
+
+
+//! Возвращает параметры сигнатуры для ключа кеша: дайджесты записи блока и распаковку.
+std::string CacheAlgorithm(const CmdLineOptions& options)
+{
+    std::string algorithm;
+
+    for (size_t i = 0; i < options.digests.size(); ++i)
+    {
+        algorithm += (i == 0 ? "" : ",") + std::string(DigestName(options.digests[i]));
+    }
+
+    // Формат сжатия определяется содержимым, поэтому достаточно признака распаковки
+    return options.isDecompress ? algorithm + "+decompress" : algorithm;
+}
+
+
+//! Ищет сигнатуру входного файла в кеше (--cache) и при успехе дописывает ее в
+//! выходной файл.
+//! @param options       - [in]  параметры командной строки
+//! @param inputFileName - [in]  имя входного файла
+//! @param blockSize     - [in]  размер блока
+//! @param cache         - [out] открытый кеш
+//! @param key           - [out] ключ входного файла, пустой algorithm - файл не кешируется
+//! @param hOutFile      - [in]  выходной файл
+//! @return true - сигнатура взята из кеша, false - файл нужно подписать.
+bool FindCachedSignature(const CmdLineOptions& options, const std::string& inputFileName, size_t blockSize,
+                         CSignatureCache& cache, SignatureCacheKey& key, std::ofstream& hOutFile)
+{
+    if (!cache.Open(options.cacheDir, options.cacheSize))
+    {
+        return false;
+    }
+
+    cache.SetVerifyMode(options.cacheVerify);
+
+    const int fd = OpenInputFd(inputFileName);
+
+    std::vector<uint8_t> signature;
+
+    // Не обычный файл (канал, устройство) не кешируется
+    bool isFound = key.Init(fd, blockSize, CacheAlgorithm(options)) &&
+                   cache.Find(options.isDecompress ? -1 : fd, key, options.digests, signature);
+
+    CloseInputFd(fd);
+
+    if (!isFound)
+    {
+        return false;
+    }
+
+    if (!signature.empty())
+    {
+        hOutFile.write(reinterpret_cast<const char*>(&signature[0]), static_cast<std::streamsize>(signature.size()));
+    }
+
+    return hOutFile.good();
+}
+
+
+//! Сохраняет сигнатуру в кеш, если входной файл не изменился во время подписи,
+//! иначе удаляет начатую запись.
+//! @param inputFileName - [in] имя входного файла
+//! @param cache         - [in] кеш
+//! @param key           - [in] ключ входного файла до подписи
+//! @param writer        - [in] запись кеша, в которую сигнатура писалась при подписи
+void StoreCachedSignature(const std::string& inputFileName, CSignatureCache& cache,
+                          const SignatureCacheKey& key, CSignatureCacheWriter& writer)
+{
+    const int fd = OpenInputFd(inputFileName);
+
+    SignatureCacheKey signedKey;
+
+    const bool isUnchanged = signedKey.Init(fd, static_cast<size_t>(key.blockSize), key.algorithm) &&
+                             (signedKey.ToString() == key.ToString());
+
+    CloseInputFd(fd);
+
+    if (!isUnchanged)
+    {
+        return;
+    }
+
+    if (!cache.CommitStore(writer))
+    {
+        std::cerr << "Unable to store signature in cache " << inputFileName << std::endl;
+    }
+}
+
+
+//! Передает запись блока приемнику и дописывает ее в запись кеша. Ошибка записи
+//! кеша не прерывает подписи: незавершенная запись не сохраняется.
+bool WriteAndCacheRecord(CSignatureSink* pSink, CSignatureCacheWriter* pWriter,
+                         uint64_t blockNum, const uint8_t* pRecord, size_t size)
+{
+    pWriter->Write(pRecord, size);
+
+    return pSink->Write(blockNum, pRecord, size);
+}
+
+
+//! Признак остановки режима сервера
+boost::atomic<bool> g_abDaemonStop(false);
+
+//! Обработчик SIGINT и SIGTERM режима сервера.
+void OnDaemonStopSignal(int)
+{
+    g_abDaemonStop = true;
+}
+
+
+//! Работа в режиме сервера: потоки и пул памяти создаются один раз, запросы
+//! принимаются через сокет до получения SIGINT или SIGTERM.
+//! @param options - [in] параметры командной строки
+//! @return код завершения процесса.
+int RunDaemon(const CmdLineOptions& options)
+{
+    CSignScheduler scheduler;
+    scheduler.SetArenaParams(options.arenaParams);
+    scheduler.SetCpuSet(options.cpus);
+
+    const size_t threadCnt = DefaultThreadCount(options);
+
+    if (!scheduler.Start(DEFAULT_READ_BLOCK_SIZE, threadCnt))
+    {
+        std::cerr << "Unable to start signing threads" << std::endl;
+        return 1;
+    }
+
+    CSignDaemon     daemon(scheduler, DEFAULT_READ_BLOCK_SIZE, MAX_DAEMON_BLOCK_SIZE);
+    CSignatureCache cache;
+
+    if (!options.cacheDir.empty())
+    {
+        if (!cache.Open(options.cacheDir, options.cacheSize))
+        {
+            return 1;
+        }
+
+        cache.SetVerifyMode(options.cacheVerify);
+        daemon.SetCache(&cache);
+    }
+
+    if (!daemon.Listen(options.daemonSocket))
+    {
+        return 1;
+    }
+
+    signal(SIGINT, &OnDaemonStopSignal);
+    signal(SIGTERM, &OnDaemonStopSignal);
+
+    std::cout << "Listening on " << options.daemonSocket << std::endl;
+
+    daemon.Run(g_abDaemonStop);
+
+    return 0;
+}
+
+
+//! Работа в режиме отслеживания каталога: сигнатуры измененных файлов пересчитываются
+//! общим планировщиком до получения SIGINT или SIGTERM.
+//! @param options - [in] параметры командной строки: каталог сигнатур и размер блока
+//!                       в Кб - позиционные аргументы
+//! @return код завершения процесса.
+int RunWatch(const CmdLineOptions& options)
+{
+    if (options.positional.empty())
+    {
+        std::cerr << "Signature directory is not set" << std::endl;
+        return 1;
+    }
+
+    size_t blockSize = DEFAULT_READ_BLOCK_SIZE;
+
+    if (options.positional.size() > 1)
+    {
+        blockSize = static_cast<size_t>(atoi(options.positional[1].c_str())) * BYTES_IN_KYLOBYTE;
+
+        if ((blockSize == 0) || (blockSize > MAX_DAEMON_BLOCK_SIZE))
+        {
+            std::cerr << "Invalid block size: " << options.positional[1] << std::endl;
+            return 1;
+        }
+    }
+
+    CSignScheduler scheduler;
+    scheduler.SetArenaParams(options.arenaParams);
+    scheduler.SetCpuSet(options.cpus);
+
+    const size_t threadCnt = DefaultThreadCount(options);
+
+    if (!scheduler.Start(blockSize, threadCnt))
+    {
+        std::cerr << "Unable to start signing threads" << std::endl;
+        return 1;
+    }
+
+    // Файлов подписывается одновременно столько же, сколько потоков рассчета: мелкие
+    // файлы не оставляют потоки без работы, пока подписывается крупный
+    CSignWatcher watcher(scheduler, blockSize, threadCnt);
+    watcher.SetDelay(options.watchDelayMs);
+    watcher.SetAppendOnly(options.isAppendOnly);
+
+    if (!watcher.Watch(options.watchDir, options.positional[0]))
+    {
+        return 1;
+    }
+
+    signal(SIGINT, &OnDaemonStopSignal);
+    signal(SIGTERM, &OnDaemonStopSignal);
+
+    std::cout << "Watching " << options.watchDir << std::endl;
+
+    watcher.Run(g_abDaemonStop);
+
+    return 0;
+}
+
+
+//! Инициализирует индекс повторяющихся блоков.
+//! @param options - [in]  параметры командной строки
+//! @param index   - [out] индекс
+//! @return true - успех, false - в случае ошибки.
+bool InitDedupIndex(const CmdLineOptions& options, CDedupIndex& index)
+{
+    std::string dir = options.dedupDir;
+
+    if (dir.empty())
+    {
+#ifdef _WIN32
+        const char* pTempDir = getenv("TEMP");
+#else
+        const char* pTempDir = getenv("TMPDIR");
+#endif
+        dir = (pTempDir != NULL) ? pTempDir : "/tmp";
+    }
+
+    return index.Init(options.dedupMemory, dir);
+}
+
+
+//! Выводит отчет о повторяющихся блоках в файл --dedup или stderr.
+//! @param options - [in] параметры командной строки
+//! @param index   - [in] индекс со всеми блоками
+//! @return true - успех, false - в случае ошибки.
+bool WriteDedupReport(const CmdLineOptions& options, CDedupIndex& index)
+{
+    CDedupIndex::Report report;
+
+    if (!index.BuildReport(report, DEDUP_REPORT_GROUPS))
+    {
+        std::cerr << "Unable to build dedup report" << std::endl;
+        return false;
+    }
+
+    if (options.dedupPath.empty())
+    {
+        report.WriteJson(std::cerr);
+        return true;
+    }
+
+    std::ofstream reportFile(options.dedupPath.c_str(), std::ios::out | std::ios::trunc);
+
+    if (!reportFile.is_open())
+    {
+        std::cerr << "Unable to open dedup report file " << options.dedupPath << std::endl;
+        return false;
+    }
+
+    report.WriteJson(reportFile);
+
+    return true;
+}
+
+
+//! Сигнатура из блоков переменного размера с границами по содержимому.
+//! @param options       - [in] параметры командной строки
+//! @param inputFileName - [in] имя входного файла
+//! @param out           - [in] поток вывода записей блоков
+//! @return код завершения процесса.
+int RunChunking(const CmdLineOptions& options, const std::string& inputFileName, std::ostream& out)
+{
+    CChunkSigner signer;
+
+    if (!signer.SetChunkSizes(options.cdcMinSize, options.cdcAvgSize, options.cdcMaxSize))
+    {
+        std::cerr << "Chunk sizes must satisfy " << CFastCdc::MIN_CHUNK_SIZE
+                  << " <= min < avg < max <= 4G" << std::endl;
+        return 1;
+    }
+
+    signer.SetDigests(options.digests);
+
+    CDedupIndex dedupIndex;
+
+    if (options.isDedup)
+    {
+        if (!InitDedupIndex(options, dedupIndex))
+        {
+            return 1;
+        }
+
+        signer.SetDedupIndex(&dedupIndex);
+    }
+
+#ifdef _WIN32
+    const int fd = _open(inputFileName.c_str(), _O_RDONLY | _O_BINARY);
+#else
+    const int fd = open(inputFileName.c_str(), O_RDONLY);
+#endif
+
+    if (fd < 0)
+    {
+        std::cerr << "Unable to open Input file" << std::endl;
+        return 1;
+    }
+
+    const size_t threadCnt = DefaultThreadCount(options);
+
+    CStreamSink sink(out);
+
+    const bool isOk = signer.Sign(fd, sink, threadCnt);
+
+#ifdef _WIN32
+    _close(fd);
+#else
+    close(fd);
+#endif
+
+    if (!isOk)
+    {
+        std::cerr << "Chunk signature generation failed" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Signatures file generation complited" << std::endl;
+
+    if (options.isDedup && !WriteDedupReport(options, dedupIndex))
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+
+//! Начинает частичную сигнатуру диапазона блоков --range: пишет заголовок, переводит
+//! входной файл на первый блок диапазона и ограничивает им генератор.
+//! Диапазон обрезается по концу файла, поэтому части с last за концом файла допустимы.
+//! @param options   - [in] параметры командной строки
+//! @param blockSize - [in] размер блока
+//! @param inFile    - [in] входной файл
+//! @param outFile   - [in] выходной файл, должен быть пустым
+//! @param signGen   - [in] генератор сигнатур
+//! @return true - успех, false - в случае ошибки.
+bool StartPartialSignature(const CmdLineOptions& options, size_t blockSize, std::ifstream& inFile,
+                           std::ofstream& outFile, CSignatureGenerator& signGen)
+{
+    PartialHeader header;
+    header.blockSize = blockSize;
+    header.digests   = options.digests;
+
+    {
+        CStreamSource probe(inFile);
+
+        if (!probe.GetSize(header.fileSize))
+        {
+            std::cerr << "--range requires a regular input file" << std::endl;
+            return false;
+        }
+    }
+
+    outFile.seekp(0, std::ios::end);
+
+    if (outFile.tellp() != std::streampos(0))
+    {
+        std::cerr << "Partial signature output file must be empty" << std::endl;
+        return false;
+    }
+
+    const uint64_t numBlocks = (header.fileSize + blockSize - 1) / blockSize;
+
+    header.lastBlock  = std::min(options.rangeLast, numBlocks);
+    header.firstBlock = std::min(options.rangeFirst, header.lastBlock);
+
+    for (size_t i = 0; i < options.digests.size(); ++i)
+    {
+        header.recordSize += static_cast<uint32_t>(DigestSize(options.digests[i]));
+    }
+
+    inFile.seekg(static_cast<std::streamoff>(header.firstBlock * blockSize));
+
+    if (!WritePartialHeader(outFile, header))
+    {
+        std::cerr << "Unable to write partial signature header" << std::endl;
+        return false;
+    }
+
+    signGen.SetBlockRange(header.firstBlock, header.lastBlock);
+
+    return true;
+}
+
+
+//! Объединяет частичные сигнатуры (позиционные аргументы) в файл --merge.
+//! @param options - [in] параметры командной строки
+//! @return код завершения процесса.
+int RunMerge(const CmdLineOptions& options)
+{
+    std::ofstream outFile(options.mergeOutput.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+
+    if (!outFile.is_open())
+    {
+        std::cerr << "Unable to open output file " << options.mergeOutput << std::endl;
+        return 1;
+    }
+
+    std::string error;
+
+    if (!MergePartialSignatures(options.positional, outFile, error))
+    {
+        std::cerr << error << std::endl;
+
+        // Неполная сигнатура не должна остаться на месте полной
+        outFile.close();
+        remove(options.mergeOutput.c_str());
+
+        return 1;
+    }
+
+    std::cout << "Merged " << options.positional.size() << " partial signatures" << std::endl;
+
+    return 0;
+}
+
+
+//! Сравнивает две сигнатуры (--sigdiff) и выводит измененные участки исходного файла.
+//! @param options - [in] параметры командной строки: старая и новая сигнатуры и размер
+//!                       блока в Кб - позиционные аргументы
+//! @return код завершения процесса.
+int RunSigDiff(const CmdLineOptions& options)
+{
+    if (options.positional.size() < 2)
+    {
+        std::cerr << "Two signature files are required" << std::endl;
+        return 1;
+    }
+
+    uint64_t blockSize = DEFAULT_READ_BLOCK_SIZE;
+
+    if (options.positional.size() > 2)
+    {
+        blockSize = strtoull(options.positional[2].c_str(), NULL, 10) * BYTES_IN_KYLOBYTE;
+
+        if (blockSize == 0)
+        {
+            std::cerr << "Invalid block size: " << options.positional[2] << std::endl;
+            return 1;
+        }
+    }
+
+    size_t recordSize = 0;
+
+    for (size_t i = 0; i < options.digests.size(); ++i)
+    {
+        recordSize += DigestSize(options.digests[i]);
+    }
+
+    CChangedRangeList ranges;
+    uint64_t          numBlocks = 0;
+    std::string       error;
+
+    if (!DiffSignatures(options.positional[0], options.positional[1], recordSize, DefaultThreadCount(options),
+                        ranges, numBlocks, error))
+    {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+
+    WriteChangedRanges(std::cout, ranges, blockSize);
+
+    uint64_t changedBlocks = 0;
+
+    for (size_t i = 0; i < ranges.size(); ++i)
+    {
+        changedBlocks += ranges[i].lastBlock - ranges[i].firstBlock;
+    }
+
+    // Итог - в stderr, чтобы stdout оставался списком участков
+    std::cerr << "Changed " << changedBlocks << " of " << numBlocks << " blocks in "
+              << ranges.size() << " ranges" << std::endl;
+
+    return 0;
+}
+
+
+//! Точка входа
+int main(int argc, char *argv[])
+{
+    std::string inputFileName;
+    std::string outputFileName;
+    size_t      blockSize = 0;
+
+    CmdLineOptions options;
+
+    if (!ParseCmdLine(argc, argv, options))
+    {
+        std::cerr << "Usage: signGen [input [output [blockSizeKb]]] [--memory-limit size[K|M|G]]"
+                  << " [--huge-pages[=hugetlb|thp|off]] [--mlock] [--cpus list] [--no-numa]"
+                  << " [--stats[=file]] [--stats-interval sec] [--trace file] [--perf]"
+                  << " [--digests crc32,sha256,xxh3] [--separate-outputs] [--cdc min,avg,max]"
+                  << " [--dedup[=file]] [--dedup-memory size[K|M|G]] [--dedup-dir dir]"
+                  << " [--range first:[last]] [--decompress[=auto|gzip|zstd]]"
+                  << " [--io-limit bytesPerSec[K|M|G]] [--cpu-limit percent] [--io-idle] [--sched-idle]"
+                  << " [--auto-tune] [--resolutions kb,kb...]"
+                  << " [--cache dir] [--cache-size size[K|M|G]] [--cache-verify meta|sample|full]" << std::endl;
+        std::cerr << "       signGen --merge output partial..." << std::endl;
+        std::cerr << "       signGen --sigdiff old new [blockSizeKb] [--digests list] [--cpus list]" << std::endl;
+        std::cerr << "       signGen --daemon socket [--huge-pages[=...]] [--mlock] [--cpus list]"
+                  << " [--io-idle] [--sched-idle] [--cache dir] [--cache-size size] [--cache-verify mode]"
+                  << std::endl;
+        std::cerr << "       signGen --watch dir outputDir [blockSizeKb] [--watch-delay ms] [--append-only]"
+                  << " [--cpus list] [--io-idle] [--sched-idle]" << std::endl;
+        return 1;
+    }
+
+    // Приоритеты задаются до создания потоков, которые их наследуют
+    if (options.isIoIdle && !SetIdleIoPriority())
+    {
+        std::cerr << "Unable to set idle I/O priority" << std::endl;
+    }
+
+    if (options.isSchedIdle && !SetIdleCpuPriority())
+    {
+        std::cerr << "Unable to set idle CPU priority" << std::endl;
+    }
+
+    if (!options.daemonSocket.empty())
+    {
+        return RunDaemon(options);
+    }
+
+    if (!options.watchDir.empty())
+    {
+        return RunWatch(options);
+    }
+
+    if (!options.mergeOutput.empty())
+    {
+        return RunMerge(options);
+    }
+
+    if (options.isSigDiff)
+    {
+        return RunSigDiff(options);
+    }
+
+    if (options.positional.size() > 0)
+    {
+        inputFileName = options.positional[0];
+    }
+    if (options.positional.size() > 1)
+    {        
+        outputFileName = options.positional[1];
+    }
+    if (options.positional.size() > 2)
+    {        
+        blockSize      = atoi(options.positional[2].c_str());
+    }
+
+    std::ifstream hInFile;
+
+    while (!SetInputFile(inputFileName, hInFile))
+    {
+        if (!isRepeatInput("input filename"))
+        {
+            return 0;
+        }
+    }
+
+    std::ofstream hOutFile;
+
+    while (!SetOutputFile(outputFileName, hOutFile))
+    {
+        if (!isRepeatInput("output filename"))
+        {
+            return 0;
+        }
+    }
+
+    if (!options.resolutions.empty())
+    {
+        if ((options.cdcMaxSize != 0) || options.isRange || options.isSeparateOutputs || !options.cacheDir.empty())
+        {
+            std::cerr << "--resolutions is not supported with --cdc, --range, --separate-outputs and --cache"
+                      << std::endl;
+            return 1;
+        }
+
+        // Объединять без повторного рассчета можно только CRC
+        if ((options.digests.size() != 1) || (options.digests[0] != DIGEST_CRC32))
+        {
+            std::cerr << "--resolutions supports CRC32 signatures only" << std::endl;
+            return 1;
+        }
+    }
+
+    if (!options.cacheDir.empty() &&
+        ((options.cdcMaxSize != 0) || options.isRange || options.isSeparateOutputs || options.isDedup))
+    {
+        std::cerr << "--cache is not supported with --cdc, --range, --separate-outputs and --dedup"
+                  << std::endl;
+        return 1;
+    }
+
+    if (options.cdcMaxSize != 0)
+    {
+        if (options.isSeparateOutputs)
+        {
+            std::cerr << "--separate-outputs is not supported with --cdc" << std::endl;
+            return 1;
+        }
+
+        if (options.isRange || options.isDecompress)
+        {
+            std::cerr << "--range and --decompress are not supported with --cdc" << std::endl;
+            return 1;
+        }
+
+        if ((options.ioLimit != 0) || (options.cpuShare != 100) || options.isAutoTune)
+        {
+            std::cerr << "--io-limit, --cpu-limit and --auto-tune are not supported with --cdc"
+                      << std::endl;
+            return 1;
+        }
+
+        return RunChunking(options, inputFileName, hOutFile);
+    }
+
+    while (!SetBlockSize(blockSize))
+    {
+        if (!isRepeatInput("blockSize"))
+        {
+            return 0;
+        }
+    }
+
+    CSignatureCache   cache;
+    SignatureCacheKey cacheKey;
+
+    if (!options.cacheDir.empty() &&
+        FindCachedSignature(options, inputFileName, blockSize, cache, cacheKey, hOutFile))
+    {
+        std::cout << "Signatures file generation complited (cached)" << std::endl;
+        return 0;
+    }
+
+    CSignatureGenerator signGen;
+    signGen.SetDigests(options.digests);
+    signGen.SetMemoryLimit(options.memoryLimit);
+    signGen.SetArenaParams(options.arenaParams);
+    signGen.SetCpuSet(options.cpus);
+    signGen.SetNumaEnabled(options.isNumaEnabled);
+    signGen.SetIoLimit(options.ioLimit);
+    signGen.SetCpuShare(options.cpuShare);
+
+    CDedupIndex dedupIndex;
+
+    if (options.isDedup)
+    {
+        if (!InitDedupIndex(options, dedupIndex))
+        {
+            return 1;
+        }
+
+        signGen.SetDedupIndex(&dedupIndex);
+    }
+
+    // По потоку рассчета CRC на каждый процессор, которым ограничена работа
+    size_t threadCnt = DefaultThreadCount(options);
+
+    if (options.isAutoTune && !AutoTune(options, inputFileName, blockSize, signGen, threadCnt))
+    {
+        return 1;
+    }
+
+    if (options.isRange)
+    {
+        if (options.isSeparateOutputs || options.isDecompress)
+        {
+            std::cerr << "--separate-outputs and --decompress are not supported with --range"
+                      << std::endl;
+            return 1;
+        }
+
+        if (!StartPartialSignature(options, blockSize, hInFile, hOutFile, signGen))
+        {
+            return 1;
+        }
+    }
+
+    CStreamSource fileSource(hInFile);
+
+    // Распаковка - отдельный поток между чтением файла и потоками рассчета
+    CDecompressSource  decompressSource(fileSource, options.compression, threadCnt);
+    CSignatureSource&  source = options.isDecompress ? static_cast<CSignatureSource&>(decompressSource)
+                                                     : fileSource;
+
+    // Дайджесты пишутся записями блоков в выходной файл или каждый в свой файл
+    std::vector< boost::shared_ptr<std::ofstream> > digestFiles;
+    std::vector<std::ostream*>                      outStreams;
+    std::vector< boost::shared_ptr<CStreamSink> >   sinks;
+    CSignatureGenerator::CSinkList                  sinkList;
+
+    if (options.isSeparateOutputs)
+    {
+        for (size_t i = 0; i < options.digests.size(); ++i)
+        {
+            const std::string fileName = outputFileName + "." + DigestName(options.digests[i]);
+
+            boost::shared_ptr<std::ofstream> pFile(new std::ofstream(fileName.c_str(),
+                                                   std::ios::out | std::ios::binary | std::ios::app));
+
+            if (!pFile->is_open())
+            {
+                std::cerr << "Unable to open output file " << fileName << std::endl;
+                return 1;
+            }
+
+            digestFiles.push_back(pFile);
+            outStreams.push_back(pFile.get());
+        }
+    }
+    else
+    {
+        outStreams.push_back(&hOutFile);
+    }
+
+    for (size_t i = 0; i < outStreams.size(); ++i)
+    {
+        sinks.push_back(boost::shared_ptr<CStreamSink>(new CStreamSink(*outStreams[i])));
+        sinkList.push_back(sinks.back().get());
+    }
+
+    // Крупные размеры блока - каждый в свой файл <output>.<размер>k
+    std::vector< boost::shared_ptr<std::ofstream> > levelFiles;
+    CMultiResolutionSink                            multiSink(*sinkList[0], blockSize);
+
+    for (size_t i = 0; i < options.resolutions.size(); ++i)
+    {
+        std::ostringstream fileName;
+        fileName << outputFileName << '.' << options.resolutions[i] / BYTES_IN_KYLOBYTE << 'k';
+
+        boost::shared_ptr<std::ofstream> pFile(new std::ofstream(fileName.str().c_str(),
+                                               std::ios::out | std::ios::binary | std::ios::app));
+
+        if (!pFile->is_open())
+        {
+            std::cerr << "Unable to open output file " << fileName.str() << std::endl;
+            return 1;
+        }
+
+        levelFiles.push_back(pFile);
+        sinks.push_back(boost::shared_ptr<CStreamSink>(new CStreamSink(*pFile)));
+
+        if (!multiSink.AddLevel(options.resolutions[i], *sinks.back()))
+        {
+            std::cerr << "Resolution " << options.resolutions[i] / BYTES_IN_KYLOBYTE
+                      << " Kb is not a multiple of the block size" << std::endl;
+            return 1;
+        }
+    }
+
+    if (!options.resolutions.empty())
+    {
+        sinkList[0] = &multiSink;
+    }
+
+    // Для кеша записи блоков по пути в выходной файл пишутся во временный файл записи
+    CSignatureCacheWriter cacheWriter;
+    CCallbackSink         cacheSink(boost::bind(&WriteAndCacheRecord, sinkList[0], &cacheWriter,
+                                                  boost::placeholders::_1, boost::placeholders::_2,
+                                                  boost::placeholders::_3));
+
+    if (!cacheKey.algorithm.empty())
+    {
+        if (cache.BeginStore(cacheKey, cacheWriter))
+        {
+            sinkList[0] = &cacheSink;
+        }
+        else
+        {
+            std::cerr << "Unable to store signature in cache " << inputFileName << std::endl;
+        }
+    }
+
+    while (!signGen.Init(source, sinkList, blockSize, threadCnt))
+    {
+        return 1;     
+    }
+
+    std::ofstream statsFile;
+    std::ostream* pStatsOut = &std::cerr;
+
+    if (!options.statsPath.empty())
+    {
+        statsFile.open(options.statsPath.c_str(), std::ios::out | std::ios::trunc);
+
+        if (!statsFile.is_open())
+        {
+            std::cerr << "Unable to open stats file " << options.statsPath << std::endl;
+            return 1;
+        }
+
+        pStatsOut = &statsFile;
+    }
+
+    std::ofstream traceFile;
+
+    if (!options.tracePath.empty())
+    {
+        traceFile.open(options.tracePath.c_str(), std::ios::out | std::ios::trunc);
+
+        if (!traceFile.is_open())
+        {
+            std::cerr << "Unable to open trace file " << options.tracePath << std::endl;
+            return 1;
+        }
+
+        signGen.EnableTrace(MAX_TRACE_EVENTS_PER_THREAD);
+    }
+
+    if (options.showPerf)
+    {
+        signGen.EnablePerfCounters();
+    }
+
+    signGen.StartProcessing();
+
+    boost::thread statsThread;
+
+    if (options.showStats && (options.statsInterval != 0))
+    {
+        boost::thread thread(boost::bind(&StatsDumpProc, &signGen, pStatsOut, options.statsInterval));
+        statsThread.swap(thread);
+    }
+
+    // Последние неполные крупные блоки дописываются после всех мелких
+    const bool isSigned = signGen.WaitFinished() && multiSink.Finish();
+
+    if (isSigned)
+    {
+        std::cout << "Signatures file generation complited" << std::endl;
+
+        if (cacheWriter.IsOpen())
+        {
+            StoreCachedSignature(inputFileName, cache, cacheKey, cacheWriter);
+        }
+    }
+    else if (options.isDecompress && !decompressSource.GetError().empty())
+    {
+        std::cerr << decompressSource.GetError() << std::endl;
+    }
+
+    if (statsThread.joinable())
+    {
+        statsThread.interrupt();
+        statsThread.join();
+    }
+
+    if (options.showStats)
+    {
+        signGen.GetPipelineStats().WriteJson(*pStatsOut, true);
+    }
+
+    if (options.showPerf)
+    {
+        signGen.WritePerfCounters(std::cerr);
+    }
+
+    if (traceFile.is_open() && !signGen.WriteTrace(traceFile))
+    {
+        std::cerr << "Unable to write trace file " << options.tracePath << std::endl;
+    }
+
+    if (options.showPoolStats)
+    {
+        PrintPoolStats(signGen.GetPoolStats());
+        std::cout << "Pipeline NUMA nodes: " << signGen.GetNodeCount() << std::endl;
+    }
+
+    const bool isReported = !isSigned || !options.isDedup || WriteDedupReport(options, dedupIndex);
+
+    hInFile.close();
+    hOutFile.close();
+
+    std::cin.ignore();
+
+    return (isSigned && isReported) ? 0 : 1;
 }
\ No newline at end of file